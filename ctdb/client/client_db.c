@@ -242,9 +242,9 @@ struct ctdb_attach_state {
 	struct ctdb_db_context *db;
 };
 
-static void ctdb_attach_mutex_done(struct tevent_req *subreq);
 static void ctdb_attach_dbid_done(struct tevent_req *subreq);
 static void ctdb_attach_dbpath_done(struct tevent_req *subreq);
+static void ctdb_attach_open_flags_done(struct tevent_req *subreq);
 static void ctdb_attach_health_done(struct tevent_req *subreq);
 static void ctdb_attach_flags_done(struct tevent_req *subreq);
 
@@ -289,29 +289,42 @@ struct tevent_req *ctdb_attach_send(TALLOC_CTX *mem_ctx,
 		state->db->persistent = true;
 	}
 
-	ctdb_req_control_get_tunable(&request, "TDBMutexEnabled");
+	state->tdb_flags = TDB_DEFAULT;
+	if (! state->db->persistent) {
+		state->tdb_flags |= (TDB_INCOMPATIBLE_HASH |
+				     TDB_CLEAR_IF_FIRST);
+	}
+
+	if (state->db->persistent) {
+		ctdb_req_control_db_attach_persistent(&request,
+						      state->db->db_name,
+						      state->tdb_flags);
+	} else {
+		ctdb_req_control_db_attach(&request, state->db->db_name,
+					   state->tdb_flags);
+	}
+
 	subreq = ctdb_client_control_send(state, ev, client,
-					  ctdb_client_pnn(client), timeout,
+					  state->destnode, timeout,
 					  &request);
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
 	}
-	tevent_req_set_callback(subreq, ctdb_attach_mutex_done, req);
+	tevent_req_set_callback(subreq, ctdb_attach_dbid_done, req);
 
 	return req;
 }
 
-static void ctdb_attach_mutex_done(struct tevent_req *subreq)
+static void ctdb_attach_dbid_done(struct tevent_req *subreq)
 {
 	struct tevent_req *req = tevent_req_callback_data(
 		subreq, struct tevent_req);
 	struct ctdb_attach_state *state = tevent_req_data(
 		req, struct ctdb_attach_state);
-	struct ctdb_reply_control *reply;
 	struct ctdb_req_control request;
-	uint32_t mutex_enabled;
-	int ret;
+	struct ctdb_reply_control *reply;
 	bool status;
+	int ret;
 
 	status = ctdb_client_control_recv(subreq, &ret, state, &reply);
 	TALLOC_FREE(subreq);
@@ -320,47 +333,36 @@ static void ctdb_attach_mutex_done(struct tevent_req *subreq)
 		return;
 	}
 
-	ret = ctdb_reply_control_get_tunable(reply, &mutex_enabled);
-	if (ret != 0) {
-		/* Treat error as mutex support not available */
-		mutex_enabled = 0;
-	}
-
-	state->tdb_flags = TDB_DEFAULT;
-	if (! state->db->persistent) {
-		state->tdb_flags |= (TDB_INCOMPATIBLE_HASH |
-				     TDB_CLEAR_IF_FIRST);
-	}
-	if (mutex_enabled == 1) {
-		state->tdb_flags |= TDB_MUTEX_LOCKING;
-	}
-
 	if (state->db->persistent) {
-		ctdb_req_control_db_attach_persistent(&request,
-						      state->db->db_name,
-						      state->tdb_flags);
+		ret = ctdb_reply_control_db_attach_persistent(
+				reply, &state->db->db_id);
 	} else {
-		ctdb_req_control_db_attach(&request, state->db->db_name,
-					   state->tdb_flags);
+		ret = ctdb_reply_control_db_attach(reply, &state->db->db_id);
+	}
+	talloc_free(reply);
+	if (ret != 0) {
+		tevent_req_error(req, ret);
+		return;
 	}
 
+	ctdb_req_control_getdbpath(&request, state->db->db_id);
 	subreq = ctdb_client_control_send(state, state->ev, state->client,
 					  state->destnode, state->timeout,
 					  &request);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
-	tevent_req_set_callback(subreq, ctdb_attach_dbid_done, req);
+	tevent_req_set_callback(subreq, ctdb_attach_dbpath_done, req);
 }
 
-static void ctdb_attach_dbid_done(struct tevent_req *subreq)
+static void ctdb_attach_dbpath_done(struct tevent_req *subreq)
 {
 	struct tevent_req *req = tevent_req_callback_data(
 		subreq, struct tevent_req);
 	struct ctdb_attach_state *state = tevent_req_data(
 		req, struct ctdb_attach_state);
-	struct ctdb_req_control request;
 	struct ctdb_reply_control *reply;
+	struct ctdb_req_control request;
 	bool status;
 	int ret;
 
@@ -371,29 +373,25 @@ static void ctdb_attach_dbid_done(struct tevent_req *subreq)
 		return;
 	}
 
-	if (state->db->persistent) {
-		ret = ctdb_reply_control_db_attach_persistent(
-				reply, &state->db->db_id);
-	} else {
-		ret = ctdb_reply_control_db_attach(reply, &state->db->db_id);
-	}
+	ret = ctdb_reply_control_getdbpath(reply, state->db,
+					   &state->db->db_path);
 	talloc_free(reply);
 	if (ret != 0) {
 		tevent_req_error(req, ret);
 		return;
 	}
 
-	ctdb_req_control_getdbpath(&request, state->db->db_id);
+	ctdb_req_control_db_open_flags(&request, state->db->db_id);
 	subreq = ctdb_client_control_send(state, state->ev, state->client,
 					  state->destnode, state->timeout,
 					  &request);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
-	tevent_req_set_callback(subreq, ctdb_attach_dbpath_done, req);
+	tevent_req_set_callback(subreq, ctdb_attach_open_flags_done, req);
 }
 
-static void ctdb_attach_dbpath_done(struct tevent_req *subreq)
+static void ctdb_attach_open_flags_done(struct tevent_req *subreq)
 {
 	struct tevent_req *req = tevent_req_callback_data(
 		subreq, struct tevent_req);
@@ -401,6 +399,7 @@ static void ctdb_attach_dbpath_done(struct tevent_req *subreq)
 		req, struct ctdb_attach_state);
 	struct ctdb_reply_control *reply;
 	struct ctdb_req_control request;
+	uint32_t tdb_flags;
 	bool status;
 	int ret;
 
@@ -411,14 +410,20 @@ static void ctdb_attach_dbpath_done(struct tevent_req *subreq)
 		return;
 	}
 
-	ret = ctdb_reply_control_getdbpath(reply, state->db,
-					   &state->db->db_path);
+	ret = ctdb_reply_control_db_open_flags(reply, &tdb_flags);
 	talloc_free(reply);
 	if (ret != 0) {
 		tevent_req_error(req, ret);
 		return;
 	}
 
+	/* The local tdb has to be locked the same way ctdbd locks it */
+	state->tdb_flags = tdb_flags & (TDB_INCOMPATIBLE_HASH |
+					TDB_CLEAR_IF_FIRST);
+#ifdef TDB_MUTEX_LOCKING
+	state->tdb_flags |= tdb_flags & TDB_MUTEX_LOCKING;
+#endif
+
 	ctdb_req_control_db_get_health(&request, state->db->db_id);
 	subreq = ctdb_client_control_send(state, state->ev, state->client,
 					  state->destnode, state->timeout,
@@ -1343,6 +1343,72 @@ int ctdb_ctrl_dbstatistics(struct ctdb_context *ctdb, uint32_t destnode, uint32_
 	return 0;
 }
 
+/*
+ * get db latency histograms and sampled hot keys
+ */
+int ctdb_ctrl_dbhistograms(struct ctdb_context *ctdb, uint32_t destnode,
+			   uint32_t dbid, TALLOC_CTX *mem_ctx,
+			   struct ctdb_db_histograms **dbhist)
+{
+	int ret;
+	TDB_DATA indata, outdata;
+	int32_t res;
+	struct ctdb_db_histograms *wire, *h;
+	size_t len;
+	uint8_t *ptr;
+	int i;
+
+	indata.dptr = (uint8_t *)&dbid;
+	indata.dsize = sizeof(dbid);
+
+	ret = ctdb_control(ctdb, destnode, 0, CTDB_CONTROL_GET_DB_HISTOGRAMS,
+			   0, indata, ctdb, &outdata, &res, NULL, NULL);
+	if (ret != 0 || res != 0) {
+		DEBUG(DEBUG_ERR,(__location__ " ctdb_control for dbhistograms failed\n"));
+		return -1;
+	}
+
+	wire = (struct ctdb_db_histograms *)outdata.dptr;
+	len = sizeof(struct ctdb_db_histograms);
+	if (outdata.dsize >= len && wire->num_hot_keys <= MAX_HOT_KEYS) {
+		for (i=0; i<wire->num_hot_keys; i++) {
+			len += wire->hot_keys[i].key.dsize;
+		}
+	}
+	if (outdata.dsize < len || wire->num_hot_keys > MAX_HOT_KEYS) {
+		DEBUG(DEBUG_ERR,(__location__ " Wrong dbhistograms size %zi - expected >= %zu\n",
+				 outdata.dsize, len));
+		talloc_free(outdata.dptr);
+		return -1;
+	}
+
+	h = talloc_zero(mem_ctx, struct ctdb_db_histograms);
+	if (h == NULL) {
+		talloc_free(outdata.dptr);
+		CTDB_NO_MEMORY(ctdb, h);
+	}
+
+	memcpy(h, wire, offsetof(struct ctdb_db_histograms, hot_keys));
+	ptr = outdata.dptr + sizeof(struct ctdb_db_histograms);
+	for (i=0; i<wire->num_hot_keys; i++) {
+		h->hot_keys[i].count = wire->hot_keys[i].count;
+		h->hot_keys[i].key.dsize = wire->hot_keys[i].key.dsize;
+		h->hot_keys[i].key.dptr = talloc_memdup(h, ptr,
+						h->hot_keys[i].key.dsize);
+		if (h->hot_keys[i].key.dptr == NULL) {
+			DEBUG(DEBUG_ERR, (__location__ " Out of memory\n"));
+			talloc_free(outdata.dptr);
+			talloc_free(h);
+			return -1;
+		}
+		ptr += h->hot_keys[i].key.dsize;
+	}
+
+	talloc_free(outdata.dptr);
+	*dbhist = h;
+	return 0;
+}
+
 /*
   shutdown a remote ctdb node
  */
@@ -1828,6 +1894,33 @@ int ctdb_ctrl_getdbpath(struct ctdb_context *ctdb, struct timeval timeout, uint3
 	return 0;
 }
 
+/*
+  get the tdb flags ctdbd has opened a database with
+ */
+int ctdb_ctrl_db_open_flags(struct ctdb_context *ctdb, struct timeval timeout,
+			    uint32_t destnode, uint32_t dbid,
+			    uint32_t *tdb_flags)
+{
+	int ret;
+	int32_t res;
+	TDB_DATA data;
+
+	data.dptr = (uint8_t *)&dbid;
+	data.dsize = sizeof(dbid);
+
+	ret = ctdb_control(ctdb, destnode, 0,
+			   CTDB_CONTROL_DB_OPEN_FLAGS, 0, data,
+			   ctdb, &data, &res, &timeout, NULL);
+	if (ret != 0 || res != 0 || data.dsize != sizeof(uint32_t)) {
+		return -1;
+	}
+
+	*tdb_flags = *(uint32_t *)data.dptr;
+	talloc_free(data.dptr);
+
+	return 0;
+}
+
 /*
   find the name of a db 
  */
@@ -1949,12 +2042,6 @@ int ctdb_ctrl_createdb(struct ctdb_context *ctdb, struct timeval timeout, uint32
 		tdb_flags = TDB_INCOMPATIBLE_HASH;
 	}
 
-#ifdef TDB_MUTEX_LOCKING
-	if (!persistent && ctdb->tunable.mutex_enabled == 1) {
-		tdb_flags |= (TDB_MUTEX_LOCKING | TDB_CLEAR_IF_FIRST);
-	}
-#endif
-
 	ret = ctdb_control(ctdb, destnode, tdb_flags,
 			   persistent?CTDB_CONTROL_DB_ATTACH_PERSISTENT:CTDB_CONTROL_DB_ATTACH, 
 			   0, data, 
@@ -2078,9 +2165,7 @@ struct ctdb_db_context *ctdb_attach(struct ctdb_context *ctdb,
 	TDB_DATA data;
 	int ret;
 	int32_t res;
-#ifdef TDB_MUTEX_LOCKING
-	uint32_t mutex_enabled = 0;
-#endif
+	uint32_t open_flags = 0;
 
 	ctdb_db = ctdb_db_handle(ctdb, name);
 	if (ctdb_db) {
@@ -2105,22 +2190,6 @@ struct ctdb_db_context *ctdb_attach(struct ctdb_context *ctdb,
 		tdb_flags |= TDB_INCOMPATIBLE_HASH;
 	}
 
-#ifdef TDB_MUTEX_LOCKING
-	if (!persistent) {
-		ret = ctdb_ctrl_get_tunable(ctdb, timeval_current_ofs(3,0),
-					    CTDB_CURRENT_NODE,
-					    "TDBMutexEnabled",
-					    &mutex_enabled);
-		if (ret != 0) {
-			DEBUG(DEBUG_WARNING, ("Assuming no mutex support.\n"));
-		}
-
-		if (mutex_enabled == 1) {
-			tdb_flags |= (TDB_MUTEX_LOCKING | TDB_CLEAR_IF_FIRST);
-		}
-	}
-#endif
-
 	/* tell ctdb daemon to attach */
 	ret = ctdb_control(ctdb, CTDB_CURRENT_NODE, tdb_flags, 
 			   persistent?CTDB_CONTROL_DB_ATTACH_PERSISTENT:CTDB_CONTROL_DB_ATTACH,
@@ -2141,14 +2210,22 @@ struct ctdb_db_context *ctdb_attach(struct ctdb_context *ctdb,
 		return NULL;
 	}
 
+	ret = ctdb_ctrl_db_open_flags(ctdb, timeout, CTDB_CURRENT_NODE,
+				      ctdb_db->db_id, &open_flags);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR,("Failed to get open flags for database '%s'\n", name));
+		talloc_free(ctdb_db);
+		return NULL;
+	}
+
 	if (persistent) {
 		tdb_flags = TDB_DEFAULT;
 	} else {
 		tdb_flags = TDB_NOSYNC;
 #ifdef TDB_MUTEX_LOCKING
-		if (mutex_enabled) {
-			tdb_flags |= (TDB_MUTEX_LOCKING | TDB_CLEAR_IF_FIRST);
-		}
+		/* lock the same way as ctdbd */
+		tdb_flags |= open_flags & (TDB_MUTEX_LOCKING |
+					   TDB_CLEAR_IF_FIRST);
 #endif
 	}
 	if (ctdb->valgrinding) {
@@ -2334,6 +2411,130 @@ int ctdb_traverse(struct ctdb_db_context *ctdb_db, ctdb_traverse_func fn, void *
 	return ctdb_traverse_ext(ctdb_db, fn, false, private_data);
 }
 
+/*
+  called on each batch of records during a ctdb_traverse_filter
+ */
+static void traverse_filter_handler(uint64_t srvid, TDB_DATA data, void *p)
+{
+	struct traverse_state *state = (struct traverse_state *)p;
+	struct ctdb_marshall_buffer *m = (struct ctdb_marshall_buffer *)data.dptr;
+	struct ctdb_rec_data_old *rec = NULL;
+	size_t offset;
+	uint32_t i;
+
+	if (state->done) {
+		return;
+	}
+
+	if (data.dsize < offsetof(struct ctdb_marshall_buffer, data)) {
+		DEBUG(DEBUG_ERR, ("Bad data size %u in traverse_filter_handler\n",
+				  (unsigned)data.dsize));
+		state->done = true;
+		return;
+	}
+
+	if (m->count == 0) {
+		/* end of traverse */
+		state->done = true;
+		return;
+	}
+
+	offset = offsetof(struct ctdb_marshall_buffer, data);
+	for (i=0; i<m->count; i++) {
+		TDB_DATA key, rdata;
+
+		if (data.dsize - offset < offsetof(struct ctdb_rec_data_old, data)) {
+			DEBUG(DEBUG_ERR, ("Bad record in traverse_filter_handler\n"));
+			state->done = true;
+			return;
+		}
+		rec = ctdb_marshall_loop_next(m, rec, NULL, NULL, &key, &rdata);
+		if (rec->length > data.dsize - offset) {
+			DEBUG(DEBUG_ERR, ("Bad record in traverse_filter_handler\n"));
+			state->done = true;
+			return;
+		}
+		offset += rec->length;
+
+		if (!state->listemptyrecords &&
+		    rdata.dsize == sizeof(struct ctdb_ltdb_header))
+		{
+			/* empty records are deleted records in ctdb */
+			continue;
+		}
+
+		if (state->fn(key, rdata, state->private_data) != 0) {
+			state->done = true;
+			return;
+		}
+
+		state->count++;
+	}
+}
+
+/**
+ * start a cluster wide traverse, calling the supplied fn only on the
+ * records matching the filter.  The filtering is done on the nodes
+ * and the matching records are sent in batches.
+ *
+ * return the number of records traversed, or -1 on error
+ */
+int ctdb_traverse_filter(struct ctdb_db_context *ctdb_db,
+			 struct ctdb_traverse_filter *filter,
+			 bool withemptyrecords,
+			 ctdb_traverse_func fn,
+			 void *private_data)
+{
+	TDB_DATA data;
+	struct ctdb_traverse_start_filter t;
+	int32_t status;
+	int ret;
+	uint64_t srvid = (getpid() | 0xFLL<<60);
+	struct traverse_state state;
+
+	state.done = false;
+	state.count = 0;
+	state.private_data = private_data;
+	state.fn = fn;
+	state.listemptyrecords = withemptyrecords;
+
+	ret = ctdb_client_set_message_handler(ctdb_db->ctdb, srvid, traverse_filter_handler, &state);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR,("Failed to setup traverse handler\n"));
+		return -1;
+	}
+
+	ZERO_STRUCT(t);
+	t.db_id = ctdb_db->db_id;
+	t.srvid = srvid;
+	t.reqid = 0;
+	t.withemptyrecords = withemptyrecords;
+	t.filter = *filter;
+
+	data.dptr = (uint8_t *)&t;
+	data.dsize = sizeof(t);
+
+	ret = ctdb_control(ctdb_db->ctdb, CTDB_CURRENT_NODE, 0, CTDB_CONTROL_TRAVERSE_START_FILTER, 0,
+			   data, NULL, NULL, &status, NULL, NULL);
+	if (ret != 0 || status != 0) {
+		DEBUG(DEBUG_ERR,("ctdb_traverse_filter failed\n"));
+		ctdb_client_remove_message_handler(ctdb_db->ctdb, srvid, &state);
+		return -1;
+	}
+
+	while (!state.done) {
+		tevent_loop_once(ctdb_db->ctdb->ev);
+	}
+
+	ret = ctdb_client_remove_message_handler(ctdb_db->ctdb, srvid, &state);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR,("Failed to remove ctdb_traverse_filter handler\n"));
+		return -1;
+	}
+
+	return state.count;
+}
+
 #define ISASCII(x) (isprint(x) && !strchr("\"\\", (x)))
 /*
   called on each key during a catdb
@@ -2407,6 +2608,14 @@ int ctdb_dump_db(struct ctdb_db_context *ctdb_db,
 				 ctx->printemptyrecords, ctx);
 }
 
+int ctdb_dump_db_filter(struct ctdb_db_context *ctdb_db,
+			struct ctdb_traverse_filter *filter,
+			struct ctdb_dump_db_context *ctx)
+{
+	return ctdb_traverse_filter(ctdb_db, filter, ctx->printemptyrecords,
+				    ctdb_dumpdb_record, ctx);
+}
+
 /*
   get the pid of a ctdb daemon
  */
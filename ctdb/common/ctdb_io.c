@@ -40,10 +40,14 @@
 
 #define QUEUE_BUFFER_SIZE	(16*1024)
 
+/* maximum number of queued packets sent with a single writev() */
+#define QUEUE_MAX_IOV		64
+
 /* structures for packet queueing - see common/ctdb_io.c */
 struct ctdb_buffer {
 	uint8_t *data;
-	uint32_t length;
+	uint32_t offset; /* start of the unprocessed data */
+	uint32_t length; /* length of the unprocessed data */
 	uint32_t size;
 	uint32_t extend;
 };
@@ -104,7 +108,7 @@ static void queue_process(struct ctdb_queue *queue)
 		return;
 	}
 
-	pkt_size = *(uint32_t *)queue->buffer.data;
+	pkt_size = *(uint32_t *)(queue->buffer.data + queue->buffer.offset);
 	if (pkt_size == 0) {
 		DEBUG(DEBUG_CRIT, ("Invalid packet of length 0\n"));
 		goto failed;
@@ -117,20 +121,34 @@ static void queue_process(struct ctdb_queue *queue)
 		return;
 	}
 
+	if (queue->buffer.length == pkt_size &&
+	    queue->buffer.offset == 0 &&
+	    queue->buffer.size > QUEUE_BUFFER_SIZE) {
+		/*
+		 * The buffer was extended to hold exactly this large
+		 * packet and would be freed below.  Hand it over instead
+		 * of copying the packet out.
+		 */
+		data = queue->buffer.data;
+		queue->buffer.data = NULL;
+		queue->buffer.size = 0;
+		queue->buffer.length = 0;
+		goto done;
+	}
+
 	/* Extract complete packet */
 	data = talloc_size(queue, pkt_size);
 	if (data == NULL) {
 		DEBUG(DEBUG_ERR, ("read error alloc failed for %u\n", pkt_size));
 		return;
 	}
-	memcpy(data, queue->buffer.data, pkt_size);
+	memcpy(data, queue->buffer.data + queue->buffer.offset, pkt_size);
 
-	/* Shift packet out from buffer */
-	if (queue->buffer.length > pkt_size) {
-		memmove(queue->buffer.data,
-			queue->buffer.data + pkt_size,
-			queue->buffer.length - pkt_size);
-	}
+	/*
+	 * Skip the packet, the remaining data is moved to the start of
+	 * the buffer only before the next read
+	 */
+	queue->buffer.offset += pkt_size;
 	queue->buffer.length -= pkt_size;
 
 	if (queue->buffer.length > 0) {
@@ -138,12 +156,15 @@ static void queue_process(struct ctdb_queue *queue)
 		tevent_schedule_immediate(queue->im, queue->ctdb->ev,
 					  queue_process_event, queue);
 	} else {
+		queue->buffer.offset = 0;
 		if (queue->buffer.size > QUEUE_BUFFER_SIZE) {
 			TALLOC_FREE(queue->buffer.data);
 			queue->buffer.size = 0;
 		}
 	}
 
+done:
+
 	/* It is the responsibility of the callback to free 'data' */
 	queue->callback(data, pkt_size, queue->private_data);
 	return;
@@ -179,6 +200,14 @@ static void queue_io_read(struct ctdb_queue *queue)
 		goto failed;
 	}
 
+	if (queue->buffer.offset > 0) {
+		/* move the partial packet to the start of the buffer */
+		memmove(queue->buffer.data,
+			queue->buffer.data + queue->buffer.offset,
+			queue->buffer.length);
+		queue->buffer.offset = 0;
+	}
+
 	if (queue->buffer.data == NULL) {
 		/* starting fresh, allocate buf to read data */
 		queue->buffer.data = talloc_size(queue, QUEUE_BUFFER_SIZE);
@@ -234,16 +263,29 @@ static void queue_dead(struct tevent_context *ev, struct tevent_immediate *im,
 
 /*
   called when an incoming connection is writeable
+
+  As many queued packets as possible are sent with a single writev()
 */
 static void queue_io_write(struct ctdb_queue *queue)
 {
+	struct iovec iov[QUEUE_MAX_IOV];
+
 	while (queue->out_queue) {
 		struct ctdb_queue_pkt *pkt = queue->out_queue;
 		ssize_t n;
+		int count = 0;
+
 		if (queue->ctdb->flags & CTDB_FLAG_TORTURE) {
 			n = write(queue->fd, pkt->data, 1);
 		} else {
-			n = write(queue->fd, pkt->data, pkt->length);
+			for (; pkt != NULL && count < QUEUE_MAX_IOV;
+			     pkt = pkt->next) {
+				iov[count].iov_base = pkt->data;
+				iov[count].iov_len = pkt->length;
+				count++;
+			}
+			pkt = queue->out_queue;
+			n = writev(queue->fd, iov, count);
 		}
 
 		if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
@@ -261,16 +303,21 @@ static void queue_io_write(struct ctdb_queue *queue)
 			return;
 		}
 		if (n <= 0) return;
-		
-		if (n != pkt->length) {
-			pkt->length -= n;
-			pkt->data += n;
-			return;
-		}
 
-		DLIST_REMOVE(queue->out_queue, pkt);
-		queue->out_queue_length--;
-		talloc_free(pkt);
+		while (n > 0) {
+			pkt = queue->out_queue;
+
+			if (n < pkt->length) {
+				pkt->length -= n;
+				pkt->data += n;
+				return;
+			}
+
+			n -= pkt->length;
+			DLIST_REMOVE(queue->out_queue, pkt);
+			queue->out_queue_length--;
+			talloc_free(pkt);
+		}
 	}
 
 	TEVENT_FD_NOT_WRITEABLE(queue->fde);
@@ -412,6 +459,7 @@ int ctdb_queue_set_fd(struct ctdb_queue *queue, int fd)
 static int queue_destructor(struct ctdb_queue *queue)
 {
 	TALLOC_FREE(queue->buffer.data);
+	queue->buffer.offset = 0;
 	queue->buffer.length = 0;
 	queue->buffer.size = 0;
 	if (queue->destroyed != NULL)
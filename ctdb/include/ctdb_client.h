@@ -147,6 +147,9 @@ int ctdb_ctrl_statistics(struct ctdb_context *ctdb, uint32_t destnode,
 int ctdb_ctrl_dbstatistics(struct ctdb_context *ctdb, uint32_t destnode,
 			   uint32_t dbid, TALLOC_CTX *mem_ctx,
 			   struct ctdb_db_statistics_old **dbstat);
+int ctdb_ctrl_dbhistograms(struct ctdb_context *ctdb, uint32_t destnode,
+			   uint32_t dbid, TALLOC_CTX *mem_ctx,
+			   struct ctdb_db_histograms **dbhist);
 
 int ctdb_ctrl_shutdown(struct ctdb_context *ctdb, struct timeval timeout,
 		       uint32_t destnode);
@@ -243,6 +246,9 @@ int ctdb_ctrl_get_runstate(struct ctdb_context *ctdb, struct timeval timeout,
 int ctdb_ctrl_getdbpath(struct ctdb_context *ctdb, struct timeval timeout,
 			uint32_t destnode, uint32_t dbid,
 			TALLOC_CTX *mem_ctx, const char **path);
+int ctdb_ctrl_db_open_flags(struct ctdb_context *ctdb, struct timeval timeout,
+			    uint32_t destnode, uint32_t dbid,
+			    uint32_t *tdb_flags);
 int ctdb_ctrl_getdbname(struct ctdb_context *ctdb, struct timeval timeout,
 			uint32_t destnode, uint32_t dbid,
 			TALLOC_CTX *mem_ctx, const char **name);
@@ -291,6 +297,11 @@ typedef int (*ctdb_traverse_func)(TDB_DATA, TDB_DATA, void *);
 
 int ctdb_traverse(struct ctdb_db_context *ctdb_db, ctdb_traverse_func fn,
 		  void *private_data);
+int ctdb_traverse_filter(struct ctdb_db_context *ctdb_db,
+			 struct ctdb_traverse_filter *filter,
+			 bool withemptyrecords,
+			 ctdb_traverse_func fn,
+			 void *private_data);
 
 struct ctdb_dump_db_context {
 	struct ctdb_context *ctdb;
@@ -305,6 +316,9 @@ struct ctdb_dump_db_context {
 int ctdb_dumpdb_record(TDB_DATA key, TDB_DATA data, void *p);
 int ctdb_dump_db(struct ctdb_db_context *ctdb_db,
 		 struct ctdb_dump_db_context *ctx);
+int ctdb_dump_db_filter(struct ctdb_db_context *ctdb_db,
+			struct ctdb_traverse_filter *filter,
+			struct ctdb_dump_db_context *ctx);
 
 /*
   get the pid of a ctdb daemon
@@ -201,6 +201,11 @@ struct ctdb_daemon_data {
 			ctdb_db->statistics.counter--;					\
 	}
 
+#define CTDB_UPDATE_DB_HISTOGRAM(ctdb_db, counter, value) \
+	{										\
+		ctdb_db->histograms.counter[ctdb_latency_bucket_id(value)]++;	\
+	}
+
 #define CTDB_UPDATE_RECLOCK_LATENCY(ctdb, name, counter, value) \
 	{										\
 		if (value > ctdb->statistics.counter.max)				\
@@ -388,6 +393,10 @@ struct ctdb_context {
 	/* Used for locking record/db/alldb */
 	struct lock_context *lock_current;
 	struct lock_context *lock_pending;
+
+	/* Idle lock helpers kept for reuse */
+	struct lock_helper *lock_helpers;
+	uint32_t lock_num_helpers;
 };
 
 struct ctdb_db_context {
@@ -401,6 +410,7 @@ struct ctdb_db_context {
 	const char *db_name;
 	const char *db_path;
 	struct tdb_wrap *ltdb;
+	uint32_t tdb_flags; /* flags the ltdb was opened with */
 	struct tdb_context *rottdb; /* ReadOnly tracking TDB */
 	struct ctdb_registered_call *calls; /* list of registered calls */
 	uint32_t seqnum;
@@ -413,6 +423,7 @@ struct ctdb_db_context {
 	struct ctdb_persistent_state *persistent_state;
 	struct trbt_tree *delete_queue;
 	struct trbt_tree *sticky_records; 
+	struct ctdb_migration_count *migration_counts;
 	int (*ctdb_ltdb_store_fn)(struct ctdb_db_context *ctdb_db,
 				  TDB_DATA key,
 				  struct ctdb_ltdb_header *header,
@@ -426,6 +437,14 @@ struct ctdb_db_context {
 
 	struct ctdb_db_statistics_old statistics;
 
+	/* latency histograms, the lock histogram is in statistics */
+	struct {
+		uint32_t call[MAX_COUNT_BUCKETS];
+		uint32_t migrate[MAX_COUNT_BUCKETS];
+		uint32_t vacuum[MAX_COUNT_BUCKETS];
+	} histograms;
+	struct ctdb_hot_key_sketch *hot_key_sketch;
+
 	struct lock_context *lock_current;
 	struct lock_context *lock_pending;
 	int lock_num_current;
@@ -437,6 +456,8 @@ struct ctdb_db_context {
 	bool freeze_transaction_started;
 	uint32_t freeze_transaction_id;
 	uint32_t generation;
+
+	struct db_push_state *push_state;
 };
 
 
@@ -475,6 +496,7 @@ struct ctdb_call_state {
 	const char *errmsg;
 	struct ctdb_call *call;
 	uint32_t generation;
+	struct timeval start_time;
 	struct {
 		void (*fn)(struct ctdb_call_state *);
 		void *private_data;
@@ -872,6 +894,13 @@ int ctdb_control_reload_nodes_file(struct ctdb_context *ctdb, uint32_t opcode);
 int32_t ctdb_control_pull_db(struct ctdb_context *ctdb, TDB_DATA indata,
 			     TDB_DATA *outdata);
 int32_t ctdb_control_push_db(struct ctdb_context *ctdb, TDB_DATA indata);
+int32_t ctdb_control_db_pull(struct ctdb_context *ctdb,
+			     struct ctdb_req_control_old *c,
+			     TDB_DATA indata, TDB_DATA *outdata);
+int32_t ctdb_control_db_push_start(struct ctdb_context *ctdb,
+				   TDB_DATA indata);
+int32_t ctdb_control_db_push_confirm(struct ctdb_context *ctdb,
+				     TDB_DATA indata, TDB_DATA *outdata);
 
 int ctdb_deferred_drop_all_ips(struct ctdb_context *ctdb);
 
@@ -953,6 +982,12 @@ int32_t ctdb_control_get_stat_history(struct ctdb_context *ctdb,
 				      struct ctdb_req_control_old *c,
 				      TDB_DATA *outdata);
 
+int ctdb_latency_bucket_id(double t);
+void ctdb_db_sample_key(struct ctdb_db_context *ctdb_db, TDB_DATA key);
+void ctdb_db_histograms_reset(struct ctdb_db_context *ctdb_db);
+int32_t ctdb_control_get_db_histograms(struct ctdb_context *ctdb,
+				       uint32_t db_id, TDB_DATA *outdata);
+
 /* from ctdb_takeover.c */
 
 int32_t ctdb_control_takeover_ip(struct ctdb_context *ctdb,
@@ -1029,10 +1064,14 @@ int32_t ctdb_control_reload_public_ips(struct ctdb_context *ctdb,
 
 int32_t ctdb_control_traverse_all_ext(struct ctdb_context *ctdb,
 				      TDB_DATA data, TDB_DATA *outdata);
+int32_t ctdb_control_traverse_all_filter(struct ctdb_context *ctdb,
+					 TDB_DATA data, TDB_DATA *outdata);
 int32_t ctdb_control_traverse_all(struct ctdb_context *ctdb,
 				  TDB_DATA data, TDB_DATA *outdata);
 int32_t ctdb_control_traverse_data(struct ctdb_context *ctdb,
 				   TDB_DATA data, TDB_DATA *outdata);
+int32_t ctdb_control_traverse_data_batch(struct ctdb_context *ctdb,
+					 TDB_DATA data, TDB_DATA *outdata);
 int32_t ctdb_control_traverse_kill(struct ctdb_context *ctdb, TDB_DATA indata,
 				    TDB_DATA *outdata, uint32_t srcnode);
 
@@ -1042,6 +1081,9 @@ int32_t ctdb_control_traverse_start_ext(struct ctdb_context *ctdb,
 int32_t ctdb_control_traverse_start(struct ctdb_context *ctdb,
 				    TDB_DATA indata, TDB_DATA *outdata,
 				    uint32_t srcnode, uint32_t client_id);
+int32_t ctdb_control_traverse_start_filter(struct ctdb_context *ctdb,
+					   TDB_DATA indata, TDB_DATA *outdata,
+					   uint32_t srcnode, uint32_t client_id);
 
 /* from ctdb_tunables.c */
 
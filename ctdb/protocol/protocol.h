@@ -124,6 +124,9 @@ struct ctdb_call {
 /* SRVID to inform of election data */
 #define CTDB_SRVID_ELECTION	0xF100000000000000LL
 
+/* SRVID prefix used during recovery for pulling and pushing databases */
+#define CTDB_SRVID_RECOVERY	0xF001000000000000LL
+
 /* SRVID to inform clients that the cluster has been reconfigured */
 #define CTDB_SRVID_RECONFIGURE 0xF200000000000000LL
 
@@ -355,6 +358,14 @@ enum ctdb_controls {CTDB_CONTROL_PROCESS_EXISTS          = 0,
 		    CTDB_CONTROL_DB_TRANSACTION_START    = 143,
 		    CTDB_CONTROL_DB_TRANSACTION_COMMIT   = 144,
 		    CTDB_CONTROL_DB_TRANSACTION_CANCEL	 = 145,
+		    CTDB_CONTROL_DB_PULL                 = 146,
+		    CTDB_CONTROL_DB_PUSH_START           = 147,
+		    CTDB_CONTROL_DB_PUSH_CONFIRM         = 148,
+		    CTDB_CONTROL_DB_OPEN_FLAGS           = 149,
+		    CTDB_CONTROL_TRAVERSE_START_FILTER   = 150,
+		    CTDB_CONTROL_TRAVERSE_ALL_FILTER     = 151,
+		    CTDB_CONTROL_TRAVERSE_DATA_BATCH     = 152,
+		    CTDB_CONTROL_GET_DB_HISTOGRAMS       = 153,
 };
 
 #define CTDB_MONITORING_ACTIVE		0
@@ -427,6 +438,8 @@ struct ctdb_statistics {
 	struct timeval statistics_current_time;
 	uint32_t total_ro_delegations;
 	uint32_t total_ro_revokes;
+	uint32_t total_sticky_records;
+	uint32_t total_pindown_deferrals;
 };
 
 #define INVALID_GENERATION 1
@@ -457,6 +470,12 @@ struct ctdb_pulldb {
 	uint32_t lmaster;
 };
 
+struct ctdb_pulldb_ext {
+	uint32_t db_id;
+	uint32_t lmaster;
+	uint64_t srvid;
+};
+
 #define CTDB_RECOVERY_NORMAL		0
 #define CTDB_RECOVERY_ACTIVE		1
 
@@ -532,6 +551,37 @@ struct ctdb_traverse_all_ext {
 	bool withemptyrecords;
 };
 
+/*
+ * Records are only returned by a filtered traverse if the key starts
+ * with prefix and (header flags & flags_mask) == flags_value
+ */
+#define CTDB_TRAVERSE_FILTER_PREFIX_MAX	64
+
+struct ctdb_traverse_filter {
+	uint32_t flags_mask;
+	uint32_t flags_value;
+	uint32_t prefix_len;
+	uint8_t prefix[CTDB_TRAVERSE_FILTER_PREFIX_MAX];
+};
+
+struct ctdb_traverse_start_filter {
+	uint32_t db_id;
+	uint32_t reqid;
+	uint64_t srvid;
+	bool withemptyrecords;
+	struct ctdb_traverse_filter filter;
+};
+
+struct ctdb_traverse_all_filter {
+	uint32_t db_id;
+	uint32_t reqid;
+	uint32_t pnn;
+	uint32_t client_reqid;
+	uint64_t srvid;
+	bool withemptyrecords;
+	struct ctdb_traverse_filter filter;
+};
+
 typedef union {
 	struct sockaddr sa;
 	struct sockaddr_in ip;
@@ -619,6 +669,11 @@ struct ctdb_tunable_list {
 	uint32_t samba3_hack;
 	uint32_t mutex_enabled;
 	uint32_t lock_processes_per_db;
+	uint32_t rec_buffer_size_limit;
+	uint32_t lock_helper_pool_size;
+	uint32_t hot_record_migrations;
+	uint32_t vacuum_traverse_budget;
+	uint32_t hot_key_sample_rate;
 };
 
 struct ctdb_tickle_list {
@@ -704,8 +759,10 @@ struct ctdb_public_ip_list {
  * Node features
  */
 #define CTDB_CAP_PARALLEL_RECOVERY	0x00010000
+#define CTDB_CAP_FRAGMENTED_CONTROLS	0x00020000
 
-#define CTDB_CAP_FEATURES		(CTDB_CAP_PARALLEL_RECOVERY)
+#define CTDB_CAP_FEATURES		(CTDB_CAP_PARALLEL_RECOVERY | \
+					 CTDB_CAP_FRAGMENTED_CONTROLS)
 
 #define CTDB_CAP_DEFAULT		(CTDB_CAP_RECMASTER | \
 					 CTDB_CAP_LMASTER   | \
@@ -837,6 +894,25 @@ struct ctdb_db_statistics {
 	} hot_keys[MAX_HOT_KEYS];
 };
 
+/*
+ * Latency histograms of a database, the buckets are the same as for
+ * the lock latency.  The hot keys are the most frequently requested
+ * keys among the sampled record requests.
+ */
+struct ctdb_db_histograms {
+	uint32_t call[MAX_COUNT_BUCKETS];
+	uint32_t migrate[MAX_COUNT_BUCKETS];
+	uint32_t lock[MAX_COUNT_BUCKETS];
+	uint32_t vacuum[MAX_COUNT_BUCKETS];
+	uint32_t sample_rate;
+	uint32_t num_samples;
+	uint32_t num_hot_keys;
+	struct {
+		uint32_t count;
+		TDB_DATA key;
+	} hot_keys[MAX_HOT_KEYS];
+};
+
 enum ctdb_runstate {
 	CTDB_RUNSTATE_UNKNOWN,
 	CTDB_RUNSTATE_INIT,
@@ -888,6 +964,9 @@ struct ctdb_req_control_data {
 		struct ctdb_uint64_array *u64_array;
 		struct ctdb_traverse_start_ext *traverse_start_ext;
 		struct ctdb_traverse_all_ext *traverse_all_ext;
+		struct ctdb_pulldb_ext *pulldb_ext;
+		struct ctdb_traverse_start_filter *traverse_start_filter;
+		struct ctdb_traverse_all_filter *traverse_all_filter;
 	} data;
 };
 
@@ -922,7 +1001,10 @@ struct ctdb_reply_control_data {
 		struct ctdb_statistics_list *stats_list;
 		struct ctdb_uint8_array *u8_array;
 		struct ctdb_db_statistics *dbstats;
+		struct ctdb_db_histograms *dbhist;
 		enum ctdb_runstate runstate;
+		uint32_t num_records;
+		uint32_t tdb_flags;
 	} data;
 };
 
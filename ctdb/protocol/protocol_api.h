@@ -634,6 +634,36 @@ void ctdb_req_control_db_transaction_cancel(struct ctdb_req_control *request,
 					    uint32_t db_id);
 int ctdb_reply_control_db_transaction_cancel(struct ctdb_reply_control *reply);
 
+void ctdb_req_control_db_pull(struct ctdb_req_control *request,
+			      struct ctdb_pulldb_ext *pulldb_ext);
+int ctdb_reply_control_db_pull(struct ctdb_reply_control *reply,
+			       uint32_t *num_records);
+
+void ctdb_req_control_db_push_start(struct ctdb_req_control *request,
+				    struct ctdb_pulldb_ext *pulldb_ext);
+int ctdb_reply_control_db_push_start(struct ctdb_reply_control *reply);
+
+void ctdb_req_control_db_push_confirm(struct ctdb_req_control *request,
+				      uint32_t db_id);
+int ctdb_reply_control_db_push_confirm(struct ctdb_reply_control *reply,
+				       uint32_t *num_records);
+
+void ctdb_req_control_db_open_flags(struct ctdb_req_control *request,
+				    uint32_t db_id);
+int ctdb_reply_control_db_open_flags(struct ctdb_reply_control *reply,
+				     uint32_t *tdb_flags);
+
+void ctdb_req_control_traverse_start_filter(
+			struct ctdb_req_control *request,
+			struct ctdb_traverse_start_filter *traverse);
+int ctdb_reply_control_traverse_start_filter(struct ctdb_reply_control *reply);
+
+void ctdb_req_control_get_db_histograms(struct ctdb_req_control *request,
+					uint32_t db_id);
+int ctdb_reply_control_get_db_histograms(struct ctdb_reply_control *reply,
+					 TALLOC_CTX *mem_ctx,
+					 struct ctdb_db_histograms **dbhist);
+
 /* From protocol/protocol_message.c */
 
 int ctdb_req_message_push(struct ctdb_req_header *h,
@@ -481,6 +481,40 @@ static size_t ctdb_req_control_data_len(struct ctdb_req_control_data *cd)
 	case CTDB_CONTROL_DB_TRANSACTION_CANCEL:
 		len = ctdb_uint32_len(cd->data.db_id);
 		break;
+
+	case CTDB_CONTROL_DB_PULL:
+		len = ctdb_pulldb_ext_len(cd->data.pulldb_ext);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_START:
+		len = ctdb_pulldb_ext_len(cd->data.pulldb_ext);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		len = ctdb_uint32_len(cd->data.db_id);
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		len = ctdb_uint32_len(cd->data.db_id);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		len = ctdb_traverse_start_filter_len(
+					cd->data.traverse_start_filter);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		len = ctdb_traverse_all_filter_len(
+					cd->data.traverse_all_filter);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		len = ctdb_rec_buffer_len(cd->data.recbuf);
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		len = ctdb_uint32_len(cd->data.db_id);
+		break;
 	}
 
 	return len;
@@ -791,6 +825,40 @@ static void ctdb_req_control_data_push(struct ctdb_req_control_data *cd,
 	case CTDB_CONTROL_DB_TRANSACTION_CANCEL:
 		ctdb_uint32_push(cd->data.db_id, buf);
 		break;
+
+	case CTDB_CONTROL_DB_PULL:
+		ctdb_pulldb_ext_push(cd->data.pulldb_ext, buf);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_START:
+		ctdb_pulldb_ext_push(cd->data.pulldb_ext, buf);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		ctdb_uint32_push(cd->data.db_id, buf);
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		ctdb_uint32_push(cd->data.db_id, buf);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		ctdb_traverse_start_filter_push(cd->data.traverse_start_filter,
+						buf);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		ctdb_traverse_all_filter_push(cd->data.traverse_all_filter,
+					      buf);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		ctdb_rec_buffer_push(cd->data.recbuf, buf);
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		ctdb_uint32_push(cd->data.db_id, buf);
+		break;
 	}
 }
 
@@ -1177,6 +1245,48 @@ static int ctdb_req_control_data_pull(uint8_t *buf, size_t buflen,
 		ret = ctdb_uint32_pull(buf, buflen, mem_ctx,
 					&cd->data.db_id);
 		break;
+
+	case CTDB_CONTROL_DB_PULL:
+		ret = ctdb_pulldb_ext_pull(buf, buflen, mem_ctx,
+					   &cd->data.pulldb_ext);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_START:
+		ret = ctdb_pulldb_ext_pull(buf, buflen, mem_ctx,
+					   &cd->data.pulldb_ext);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		ret = ctdb_uint32_pull(buf, buflen, mem_ctx,
+				       &cd->data.db_id);
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		ret = ctdb_uint32_pull(buf, buflen, mem_ctx,
+				       &cd->data.db_id);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		ret = ctdb_traverse_start_filter_pull(
+					buf, buflen, mem_ctx,
+					&cd->data.traverse_start_filter);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		ret = ctdb_traverse_all_filter_pull(
+					buf, buflen, mem_ctx,
+					&cd->data.traverse_all_filter);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		ret = ctdb_rec_buffer_pull(buf, buflen, mem_ctx,
+					   &cd->data.recbuf);
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		ret = ctdb_uint32_pull(buf, buflen, mem_ctx,
+				       &cd->data.db_id);
+		break;
 	}
 
 	return ret;
@@ -1574,6 +1684,34 @@ static size_t ctdb_reply_control_data_len(struct ctdb_reply_control_data *cd)
 
 	case CTDB_CONTROL_DB_TRANSACTION_CANCEL:
 		break;
+
+	case CTDB_CONTROL_DB_PULL:
+		len = ctdb_uint32_len(cd->data.num_records);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_START:
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		len = ctdb_uint32_len(cd->data.num_records);
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		len = ctdb_uint32_len(cd->data.tdb_flags);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		len = ctdb_db_histograms_len(cd->data.dbhist);
+		break;
 	}
 
 	return len;
@@ -1726,6 +1864,22 @@ static void ctdb_reply_control_data_push(struct ctdb_reply_control_data *cd,
 	case CTDB_CONTROL_GET_NODES_FILE:
 		ctdb_node_map_push(cd->data.nodemap, buf);
 		break;
+
+	case CTDB_CONTROL_DB_PULL:
+		ctdb_uint32_push(cd->data.num_records, buf);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		ctdb_uint32_push(cd->data.num_records, buf);
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		ctdb_uint32_push(cd->data.tdb_flags, buf);
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		ctdb_db_histograms_push(cd->data.dbhist, buf);
+		break;
 	}
 }
 
@@ -1913,6 +2067,26 @@ static int ctdb_reply_control_data_pull(uint8_t *buf, size_t buflen,
 		ret = ctdb_node_map_pull(buf, buflen, mem_ctx,
 					 &cd->data.nodemap);
 		break;
+
+	case CTDB_CONTROL_DB_PULL:
+		ret = ctdb_uint32_pull(buf, buflen, mem_ctx,
+				       &cd->data.num_records);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		ret = ctdb_uint32_pull(buf, buflen, mem_ctx,
+				       &cd->data.num_records);
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		ret = ctdb_uint32_pull(buf, buflen, mem_ctx,
+				       &cd->data.tdb_flags);
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		ret = ctdb_db_histograms_pull(buf, buflen, mem_ctx,
+					      &cd->data.dbhist);
+		break;
 	}
 
 	return ret;
@@ -91,6 +91,11 @@ void ctdb_pulldb_push(struct ctdb_pulldb *pulldb, uint8_t *buf);
 int ctdb_pulldb_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
 		     struct ctdb_pulldb **out);
 
+size_t ctdb_pulldb_ext_len(struct ctdb_pulldb_ext *pulldb);
+void ctdb_pulldb_ext_push(struct ctdb_pulldb_ext *pulldb, uint8_t *buf);
+int ctdb_pulldb_ext_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
+			 struct ctdb_pulldb_ext **out);
+
 size_t ctdb_traverse_start_len(struct ctdb_traverse_start *traverse);
 void ctdb_traverse_start_push(struct ctdb_traverse_start *traverse,
 			      uint8_t *buf);
@@ -116,6 +121,22 @@ int ctdb_traverse_all_ext_pull(uint8_t *buf, size_t buflen,
 			       TALLOC_CTX *mem_ctx,
 			       struct ctdb_traverse_all_ext **out);
 
+size_t ctdb_traverse_start_filter_len(
+			struct ctdb_traverse_start_filter *traverse);
+void ctdb_traverse_start_filter_push(
+			struct ctdb_traverse_start_filter *traverse,
+			uint8_t *buf);
+int ctdb_traverse_start_filter_pull(uint8_t *buf, size_t buflen,
+				    TALLOC_CTX *mem_ctx,
+				    struct ctdb_traverse_start_filter **out);
+
+size_t ctdb_traverse_all_filter_len(struct ctdb_traverse_all_filter *traverse);
+void ctdb_traverse_all_filter_push(struct ctdb_traverse_all_filter *traverse,
+				   uint8_t *buf);
+int ctdb_traverse_all_filter_pull(uint8_t *buf, size_t buflen,
+				  TALLOC_CTX *mem_ctx,
+				  struct ctdb_traverse_all_filter **out);
+
 size_t ctdb_sock_addr_len(ctdb_sock_addr *addr);
 void ctdb_sock_addr_push(ctdb_sock_addr *addr, uint8_t *buf);
 int ctdb_sock_addr_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
@@ -254,6 +275,11 @@ void ctdb_db_statistics_push(struct ctdb_db_statistics *dbstats, void *buf);
 int ctdb_db_statistics_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
 			    struct ctdb_db_statistics **out);
 
+size_t ctdb_db_histograms_len(struct ctdb_db_histograms *dbhist);
+void ctdb_db_histograms_push(struct ctdb_db_histograms *dbhist, void *buf);
+int ctdb_db_histograms_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
+			    struct ctdb_db_histograms **out);
+
 size_t ctdb_election_message_len(struct ctdb_election_message *election);
 void ctdb_election_message_push(struct ctdb_election_message *election,
 				uint8_t *buf);
@@ -473,6 +473,34 @@ int ctdb_pulldb_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
 	return 0;
 }
 
+size_t ctdb_pulldb_ext_len(struct ctdb_pulldb_ext *pulldb)
+{
+	return sizeof(struct ctdb_pulldb_ext);
+}
+
+void ctdb_pulldb_ext_push(struct ctdb_pulldb_ext *pulldb, uint8_t *buf)
+{
+	memcpy(buf, pulldb, sizeof(struct ctdb_pulldb_ext));
+}
+
+int ctdb_pulldb_ext_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
+			 struct ctdb_pulldb_ext **out)
+{
+	struct ctdb_pulldb_ext *pulldb;
+
+	if (buflen < sizeof(struct ctdb_pulldb_ext)) {
+		return EMSGSIZE;
+	}
+
+	pulldb = talloc_memdup(mem_ctx, buf, sizeof(struct ctdb_pulldb_ext));
+	if (pulldb == NULL) {
+		return ENOMEM;
+	}
+
+	*out = pulldb;
+	return 0;
+}
+
 size_t ctdb_ltdb_header_len(struct ctdb_ltdb_header *header)
 {
 	return sizeof(struct ctdb_ltdb_header);
@@ -893,6 +921,70 @@ int ctdb_traverse_all_ext_pull(uint8_t *buf, size_t buflen,
 	return 0;
 }
 
+size_t ctdb_traverse_start_filter_len(
+			struct ctdb_traverse_start_filter *traverse)
+{
+	return sizeof(struct ctdb_traverse_start_filter);
+}
+
+void ctdb_traverse_start_filter_push(
+			struct ctdb_traverse_start_filter *traverse,
+			uint8_t *buf)
+{
+	memcpy(buf, traverse, sizeof(struct ctdb_traverse_start_filter));
+}
+
+int ctdb_traverse_start_filter_pull(uint8_t *buf, size_t buflen,
+				    TALLOC_CTX *mem_ctx,
+				    struct ctdb_traverse_start_filter **out)
+{
+	struct ctdb_traverse_start_filter *traverse;
+
+	if (buflen < sizeof(struct ctdb_traverse_start_filter)) {
+		return EMSGSIZE;
+	}
+
+	traverse = talloc_memdup(mem_ctx, buf,
+				 sizeof(struct ctdb_traverse_start_filter));
+	if (traverse == NULL) {
+		return ENOMEM;
+	}
+
+	*out = traverse;
+	return 0;
+}
+
+size_t ctdb_traverse_all_filter_len(struct ctdb_traverse_all_filter *traverse)
+{
+	return sizeof(struct ctdb_traverse_all_filter);
+}
+
+void ctdb_traverse_all_filter_push(struct ctdb_traverse_all_filter *traverse,
+				   uint8_t *buf)
+{
+	memcpy(buf, traverse, sizeof(struct ctdb_traverse_all_filter));
+}
+
+int ctdb_traverse_all_filter_pull(uint8_t *buf, size_t buflen,
+				  TALLOC_CTX *mem_ctx,
+				  struct ctdb_traverse_all_filter **out)
+{
+	struct ctdb_traverse_all_filter *traverse;
+
+	if (buflen < sizeof(struct ctdb_traverse_all_filter)) {
+		return EMSGSIZE;
+	}
+
+	traverse = talloc_memdup(mem_ctx, buf,
+				 sizeof(struct ctdb_traverse_all_filter));
+	if (traverse == NULL) {
+		return ENOMEM;
+	}
+
+	*out = traverse;
+	return 0;
+}
+
 size_t ctdb_sock_addr_len(ctdb_sock_addr *addr)
 {
 	return sizeof(ctdb_sock_addr);
@@ -2363,6 +2455,97 @@ int ctdb_db_statistics_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
 	return 0;
 }
 
+struct ctdb_db_histograms_wire {
+	struct ctdb_db_histograms dbhist;
+	char hot_keys_wire[1];
+};
+
+size_t ctdb_db_histograms_len(struct ctdb_db_histograms *dbhist)
+{
+	size_t len;
+	int i;
+
+	len = sizeof(struct ctdb_db_histograms);
+	for (i=0; i<dbhist->num_hot_keys; i++) {
+		len += dbhist->hot_keys[i].key.dsize;
+	}
+	return len;
+}
+
+void ctdb_db_histograms_push(struct ctdb_db_histograms *dbhist, void *buf)
+{
+	struct ctdb_db_histograms_wire *wire =
+		(struct ctdb_db_histograms_wire *)buf;
+	size_t offset;
+	int i;
+
+	memcpy(wire, dbhist, sizeof(struct ctdb_db_histograms));
+
+	offset = 0;
+	for (i=0; i<dbhist->num_hot_keys; i++) {
+		memcpy(&wire->hot_keys_wire[offset],
+		       dbhist->hot_keys[i].key.dptr,
+		       dbhist->hot_keys[i].key.dsize);
+		offset += dbhist->hot_keys[i].key.dsize;
+	}
+}
+
+int ctdb_db_histograms_pull(uint8_t *buf, size_t buflen, TALLOC_CTX *mem_ctx,
+			    struct ctdb_db_histograms **out)
+{
+	struct ctdb_db_histograms *dbhist;
+	struct ctdb_db_histograms_wire *wire =
+		(struct ctdb_db_histograms_wire *)buf;
+	size_t offset;
+	int i;
+
+	if (buflen < sizeof(struct ctdb_db_histograms)) {
+		return EMSGSIZE;
+	}
+	if (wire->dbhist.num_hot_keys > MAX_HOT_KEYS) {
+		return EMSGSIZE;
+	}
+	offset = 0;
+	for (i=0; i<wire->dbhist.num_hot_keys; i++) {
+		offset += wire->dbhist.hot_keys[i].key.dsize;
+	}
+	if (buflen < sizeof(struct ctdb_db_histograms) + offset) {
+		return EMSGSIZE;
+	}
+
+	dbhist = talloc(mem_ctx, struct ctdb_db_histograms);
+	if (dbhist == NULL) {
+		return ENOMEM;
+	}
+
+	memcpy(dbhist, wire, sizeof(struct ctdb_db_histograms));
+
+	offset = 0;
+	for (i=0; i<MAX_HOT_KEYS; i++) {
+		uint8_t *ptr;
+		size_t key_size;
+
+		if (i >= wire->dbhist.num_hot_keys) {
+			dbhist->hot_keys[i].count = 0;
+			dbhist->hot_keys[i].key = tdb_null;
+			continue;
+		}
+
+		key_size = dbhist->hot_keys[i].key.dsize;
+		ptr = talloc_memdup(dbhist, &wire->hot_keys_wire[offset],
+				    key_size);
+		if (ptr == NULL) {
+			talloc_free(dbhist);
+			return ENOMEM;
+		}
+		dbhist->hot_keys[i].key.dptr = ptr;
+		offset += key_size;
+	}
+
+	*out = dbhist;
+	return 0;
+}
+
 size_t ctdb_election_message_len(struct ctdb_election_message *election)
 {
 	return sizeof(struct ctdb_election_message);
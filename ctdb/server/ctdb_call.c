@@ -47,6 +47,15 @@ struct ctdb_sticky_record {
 	TDB_CONTEXT *pindown;
 };
 
+/* Number of migrations of a record within the current second */
+struct ctdb_migration_count {
+	uint32_t hash;
+	uint32_t count;
+	struct timeval start;
+};
+
+#define MIGRATION_COUNT_SLOTS 256
+
 /*
   find the ctdb_db from a db index
  */
@@ -283,7 +292,7 @@ static void ctdb_sticky_pindown_timeout(struct tevent_context *ev,
 	struct ctdb_sticky_record *sr = talloc_get_type(private_data, 
 						       struct ctdb_sticky_record);
 
-	DEBUG(DEBUG_ERR,("Pindown timeout db:%s  unstick record\n", sr->ctdb_db->db_name));
+	DEBUG(DEBUG_INFO,("Pindown timeout db:%s  unstick record\n", sr->ctdb_db->db_name));
 	if (sr->pindown != NULL) {
 		talloc_free(sr->pindown);
 		sr->pindown = NULL;
@@ -313,7 +322,7 @@ ctdb_set_sticky_pindown(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb_
 	talloc_free(tmp_ctx);
 
 	if (sr->pindown == NULL) {
-		DEBUG(DEBUG_ERR,("Pinning down record in %s for %d ms\n", ctdb_db->db_name, ctdb->tunable.sticky_pindown));
+		DEBUG(DEBUG_INFO,("Pinning down record in %s for %d ms\n", ctdb_db->db_name, ctdb->tunable.sticky_pindown));
 		sr->pindown = talloc_new(sr);
 		if (sr->pindown == NULL) {
 			DEBUG(DEBUG_ERR,("Failed to allocate pindown context for sticky record\n"));
@@ -375,11 +384,11 @@ static void ctdb_become_dmaster(struct ctdb_db_context *ctdb_db,
 		return;
 	}
 
-	/* we just became DMASTER and this database is "sticky",
+	/* we just became DMASTER and this database has sticky records,
 	   see if the record is flagged as "hot" and set up a pin-down
 	   context to stop migrations for a little while if so
 	*/
-	if (ctdb_db->sticky) {
+	if (ctdb_db->sticky_records != NULL) {
 		ctdb_set_sticky_pindown(ctdb, ctdb_db, key);
 	}
 
@@ -415,6 +424,9 @@ static void ctdb_become_dmaster(struct ctdb_db_context *ctdb_db,
 		return;
 	}
 
+	CTDB_UPDATE_DB_HISTOGRAM(ctdb_db, migrate,
+				 timeval_elapsed(&state->start_time));
+
 	ctdb_call_local(ctdb_db, state->call, &header, state, &data, true);
 
 	ret = ctdb_ltdb_unlock(ctdb_db, state->call->key);
@@ -730,11 +742,12 @@ ctdb_make_record_sticky(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb_
 	sr->ctdb_db = ctdb_db;
 	sr->pindown = NULL;
 
-	DEBUG(DEBUG_ERR,("Make record sticky for %d seconds in db %s key:0x%08x.\n",
+	DEBUG(DEBUG_NOTICE,("Make record sticky for %d seconds in db %s key:0x%08x.\n",
 			 ctdb->tunable.sticky_duration,
 			 ctdb_db->db_name, ctdb_hash(&key)));
 
 	trbt_insertarray32_callback(ctdb_db->sticky_records, k[0], &k[0], ctdb_make_sticky_record_callback, sr);
+	CTDB_INCREMENT_STAT(ctdb, total_sticky_records);
 
 	tevent_add_timer(ctdb->ev, sr,
 			 timeval_current_ofs(ctdb->tunable.sticky_duration, 0),
@@ -883,6 +896,60 @@ sort_keys:
 	}
 }
 
+/*
+ * Detect hot records in databases that are not sticky.
+ *
+ * Count the migrations of each record off this node within one second.
+ * A record migrated HotRecordMigrations times within a second is made
+ * sticky, so it is pinned down for StickyPindown ms whenever it comes
+ * back to this node.  Records are tracked in a small table indexed by
+ * key hash, colliding records simply restart each other's count.
+ */
+static void ctdb_count_migration(struct ctdb_db_context *ctdb_db, TDB_DATA key)
+{
+	struct ctdb_context *ctdb = ctdb_db->ctdb;
+	struct ctdb_migration_count *mc;
+	uint32_t hash;
+
+	if (ctdb->tunable.hot_record_migrations == 0 || ctdb_db->persistent) {
+		return;
+	}
+
+	if (ctdb_db->migration_counts == NULL) {
+		ctdb_db->migration_counts = talloc_zero_array(
+			ctdb_db, struct ctdb_migration_count,
+			MIGRATION_COUNT_SLOTS);
+		if (ctdb_db->migration_counts == NULL) {
+			return;
+		}
+	}
+
+	hash = ctdb_hash(&key);
+	mc = &ctdb_db->migration_counts[hash % MIGRATION_COUNT_SLOTS];
+
+	if (mc->count == 0 || mc->hash != hash ||
+	    timeval_elapsed(&mc->start) >= 1.0) {
+		mc->hash = hash;
+		mc->count = 0;
+		mc->start = timeval_current();
+	}
+
+	mc->count++;
+	if (mc->count < ctdb->tunable.hot_record_migrations) {
+		return;
+	}
+	mc->count = 0;
+
+	if (ctdb_db->sticky_records == NULL) {
+		ctdb_db->sticky_records = trbt_create(ctdb_db, 0);
+		if (ctdb_db->sticky_records == NULL) {
+			return;
+		}
+	}
+
+	ctdb_make_record_sticky(ctdb, ctdb_db, key);
+}
+
 /*
   called when a CTDB_REQ_CALL packet comes in
 */
@@ -934,10 +1001,11 @@ void ctdb_request_call(struct ctdb_context *ctdb, struct ctdb_req_header *hdr)
 	/* If this record is pinned down we should defer the
 	   request until the pindown times out
 	*/
-	if (ctdb_db->sticky) {
+	if (ctdb_db->sticky_records != NULL) {
 		if (ctdb_defer_pinned_down_request(ctdb, ctdb_db, call->key, hdr) == 0) {
-			DEBUG(DEBUG_WARNING,
+			DEBUG(DEBUG_INFO,
 			      ("Defer request for pinned down record in %s\n", ctdb_db->db_name));
+			CTDB_INCREMENT_STAT(ctdb, total_pindown_deferrals);
 			talloc_free(call);
 			return;
 		}
@@ -1128,6 +1196,7 @@ void ctdb_request_call(struct ctdb_context *ctdb, struct ctdb_req_header *hdr)
 		} else {
 			DEBUG(DEBUG_DEBUG,("pnn %u starting migration of %08x to %u\n",
 				 ctdb->pnn, ctdb_hash(&(call->key)), c->hdr.srcnode));
+			ctdb_count_migration(ctdb_db, call->key);
 			ctdb_call_send_dmaster(ctdb_db, c, &header, &(call->key), &data);
 			talloc_free(data.dptr);
 
@@ -1500,6 +1569,7 @@ struct ctdb_call_state *ctdb_daemon_call_send_remote(struct ctdb_db_context *ctd
 
 	state->reqid = reqid_new(ctdb->idr, state);
 	state->ctdb_db = ctdb_db;
+	state->start_time = timeval_current();
 	talloc_set_destructor(state, ctdb_call_destructor);
 
 	len = offsetof(struct ctdb_req_call_old, data) + call->key.dsize + call->call_data.dsize;
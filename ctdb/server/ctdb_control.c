@@ -266,6 +266,19 @@ static int32_t ctdb_control_dispatch(struct ctdb_context *ctdb,
 		return 0;
 	}
 
+	case CTDB_CONTROL_DB_OPEN_FLAGS: {
+		uint32_t db_id;
+		struct ctdb_db_context *ctdb_db;
+
+		CHECK_CONTROL_DATA_SIZE(sizeof(db_id));
+		db_id = *(uint32_t *)indata.dptr;
+		ctdb_db = find_ctdb_db(ctdb, db_id);
+		if (ctdb_db == NULL) return -1;
+		outdata->dptr = (uint8_t *)&ctdb_db->tdb_flags;
+		outdata->dsize = sizeof(ctdb_db->tdb_flags);
+		return 0;
+	}
+
 	case CTDB_CONTROL_DB_ATTACH:
 	  return ctdb_control_db_attach(ctdb, indata, outdata, srvid, false, client_id, c, async_reply);
 
@@ -296,6 +309,16 @@ static int32_t ctdb_control_dispatch(struct ctdb_context *ctdb,
 		CHECK_CONTROL_DATA_SIZE(sizeof(struct ctdb_traverse_start));
 		return ctdb_control_traverse_kill(ctdb, indata, outdata, srcnode);
 
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		CHECK_CONTROL_DATA_SIZE(sizeof(struct ctdb_traverse_start_filter));
+		return ctdb_control_traverse_start_filter(ctdb, indata, outdata, srcnode, client_id);
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		return ctdb_control_traverse_all_filter(ctdb, indata, outdata);
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		return ctdb_control_traverse_data_batch(ctdb, indata, outdata);
+
 	case CTDB_CONTROL_REGISTER_SRVID:
 		return daemon_register_message_handler(ctdb, client_id, srvid);
 
@@ -684,6 +707,10 @@ static int32_t ctdb_control_dispatch(struct ctdb_context *ctdb,
 		CHECK_CONTROL_DATA_SIZE(sizeof(uint32_t));
 		return ctdb_control_get_db_statistics(ctdb, *(uint32_t *)indata.dptr, outdata);
 
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		CHECK_CONTROL_DATA_SIZE(sizeof(uint32_t));
+		return ctdb_control_get_db_histograms(ctdb, *(uint32_t *)indata.dptr, outdata);
+
 	case CTDB_CONTROL_RELOAD_PUBLIC_IPS:
 		CHECK_CONTROL_DATA_SIZE(0);
 		return ctdb_control_reload_public_ips(ctdb, c, async_reply);
@@ -715,6 +742,18 @@ static int32_t ctdb_control_dispatch(struct ctdb_context *ctdb,
 		CHECK_CONTROL_DATA_SIZE(sizeof(uint32_t));
 		return ctdb_control_db_transaction_cancel(ctdb, indata);
 
+	case CTDB_CONTROL_DB_PULL:
+		CHECK_CONTROL_DATA_SIZE(sizeof(struct ctdb_pulldb_ext));
+		return ctdb_control_db_pull(ctdb, c, indata, outdata);
+
+	case CTDB_CONTROL_DB_PUSH_START:
+		CHECK_CONTROL_DATA_SIZE(sizeof(struct ctdb_pulldb_ext));
+		return ctdb_control_db_push_start(ctdb, indata);
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		CHECK_CONTROL_DATA_SIZE(sizeof(uint32_t));
+		return ctdb_control_db_push_confirm(ctdb, indata, outdata);
+
 	default:
 		DEBUG(DEBUG_CRIT,(__location__ " Unknown CTDB control opcode %u\n", opcode));
 		return -1;
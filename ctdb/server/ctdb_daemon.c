@@ -379,6 +379,8 @@ static void daemon_call_from_client_callback(struct ctdb_call_state *state)
 		DEBUG(DEBUG_ERR, (__location__ " Failed to queue packet from daemon to client\n"));
 	}
 	CTDB_UPDATE_LATENCY(client->ctdb, ctdb_db, "call_from_client_cb 3", call_latency, dstate->start_time);
+	CTDB_UPDATE_DB_HISTOGRAM(ctdb_db, call,
+				 timeval_elapsed(&dstate->start_time));
 	CTDB_DECREMENT_STAT(client->ctdb, pending_calls);
 	talloc_free(dstate);
 }
@@ -660,6 +662,8 @@ static void daemon_request_call_from_client(struct ctdb_client *client,
 		return;
 	}
 
+	ctdb_db_sample_key(ctdb_db, key);
+
 
 	/* check if this fetch request is a duplicate for a
 	   request we already have in flight. If so defer it until
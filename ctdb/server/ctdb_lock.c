@@ -38,12 +38,18 @@
 /*
  * Non-blocking Locking API
  *
- * 1. Create a child process to do blocking locks.
+ * 1. Hand the lock request to a child process to do blocking locks.
  * 2. Once the locks are obtained, signal parent process via fd.
  * 3. Invoke registered callback routine with locking status.
  * 4. If the child process cannot get locks within certain time,
  *    execute an external script to debug.
  *
+ * Child processes (lock helpers) are kept in a pool after the locks are
+ * released and reused for the next lock request, up to LockHelperPoolSize
+ * idle helpers.  A helper that has not obtained the locks when the lock
+ * request goes away is killed.  With LockHelperPoolSize set to 0, a new
+ * helper is started for each lock request.
+ *
  * ctdb_lock_record()      - get a lock on a record
  * ctdb_lock_db()          - get a lock on a DB
  * ctdb_lock_alldb_prio()  - get a lock on all DBs with given priority
@@ -72,6 +78,16 @@ static const char * const lock_type_str[] = {
 
 struct lock_request;
 
+/* lock_helper is a child process serving lock requests */
+struct lock_helper {
+	struct lock_helper *next, *prev;
+	struct ctdb_context *ctdb;
+	pid_t pid;
+	int req_fd;
+	int res_fd;
+	bool idle;
+};
+
 /* lock_context is the common part for a lock request */
 struct lock_context {
 	struct lock_context *next, *prev;
@@ -84,6 +100,8 @@ struct lock_context {
 	struct lock_request *request;
 	pid_t child;
 	int fd[2];
+	struct lock_helper *helper;
+	bool replied;
 	struct tevent_fd *tfd;
 	struct tevent_timer *ttimer;
 	struct timeval start_time;
@@ -318,6 +336,8 @@ static int ctdb_lockall_unmark(struct ctdb_context *ctdb)
 
 static void ctdb_lock_schedule(struct ctdb_context *ctdb);
 
+static void lock_helper_release(struct lock_helper *helper, bool reuse);
+
 /*
  * Destructor to kill the child locking process
  */
@@ -327,7 +347,15 @@ static int ctdb_lock_context_destructor(struct lock_context *lock_ctx)
 		lock_ctx->request->lctx = NULL;
 	}
 	if (lock_ctx->child > 0) {
-		ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGKILL);
+		if (lock_ctx->helper != NULL) {
+			/* Stop listening before the helper is reused */
+			TALLOC_FREE(lock_ctx->tfd);
+			lock_helper_release(lock_ctx->helper,
+					    lock_ctx->replied);
+			lock_ctx->helper = NULL;
+		} else {
+			ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGKILL);
+		}
 		if (lock_ctx->type == LOCK_RECORD) {
 			DLIST_REMOVE(lock_ctx->ctdb_db->lock_current, lock_ctx);
 		} else {
@@ -444,38 +472,6 @@ static void process_callbacks(struct lock_context *lock_ctx, bool locked)
 }
 
 
-static int lock_bucket_id(double t)
-{
-	double ms = 1.e-3, s = 1;
-	int id;
-
-	if (t < 1*ms) {
-		id = 0;
-	} else if (t < 10*ms) {
-		id = 1;
-	} else if (t < 100*ms) {
-		id = 2;
-	} else if (t < 1*s) {
-		id = 3;
-	} else if (t < 2*s) {
-		id = 4;
-	} else if (t < 4*s) {
-		id = 5;
-	} else if (t < 8*s) {
-		id = 6;
-	} else if (t < 16*s) {
-		id = 7;
-	} else if (t < 32*s) {
-		id = 8;
-	} else if (t < 64*s) {
-		id = 9;
-	} else {
-		id = 10;
-	}
-
-	return id;
-}
-
 /*
  * Callback routine when the required locks are obtained.
  * Called from parent context
@@ -497,13 +493,19 @@ static void ctdb_lock_handler(struct tevent_context *ev,
 	TALLOC_FREE(lock_ctx->ttimer);
 
 	t = timeval_elapsed(&lock_ctx->start_time);
-	id = lock_bucket_id(t);
+	id = ctdb_latency_bucket_id(t);
 
 	/* Read the status from the child process */
 	if (sys_read(lock_ctx->fd[0], &c, 1) != 1) {
 		locked = false;
 	} else {
 		locked = (c == 0 ? true : false);
+		lock_ctx->replied = true;
+	}
+
+	/* A lock helper does not write again until it is reused */
+	if (lock_ctx->helper != NULL) {
+		TALLOC_FREE(lock_ctx->tfd);
 	}
 
 	/* Update statistics */
@@ -619,7 +621,7 @@ static int db_flags(struct ctdb_db_context *ctdb_db)
 	int tdb_flags = TDB_DEFAULT;
 
 #ifdef TDB_MUTEX_LOCKING
-	if (!ctdb_db->persistent && ctdb_db->ctdb->tunable.mutex_enabled) {
+	if (ctdb_db->tdb_flags & TDB_MUTEX_LOCKING) {
 		tdb_flags = (TDB_MUTEX_LOCKING | TDB_CLEAR_IF_FIRST);
 	}
 #endif
@@ -802,36 +804,236 @@ static struct lock_context *ctdb_find_lock_context(struct ctdb_context *ctdb)
 }
 
 /*
- * Schedule a new lock child process
- * Set up callback handler and timeout handler
+ * Destructor to kill the lock helper, which releases any locks held
  */
-static void ctdb_lock_schedule(struct ctdb_context *ctdb)
+static int lock_helper_destructor(struct lock_helper *helper)
 {
-	struct lock_context *lock_ctx;
-	int ret, argc;
-	TALLOC_CTX *tmp_ctx;
-	static char prog[PATH_MAX+1] = "";
-	const char **args;
+	struct ctdb_context *ctdb = helper->ctdb;
 
-	if (!ctdb_set_helper("lock helper",
-			     prog, sizeof(prog),
-			     "CTDB_LOCK_HELPER",
-			     CTDB_HELPER_BINDIR, "ctdb_lock_helper")) {
-		ctdb_die(ctdb, __location__
-			 " Unable to set lock helper\n");
+	if (helper->idle) {
+		DLIST_REMOVE(ctdb->lock_helpers, helper);
+		ctdb->lock_num_helpers--;
 	}
+	close(helper->req_fd);
+	close(helper->res_fd);
+	ctdb_kill(ctdb, helper->pid, SIGKILL);
 
-	/* Find a lock context with requests */
-	lock_ctx = ctdb_find_lock_context(ctdb);
-	if (lock_ctx == NULL) {
+	return 0;
+}
+
+/*
+ * Start a lock helper which serves lock requests over a pipe
+ */
+static struct lock_helper *lock_helper_create(struct ctdb_context *ctdb,
+					      const char *prog)
+{
+	struct lock_helper *helper;
+	int req[2], res[2];
+	const char *args[5];
+
+	helper = talloc_zero(ctdb, struct lock_helper);
+	if (helper == NULL) {
+		DEBUG(DEBUG_ERR, ("Failed to allocate lock helper\n"));
+		return NULL;
+	}
+	helper->ctdb = ctdb;
+
+	if (pipe(req) != 0) {
+		DEBUG(DEBUG_ERR, ("Failed to create pipe for lock helper\n"));
+		talloc_free(helper);
+		return NULL;
+	}
+	if (pipe(res) != 0) {
+		DEBUG(DEBUG_ERR, ("Failed to create pipe for lock helper\n"));
+		close(req[0]);
+		close(req[1]);
+		talloc_free(helper);
+		return NULL;
+	}
+
+	set_close_on_exec(req[1]);
+	set_close_on_exec(res[0]);
+
+	args[0] = talloc_asprintf(helper, "%d", getpid());
+	args[1] = talloc_asprintf(helper, "%d", res[1]);
+	args[2] = "SERVER";
+	args[3] = talloc_asprintf(helper, "%d", req[0]);
+	args[4] = NULL;
+
+	if (args[0] == NULL || args[1] == NULL || args[3] == NULL ||
+	    !ctdb_vfork_with_logging(helper, ctdb, "lock_helper",
+				     prog, 5, args,
+				     NULL, NULL, &helper->pid)) {
+		DEBUG(DEBUG_ERR, ("Failed to start lock helper\n"));
+		close(req[0]);
+		close(req[1]);
+		close(res[0]);
+		close(res[1]);
+		talloc_free(helper);
+		return NULL;
+	}
+
+	close(req[0]);
+	close(res[1]);
+
+	helper->req_fd = req[1];
+	helper->res_fd = res[0];
+	talloc_set_destructor(helper, lock_helper_destructor);
+
+	return helper;
+}
+
+/*
+ * Get an idle lock helper or start a new one
+ */
+static struct lock_helper *lock_helper_get(struct ctdb_context *ctdb,
+					   const char *prog)
+{
+	struct lock_helper *helper = ctdb->lock_helpers;
+
+	if (helper == NULL) {
+		return lock_helper_create(ctdb, prog);
+	}
+
+	DLIST_REMOVE(ctdb->lock_helpers, helper);
+	ctdb->lock_num_helpers--;
+	helper->idle = false;
+
+	return helper;
+}
+
+/*
+ * Tell the lock helper to release the locks and keep it for reuse.
+ *
+ * A helper which has not replied may still be waiting for the locks, so
+ * it cannot be reused.
+ */
+static void lock_helper_release(struct lock_helper *helper, bool reuse)
+{
+	struct ctdb_context *ctdb = helper->ctdb;
+	uint32_t len = 0;
+
+	if (!reuse ||
+	    ctdb->lock_num_helpers >= ctdb->tunable.lock_helper_pool_size) {
+		talloc_free(helper);
 		return;
 	}
 
-	lock_ctx->child = -1;
+	if (sys_write(helper->req_fd, &len, sizeof(len)) != sizeof(len)) {
+		DEBUG(DEBUG_WARNING, ("Failed to release locks in lock "
+				      "helper %d\n", (int)helper->pid));
+		talloc_free(helper);
+		return;
+	}
+
+	helper->idle = true;
+	DLIST_ADD(ctdb->lock_helpers, helper);
+	ctdb->lock_num_helpers++;
+}
+
+/*
+ * Send the lock request to the lock helper.
+ *
+ * The request is the helper arguments after <ctdbd-pid> <output-fd> as
+ * NUL-terminated strings, preceded by the total length.
+ */
+static bool lock_helper_send(struct lock_helper *helper,
+			     int argc, const char **argv)
+{
+	uint8_t *buf;
+	uint32_t len = 0;
+	size_t offset, n;
+	int i;
+	bool ok;
+
+	/* Skip <ctdbd-pid> <output-fd> and the trailing NULL */
+	for (i=2; i<argc-1; i++) {
+		len += strlen(argv[i]) + 1;
+	}
+
+	buf = talloc_size(helper, sizeof(len) + len);
+	if (buf == NULL) {
+		return false;
+	}
+
+	memcpy(buf, &len, sizeof(len));
+	offset = sizeof(len);
+	for (i=2; i<argc-1; i++) {
+		n = strlen(argv[i]) + 1;
+		memcpy(buf+offset, argv[i], n);
+		offset += n;
+	}
+
+	ok = (sys_write(helper->req_fd, buf, offset) == offset);
+	talloc_free(buf);
+
+	return ok;
+}
+
+/*
+ * Hand the lock request to a lock helper from the pool
+ */
+static bool ctdb_lock_start_helper(struct lock_context *lock_ctx,
+				   const char *prog)
+{
+	struct ctdb_context *ctdb = lock_ctx->ctdb;
+	struct lock_helper *helper;
+	const char **args;
+	int argc;
+	bool ok;
+
+	if (!lock_helper_args(lock_ctx, lock_ctx, -1, &argc, &args)) {
+		DEBUG(DEBUG_ERR, ("Failed to create lock helper args\n"));
+		return false;
+	}
+
+	/* An idle helper may have died, then try the next one */
+	do {
+		bool idle = (ctdb->lock_helpers != NULL);
+
+		helper = lock_helper_get(ctdb, prog);
+		if (helper == NULL) {
+			talloc_free(args);
+			return false;
+		}
+
+		ok = lock_helper_send(helper, argc, args);
+		if (!ok) {
+			DEBUG(DEBUG_WARNING,
+			      ("Failed to send request to lock helper %d\n",
+			       (int)helper->pid));
+			talloc_free(helper);
+			if (!idle) {
+				talloc_free(args);
+				return false;
+			}
+		}
+	} while (!ok);
+
+	talloc_free(args);
+
+	lock_ctx->helper = helper;
+	lock_ctx->child = helper->pid;
+	lock_ctx->fd[0] = helper->res_fd;
+
+	return true;
+}
+
+/*
+ * Start a new child process for the lock request
+ */
+static bool ctdb_lock_start_child(struct lock_context *lock_ctx,
+				  const char *prog)
+{
+	struct ctdb_context *ctdb = lock_ctx->ctdb;
+	TALLOC_CTX *tmp_ctx;
+	const char **args;
+	int ret, argc;
+
 	ret = pipe(lock_ctx->fd);
 	if (ret != 0) {
 		DEBUG(DEBUG_ERR, ("Failed to create pipe in ctdb_lock_schedule\n"));
-		return;
+		return false;
 	}
 
 	set_close_on_exec(lock_ctx->fd[0]);
@@ -842,7 +1044,7 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 		DEBUG(DEBUG_ERR, ("Failed to allocate memory for helper args\n"));
 		close(lock_ctx->fd[0]);
 		close(lock_ctx->fd[1]);
-		return;
+		return false;
 	}
 
 	/* Create arguments for lock helper */
@@ -852,7 +1054,7 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 		close(lock_ctx->fd[0]);
 		close(lock_ctx->fd[1]);
 		talloc_free(tmp_ctx);
-		return;
+		return false;
 	}
 
 	if (!ctdb_vfork_with_logging(lock_ctx, ctdb, "lock_helper",
@@ -862,7 +1064,7 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 		close(lock_ctx->fd[0]);
 		close(lock_ctx->fd[1]);
 		talloc_free(tmp_ctx);
-		return;
+		return false;
 	}
 
 	/* Parent process */
@@ -870,6 +1072,62 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 
 	talloc_free(tmp_ctx);
 
+	return true;
+}
+
+/*
+ * Undo ctdb_lock_start_helper() or ctdb_lock_start_child()
+ */
+static void ctdb_lock_stop(struct lock_context *lock_ctx)
+{
+	if (lock_ctx->helper != NULL) {
+		TALLOC_FREE(lock_ctx->helper);
+	} else {
+		ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGKILL);
+		close(lock_ctx->fd[0]);
+	}
+	lock_ctx->child = -1;
+}
+
+/*
+ * Schedule a new lock child process
+ * Set up callback handler and timeout handler
+ */
+static void ctdb_lock_schedule(struct ctdb_context *ctdb)
+{
+	struct lock_context *lock_ctx;
+	static char prog[PATH_MAX+1] = "";
+	bool ok;
+
+	if (!ctdb_set_helper("lock helper",
+			     prog, sizeof(prog),
+			     "CTDB_LOCK_HELPER",
+			     CTDB_HELPER_BINDIR, "ctdb_lock_helper")) {
+		ctdb_die(ctdb, __location__
+			 " Unable to set lock helper\n");
+	}
+
+	/* Find a lock context with requests */
+	lock_ctx = ctdb_find_lock_context(ctdb);
+	if (lock_ctx == NULL) {
+		return;
+	}
+
+	/* Shrink the pool if LockHelperPoolSize has been lowered */
+	while (ctdb->lock_num_helpers > ctdb->tunable.lock_helper_pool_size) {
+		talloc_free(ctdb->lock_helpers);
+	}
+
+	lock_ctx->child = -1;
+	if (ctdb->tunable.lock_helper_pool_size > 0) {
+		ok = ctdb_lock_start_helper(lock_ctx, prog);
+	} else {
+		ok = ctdb_lock_start_child(lock_ctx, prog);
+	}
+	if (!ok) {
+		return;
+	}
+
 	/* Set up timeout handler */
 	lock_ctx->ttimer = tevent_add_timer(ctdb->ev,
 					    lock_ctx,
@@ -877,9 +1135,7 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 					    ctdb_lock_timeout_handler,
 					    (void *)lock_ctx);
 	if (lock_ctx->ttimer == NULL) {
-		ctdb_kill(ctdb, lock_ctx->child, SIGKILL);
-		lock_ctx->child = -1;
-		close(lock_ctx->fd[0]);
+		ctdb_lock_stop(lock_ctx);
 		return;
 	}
 
@@ -892,12 +1148,12 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 				      (void *)lock_ctx);
 	if (lock_ctx->tfd == NULL) {
 		TALLOC_FREE(lock_ctx->ttimer);
-		ctdb_kill(ctdb, lock_ctx->child, SIGKILL);
-		lock_ctx->child = -1;
-		close(lock_ctx->fd[0]);
+		ctdb_lock_stop(lock_ctx);
 		return;
 	}
-	tevent_fd_set_auto_close(lock_ctx->tfd);
+	if (lock_ctx->helper == NULL) {
+		tevent_fd_set_auto_close(lock_ctx->tfd);
+	}
 
 	/* Move the context from pending to current */
 	if (lock_ctx->type == LOCK_RECORD) {
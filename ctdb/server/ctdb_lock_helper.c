@@ -20,6 +20,7 @@
 #include "replace.h"
 #include "system/filesys.h"
 #include "system/network.h"
+#include "system/select.h"
 
 #include <talloc.h>
 
@@ -29,6 +30,16 @@
 
 static char *progname = NULL;
 
+/*
+ * Locks held by the helper.  A record lock is a chain lock on one key,
+ * a database lock is an allrecord lock.
+ */
+struct lock_held {
+	struct tdb_context *tdb;
+	TDB_DATA key;
+	bool record;
+};
+
 static void send_result(int fd, char result)
 {
 	sys_write(fd, &result, 1);
@@ -45,6 +56,8 @@ static void usage(void)
 		progname);
 	fprintf(stderr, "       %s <log-fd> <ctdbd-pid> <output-fd> DB <db1-path> <db1-flags> [<db2-path> <db2-flags>...]\n",
 		progname);
+	fprintf(stderr, "       %s <log-fd> <ctdbd-pid> <output-fd> SERVER <input-fd>\n",
+		progname);
 }
 
 static uint8_t *hex_decode_talloc(TALLOC_CTX *mem_ctx,
@@ -64,7 +77,9 @@ static uint8_t *hex_decode_talloc(TALLOC_CTX *mem_ctx,
 	return buffer;
 }
 
-static int lock_record(const char *dbpath, const char *dbflags, const char *dbkey)
+static int lock_record(TALLOC_CTX *mem_ctx, const char *dbpath,
+		       const char *dbflags, const char *dbkey,
+		       struct lock_held *held)
 {
 	TDB_DATA key;
 	struct tdb_context *tdb;
@@ -78,7 +93,7 @@ static int lock_record(const char *dbpath, const char *dbflags, const char *dbke
 		key.dptr = NULL;
 		key.dsize = 0;
 	} else {
-		key.dptr = hex_decode_talloc(NULL, dbkey, &key.dsize);
+		key.dptr = hex_decode_talloc(mem_ctx, dbkey, &key.dsize);
 	}
 
 	tdb = tdb_open(dbpath, 0, tdb_flags, O_RDWR, 0600);
@@ -90,15 +105,20 @@ static int lock_record(const char *dbpath, const char *dbflags, const char *dbke
 	if (tdb_chainlock(tdb, key) < 0) {
 		fprintf(stderr, "%s: Error getting record lock (%s)\n",
 			progname, tdb_errorstr(tdb));
+		tdb_close(tdb);
 		return 1;
 	}
 
+	held->tdb = tdb;
+	held->key = key;
+	held->record = true;
 	return 0;
 
 }
 
 
-static int lock_db(const char *dbpath, const char *dbflags)
+static int lock_db(const char *dbpath, const char *dbflags,
+		   struct lock_held *held)
 {
 	struct tdb_context *tdb;
 	int tdb_flags;
@@ -115,19 +135,232 @@ static int lock_db(const char *dbpath, const char *dbflags)
 	if (tdb_lockall(tdb) < 0) {
 		fprintf(stderr, "%s: Error getting db lock (%s)\n",
 			progname, tdb_errorstr(tdb));
+		tdb_close(tdb);
+		return 1;
+	}
+
+	held->tdb = tdb;
+	held->key = tdb_null;
+	held->record = false;
+	return 0;
+}
+
+
+/*
+ * Release the locks explicitly before closing, closing a database with
+ * mutexes does not drop the mutexes held.
+ */
+static void unlock_held(struct lock_held *held, int num_held)
+{
+	int i;
+
+	for (i=num_held-1; i>=0; i--) {
+		if (held[i].record) {
+			tdb_chainunlock(held[i].tdb, held[i].key);
+		} else {
+			tdb_unlockall(held[i].tdb);
+		}
+		tdb_close(held[i].tdb);
+	}
+}
+
+
+/*
+ * Get the locks described by the arguments <lock-type> [<args>...]
+ *
+ * On success the locks are returned in held, on failure all the locks
+ * obtained so far are released.
+ */
+static char lock_args(TALLOC_CTX *mem_ctx, int argc, const char **argv,
+		      struct lock_held **pheld, int *pnum_held)
+{
+	struct lock_held *held;
+	int num_held = 0;
+	char result = 0;
+
+	held = talloc_zero_array(mem_ctx, struct lock_held, argc);
+	if (held == NULL) {
+		fprintf(stderr, "%s: Memory allocation error\n", progname);
 		return 1;
 	}
 
+	if (strcmp(argv[0], "RECORD") == 0) {
+		if (argc != 4) {
+			fprintf(stderr, "%s: Invalid number of arguments (%d)\n",
+				progname, argc+4);
+			usage();
+			exit(1);
+		}
+		result = lock_record(held, argv[1], argv[2], argv[3],
+				     &held[0]);
+		if (result == 0) {
+			num_held = 1;
+		}
+
+	} else if (strcmp(argv[0], "DB") == 0) {
+		int n;
+
+		/* If there are no databases specified, no need for lock */
+		for (n=1; n+1<argc; n+=2) {
+			result = lock_db(argv[n], argv[n+1], &held[num_held]);
+			if (result != 0) {
+				break;
+			}
+			num_held++;
+		}
+
+	} else {
+		fprintf(stderr, "%s: Invalid lock-type '%s'\n", progname, argv[0]);
+		usage();
+		exit(1);
+	}
+
+	if (result != 0) {
+		unlock_held(held, num_held);
+		talloc_free(held);
+		return result;
+	}
+
+	*pheld = held;
+	*pnum_held = num_held;
 	return 0;
 }
 
 
+/*
+ * Wait for data from ctdbd, give up if ctdbd goes away
+ */
+static bool wait_for_input(int fd, int ppid)
+{
+	struct pollfd pfd;
+	int ret;
+
+	while (true) {
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		ret = poll(&pfd, 1, 5000);
+		if (ret > 0) {
+			return true;
+		}
+		if (ret < 0 && errno != EINTR) {
+			return false;
+		}
+		if (kill(ppid, 0) != 0 && errno == ESRCH) {
+			return false;
+		}
+	}
+}
+
+static bool read_data(int fd, int ppid, void *buf, size_t len)
+{
+	uint8_t *ptr = (uint8_t *)buf;
+	size_t nread = 0;
+	ssize_t n;
+
+	while (nread < len) {
+		if (! wait_for_input(fd, ppid)) {
+			return false;
+		}
+		n = sys_read(fd, ptr + nread, len - nread);
+		if (n <= 0) {
+			return false;
+		}
+		nread += n;
+	}
+
+	return true;
+}
+
+
+/*
+ * Serve lock requests from ctdbd until it closes the input pipe.
+ *
+ * Each request is a uint32_t length followed by NUL-terminated strings
+ * <lock-type> [<args>...], same as the command line arguments.  The
+ * result is sent back as a single byte.  A request of length 0 releases
+ * the locks held.
+ */
+static void lock_server(int ppid, int read_fd, int write_fd)
+{
+	TALLOC_CTX *mem_ctx = NULL;
+	struct lock_held *held = NULL;
+	int num_held = 0;
+
+	while (true) {
+		uint32_t len;
+		char *buf, *ptr;
+		const char **args;
+		int nargs, i;
+		char result;
+
+		if (! read_data(read_fd, ppid, &len, sizeof(len))) {
+			break;
+		}
+
+		unlock_held(held, num_held);
+		held = NULL;
+		num_held = 0;
+		TALLOC_FREE(mem_ctx);
+
+		if (len == 0) {
+			continue;
+		}
+
+		mem_ctx = talloc_new(NULL);
+		buf = talloc_size(mem_ctx, len);
+		if (buf == NULL) {
+			fprintf(stderr, "%s: Memory allocation error\n",
+				progname);
+			break;
+		}
+		if (! read_data(read_fd, ppid, buf, len)) {
+			break;
+		}
+		if (buf[len-1] != '\0') {
+			fprintf(stderr, "%s: Invalid lock request\n", progname);
+			break;
+		}
+
+		nargs = 0;
+		for (i=0; i<len; i++) {
+			if (buf[i] == '\0') {
+				nargs++;
+			}
+		}
+
+		args = talloc_array(mem_ctx, const char *, nargs);
+		if (args == NULL) {
+			fprintf(stderr, "%s: Memory allocation error\n",
+				progname);
+			break;
+		}
+		ptr = buf;
+		for (i=0; i<nargs; i++) {
+			args[i] = ptr;
+			ptr += strlen(ptr) + 1;
+		}
+
+		result = lock_args(mem_ctx, nargs, args, &held, &num_held);
+		if (sys_write(write_fd, &result, 1) != 1) {
+			break;
+		}
+	}
+
+	/* Exiting releases all the locks */
+	exit(0);
+}
+
+
 int main(int argc, char *argv[])
 {
 	int write_fd, log_fd;
 	char result = 0;
 	int ppid;
 	const char *lock_type;
+	struct lock_held *held;
+	int num_held;
 
 	progname = argv[0];
 
@@ -152,34 +385,19 @@ int main(int argc, char *argv[])
 	write_fd = atoi(argv[3]);
 	lock_type = argv[4];
 
-	if (strcmp(lock_type, "RECORD") == 0) {
-		if (argc != 8) {
+	if (strcmp(lock_type, "SERVER") == 0) {
+		if (argc != 6) {
 			fprintf(stderr, "%s: Invalid number of arguments (%d)\n",
 				progname, argc);
 			usage();
 			exit(1);
 		}
-		result = lock_record(argv[5], argv[6], argv[7]);
-
-	} else if (strcmp(lock_type, "DB") == 0) {
-		int n;
-
-		/* If there are no databases specified, no need for lock */
-		if (argc > 5) {
-			for (n=5; n+1<argc; n+=2) {
-				result = lock_db(argv[n], argv[n+1]);
-				if (result != 0) {
-					break;
-				}
-			}
-		}
-
-	} else {
-		fprintf(stderr, "%s: Invalid lock-type '%s'\n", progname, lock_type);
-		usage();
-		exit(1);
+		lock_server(ppid, atoi(argv[5]), write_fd);
 	}
 
+	result = lock_args(NULL, argc-4, (const char **)&argv[4],
+			   &held, &num_held);
+
 	send_result(write_fd, result);
 
 	while (kill(ppid, 0) == 0 || errno != ESRCH) {
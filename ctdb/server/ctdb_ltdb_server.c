@@ -755,7 +755,7 @@ int ctdb_set_db_readonly(struct ctdb_context *ctdb, struct ctdb_db_context *ctdb
  */
 static int ctdb_local_attach(struct ctdb_context *ctdb, const char *db_name,
 			     bool persistent, const char *unhealthy_reason,
-			     bool jenkinshash, bool mutexes)
+			     bool jenkinshash)
 {
 	struct ctdb_db_context *ctdb_db, *tmp_db;
 	int ret;
@@ -851,7 +851,13 @@ static int ctdb_local_attach(struct ctdb_context *ctdb, const char *db_name,
 		tdb_flags |= TDB_INCOMPATIBLE_HASH;
 	}
 #ifdef TDB_MUTEX_LOCKING
-	if (ctdb->tunable.mutex_enabled && mutexes &&
+	/*
+	 * Volatile databases can use robust mutexes in the shared tdb
+	 * instead of fcntl locks.  The daemon decides, clients ask for
+	 * the open flags with CTDB_CONTROL_DB_OPEN_FLAGS and follow.
+	 */
+	if (!persistent && ctdb->tunable.mutex_enabled &&
+	    !ctdb->valgrinding &&
 	    tdb_runtime_check_for_robust_mutexes()) {
 		tdb_flags |= (TDB_MUTEX_LOCKING | TDB_CLEAR_IF_FIRST);
 	}
@@ -912,6 +918,8 @@ again:
 		goto again;
 	}
 
+	ctdb_db->tdb_flags = tdb_flags;
+
 	if (!persistent) {
 		ctdb_check_db_empty(ctdb_db);
 	} else {
@@ -1100,7 +1108,7 @@ int32_t ctdb_control_db_attach(struct ctdb_context *ctdb, TDB_DATA indata,
 	struct ctdb_db_context *db;
 	struct ctdb_node *node = ctdb->nodes[ctdb->pnn];
 	struct ctdb_client *client = NULL;
-	bool with_jenkinshash, with_mutexes;
+	bool with_jenkinshash;
 
 	if (ctdb->tunable.allow_client_db_attach == 0) {
 		DEBUG(DEBUG_ERR, ("DB Attach to database %s denied by tunable "
@@ -1154,12 +1162,9 @@ int32_t ctdb_control_db_attach(struct ctdb_context *ctdb, TDB_DATA indata,
 	/* the client can optionally pass additional tdb flags, but we
 	   only allow a subset of those on the database in ctdb. Note
 	   that tdb_flags is passed in via the (otherwise unused)
-	   srvid to the attach control */
-#ifdef TDB_MUTEX_LOCKING
-	tdb_flags &= (TDB_NOSYNC|TDB_INCOMPATIBLE_HASH|TDB_MUTEX_LOCKING|TDB_CLEAR_IF_FIRST);
-#else
+	   srvid to the attach control.  Whether mutexes are used is
+	   decided by ctdbd, see ctdb_local_attach() */
 	tdb_flags &= (TDB_NOSYNC|TDB_INCOMPATIBLE_HASH);
-#endif
 
 	/* see if we already have this name */
 	db = ctdb_db_handle(ctdb, db_name);
@@ -1177,14 +1182,9 @@ int32_t ctdb_control_db_attach(struct ctdb_context *ctdb, TDB_DATA indata,
 	}
 
 	with_jenkinshash = (tdb_flags & TDB_INCOMPATIBLE_HASH) ? true : false;
-#ifdef TDB_MUTEX_LOCKING
-	with_mutexes = (tdb_flags & TDB_MUTEX_LOCKING) ? true : false;
-#else
-	with_mutexes = false;
-#endif
 
 	if (ctdb_local_attach(ctdb, db_name, persistent, NULL,
-			      with_jenkinshash, with_mutexes) != 0) {
+			      with_jenkinshash) != 0) {
 		return -1;
 	}
 
@@ -1357,7 +1357,7 @@ static int ctdb_attach_persistent(struct ctdb_context *ctdb,
 		}
 		p[4] = 0;
 
-		if (ctdb_local_attach(ctdb, s, true, unhealthy_reason, false, false) != 0) {
+		if (ctdb_local_attach(ctdb, s, true, unhealthy_reason, false) != 0) {
 			DEBUG(DEBUG_ERR,("Failed to attach to persistent database '%s'\n", de->d_name));
 			closedir(d);
 			talloc_free(s);
@@ -1638,6 +1638,8 @@ void ctdb_db_statistics_reset(struct ctdb_db_context *ctdb_db)
 	}
 
 	ZERO_STRUCT(ctdb_db->statistics);
+
+	ctdb_db_histograms_reset(ctdb_db);
 }
 
 int32_t ctdb_control_get_db_statistics(struct ctdb_context *ctdb,
@@ -37,6 +37,7 @@
 #include "ctdb_client.h"
 
 #include "common/system.h"
+#include "common/srvid.h"
 #include "common/common.h"
 #include "common/logging.h"
 
@@ -313,6 +314,74 @@ int32_t ctdb_control_pull_db(struct ctdb_context *ctdb, TDB_DATA indata, TDB_DAT
 	return 0;
 }
 
+/*
+  store a bunch of records into a ltdb
+ */
+static int push_db_records(struct ctdb_db_context *ctdb_db,
+			   struct ctdb_marshall_buffer *recs)
+{
+	struct ctdb_rec_data_old *rec;
+	int i, ret;
+
+	rec = (struct ctdb_rec_data_old *)&recs->data[0];
+
+	for (i=0;i<recs->count;i++) {
+		TDB_DATA key, data;
+		struct ctdb_ltdb_header *hdr;
+
+		key.dptr = &rec->data[0];
+		key.dsize = rec->keylen;
+		data.dptr = &rec->data[key.dsize];
+		data.dsize = rec->datalen;
+
+		if (data.dsize < sizeof(struct ctdb_ltdb_header)) {
+			DEBUG(DEBUG_CRIT,(__location__ " bad ltdb record\n"));
+			return -1;
+		}
+		hdr = (struct ctdb_ltdb_header *)data.dptr;
+		/* strip off any read only record flags. All readonly records
+		   are revoked implicitely by a recovery
+		*/
+		hdr->flags &= ~CTDB_REC_RO_FLAGS;
+
+		data.dptr += sizeof(*hdr);
+		data.dsize -= sizeof(*hdr);
+
+		ret = ctdb_ltdb_store(ctdb_db, key, hdr, data);
+		if (ret != 0) {
+			DEBUG(DEBUG_CRIT, (__location__ " Unable to store record\n"));
+			return -1;
+		}
+
+		rec = (struct ctdb_rec_data_old *)(rec->length + (uint8_t *)rec);
+	}
+
+	return 0;
+}
+
+/*
+  all read only delegations are revoked by a recovery
+ */
+static void push_db_clear_readonly(struct ctdb_db_context *ctdb_db)
+{
+	if (!ctdb_db->readonly) {
+		return;
+	}
+
+	DEBUG(DEBUG_CRIT,("Clearing the tracking database for dbid 0x%x\n",
+			  ctdb_db->db_id));
+	if (tdb_wipe_all(ctdb_db->rottdb) != 0) {
+		DEBUG(DEBUG_ERR,("Failed to wipe tracking database for 0x%x. Dropping read-only delegation support\n", ctdb_db->db_id));
+		ctdb_db->readonly = false;
+		tdb_close(ctdb_db->rottdb);
+		ctdb_db->rottdb = NULL;
+		ctdb_db->readonly = false;
+	}
+	while (ctdb_db->revokechild_active != NULL) {
+		talloc_free(ctdb_db->revokechild_active);
+	}
+}
+
 /*
   push a bunch of records into a ltdb, filtering by rsn
  */
@@ -320,8 +389,7 @@ int32_t ctdb_control_push_db(struct ctdb_context *ctdb, TDB_DATA indata)
 {
 	struct ctdb_marshall_buffer *reply = (struct ctdb_marshall_buffer *)indata.dptr;
 	struct ctdb_db_context *ctdb_db;
-	int i, ret;
-	struct ctdb_rec_data_old *rec;
+	int ret;
 
 	if (indata.dsize < offsetof(struct ctdb_marshall_buffer, data)) {
 		DEBUG(DEBUG_ERR,(__location__ " invalid data in pulldb reply\n"));
@@ -345,66 +413,358 @@ int32_t ctdb_control_push_db(struct ctdb_context *ctdb, TDB_DATA indata)
 		return -1;
 	}
 
-	rec = (struct ctdb_rec_data_old *)&reply->data[0];
-
 	DEBUG(DEBUG_INFO,("starting push of %u records for dbid 0x%x\n",
 		 reply->count, reply->db_id));
 
-	for (i=0;i<reply->count;i++) {
-		TDB_DATA key, data;
-		struct ctdb_ltdb_header *hdr;
+	ret = push_db_records(ctdb_db, reply);
+	if (ret != 0) {
+		goto failed;
+	}
 
-		key.dptr = &rec->data[0];
-		key.dsize = rec->keylen;
-		data.dptr = &rec->data[key.dsize];
-		data.dsize = rec->datalen;
+	DEBUG(DEBUG_DEBUG,("finished push of %u records for dbid 0x%x\n",
+		 reply->count, reply->db_id));
 
-		if (data.dsize < sizeof(struct ctdb_ltdb_header)) {
-			DEBUG(DEBUG_CRIT,(__location__ " bad ltdb record\n"));
-			goto failed;
-		}
-		hdr = (struct ctdb_ltdb_header *)data.dptr;
-		/* strip off any read only record flags. All readonly records
-		   are revoked implicitely by a recovery
-		*/
-		hdr->flags &= ~CTDB_REC_RO_FLAGS;
+	push_db_clear_readonly(ctdb_db);
 
-		data.dptr += sizeof(*hdr);
-		data.dsize -= sizeof(*hdr);
+	ctdb_lockdb_unmark(ctdb_db);
+	return 0;
 
-		ret = ctdb_ltdb_store(ctdb_db, key, hdr, data);
-		if (ret != 0) {
-			DEBUG(DEBUG_CRIT, (__location__ " Unable to store record\n"));
-			goto failed;
-		}
+failed:
+	ctdb_lockdb_unmark(ctdb_db);
+	return -1;
+}
 
-		rec = (struct ctdb_rec_data_old *)(rec->length + (uint8_t *)rec);
-	}	    
+/*
+  send a chunk of records pulled from a ltdb to the recovery process
 
-	DEBUG(DEBUG_DEBUG,("finished push of %u records for dbid 0x%x\n",
-		 reply->count, reply->db_id));
+  Chunks for the local node are handed to the message handlers right
+  away, so they are guaranteed to be delivered before the control reply.
+ */
+static int db_pull_send_chunk(struct ctdb_context *ctdb, uint32_t pnn,
+			      uint64_t srvid, TDB_DATA data)
+{
+	if (pnn == ctdb->pnn) {
+		return srvid_dispatch(ctdb->srv, srvid, 0, data);
+	}
 
-	if (ctdb_db->readonly) {
-		DEBUG(DEBUG_CRIT,("Clearing the tracking database for dbid 0x%x\n",
-				  ctdb_db->db_id));
-		if (tdb_wipe_all(ctdb_db->rottdb) != 0) {
-			DEBUG(DEBUG_ERR,("Failed to wipe tracking database for 0x%x. Dropping read-only delegation support\n", ctdb_db->db_id));
-			ctdb_db->readonly = false;
-			tdb_close(ctdb_db->rottdb);
-			ctdb_db->rottdb = NULL;
-			ctdb_db->readonly = false;
-		}
-		while (ctdb_db->revokechild_active != NULL) {
-			talloc_free(ctdb_db->revokechild_active);
+	return ctdb_daemon_send_message(ctdb, pnn, srvid, data);
+}
+
+struct db_pull_state {
+	struct ctdb_context *ctdb;
+	struct ctdb_db_context *ctdb_db;
+	struct ctdb_marshall_buffer *recs;
+	uint32_t pnn;
+	uint64_t srvid;
+	uint32_t num_records;
+	uint64_t num_bytes;
+};
+
+static int db_pull_flush(struct db_pull_state *state)
+{
+	TDB_DATA data;
+	int ret;
+
+	if (state->recs == NULL) {
+		return 0;
+	}
+
+	data = ctdb_marshall_finish(state->recs);
+	ret = db_pull_send_chunk(state->ctdb, state->pnn, state->srvid, data);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR, (__location__ " Failed to send records of "
+				  "db %s to node %u\n",
+				  state->ctdb_db->db_name, state->pnn));
+		TALLOC_FREE(state->recs);
+		return -1;
+	}
+
+	state->num_records += state->recs->count;
+	state->num_bytes += data.dsize;
+	TALLOC_FREE(state->recs);
+	return 0;
+}
+
+static int traverse_db_pull(struct tdb_context *tdb, TDB_DATA key,
+			    TDB_DATA data, void *private_data)
+{
+	struct db_pull_state *state = (struct db_pull_state *)private_data;
+	struct ctdb_context *ctdb = state->ctdb;
+	struct ctdb_marshall_buffer *recs;
+
+	recs = ctdb_marshall_add(ctdb, state->recs, state->ctdb_db->db_id,
+				 0, key, NULL, data);
+	if (recs == NULL) {
+		state->recs = NULL;
+		return -1;
+	}
+	state->recs = recs;
+
+	if (ctdb->tunable.db_record_size_warn != 0 &&
+	    data.dsize > ctdb->tunable.db_record_size_warn) {
+		DEBUG(DEBUG_ERR,("Data record in %s is big. Record size is %d bytes\n",
+				 state->ctdb_db->db_name, (int)data.dsize));
+	}
+
+	if (talloc_get_size(state->recs) >= ctdb->tunable.rec_buffer_size_limit) {
+		if (db_pull_flush(state) != 0) {
+			return -1;
 		}
 	}
 
+	return 0;
+}
+
+/*
+  pull the records of a ltdb, sending them as a series of messages of
+  at most RecBufferSizeLimit bytes to the node that sent the control
+ */
+int32_t ctdb_control_db_pull(struct ctdb_context *ctdb,
+			     struct ctdb_req_control_old *c,
+			     TDB_DATA indata, TDB_DATA *outdata)
+{
+	struct ctdb_pulldb_ext *pulldb_ext;
+	struct ctdb_db_context *ctdb_db;
+	struct db_pull_state state;
+	int ret;
+
+	pulldb_ext = (struct ctdb_pulldb_ext *)indata.dptr;
+
+	ctdb_db = find_ctdb_db(ctdb, pulldb_ext->db_id);
+	if (ctdb_db == NULL) {
+		DEBUG(DEBUG_ERR,(__location__ " Unknown db 0x%08x\n",
+				 pulldb_ext->db_id));
+		return -1;
+	}
+
+	if (!ctdb_db_frozen(ctdb_db)) {
+		DEBUG(DEBUG_ERR,
+		      ("rejecting ctdb_control_db_pull when not frozen\n"));
+		return -1;
+	}
+
+	if (ctdb_db->unhealthy_reason) {
+		/* this is just a warning, as the tdb should be empty anyway */
+		DEBUG(DEBUG_WARNING,
+		      ("db(%s) unhealty in ctdb_control_db_pull: %s\n",
+		       ctdb_db->db_name, ctdb_db->unhealthy_reason));
+	}
+
+	state.ctdb = ctdb;
+	state.ctdb_db = ctdb_db;
+	state.recs = NULL;
+	state.pnn = c->hdr.srcnode;
+	state.srvid = pulldb_ext->srvid;
+	state.num_records = 0;
+	state.num_bytes = 0;
+
+	if (ctdb_lockdb_mark(ctdb_db) != 0) {
+		DEBUG(DEBUG_ERR,
+		      (__location__ " Failed to get lock on entire db - failing\n"));
+		return -1;
+	}
+
+	ret = tdb_traverse_read(ctdb_db->ltdb->tdb, traverse_db_pull, &state);
+	if (ret == -1) {
+		DEBUG(DEBUG_ERR,
+		      (__location__ " Failed to get traverse db '%s'\n",
+		       ctdb_db->db_name));
+		ctdb_lockdb_unmark(ctdb_db);
+		TALLOC_FREE(state.recs);
+		return -1;
+	}
+
+	ret = db_pull_flush(&state);
 	ctdb_lockdb_unmark(ctdb_db);
+	if (ret != 0) {
+		return -1;
+	}
+
+	if (ctdb->tunable.db_record_count_warn != 0 &&
+	    state.num_records > ctdb->tunable.db_record_count_warn) {
+		DEBUG(DEBUG_ERR,("Database %s is big. Contains %u records\n",
+				 ctdb_db->db_name, state.num_records));
+	}
+	if (ctdb->tunable.db_size_warn != 0 &&
+	    state.num_bytes > ctdb->tunable.db_size_warn) {
+		DEBUG(DEBUG_ERR,("Database %s is big. Contains %llu bytes\n",
+				 ctdb_db->db_name,
+				 (unsigned long long)state.num_bytes));
+	}
+
+	outdata->dptr = talloc_size(outdata, sizeof(uint32_t));
+	CTDB_NO_MEMORY(ctdb, outdata->dptr);
+	*(uint32_t *)outdata->dptr = state.num_records;
+	outdata->dsize = sizeof(uint32_t);
+
 	return 0;
+}
 
-failed:
+/*
+  records pushed as a series of messages between DB_PUSH_START and
+  DB_PUSH_CONFIRM
+ */
+struct db_push_state {
+	struct ctdb_context *ctdb;
+	struct ctdb_db_context *ctdb_db;
+	uint64_t srvid;
+	uint32_t num_records;
+	bool failed;
+};
+
+static int db_push_state_destructor(struct db_push_state *state)
+{
+	state->ctdb_db->push_state = NULL;
+	return 0;
+}
+
+static void db_push_msg_handler(uint64_t srvid, TDB_DATA indata,
+				void *private_data)
+{
+	struct db_push_state *state = talloc_get_type_abort(
+		private_data, struct db_push_state);
+	struct ctdb_db_context *ctdb_db = state->ctdb_db;
+	struct ctdb_marshall_buffer *recs;
+	int ret;
+
+	if (state->failed) {
+		return;
+	}
+
+	recs = (struct ctdb_marshall_buffer *)indata.dptr;
+	if (indata.dsize < offsetof(struct ctdb_marshall_buffer, data) ||
+	    recs->db_id != ctdb_db->db_id) {
+		DEBUG(DEBUG_ERR, (__location__ " invalid records pushed for "
+				  "db %s\n", ctdb_db->db_name));
+		state->failed = true;
+		return;
+	}
+
+	if (ctdb_lockdb_mark(ctdb_db) != 0) {
+		DEBUG(DEBUG_ERR,
+		      (__location__ " Failed to get lock on entire db - failing\n"));
+		state->failed = true;
+		return;
+	}
+
+	ret = push_db_records(ctdb_db, recs);
 	ctdb_lockdb_unmark(ctdb_db);
-	return -1;
+	if (ret != 0) {
+		state->failed = true;
+		return;
+	}
+
+	state->num_records += recs->count;
+}
+
+/*
+  start receiving the records of a ltdb as messages
+ */
+int32_t ctdb_control_db_push_start(struct ctdb_context *ctdb, TDB_DATA indata)
+{
+	struct ctdb_pulldb_ext *pulldb_ext;
+	struct ctdb_db_context *ctdb_db;
+	struct db_push_state *state;
+	int ret;
+
+	pulldb_ext = (struct ctdb_pulldb_ext *)indata.dptr;
+
+	ctdb_db = find_ctdb_db(ctdb, pulldb_ext->db_id);
+	if (ctdb_db == NULL) {
+		DEBUG(DEBUG_ERR,(__location__ " Unknown db 0x%08x\n",
+				 pulldb_ext->db_id));
+		return -1;
+	}
+
+	if (!ctdb_db_frozen(ctdb_db)) {
+		DEBUG(DEBUG_ERR,
+		      ("rejecting ctdb_control_db_push_start when not frozen\n"));
+		return -1;
+	}
+
+	if (ctdb_db->push_state != NULL) {
+		DEBUG(DEBUG_WARNING, ("Restarting push for db %s\n",
+				      ctdb_db->db_name));
+		TALLOC_FREE(ctdb_db->push_state);
+	}
+
+	/* the push is abandoned when the database is thawed */
+	state = talloc_zero(ctdb_db->freeze_handle, struct db_push_state);
+	CTDB_NO_MEMORY(ctdb, state);
+
+	state->ctdb = ctdb;
+	state->ctdb_db = ctdb_db;
+	state->srvid = pulldb_ext->srvid;
+
+	ret = srvid_register(ctdb->srv, state, state->srvid,
+			     db_push_msg_handler, state);
+	if (ret != 0) {
+		DEBUG(DEBUG_ERR, (__location__ " Failed to register srvid for "
+				  "push of db %s\n", ctdb_db->db_name));
+		talloc_free(state);
+		return -1;
+	}
+
+	ctdb_db->push_state = state;
+	talloc_set_destructor(state, db_push_state_destructor);
+
+	DEBUG(DEBUG_INFO, ("starting push for db %s\n", ctdb_db->db_name));
+
+	return 0;
+}
+
+/*
+  finish receiving the records of a ltdb, returning the number of
+  records stored
+ */
+int32_t ctdb_control_db_push_confirm(struct ctdb_context *ctdb,
+				     TDB_DATA indata, TDB_DATA *outdata)
+{
+	uint32_t db_id;
+	struct ctdb_db_context *ctdb_db;
+	struct db_push_state *state;
+
+	db_id = *(uint32_t *)indata.dptr;
+
+	ctdb_db = find_ctdb_db(ctdb, db_id);
+	if (ctdb_db == NULL) {
+		DEBUG(DEBUG_ERR,(__location__ " Unknown db 0x%08x\n", db_id));
+		return -1;
+	}
+
+	if (!ctdb_db_frozen(ctdb_db)) {
+		DEBUG(DEBUG_ERR,
+		      ("rejecting ctdb_control_db_push_confirm when not frozen\n"));
+		return -1;
+	}
+
+	state = ctdb_db->push_state;
+	if (state == NULL) {
+		DEBUG(DEBUG_ERR, ("Missing push start for db %s\n",
+				  ctdb_db->db_name));
+		return -1;
+	}
+
+	if (state->failed) {
+		DEBUG(DEBUG_ERR, ("Failed to push records for db %s\n",
+				  ctdb_db->db_name));
+		TALLOC_FREE(ctdb_db->push_state);
+		return -1;
+	}
+
+	outdata->dptr = talloc_size(outdata, sizeof(uint32_t));
+	CTDB_NO_MEMORY(ctdb, outdata->dptr);
+	*(uint32_t *)outdata->dptr = state->num_records;
+	outdata->dsize = sizeof(uint32_t);
+
+	DEBUG(DEBUG_INFO, ("finished push of %u records for db %s\n",
+			   state->num_records, ctdb_db->db_name));
+
+	TALLOC_FREE(ctdb_db->push_state);
+
+	push_db_clear_readonly(ctdb_db);
+
+	return 0;
 }
 
 struct ctdb_set_recmode_state {
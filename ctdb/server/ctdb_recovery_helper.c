@@ -73,6 +73,10 @@ struct recdb_context {
 	const char *db_path;
 	struct tdb_wrap *db;
 	bool persistent;
+	uint32_t num_pulled;
+	size_t bytes_pulled;
+	uint32_t num_pushed;
+	size_t bytes_pushed;
 };
 
 static struct recdb_context *recdb_create(TALLOC_CTX *mem_ctx, uint32_t db_id,
@@ -83,7 +87,7 @@ static struct recdb_context *recdb_create(TALLOC_CTX *mem_ctx, uint32_t db_id,
 	struct recdb_context *recdb;
 	unsigned int tdb_flags;
 
-	recdb = talloc(mem_ctx, struct recdb_context);
+	recdb = talloc_zero(mem_ctx, struct recdb_context);
 	if (recdb == NULL) {
 		return NULL;
 	}
@@ -112,6 +116,11 @@ static struct recdb_context *recdb_create(TALLOC_CTX *mem_ctx, uint32_t db_id,
 	return recdb;
 }
 
+static uint32_t recdb_id(struct recdb_context *recdb)
+{
+	return recdb->db_id;
+}
+
 static const char *recdb_name(struct recdb_context *recdb)
 {
 	return recdb->db_name;
@@ -137,137 +146,1065 @@ static int recdb_add_traverse(uint32_t reqid, struct ctdb_ltdb_header *header,
 		return -1;
 	}
 
-	hdr = (struct ctdb_ltdb_header *)data.dptr;
+	hdr = (struct ctdb_ltdb_header *)data.dptr;
+
+	/* fetch the existing record, if any */
+	prev_data = tdb_fetch(state->recdb->db->tdb, key);
+
+	if (prev_data.dptr != NULL) {
+		struct ctdb_ltdb_header prev_hdr;
+
+		prev_hdr = *(struct ctdb_ltdb_header *)prev_data.dptr;
+		free(prev_data.dptr);
+		if (hdr->rsn < prev_hdr.rsn ||
+		    (hdr->rsn == prev_hdr.rsn &&
+		     prev_hdr.dmaster != state->mypnn)) {
+			return 0;
+		}
+	}
+
+	ret = tdb_store(state->recdb->db->tdb, key, data, TDB_REPLACE);
+	if (ret != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static bool recdb_add(struct recdb_context *recdb, int mypnn,
+		      struct ctdb_rec_buffer *recbuf)
+{
+	struct recdb_add_traverse_state state;
+	int ret;
+
+	state.recdb = recdb;
+	state.mypnn = mypnn;
+
+	ret = ctdb_rec_buffer_traverse(recbuf, recdb_add_traverse, &state);
+	if (ret != 0) {
+		return false;
+	}
+
+	recdb->num_pulled += recbuf->count;
+	recdb->bytes_pulled += recbuf->buflen;
+
+	return true;
+}
+
+struct recdb_traverse_state {
+	struct ctdb_rec_buffer *recbuf;
+	uint32_t pnn;
+	uint32_t reqid;
+	bool persistent;
+	bool failed;
+};
+
+static int recdb_traverse(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data,
+			  void *private_data)
+{
+	struct recdb_traverse_state *state =
+		(struct recdb_traverse_state *)private_data;
+	struct ctdb_ltdb_header *header;
+	int ret;
+
+	/*
+	 * skip empty records - but NOT for persistent databases:
+	 *
+	 * The record-by-record mode of recovery deletes empty records.
+	 * For persistent databases, this can lead to data corruption
+	 * by deleting records that should be there:
+	 *
+	 * - Assume the cluster has been running for a while.
+	 *
+	 * - A record R in a persistent database has been created and
+	 *   deleted a couple of times, the last operation being deletion,
+	 *   leaving an empty record with a high RSN, say 10.
+	 *
+	 * - Now a node N is turned off.
+	 *
+	 * - This leaves the local database copy of D on N with the empty
+	 *   copy of R and RSN 10. On all other nodes, the recovery has deleted
+	 *   the copy of record R.
+	 *
+	 * - Now the record is created again while node N is turned off.
+	 *   This creates R with RSN = 1 on all nodes except for N.
+	 *
+	 * - Now node N is turned on again. The following recovery will chose
+	 *   the older empty copy of R due to RSN 10 > RSN 1.
+	 *
+	 * ==> Hence the record is gone after the recovery.
+	 *
+	 * On databases like Samba's registry, this can damage the higher-level
+	 * data structures built from the various tdb-level records.
+	 */
+	if (!state->persistent &&
+	    data.dsize <= sizeof(struct ctdb_ltdb_header)) {
+		return 0;
+	}
+
+	/* update the dmaster field to point to us */
+	header = (struct ctdb_ltdb_header *)data.dptr;
+	if (!state->persistent) {
+		header->dmaster = state->pnn;
+		header->flags |= CTDB_REC_FLAG_MIGRATED_WITH_DATA;
+	}
+
+	ret = ctdb_rec_buffer_add(state->recbuf, state->recbuf, state->reqid,
+				  NULL, key, data);
+	if (ret != 0) {
+		state->failed = true;
+		return ret;
+	}
+
+	return 0;
+}
+
+static struct ctdb_rec_buffer *recdb_records(struct recdb_context *recdb,
+					     TALLOC_CTX *mem_ctx, uint32_t pnn)
+{
+	struct recdb_traverse_state state;
+	int ret;
+
+	state.recbuf = ctdb_rec_buffer_init(mem_ctx, recdb->db_id);
+	if (state.recbuf == NULL) {
+		return NULL;
+	}
+	state.pnn = pnn;
+	state.reqid = 0;
+	state.persistent = recdb->persistent;
+	state.failed = false;
+
+	ret = tdb_traverse_read(recdb->db->tdb, recdb_traverse, &state);
+	if (ret == -1 || state.failed) {
+		TALLOC_FREE(state.recbuf);
+		return NULL;
+	}
+
+	return state.recbuf;
+}
+
+/*
+ * Collect the next records from the recovery database, continuing after
+ * the key in *pos, until the buffer holds at least max_size bytes.  An
+ * empty buffer is returned once all records have been collected.
+ */
+static struct ctdb_rec_buffer *recdb_records_next(struct recdb_context *recdb,
+						  TALLOC_CTX *mem_ctx,
+						  uint32_t pnn, TDB_DATA *pos,
+						  bool *started,
+						  size_t max_size)
+{
+	struct recdb_traverse_state state;
+	struct tdb_context *tdb = recdb->db->tdb;
+	int ret;
+
+	state.recbuf = ctdb_rec_buffer_init(mem_ctx, recdb->db_id);
+	if (state.recbuf == NULL) {
+		return NULL;
+	}
+	state.pnn = pnn;
+	state.reqid = 0;
+	state.persistent = recdb->persistent;
+	state.failed = false;
+
+	for (;;) {
+		TDB_DATA key, data;
+
+		if (! *started) {
+			key = tdb_firstkey(tdb);
+			*started = true;
+		} else if (pos->dptr == NULL) {
+			break;
+		} else {
+			key = tdb_nextkey(tdb, *pos);
+			free(pos->dptr);
+		}
+		*pos = key;
+		if (key.dptr == NULL) {
+			break;
+		}
+
+		data = tdb_fetch(tdb, key);
+		if (data.dptr == NULL) {
+			continue;
+		}
+
+		ret = recdb_traverse(tdb, key, data, &state);
+		free(data.dptr);
+		if (ret != 0 || state.failed) {
+			TALLOC_FREE(state.recbuf);
+			return NULL;
+		}
+
+		if (state.recbuf->buflen >= max_size) {
+			break;
+		}
+	}
+
+	return state.recbuf;
+}
+
+/*
+ * Pull database from a single node
+ *
+ * Nodes with the fragmented controls capability send the records as a
+ * series of messages, each of which is merged into the recovery database
+ * as soon as it arrives.  Other nodes send all records in the reply to
+ * a PULL_DB control.
+ */
+
+static uint64_t srvid_next(void)
+{
+	static uint64_t srvid = 0;
+
+	srvid += 1;
+	return (CTDB_SRVID_RECOVERY | srvid);
+}
+
+struct pull_database_state {
+	struct tevent_context *ev;
+	struct ctdb_client_context *client;
+	struct recdb_context *recdb;
+	uint32_t pnn;
+	uint64_t srvid;
+	uint32_t num_records;
+	int result;
+};
+
+static void pull_database_handler(uint64_t srvid, TDB_DATA data,
+				  void *private_data);
+static void pull_database_register_done(struct tevent_req *subreq);
+static void pull_database_old_done(struct tevent_req *subreq);
+static void pull_database_new_done(struct tevent_req *subreq);
+static void pull_database_unregister(struct tevent_req *req);
+static void pull_database_unregister_done(struct tevent_req *subreq);
+
+static struct tevent_req *pull_database_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct ctdb_client_context *client,
+			uint32_t pnn, uint32_t caps,
+			struct recdb_context *recdb)
+{
+	struct tevent_req *req, *subreq;
+	struct pull_database_state *state;
+	struct ctdb_req_control request;
+
+	req = tevent_req_create(mem_ctx, &state, struct pull_database_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	state->ev = ev;
+	state->client = client;
+	state->recdb = recdb;
+	state->pnn = pnn;
+	state->srvid = srvid_next();
+	state->num_records = 0;
+	state->result = 0;
+
+	if (caps & CTDB_CAP_FRAGMENTED_CONTROLS) {
+		subreq = ctdb_client_set_message_handler_send(
+					state, ev, client, state->srvid,
+					pull_database_handler, req);
+		if (tevent_req_nomem(subreq, req)) {
+			return tevent_req_post(req, ev);
+		}
+
+		tevent_req_set_callback(subreq, pull_database_register_done,
+					req);
+
+	} else {
+		struct ctdb_pulldb pulldb;
+
+		pulldb.db_id = recdb_id(recdb);
+		pulldb.lmaster = CTDB_LMASTER_ANY;
+
+		ctdb_req_control_pull_db(&request, &pulldb);
+		subreq = ctdb_client_control_send(state, state->ev,
+						  state->client,
+						  pnn, TIMEOUT(),
+						  &request);
+		if (tevent_req_nomem(subreq, req)) {
+			return tevent_req_post(req, ev);
+		}
+		tevent_req_set_callback(subreq, pull_database_old_done, req);
+	}
+
+	return req;
+}
+
+static void pull_database_handler(uint64_t srvid, TDB_DATA data,
+				  void *private_data)
+{
+	struct tevent_req *req = talloc_get_type_abort(
+		private_data, struct tevent_req);
+	struct pull_database_state *state = tevent_req_data(
+		req, struct pull_database_state);
+	struct ctdb_rec_buffer *recbuf;
+	int ret;
+	bool status;
+
+	if (srvid != state->srvid || state->result != 0) {
+		return;
+	}
+
+	ret = ctdb_rec_buffer_pull(data.dptr, data.dsize, state, &recbuf);
+	if (ret != 0) {
+		LOG("Invalid data received for DB_PULL messages\n");
+		state->result = EPROTO;
+		return;
+	}
+
+	if (recbuf->db_id != recdb_id(state->recdb)) {
+		LOG("Invalid dbid:%08x for DB_PULL messages for %s\n",
+		    recbuf->db_id, recdb_name(state->recdb));
+		talloc_free(recbuf);
+		state->result = EPROTO;
+		return;
+	}
+
+	status = recdb_add(state->recdb, ctdb_client_pnn(state->client),
+			   recbuf);
+	if (! status) {
+		talloc_free(recbuf);
+		LOG("Failed to add records to recdb for %s\n",
+		    recdb_name(state->recdb));
+		state->result = EIO;
+		return;
+	}
+
+	state->num_records += recbuf->count;
+	talloc_free(recbuf);
+}
+
+static void pull_database_register_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct pull_database_state *state = tevent_req_data(
+		req, struct pull_database_state);
+	struct ctdb_req_control request;
+	struct ctdb_pulldb_ext pulldb_ext;
+	int ret;
+	bool status;
+
+	status = ctdb_client_set_message_handler_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		LOG("failed to set message handler for DB_PULL for %s\n",
+		    recdb_name(state->recdb));
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	pulldb_ext.db_id = recdb_id(state->recdb);
+	pulldb_ext.lmaster = CTDB_LMASTER_ANY;
+	pulldb_ext.srvid = state->srvid;
+
+	ctdb_req_control_db_pull(&request, &pulldb_ext);
+	subreq = ctdb_client_control_send(state, state->ev, state->client,
+					  state->pnn, TIMEOUT(), &request);
+	if (subreq == NULL) {
+		state->result = ENOMEM;
+		pull_database_unregister(req);
+		return;
+	}
+	tevent_req_set_callback(subreq, pull_database_new_done, req);
+}
+
+static void pull_database_old_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct pull_database_state *state = tevent_req_data(
+		req, struct pull_database_state);
+	struct ctdb_reply_control *reply;
+	struct ctdb_rec_buffer *recbuf;
+	int ret;
+	bool status;
+
+	status = ctdb_client_control_recv(subreq, &ret, state, &reply);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		LOG("control PULL_DB failed for %s on node %u, ret=%d\n",
+		    recdb_name(state->recdb), state->pnn, ret);
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	ret = ctdb_reply_control_pull_db(reply, state, &recbuf);
+	talloc_free(reply);
+	if (ret != 0) {
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	status = recdb_add(state->recdb, ctdb_client_pnn(state->client),
+			   recbuf);
+	if (! status) {
+		talloc_free(recbuf);
+		tevent_req_error(req, EIO);
+		return;
+	}
+
+	state->num_records = recbuf->count;
+	talloc_free(recbuf);
+
+	LOG("Pulled %d records for db %s from node %d\n",
+	    state->num_records, recdb_name(state->recdb), state->pnn);
+
+	tevent_req_done(req);
+}
+
+static void pull_database_new_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct pull_database_state *state = tevent_req_data(
+		req, struct pull_database_state);
+	struct ctdb_reply_control *reply;
+	uint32_t num_records;
+	int ret;
+	bool status;
+
+	status = ctdb_client_control_recv(subreq, &ret, state, &reply);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		LOG("control DB_PULL failed for %s on node %u, ret=%d\n",
+		    recdb_name(state->recdb), state->pnn, ret);
+		state->result = ret;
+		pull_database_unregister(req);
+		return;
+	}
+
+	ret = ctdb_reply_control_db_pull(reply, &num_records);
+	talloc_free(reply);
+	if (ret != 0) {
+		LOG("control DB_PULL failed for %s on node %u, ret=%d\n",
+		    recdb_name(state->recdb), state->pnn, ret);
+		state->result = EPROTO;
+		pull_database_unregister(req);
+		return;
+	}
+
+	if (state->result == 0 && num_records != state->num_records) {
+		LOG("mismatch (%u != %u) in DB_PULL records for %s\n",
+		    num_records, state->num_records,
+		    recdb_name(state->recdb));
+		state->result = EIO;
+	}
+
+	if (state->result == 0) {
+		LOG("Pulled %d records for db %s from node %d\n",
+		    state->num_records, recdb_name(state->recdb),
+		    state->pnn);
+	}
+
+	pull_database_unregister(req);
+}
+
+/*
+ * The message handler is always removed before the request completes,
+ * so no message can reach a freed request.
+ */
+static void pull_database_unregister(struct tevent_req *req)
+{
+	struct pull_database_state *state = tevent_req_data(
+		req, struct pull_database_state);
+	struct tevent_req *subreq;
+
+	subreq = ctdb_client_remove_message_handler_send(
+					state, state->ev, state->client,
+					state->srvid, req);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, pull_database_unregister_done, req);
+}
+
+static void pull_database_unregister_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct pull_database_state *state = tevent_req_data(
+		req, struct pull_database_state);
+	int ret;
+	bool status;
+
+	status = ctdb_client_remove_message_handler_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		LOG("failed to remove message handler for DB_PULL for %s\n",
+		    recdb_name(state->recdb));
+		if (state->result == 0) {
+			state->result = ret;
+		}
+	}
+
+	if (state->result != 0) {
+		tevent_req_error(req, state->result);
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+static bool pull_database_recv(struct tevent_req *req, int *perr)
+{
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		if (perr != NULL) {
+			*perr = err;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Push database to specified nodes (old style)
+ */
+
+struct push_database_old_state {
+	struct ctdb_client_context *client;
+	struct recdb_context *recdb;
+	uint32_t *pnn_list;
+	int count;
+	struct ctdb_rec_buffer *recbuf;
+};
+
+static void push_database_old_push_done(struct tevent_req *subreq);
+
+static struct tevent_req *push_database_old_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct ctdb_client_context *client,
+			uint32_t *pnn_list, int count,
+			struct recdb_context *recdb)
+{
+	struct tevent_req *req, *subreq;
+	struct push_database_old_state *state;
+	struct ctdb_req_control request;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct push_database_old_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	state->client = client;
+	state->recdb = recdb;
+	state->pnn_list = pnn_list;
+	state->count = count;
+
+	state->recbuf = recdb_records(recdb, state, ctdb_client_pnn(client));
+	if (tevent_req_nomem(state->recbuf, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	ctdb_req_control_push_db(&request, state->recbuf);
+	subreq = ctdb_client_control_multi_send(state, ev, client,
+						pnn_list, count,
+						TIMEOUT(), &request);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, push_database_old_push_done, req);
+
+	return req;
+}
+
+static void push_database_old_push_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct push_database_old_state *state = tevent_req_data(
+		req, struct push_database_old_state);
+	int *err_list;
+	int ret;
+	bool status;
+
+	status = ctdb_client_control_multi_recv(subreq, &ret, NULL, &err_list,
+						NULL);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		int ret2;
+		uint32_t pnn;
+
+		ret2 = ctdb_client_control_multi_error(state->pnn_list,
+						       state->count,
+						       err_list, &pnn);
+		if (ret2 != 0) {
+			LOG("control PUSHDB failed for db %s on node %u,"
+			    " ret=%d\n", recdb_name(state->recdb), pnn, ret2);
+		} else {
+			LOG("control PUSHDB failed for db %s, ret=%d\n",
+			    recdb_name(state->recdb), ret);
+		}
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	state->recdb->num_pushed += state->recbuf->count;
+	state->recdb->bytes_pushed += state->recbuf->buflen;
+	TALLOC_FREE(state->recbuf);
+
+	tevent_req_done(req);
+}
+
+static bool push_database_old_recv(struct tevent_req *req, int *perr)
+{
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		if (perr != NULL) {
+			*perr = err;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Push database to specified nodes (new style)
+ *
+ * The records are sent as a series of messages of at most max_size
+ * bytes, each message going to all nodes in parallel.  The next message
+ * is only collected from the recovery database once the previous one
+ * has been sent, so the memory used does not grow with the database.
+ */
+
+struct push_database_new_state {
+	struct tevent_context *ev;
+	struct ctdb_client_context *client;
+	struct recdb_context *recdb;
+	uint32_t *pnn_list;
+	int count;
+	uint64_t srvid;
+	size_t max_size;
+	TDB_DATA pos;
+	bool started;
+	uint32_t num_records;
+	int num_pending;
+};
+
+static int push_database_new_state_destructor(
+	struct push_database_new_state *state);
+static void push_database_new_started(struct tevent_req *subreq);
+static void push_database_new_send_msg(struct tevent_req *req);
+static void push_database_new_send_done(struct tevent_req *subreq);
+static void push_database_new_confirmed(struct tevent_req *subreq);
+
+static struct tevent_req *push_database_new_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct ctdb_client_context *client,
+			uint32_t *pnn_list, int count,
+			struct recdb_context *recdb,
+			size_t max_size)
+{
+	struct tevent_req *req, *subreq;
+	struct push_database_new_state *state;
+	struct ctdb_req_control request;
+	struct ctdb_pulldb_ext pulldb_ext;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct push_database_new_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	state->ev = ev;
+	state->client = client;
+	state->recdb = recdb;
+	state->pnn_list = pnn_list;
+	state->count = count;
+
+	state->srvid = srvid_next();
+	state->max_size = max_size;
+	state->pos = tdb_null;
+	state->started = false;
+	state->num_records = 0;
+	state->num_pending = 0;
+
+	talloc_set_destructor(state, push_database_new_state_destructor);
+
+	pulldb_ext.db_id = recdb_id(recdb);
+	pulldb_ext.lmaster = CTDB_LMASTER_ANY;
+	pulldb_ext.srvid = state->srvid;
+
+	ctdb_req_control_db_push_start(&request, &pulldb_ext);
+	subreq = ctdb_client_control_multi_send(state, ev, client,
+						pnn_list, count,
+						TIMEOUT(), &request);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, push_database_new_started, req);
+
+	return req;
+}
+
+static int push_database_new_state_destructor(
+	struct push_database_new_state *state)
+{
+	free(state->pos.dptr);
+	state->pos = tdb_null;
+	return 0;
+}
+
+static void push_database_new_started(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct push_database_new_state *state = tevent_req_data(
+		req, struct push_database_new_state);
+	int *err_list;
+	int ret;
+	bool status;
+
+	status = ctdb_client_control_multi_recv(subreq, &ret, state,
+						&err_list, NULL);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		int ret2;
+		uint32_t pnn;
+
+		ret2 = ctdb_client_control_multi_error(state->pnn_list,
+						       state->count,
+						       err_list, &pnn);
+		if (ret2 != 0) {
+			LOG("control DB_PUSH_START failed for db %s "
+			    "on node %u, ret=%d\n",
+			    recdb_name(state->recdb), pnn, ret2);
+		} else {
+			LOG("control DB_PUSH_START failed for db %s, "
+			    "ret=%d\n",
+			    recdb_name(state->recdb), ret);
+		}
+		talloc_free(err_list);
+
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	push_database_new_send_msg(req);
+}
+
+static void push_database_new_send_msg(struct tevent_req *req)
+{
+	struct push_database_new_state *state = tevent_req_data(
+		req, struct push_database_new_state);
+	struct tevent_req *subreq;
+	struct ctdb_rec_buffer *recbuf;
+	struct ctdb_req_message message;
+	TDB_DATA data;
+	int i;
+
+	recbuf = recdb_records_next(state->recdb, state,
+				    ctdb_client_pnn(state->client),
+				    &state->pos, &state->started,
+				    state->max_size);
+	if (recbuf == NULL) {
+		LOG("Failed to collect records for db %s\n",
+		    recdb_name(state->recdb));
+		tevent_req_error(req, EIO);
+		return;
+	}
+
+	if (recbuf->count == 0) {
+		struct ctdb_req_control request;
+
+		talloc_free(recbuf);
+
+		ctdb_req_control_db_push_confirm(&request,
+						 recdb_id(state->recdb));
+		subreq = ctdb_client_control_multi_send(state, state->ev,
+							state->client,
+							state->pnn_list,
+							state->count,
+							TIMEOUT(), &request);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq, push_database_new_confirmed,
+					req);
+		return;
+	}
+
+	data.dsize = ctdb_rec_buffer_len(recbuf);
+	data.dptr = talloc_size(state, data.dsize);
+	if (tevent_req_nomem(data.dptr, req)) {
+		return;
+	}
+
+	ctdb_rec_buffer_push(recbuf, data.dptr);
+
+	message.srvid = state->srvid;
+	message.data.data = data;
+
+	for (i=0; i<state->count; i++) {
+		subreq = ctdb_client_message_send(state, state->ev,
+						  state->client,
+						  state->pnn_list[i],
+						  &message);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq, push_database_new_send_done,
+					req);
+		state->num_pending += 1;
+	}
+
+	state->num_records += recbuf->count;
+	state->recdb->num_pushed += recbuf->count;
+	state->recdb->bytes_pushed += data.dsize;
+
+	talloc_free(data.dptr);
+	talloc_free(recbuf);
+}
+
+static void push_database_new_send_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct push_database_new_state *state = tevent_req_data(
+		req, struct push_database_new_state);
+	bool status;
+	int ret;
+
+	status = ctdb_client_message_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		LOG("Sending recovery records failed for %s\n",
+		    recdb_name(state->recdb));
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	state->num_pending -= 1;
+	if (state->num_pending > 0) {
+		return;
+	}
+
+	push_database_new_send_msg(req);
+}
+
+static void push_database_new_confirmed(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct push_database_new_state *state = tevent_req_data(
+		req, struct push_database_new_state);
+	struct ctdb_reply_control **reply;
+	int *err_list;
+	bool status;
+	int ret, i;
+	uint32_t num_records;
+
+	status = ctdb_client_control_multi_recv(subreq, &ret, state,
+						&err_list, &reply);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		int ret2;
+		uint32_t pnn;
+
+		ret2 = ctdb_client_control_multi_error(state->pnn_list,
+						       state->count, err_list,
+						       &pnn);
+		if (ret2 != 0) {
+			LOG("control DB_PUSH_CONFIRM failed for db %s "
+			    "on node %u, ret=%d\n",
+			    recdb_name(state->recdb), pnn, ret2);
+		} else {
+			LOG("control DB_PUSH_CONFIRM failed for db %s, "
+			    "ret=%d\n",
+			    recdb_name(state->recdb), ret);
+		}
+		tevent_req_error(req, ret);
+		return;
+	}
+
+	for (i=0; i<state->count; i++) {
+		ret = ctdb_reply_control_db_push_confirm(reply[i],
+							 &num_records);
+		if (ret != 0) {
+			tevent_req_error(req, EPROTO);
+			return;
+		}
+
+		if (num_records != state->num_records) {
+			LOG("Node %u received %d of %d records for %s\n",
+			    state->pnn_list[i], num_records,
+			    state->num_records, recdb_name(state->recdb));
+			tevent_req_error(req, EPROTO);
+			return;
+		}
+	}
+
+	talloc_free(reply);
+
+	LOG("Pushed %d records for db %s\n",
+	    state->num_records, recdb_name(state->recdb));
+
+	tevent_req_done(req);
+}
+
+static bool push_database_new_recv(struct tevent_req *req, int *perr)
+{
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		if (perr != NULL) {
+			*perr = err;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * wrapper for push_database_old and push_database_new
+ */
+
+struct push_database_state {
+	bool old_done, new_done;
+};
+
+static void push_database_old_done(struct tevent_req *subreq);
+static void push_database_new_done(struct tevent_req *subreq);
+
+static struct tevent_req *push_database_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct ctdb_client_context *client,
+			uint32_t *pnn_list, int count, uint32_t *caps,
+			struct ctdb_tunable_list *tun_list,
+			struct recdb_context *recdb)
+{
+	struct tevent_req *req, *subreq;
+	struct push_database_state *state;
+	uint32_t *old_list, *new_list;
+	int old_count, new_count;
+	int i;
+
+	req = tevent_req_create(mem_ctx, &state, struct push_database_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	state->old_done = false;
+	state->new_done = false;
 
-	/* fetch the existing record, if any */
-	prev_data = tdb_fetch(state->recdb->db->tdb, key);
+	old_count = 0;
+	new_count = 0;
+	old_list = talloc_array(state, uint32_t, count);
+	new_list = talloc_array(state, uint32_t, count);
+	if (tevent_req_nomem(old_list, req) ||
+	    tevent_req_nomem(new_list,req)) {
+		return tevent_req_post(req, ev);
+	}
 
-	if (prev_data.dptr != NULL) {
-		struct ctdb_ltdb_header prev_hdr;
+	for (i=0; i<count; i++) {
+		uint32_t pnn = pnn_list[i];
 
-		prev_hdr = *(struct ctdb_ltdb_header *)prev_data.dptr;
-		free(prev_data.dptr);
-		if (hdr->rsn < prev_hdr.rsn ||
-		    (hdr->rsn == prev_hdr.rsn &&
-		     prev_hdr.dmaster != state->mypnn)) {
-			return 0;
+		if (caps[pnn] & CTDB_CAP_FRAGMENTED_CONTROLS) {
+			new_list[new_count] = pnn;
+			new_count += 1;
+		} else {
+			old_list[old_count] = pnn;
+			old_count += 1;
 		}
 	}
 
-	ret = tdb_store(state->recdb->db->tdb, key, data, TDB_REPLACE);
-	if (ret != 0) {
-		return -1;
+	if (old_count > 0) {
+		subreq = push_database_old_send(state, ev, client,
+						old_list, old_count, recdb);
+		if (tevent_req_nomem(subreq, req)) {
+			return tevent_req_post(req, ev);
+		}
+		tevent_req_set_callback(subreq, push_database_old_done, req);
+	} else {
+		state->old_done = true;
 	}
-	return 0;
+
+	if (new_count > 0) {
+		subreq = push_database_new_send(state, ev, client,
+						new_list, new_count, recdb,
+						tun_list->rec_buffer_size_limit);
+		if (tevent_req_nomem(subreq, req)) {
+			return tevent_req_post(req, ev);
+		}
+		tevent_req_set_callback(subreq, push_database_new_done, req);
+	} else {
+		state->new_done = true;
+	}
+
+	return req;
 }
 
-static bool recdb_add(struct recdb_context *recdb, int mypnn,
-		      struct ctdb_rec_buffer *recbuf)
+static void push_database_old_done(struct tevent_req *subreq)
 {
-	struct recdb_add_traverse_state state;
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct push_database_state *state = tevent_req_data(
+		req, struct push_database_state);
+	bool status;
 	int ret;
 
-	state.recdb = recdb;
-	state.mypnn = mypnn;
-
-	ret = ctdb_rec_buffer_traverse(recbuf, recdb_add_traverse, &state);
-	if (ret != 0) {
-		return false;
+	status = push_database_old_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		tevent_req_error(req, ret);
+		return;
 	}
 
-	return true;
-}
+	state->old_done = true;
 
-struct recdb_traverse_state {
-	struct ctdb_rec_buffer *recbuf;
-	uint32_t pnn;
-	uint32_t reqid;
-	bool persistent;
-	bool failed;
-};
+	if (state->old_done && state->new_done) {
+		tevent_req_done(req);
+	}
+}
 
-static int recdb_traverse(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data,
-			  void *private_data)
+static void push_database_new_done(struct tevent_req *subreq)
 {
-	struct recdb_traverse_state *state =
-		(struct recdb_traverse_state *)private_data;
-	struct ctdb_ltdb_header *header;
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct push_database_state *state = tevent_req_data(
+		req, struct push_database_state);
+	bool status;
 	int ret;
 
-	/*
-	 * skip empty records - but NOT for persistent databases:
-	 *
-	 * The record-by-record mode of recovery deletes empty records.
-	 * For persistent databases, this can lead to data corruption
-	 * by deleting records that should be there:
-	 *
-	 * - Assume the cluster has been running for a while.
-	 *
-	 * - A record R in a persistent database has been created and
-	 *   deleted a couple of times, the last operation being deletion,
-	 *   leaving an empty record with a high RSN, say 10.
-	 *
-	 * - Now a node N is turned off.
-	 *
-	 * - This leaves the local database copy of D on N with the empty
-	 *   copy of R and RSN 10. On all other nodes, the recovery has deleted
-	 *   the copy of record R.
-	 *
-	 * - Now the record is created again while node N is turned off.
-	 *   This creates R with RSN = 1 on all nodes except for N.
-	 *
-	 * - Now node N is turned on again. The following recovery will chose
-	 *   the older empty copy of R due to RSN 10 > RSN 1.
-	 *
-	 * ==> Hence the record is gone after the recovery.
-	 *
-	 * On databases like Samba's registry, this can damage the higher-level
-	 * data structures built from the various tdb-level records.
-	 */
-	if (!state->persistent &&
-	    data.dsize <= sizeof(struct ctdb_ltdb_header)) {
-		return 0;
+	status = push_database_new_recv(subreq, &ret);
+	TALLOC_FREE(subreq);
+	if (! status) {
+		tevent_req_error(req, ret);
+		return;
 	}
 
-	/* update the dmaster field to point to us */
-	header = (struct ctdb_ltdb_header *)data.dptr;
-	if (!state->persistent) {
-		header->dmaster = state->pnn;
-		header->flags |= CTDB_REC_FLAG_MIGRATED_WITH_DATA;
-	}
+	state->new_done = true;
 
-	ret = ctdb_rec_buffer_add(state->recbuf, state->recbuf, state->reqid,
-				  NULL, key, data);
-	if (ret != 0) {
-		state->failed = true;
-		return ret;
+	if (state->old_done && state->new_done) {
+		tevent_req_done(req);
 	}
-
-	return 0;
 }
 
-static struct ctdb_rec_buffer *recdb_records(struct recdb_context *recdb,
-					     TALLOC_CTX *mem_ctx, uint32_t pnn)
+static bool push_database_recv(struct tevent_req *req, int *perr)
 {
-	struct recdb_traverse_state state;
-	int ret;
-
-	state.recbuf = ctdb_rec_buffer_init(mem_ctx, recdb->db_id);
-	if (state.recbuf == NULL) {
-		return NULL;
-	}
-	state.pnn = pnn;
-	state.reqid = 0;
-	state.persistent = recdb->persistent;
-	state.failed = false;
+	int err;
 
-	ret = tdb_traverse_read(recdb->db->tdb, recdb_traverse, &state);
-	if (ret == -1 || state.failed) {
-		TALLOC_FREE(state.recbuf);
-		return NULL;
+	if (tevent_req_is_unix_error(req, &err)) {
+		if (perr != NULL) {
+			*perr = err;
+		}
+		return false;
 	}
 
-	return state.recbuf;
+	return true;
 }
 
 /*
@@ -279,6 +1216,7 @@ struct collect_highseqnum_db_state {
 	struct ctdb_client_context *client;
 	uint32_t *pnn_list;
 	int count;
+	uint32_t *caps;
 	uint32_t db_id;
 	struct recdb_context *recdb;
 	uint32_t max_pnn;
@@ -291,7 +1229,7 @@ static struct tevent_req *collect_highseqnum_db_send(
 			TALLOC_CTX *mem_ctx,
 			struct tevent_context *ev,
 			struct ctdb_client_context *client,
-			uint32_t *pnn_list, int count,
+			uint32_t *pnn_list, int count, uint32_t *caps,
 			uint32_t db_id, struct recdb_context *recdb)
 {
 	struct tevent_req *req, *subreq;
@@ -308,6 +1246,7 @@ static struct tevent_req *collect_highseqnum_db_send(
 	state->client = client;
 	state->pnn_list = pnn_list;
 	state->count = count;
+	state->caps = caps;
 	state->db_id = db_id;
 	state->recdb = recdb;
 
@@ -331,8 +1270,6 @@ static void collect_highseqnum_db_seqnum_done(struct tevent_req *subreq)
 	struct collect_highseqnum_db_state *state = tevent_req_data(
 		req, struct collect_highseqnum_db_state);
 	struct ctdb_reply_control **reply;
-	struct ctdb_req_control request;
-	struct ctdb_pulldb pulldb;
 	int *err_list;
 	bool status;
 	int ret, i;
@@ -379,12 +1316,10 @@ static void collect_highseqnum_db_seqnum_done(struct tevent_req *subreq)
 	LOG("Pull persistent db %s from node %d with seqnum 0x%"PRIx64"\n",
 	    recdb_name(state->recdb), state->max_pnn, max_seqnum);
 
-	pulldb.db_id = state->db_id;
-	pulldb.lmaster = CTDB_LMASTER_ANY;
-
-	ctdb_req_control_pull_db(&request, &pulldb);
-	subreq = ctdb_client_control_send(state, state->ev, state->client,
-					  state->max_pnn, TIMEOUT(), &request);
+	subreq = pull_database_send(state, state->ev, state->client,
+				    state->max_pnn,
+				    state->caps[state->max_pnn],
+				    state->recdb);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
@@ -396,37 +1331,16 @@ static void collect_highseqnum_db_pulldb_done(struct tevent_req *subreq)
 {
 	struct tevent_req *req = tevent_req_callback_data(
 		subreq, struct tevent_req);
-	struct collect_highseqnum_db_state *state = tevent_req_data(
-		req, struct collect_highseqnum_db_state);
-	struct ctdb_reply_control *reply;
-	struct ctdb_rec_buffer *recbuf;
 	int ret;
 	bool status;
 
-	status = ctdb_client_control_recv(subreq, &ret, state, &reply);
+	status = pull_database_recv(subreq, &ret);
 	TALLOC_FREE(subreq);
 	if (! status) {
-		LOG("control PULL_DB failed for %s on node %u, ret=%d\n",
-		    recdb_name(state->recdb), state->max_pnn, ret);
 		tevent_req_error(req, ret);
 		return;
 	}
 
-	ret = ctdb_reply_control_pull_db(reply, state, &recbuf);
-	if (ret != 0) {
-		tevent_req_error(req, EPROTO);
-		return;
-	}
-
-	talloc_free(reply);
-
-	ret = recdb_add(state->recdb, ctdb_client_pnn(state->client), recbuf);
-	talloc_free(recbuf);
-	if (! ret) {
-		tevent_req_error(req, EIO);
-		return;
-	}
-
 	tevent_req_done(req);
 }
 
@@ -449,14 +1363,10 @@ static bool collect_highseqnum_db_recv(struct tevent_req *req, int *perr)
  */
 
 struct collect_all_db_state {
-	struct tevent_context *ev;
-	struct ctdb_client_context *client;
 	uint32_t *pnn_list;
 	int count;
-	uint32_t db_id;
-	struct recdb_context *recdb;
-	struct ctdb_pulldb pulldb;
-	int index;
+	int num_replies;
+	int result;
 };
 
 static void collect_all_db_pulldb_done(struct tevent_req *subreq);
@@ -465,12 +1375,12 @@ static struct tevent_req *collect_all_db_send(
 			TALLOC_CTX *mem_ctx,
 			struct tevent_context *ev,
 			struct ctdb_client_context *client,
-			uint32_t *pnn_list, int count,
+			uint32_t *pnn_list, int count, uint32_t *caps,
 			uint32_t db_id, struct recdb_context *recdb)
 {
 	struct tevent_req *req, *subreq;
 	struct collect_all_db_state *state;
-	struct ctdb_req_control request;
+	int i;
 
 	req = tevent_req_create(mem_ctx, &state,
 				struct collect_all_db_state);
@@ -478,26 +1388,35 @@ static struct tevent_req *collect_all_db_send(
 		return NULL;
 	}
 
-	state->ev = ev;
-	state->client = client;
 	state->pnn_list = pnn_list;
 	state->count = count;
-	state->db_id = db_id;
-	state->recdb = recdb;
-
-	state->pulldb.db_id = db_id;
-	state->pulldb.lmaster = CTDB_LMASTER_ANY;
+	state->num_replies = 0;
+	state->result = 0;
 
-	state->index = 0;
+	/*
+	 * Pull from all nodes at once, the records are merged into the
+	 * recovery database as they arrive.
+	 */
+	for (i=0; i<count; i++) {
+		subreq = pull_database_send(state, ev, client, pnn_list[i],
+					    caps[pnn_list[i]], recdb);
+		if (subreq == NULL) {
+			break;
+		}
+		tevent_req_set_callback(subreq, collect_all_db_pulldb_done,
+					req);
+	}
 
-	ctdb_req_control_pull_db(&request, &state->pulldb);
-	subreq = ctdb_client_control_send(state, ev, client,
-					  state->pnn_list[state->index],
-					  TIMEOUT(), &request);
-	if (tevent_req_nomem(subreq, req)) {
+	if (i == 0) {
+		tevent_req_nomem(NULL, req);
 		return tevent_req_post(req, ev);
 	}
-	tevent_req_set_callback(subreq, collect_all_db_pulldb_done, req);
+
+	if (i < count) {
+		/* Wait for the pulls already started */
+		state->count = i;
+		state->result = ENOMEM;
+	}
 
 	return req;
 }
@@ -508,53 +1427,30 @@ static void collect_all_db_pulldb_done(struct tevent_req *subreq)
 		subreq, struct tevent_req);
 	struct collect_all_db_state *state = tevent_req_data(
 		req, struct collect_all_db_state);
-	struct ctdb_reply_control *reply;
-	struct ctdb_req_control request;
-	struct ctdb_rec_buffer *recbuf;
 	int ret;
 	bool status;
 
-	status = ctdb_client_control_recv(subreq, &ret, state, &reply);
+	status = pull_database_recv(subreq, &ret);
 	TALLOC_FREE(subreq);
-	if (! status) {
-		LOG("control PULL_DB failed for %s from node %u, ret=%d\n",
-		    recdb_name(state->recdb), state->pnn_list[state->index],
-		    ret);
-		tevent_req_error(req, ret);
-		return;
-	}
-
-	ret = ctdb_reply_control_pull_db(reply, state, &recbuf);
-	if (ret != 0) {
-		LOG("control PULL_DB failed for %s, ret=%d\n",
-		    recdb_name(state->recdb), ret);
-		tevent_req_error(req, EPROTO);
-		return;
+	if (! status && state->result == 0) {
+		state->result = ret;
 	}
 
-	talloc_free(reply);
-
-	status = recdb_add(state->recdb, ctdb_client_pnn(state->client), recbuf);
-	talloc_free(recbuf);
-	if (! status) {
-		tevent_req_error(req, EIO);
+	/*
+	 * Every pull has to finish, even after a failure, before the
+	 * recovery database can go away.
+	 */
+	state->num_replies += 1;
+	if (state->num_replies < state->count) {
 		return;
 	}
 
-	state->index += 1;
-	if (state->index == state->count) {
-		tevent_req_done(req);
+	if (state->result != 0) {
+		tevent_req_error(req, state->result);
 		return;
 	}
 
-	ctdb_req_control_pull_db(&request, &state->pulldb);
-	subreq = ctdb_client_control_send(state, state->ev, state->client,
-					  state->pnn_list[state->index],
-					  TIMEOUT(), &request);
-	if (tevent_req_nomem(subreq, req)) {
-		return;
-	}
-	tevent_req_set_callback(subreq, collect_all_db_pulldb_done, req);
+	tevent_req_done(req);
 }
 
 static bool collect_all_db_recv(struct tevent_req *req, int *perr)
@@ -581,6 +1477,9 @@ static bool collect_all_db_recv(struct tevent_req *req, int *perr)
  *  - Collect database from all nodes
  *  - Wipe database on all nodes
  *  - Push database to all nodes
+ *
+ * Nodes with the fragmented controls capability transfer the records in
+ * chunks of at most RecBufferSizeLimit bytes.
  *  - Commit transaction on all nodes
  *  - Thaw database on all nodes
  */
@@ -591,6 +1490,7 @@ struct recover_db_state {
 	struct ctdb_tunable_list *tun_list;
 	uint32_t *pnn_list;
 	int count;
+	uint32_t *caps;
 	uint32_t db_id;
 	bool persistent;
 
@@ -599,8 +1499,9 @@ struct recover_db_state {
 
 	const char *db_name, *db_path;
 	struct recdb_context *recdb;
-	struct ctdb_rec_buffer *recbuf;
 
+	struct timeval start_time;
+	double pull_time, push_time;
 };
 
 static void recover_db_name_done(struct tevent_req *subreq);
@@ -618,6 +1519,7 @@ static struct tevent_req *recover_db_send(TALLOC_CTX *mem_ctx,
 					  struct ctdb_client_context *client,
 					  struct ctdb_tunable_list *tun_list,
 					  uint32_t *pnn_list, int count,
+					  uint32_t *caps,
 					  uint32_t generation,
 					  uint32_t db_id, bool persistent)
 {
@@ -635,6 +1537,7 @@ static struct tevent_req *recover_db_send(TALLOC_CTX *mem_ctx,
 	state->tun_list = tun_list;
 	state->pnn_list = pnn_list;
 	state->count = count;
+	state->caps = caps;
 	state->db_id = db_id;
 	state->persistent = persistent;
 
@@ -816,15 +1719,17 @@ static void recover_db_transaction_started(struct tevent_req *subreq)
 		return;
 	}
 
+	state->start_time = timeval_current();
+
 	if (state->persistent && state->tun_list->recover_pdb_by_seqnum != 0) {
 		subreq = collect_highseqnum_db_send(
 				state, state->ev, state->client,
-				state->pnn_list, state->count,
+				state->pnn_list, state->count, state->caps,
 				state->db_id, state->recdb);
 	} else {
 		subreq = collect_all_db_send(
 				state, state->ev, state->client,
-				state->pnn_list, state->count,
+				state->pnn_list, state->count, state->caps,
 				state->db_id, state->recdb);
 	}
 	if (tevent_req_nomem(subreq, req)) {
@@ -854,6 +1759,8 @@ static void recover_db_collect_done(struct tevent_req *subreq)
 		return;
 	}
 
+	state->pull_time = timeval_elapsed(&state->start_time);
+
 	ctdb_req_control_wipe_database(&request, &state->transdb);
 	subreq = ctdb_client_control_multi_send(state, state->ev,
 						state->client,
@@ -871,7 +1778,6 @@ static void recover_db_wipedb_done(struct tevent_req *subreq)
 		subreq, struct tevent_req);
 	struct recover_db_state *state = tevent_req_data(
 		req, struct recover_db_state);
-	struct ctdb_req_control request;
 	int *err_list;
 	int ret;
 	bool status;
@@ -897,18 +1803,10 @@ static void recover_db_wipedb_done(struct tevent_req *subreq)
 		return;
 	}
 
-	state->recbuf = recdb_records(state->recdb, state, state->destnode);
-	if (tevent_req_nomem(state->recbuf, req)) {
-		return;
-	}
-
-	TALLOC_FREE(state->recdb);
-
-	ctdb_req_control_push_db(&request, state->recbuf);
-	subreq = ctdb_client_control_multi_send(state, state->ev,
-						state->client,
-						state->pnn_list, state->count,
-						TIMEOUT(), &request);
+	subreq = push_database_send(state, state->ev, state->client,
+				    state->pnn_list, state->count,
+				    state->caps, state->tun_list,
+				    state->recdb);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
@@ -922,32 +1820,28 @@ static void recover_db_pushdb_done(struct tevent_req *subreq)
 	struct recover_db_state *state = tevent_req_data(
 		req, struct recover_db_state);
 	struct ctdb_req_control request;
-	int *err_list;
 	int ret;
 	bool status;
 
-	status = ctdb_client_control_multi_recv(subreq, &ret, NULL, &err_list,
-						NULL);
+	status = push_database_recv(subreq, &ret);
 	TALLOC_FREE(subreq);
 	if (! status) {
-		int ret2;
-		uint32_t pnn;
-
-		ret2 = ctdb_client_control_multi_error(state->pnn_list,
-						       state->count,
-						       err_list, &pnn);
-		if (ret2 != 0) {
-			LOG("control PUSHDB failed for db %s on node %u,"
-			    " ret=%d\n", state->db_name, pnn, ret2);
-		} else {
-			LOG("control PUSHDB failed for db %s, ret=%d\n",
-			    state->db_name, ret);
-		}
 		tevent_req_error(req, ret);
 		return;
 	}
 
-	TALLOC_FREE(state->recbuf);
+	state->push_time = timeval_elapsed(&state->start_time) -
+			   state->pull_time;
+
+	LOG("Recovered db %s: pulled %u records (%zu bytes) in %.3lf seconds,"
+	    " pushed %u records (%zu bytes) in %.3lf seconds\n",
+	    state->db_name,
+	    state->recdb->num_pulled, state->recdb->bytes_pulled,
+	    state->pull_time,
+	    state->recdb->num_pushed, state->recdb->bytes_pushed,
+	    state->push_time);
+
+	TALLOC_FREE(state->recdb);
 
 	ctdb_req_control_db_transaction_commit(&request, &state->transdb);
 	subreq = ctdb_client_control_multi_send(state, state->ev,
@@ -1069,6 +1963,7 @@ struct db_recovery_one_state {
 	struct ctdb_tunable_list *tun_list;
 	uint32_t *pnn_list;
 	int count;
+	uint32_t *caps;
 	uint32_t generation;
 	uint32_t db_id;
 	bool persistent;
@@ -1083,6 +1978,7 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 					   struct ctdb_dbid_map *dbmap,
 					   struct ctdb_tunable_list *tun_list,
 					   uint32_t *pnn_list, int count,
+					   uint32_t *caps,
 					   uint32_t generation)
 {
 	struct tevent_req *req, *subreq;
@@ -1118,13 +2014,14 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 		substate->tun_list = tun_list;
 		substate->pnn_list = pnn_list;
 		substate->count = count;
+		substate->caps = caps;
 		substate->generation = generation;
 		substate->db_id = dbmap->dbs[i].db_id;
 		substate->persistent = dbmap->dbs[i].flags &
 				       CTDB_DB_FLAGS_PERSISTENT;
 
 		subreq = recover_db_send(state, ev, client, tun_list,
-					 pnn_list, count, generation,
+					 pnn_list, count, caps, generation,
 					 substate->db_id,
 					 substate->persistent);
 		if (tevent_req_nomem(subreq, req)) {
@@ -1160,6 +2057,7 @@ static void db_recovery_one_done(struct tevent_req *subreq)
 		subreq = recover_db_send(state, state->ev, substate->client,
 					 substate->tun_list,
 					 substate->pnn_list, substate->count,
+					 substate->caps,
 					 substate->generation, substate->db_id,
 					 substate->persistent);
 		if (tevent_req_nomem(subreq, req)) {
@@ -1674,6 +2572,7 @@ static void recovery_vnnmap_update_done(struct tevent_req *subreq)
 	subreq = db_recovery_send(state, state->ev, state->client,
 				  state->dbmap, state->tun_list,
 				  state->pnn_list, state->count,
+				  state->caps,
 				  state->vnnmap->generation);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
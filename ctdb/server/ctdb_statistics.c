@@ -29,6 +29,7 @@
 
 #include "ctdb_private.h"
 
+#include "common/common.h"
 #include "common/logging.h"
 
 static void ctdb_statistics_update(struct tevent_context *ev,
@@ -91,3 +92,267 @@ int32_t ctdb_control_get_stat_history(struct ctdb_context *ctdb,
 
 	return 0;
 }
+
+/*
+ * Upper limits of the latency buckets, the last bucket counts
+ * everything above.  Keep in sync with the labels in the ctdb tool.
+ */
+static const double latency_bucket_limits[MAX_COUNT_BUCKETS-1] = {
+	100.e-6, 250.e-6, 500.e-6, 1.e-3, 5.e-3, 10.e-3, 50.e-3, 100.e-3,
+	500.e-3, 1, 2, 4, 8, 16, 64,
+};
+
+int ctdb_latency_bucket_id(double t)
+{
+	int id;
+
+	for (id=0; id<MAX_COUNT_BUCKETS-1; id++) {
+		if (t < latency_bucket_limits[id]) {
+			break;
+		}
+	}
+
+	return id;
+}
+
+/*
+ * Hot keys are found by sampling the record requests from clients
+ * into a count-min sketch.  Each sampled key increments one counter in
+ * every row, the smallest of these counters is an upper bound of the
+ * number of times the key was sampled.  The keys with the highest
+ * estimates are kept in a small table.
+ *
+ * All counters are halved every HOT_KEY_DECAY_SAMPLES samples, so keys
+ * that are no longer used drop out of the table again.
+ */
+#define HOT_KEY_SKETCH_DEPTH	4
+#define HOT_KEY_SKETCH_WIDTH	1024
+#define HOT_KEY_DECAY_SAMPLES	(64 * HOT_KEY_SKETCH_WIDTH)
+
+struct ctdb_hot_key_sketch {
+	uint32_t countdown;
+	uint32_t num_samples;
+	uint32_t decay_samples;
+	uint32_t counter[HOT_KEY_SKETCH_DEPTH][HOT_KEY_SKETCH_WIDTH];
+	uint32_t num_hot_keys;
+	struct {
+		uint32_t count;
+		TDB_DATA key;
+	} hot_keys[MAX_HOT_KEYS];
+};
+
+/* FNV-1a, independent of the jenkins hash used by ctdb_hash() */
+static uint32_t hot_key_hash2(TDB_DATA key)
+{
+	uint32_t hash = 2166136261U;
+	size_t i;
+
+	for (i=0; i<key.dsize; i++) {
+		hash ^= key.dptr[i];
+		hash *= 16777619U;
+	}
+
+	return hash | 1;
+}
+
+static uint32_t hot_key_sketch_add(struct ctdb_hot_key_sketch *s,
+				   TDB_DATA key)
+{
+	uint32_t h1, h2, estimate = UINT32_MAX;
+	int i;
+
+	h1 = ctdb_hash(&key);
+	h2 = hot_key_hash2(key);
+
+	for (i=0; i<HOT_KEY_SKETCH_DEPTH; i++) {
+		uint32_t *c = &s->counter[i][(h1 + i*h2) % HOT_KEY_SKETCH_WIDTH];
+
+		*c += 1;
+		if (*c < estimate) {
+			estimate = *c;
+		}
+	}
+
+	return estimate;
+}
+
+static void hot_key_sketch_decay(struct ctdb_hot_key_sketch *s)
+{
+	int i, j;
+
+	for (i=0; i<HOT_KEY_SKETCH_DEPTH; i++) {
+		for (j=0; j<HOT_KEY_SKETCH_WIDTH; j++) {
+			s->counter[i][j] /= 2;
+		}
+	}
+
+	for (i=0; i<s->num_hot_keys; i++) {
+		s->hot_keys[i].count /= 2;
+	}
+
+	s->decay_samples = 0;
+}
+
+static void hot_key_update(struct ctdb_hot_key_sketch *s, TDB_DATA key,
+			   uint32_t estimate)
+{
+	int i, id = -1;
+
+	for (i=0; i<s->num_hot_keys; i++) {
+		if (s->hot_keys[i].key.dsize == key.dsize &&
+		    memcmp(s->hot_keys[i].key.dptr, key.dptr, key.dsize) == 0) {
+			s->hot_keys[i].count = estimate;
+			return;
+		}
+	}
+
+	if (s->num_hot_keys < MAX_HOT_KEYS) {
+		id = s->num_hot_keys;
+	} else {
+		/* Replace the coldest key if this one is hotter */
+		for (i=0; i<s->num_hot_keys; i++) {
+			if (s->hot_keys[i].count >= estimate) {
+				continue;
+			}
+			if (id == -1 ||
+			    s->hot_keys[i].count < s->hot_keys[id].count) {
+				id = i;
+			}
+		}
+		if (id == -1) {
+			return;
+		}
+	}
+
+	key.dptr = talloc_memdup(s, key.dptr, key.dsize);
+	if (key.dptr == NULL) {
+		return;
+	}
+
+	if (id == s->num_hot_keys) {
+		s->num_hot_keys++;
+	} else {
+		talloc_free(s->hot_keys[id].key.dptr);
+	}
+	s->hot_keys[id].key = key;
+	s->hot_keys[id].count = estimate;
+}
+
+/*
+ * Called for every record request from a client, samples one in
+ * HotKeySampleRate requests on average.
+ */
+void ctdb_db_sample_key(struct ctdb_db_context *ctdb_db, TDB_DATA key)
+{
+	uint32_t rate = ctdb_db->ctdb->tunable.hot_key_sample_rate;
+	struct ctdb_hot_key_sketch *s = ctdb_db->hot_key_sketch;
+	uint32_t estimate;
+
+	if (rate == 0 || key.dsize == 0) {
+		return;
+	}
+
+	if (s == NULL) {
+		s = talloc_zero(ctdb_db, struct ctdb_hot_key_sketch);
+		if (s == NULL) {
+			return;
+		}
+		ctdb_db->hot_key_sketch = s;
+	}
+
+	if (s->countdown > 0) {
+		s->countdown--;
+		return;
+	}
+	/* Randomise the interval so periodic access patterns don't bias */
+	s->countdown = random() % (2*rate - 1);
+
+	estimate = hot_key_sketch_add(s, key);
+	hot_key_update(s, key, estimate);
+
+	s->num_samples++;
+	s->decay_samples++;
+	if (s->decay_samples >= HOT_KEY_DECAY_SAMPLES) {
+		hot_key_sketch_decay(s);
+	}
+}
+
+void ctdb_db_histograms_reset(struct ctdb_db_context *ctdb_db)
+{
+	ZERO_STRUCT(ctdb_db->histograms);
+	TALLOC_FREE(ctdb_db->hot_key_sketch);
+}
+
+int32_t ctdb_control_get_db_histograms(struct ctdb_context *ctdb,
+				       uint32_t db_id, TDB_DATA *outdata)
+{
+	struct ctdb_db_context *ctdb_db;
+	struct ctdb_hot_key_sketch *s;
+	struct ctdb_db_histograms *hist;
+	int order[MAX_HOT_KEYS];
+	size_t len;
+	uint8_t *ptr;
+	int i, j;
+
+	ctdb_db = find_ctdb_db(ctdb, db_id);
+	if (ctdb_db == NULL) {
+		DEBUG(DEBUG_ERR, ("Unknown db_id 0x%x in get_db_histograms\n",
+				  db_id));
+		return -1;
+	}
+	s = ctdb_db->hot_key_sketch;
+
+	len = sizeof(struct ctdb_db_histograms);
+	if (s != NULL) {
+		for (i=0; i<s->num_hot_keys; i++) {
+			len += s->hot_keys[i].key.dsize;
+		}
+	}
+
+	hist = talloc_zero_size(outdata, len);
+	if (hist == NULL) {
+		DEBUG(DEBUG_ERR, ("Failed to allocate db histograms\n"));
+		return -1;
+	}
+
+	memcpy(hist->call, ctdb_db->histograms.call, sizeof(hist->call));
+	memcpy(hist->migrate, ctdb_db->histograms.migrate,
+	       sizeof(hist->migrate));
+	memcpy(hist->lock, ctdb_db->statistics.locks.buckets,
+	       sizeof(hist->lock));
+	memcpy(hist->vacuum, ctdb_db->histograms.vacuum,
+	       sizeof(hist->vacuum));
+	hist->sample_rate = ctdb->tunable.hot_key_sample_rate;
+
+	if (s != NULL) {
+		hist->num_samples = s->num_samples;
+		hist->num_hot_keys = s->num_hot_keys;
+
+		/* Hottest key first */
+		for (i=0; i<s->num_hot_keys; i++) {
+			for (j=i; j>0; j--) {
+				if (s->hot_keys[order[j-1]].count >=
+				    s->hot_keys[i].count) {
+					break;
+				}
+				order[j] = order[j-1];
+			}
+			order[j] = i;
+		}
+
+		ptr = (uint8_t *)hist + sizeof(struct ctdb_db_histograms);
+		for (i=0; i<s->num_hot_keys; i++) {
+			TDB_DATA key = s->hot_keys[order[i]].key;
+
+			hist->hot_keys[i].count = s->hot_keys[order[i]].count;
+			hist->hot_keys[i].key.dsize = key.dsize;
+			memcpy(ptr, key.dptr, key.dsize);
+			ptr += key.dsize;
+		}
+	}
+
+	outdata->dptr = (uint8_t *)hist;
+	outdata->dsize = len;
+
+	return 0;
+}
@@ -1253,6 +1253,9 @@ struct public_ip_list {
 	struct public_ip_list *next;
 	uint32_t pnn;
 	ctdb_sock_addr addr;
+	/* LCP2 bookkeeping for each node, see lcp2_init_ips() */
+	bool *lcp2_can_takeover;
+	uint32_t *lcp2_dsums;
 };
 
 /* Given a physical node, return the number of
@@ -1728,6 +1731,140 @@ try_again:
 	}
 }
 
+struct lcp2_ip_key {
+	uint32_t key[IP_KEYLEN];
+	struct public_ip_list *ip;
+};
+
+static int lcp2_cmp_ip_key(const void *a, const void *b)
+{
+	const struct lcp2_ip_key *ka = (const struct lcp2_ip_key *)a;
+	const struct lcp2_ip_key *kb = (const struct lcp2_ip_key *)b;
+	int i;
+
+	for (i=0; i<IP_KEYLEN; i++) {
+		if (ka->key[i] < kb->key[i]) {
+			return -1;
+		}
+		if (ka->key[i] > kb->key[i]) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Cache which nodes can take over each IP and the distance sum of
+ * each IP relative to the IPs on each node.  This saves the LCP2
+ * algorithm from recalculating them for every IP/node combination it
+ * considers.  lcp2_move_ip() keeps the distance sums up to date.
+ */
+static bool lcp2_init_ips(struct ipalloc_state *ipalloc_state)
+{
+	int i, j, numnodes, numips;
+	struct public_ip_list *t, *u;
+	struct ctdb_public_ip_list_old *public_ips;
+	struct lcp2_ip_key *keys, k, *found;
+	uint32_t d;
+
+	numnodes = ipalloc_state->num;
+
+	numips = 0;
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		numips++;
+	}
+
+	keys = talloc_array(ipalloc_state, struct lcp2_ip_key, numips);
+	if (keys == NULL) {
+		DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+		return false;
+	}
+
+	for (i = 0, t = ipalloc_state->all_ips; t != NULL; t = t->next, i++) {
+		t->lcp2_can_takeover = talloc_zero_array(ipalloc_state, bool,
+							 numnodes);
+		t->lcp2_dsums = talloc_zero_array(ipalloc_state, uint32_t,
+						  numnodes);
+		if (t->lcp2_can_takeover == NULL || t->lcp2_dsums == NULL) {
+			DEBUG(DEBUG_ERR, (__location__ " out of memory\n"));
+			talloc_free(keys);
+			return false;
+		}
+
+		memcpy(keys[i].key, ip_key(&t->addr), sizeof(keys[i].key));
+		keys[i].ip = t;
+	}
+
+	qsort(keys, numips, sizeof(struct lcp2_ip_key), lcp2_cmp_ip_key);
+
+	/* Same as can_node_takeover_ip(), but looks up each available
+	 * IP instead of searching the available IPs for each IP */
+	for (i=0; i<numnodes; i++) {
+		if (ipalloc_state->noiptakeover[i] ||
+		    ipalloc_state->noiphost[i]) {
+			continue;
+		}
+
+		public_ips = ipalloc_state->available_public_ips[i];
+		if (public_ips == NULL) {
+			continue;
+		}
+
+		for (j=0; j<public_ips->num; j++) {
+			memcpy(k.key, ip_key(&public_ips->ips[j].addr),
+			       sizeof(k.key));
+			found = bsearch(&k, keys, numips,
+					sizeof(struct lcp2_ip_key),
+					lcp2_cmp_ip_key);
+			if (found != NULL) {
+				found->ip->lcp2_can_takeover[i] = true;
+			}
+		}
+	}
+
+	talloc_free(keys);
+
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		for (u = t->next; u != NULL; u = u->next) {
+			if (t->pnn == -1 && u->pnn == -1) {
+				continue;
+			}
+			d = ip_distance(&(t->addr), &(u->addr));
+			if (u->pnn != -1) {
+				t->lcp2_dsums[u->pnn] += d * d;
+			}
+			if (t->pnn != -1) {
+				u->lcp2_dsums[t->pnn] += d * d;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* Assign an IP to a node, updating the cached distance sums of all
+ * the other IPs relative to the old and new nodes.
+ */
+static void lcp2_move_ip(struct ipalloc_state *ipalloc_state,
+			 struct public_ip_list *ip, int pnn)
+{
+	struct public_ip_list *t;
+	uint32_t d;
+
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		if (t == ip) {
+			continue;
+		}
+		d = ip_distance(&(t->addr), &(ip->addr));
+		if (ip->pnn != -1) {
+			t->lcp2_dsums[ip->pnn] -= d * d;
+		}
+		t->lcp2_dsums[pnn] += d * d;
+	}
+
+	ip->pnn = pnn;
+}
+
 static bool lcp2_init(struct ipalloc_state *ipalloc_state,
 		      uint32_t **lcp2_imbalances,
 		      bool **rebalance_candidates)
@@ -1755,6 +1892,10 @@ static bool lcp2_init(struct ipalloc_state *ipalloc_state,
 		(*rebalance_candidates)[i] = true;
 	}
 
+	if (!lcp2_init_ips(ipalloc_state)) {
+		return false;
+	}
+
 	/* 2nd step: if a node has IPs assigned then it must have been
 	 * healthy before, so we remove it from consideration.  This
 	 * is overkill but is all we have because we don't maintain
@@ -1827,16 +1968,12 @@ static void lcp2_allocate_unassigned(struct ipalloc_state *ipalloc_state,
 
 			for (dstnode = 0; dstnode < numnodes; dstnode++) {
 				/* only check nodes that can actually takeover this ip */
-				if (!can_node_takeover_ip(ipalloc_state,
-							  dstnode,
-							  t)) {
+				if (!t->lcp2_can_takeover[dstnode]) {
 					/* no it couldnt   so skip to the next node */
 					continue;
 				}
 
-				dstdsum = ip_distance_2_sum(&(t->addr),
-							    ipalloc_state->all_ips,
-							    dstnode);
+				dstdsum = t->lcp2_dsums[dstnode];
 				dstimbl = lcp2_imbalances[dstnode] + dstdsum;
 				DEBUG(DEBUG_DEBUG,
 				      (" %s -> %d [+%d]\n",
@@ -1859,7 +1996,7 @@ static void lcp2_allocate_unassigned(struct ipalloc_state *ipalloc_state,
 
 		/* If we found one then assign it to the given node. */
 		if (minnode != -1) {
-			minip->pnn = minnode;
+			lcp2_move_ip(ipalloc_state, minip, minnode);
 			lcp2_imbalances[minnode] = minimbl;
 			DEBUG(DEBUG_INFO,(" %s -> %d [+%d]\n",
 					  ctdb_addr_to_str(&(minip->addr)),
@@ -1925,9 +2062,7 @@ static bool lcp2_failback_candidate(struct ipalloc_state *ipalloc_state,
 		}
 
 		/* What is this IP address costing the source node? */
-		srcdsum = ip_distance_2_sum(&(t->addr),
-					    ipalloc_state->all_ips,
-					    srcnode);
+		srcdsum = t->lcp2_dsums[srcnode];
 		srcimbl = lcp2_imbalances[srcnode] - srcdsum;
 
 		/* Consider this IP address would cost each potential
@@ -1942,15 +2077,12 @@ static bool lcp2_failback_candidate(struct ipalloc_state *ipalloc_state,
 			}
 
 			/* only check nodes that can actually takeover this ip */
-			if (!can_node_takeover_ip(ipalloc_state, dstnode,
-						  t)) {
+			if (!t->lcp2_can_takeover[dstnode]) {
 				/* no it couldnt   so skip to the next node */
 				continue;
 			}
 
-			dstdsum = ip_distance_2_sum(&(t->addr),
-						    ipalloc_state->all_ips,
-						    dstnode);
+			dstdsum = t->lcp2_dsums[dstnode];
 			dstimbl = lcp2_imbalances[dstnode] + dstdsum;
 			DEBUG(DEBUG_DEBUG,(" %d [%d] -> %s -> %d [+%d]\n",
 					   srcnode, -srcdsum,
@@ -1982,7 +2114,7 @@ static bool lcp2_failback_candidate(struct ipalloc_state *ipalloc_state,
 
 		lcp2_imbalances[srcnode] = minsrcimbl;
 		lcp2_imbalances[mindstnode] = mindstimbl;
-		minip->pnn = mindstnode;
+		lcp2_move_ip(ipalloc_state, minip, mindstnode);
 
 		return true;
 	}
@@ -58,6 +58,8 @@ struct ctdb_traverse_local_handle {
 	void *private_data;
 	ctdb_traverse_fn_t callback;
 	bool withemptyrecords;
+	struct ctdb_traverse_filter *filter;
+	struct ctdb_marshall_buffer *batch;
 	struct tevent_fd *fde;
 	int records_failed;
 	int records_sent;
@@ -105,6 +107,63 @@ static int traverse_local_destructor(struct ctdb_traverse_local_handle *h)
 	return 0;
 }
 
+/*
+  check if a record matches the filter of a filtered traverse
+ */
+static bool traverse_filter_match(struct ctdb_traverse_filter *filter,
+				  TDB_DATA key, TDB_DATA data)
+{
+	struct ctdb_ltdb_header *hdr;
+
+	if (data.dsize < sizeof(struct ctdb_ltdb_header)) {
+		return false;
+	}
+	hdr = (struct ctdb_ltdb_header *)data.dptr;
+
+	if ((hdr->flags & filter->flags_mask) != filter->flags_value) {
+		return false;
+	}
+
+	if (key.dsize < filter->prefix_len) {
+		return false;
+	}
+	if (memcmp(key.dptr, filter->prefix, filter->prefix_len) != 0) {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+  send the batched records of a filtered traverse to the originator
+ */
+static int ctdb_traverse_local_flush(struct ctdb_traverse_local_handle *h)
+{
+	TDB_DATA outdata;
+	uint32_t count;
+	int res, status;
+
+	if (h->batch == NULL) {
+		return 0;
+	}
+
+	count = h->batch->count;
+	outdata = ctdb_marshall_finish(h->batch);
+
+	res = ctdb_control(h->ctdb_db->ctdb, h->srcnode, 0,
+			   CTDB_CONTROL_TRAVERSE_DATA_BATCH,
+			   CTDB_CTRL_FLAG_NOREPLY, outdata,
+			   NULL, NULL, &status, NULL, NULL);
+	TALLOC_FREE(h->batch);
+	if (res != 0 || status != 0) {
+		h->records_failed += count;
+		return -1;
+	}
+
+	h->records_sent += count;
+	return 0;
+}
+
 /*
   callback from tdb_traverse_read()
  */
@@ -133,6 +192,26 @@ static int ctdb_traverse_local_fn(struct tdb_context *tdb, TDB_DATA key, TDB_DAT
 		}
 	}
 
+	if (h->filter != NULL) {
+		if (!traverse_filter_match(h->filter, key, data)) {
+			return 0;
+		}
+
+		/* matching records are sent in batches */
+		h->batch = ctdb_marshall_add(h, h->batch, h->ctdb_db->db_id,
+					     h->reqid, key, NULL, data);
+		if (h->batch == NULL) {
+			h->records_failed++;
+			return -1;
+		}
+
+		if (talloc_get_size(h->batch) >=
+		    h->ctdb_db->ctdb->tunable.rec_buffer_size_limit) {
+			return ctdb_traverse_local_flush(h);
+		}
+		return 0;
+	}
+
 	d = ctdb_marshall_record(h, h->reqid, key, NULL, data);
 	if (d == NULL) {
 		/* error handling is tricky in this child code .... */
@@ -162,6 +241,7 @@ struct traverse_all_state {
 	uint32_t client_reqid;
 	uint64_t srvid;
 	bool withemptyrecords;
+	struct ctdb_traverse_filter *filter;
 };
 
 /*
@@ -207,6 +287,7 @@ static struct ctdb_traverse_local_handle *ctdb_traverse_local(struct ctdb_db_con
 	h->srvid = all_state->srvid;
 	h->srcnode = all_state->srcnode;
 	h->withemptyrecords = all_state->withemptyrecords;
+	h->filter = all_state->filter;
 
 	if (h->child == 0) {
 		/* start the traverse in the child */
@@ -233,6 +314,10 @@ static struct ctdb_traverse_local_handle *ctdb_traverse_local(struct ctdb_db_con
 		}
 
 		res = tdb_traverse_read(ctdb_db->ltdb->tdb, ctdb_traverse_local_fn, h);
+		if (res != -1) {
+			/* Send the last partial batch */
+			ctdb_traverse_local_flush(h);
+		}
 		if (res == -1 || h->records_failed > 0) {
 			/* traverse failed */
 			res = -(h->records_sent);
@@ -328,6 +413,8 @@ struct traverse_start_state {
 	uint32_t db_id;
 	uint64_t srvid;
 	bool withemptyrecords;
+	struct ctdb_traverse_filter *filter;
+	struct ctdb_marshall_buffer *batch;
 	int num_records;
 };
 
@@ -350,6 +437,7 @@ static struct ctdb_traverse_all_handle *ctdb_daemon_traverse_all(struct ctdb_db_
 	TDB_DATA data;
 	struct ctdb_traverse_all r;
 	struct ctdb_traverse_all_ext r_ext;
+	struct ctdb_traverse_all_filter r_filter;
 	uint32_t destination;
 
 	state = talloc(start_state, struct ctdb_traverse_all_handle);
@@ -367,7 +455,18 @@ static struct ctdb_traverse_all_handle *ctdb_daemon_traverse_all(struct ctdb_db_
 	
 	talloc_set_destructor(state, ctdb_traverse_all_destructor);
 
-	if (start_state->withemptyrecords) {
+	if (start_state->filter != NULL) {
+		r_filter.db_id = ctdb_db->db_id;
+		r_filter.reqid = state->reqid;
+		r_filter.pnn   = ctdb->pnn;
+		r_filter.client_reqid = start_state->reqid;
+		r_filter.srvid = start_state->srvid;
+		r_filter.withemptyrecords = start_state->withemptyrecords;
+		r_filter.filter = *start_state->filter;
+
+		data.dptr = (uint8_t *)&r_filter;
+		data.dsize = sizeof(r_filter);
+	} else if (start_state->withemptyrecords) {
 		r_ext.db_id = ctdb_db->db_id;
 		r_ext.reqid = state->reqid;
 		r_ext.pnn   = ctdb->pnn;
@@ -416,7 +515,11 @@ static struct ctdb_traverse_all_handle *ctdb_daemon_traverse_all(struct ctdb_db_
 	 * node
 	 */
 
-	if (start_state->withemptyrecords) {
+	if (start_state->filter != NULL) {
+		ret = ctdb_daemon_send_control(ctdb, destination, 0,
+				       CTDB_CONTROL_TRAVERSE_ALL_FILTER,
+				       0, CTDB_CTRL_FLAG_NOREPLY, data, NULL, NULL);
+	} else if (start_state->withemptyrecords) {
 		ret = ctdb_daemon_send_control(ctdb, destination, 0,
 				       CTDB_CONTROL_TRAVERSE_ALL_EXT,
 				       0, CTDB_CTRL_FLAG_NOREPLY, data, NULL, NULL);
@@ -493,6 +596,69 @@ int32_t ctdb_control_traverse_all_ext(struct ctdb_context *ctdb, TDB_DATA data,
 	state->client_reqid = c->client_reqid;
 	state->srvid = c->srvid;
 	state->withemptyrecords = c->withemptyrecords;
+	state->filter = NULL;
+
+	state->h = ctdb_traverse_local(ctdb_db, traverse_all_callback, state);
+	if (state->h == NULL) {
+		talloc_free(state);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * filtered version, only the matching records are sent back to the
+ * originator in CTDB_CONTROL_TRAVERSE_DATA_BATCH controls
+ */
+int32_t ctdb_control_traverse_all_filter(struct ctdb_context *ctdb, TDB_DATA data, TDB_DATA *outdata)
+{
+	struct ctdb_traverse_all_filter *c = (struct ctdb_traverse_all_filter *)data.dptr;
+	struct traverse_all_state *state;
+	struct ctdb_db_context *ctdb_db;
+
+	if (data.dsize != sizeof(struct ctdb_traverse_all_filter)) {
+		DEBUG(DEBUG_ERR,(__location__ " Invalid size in ctdb_control_traverse_all_filter\n"));
+		return -1;
+	}
+
+	if (c->filter.prefix_len > CTDB_TRAVERSE_FILTER_PREFIX_MAX) {
+		DEBUG(DEBUG_ERR,(__location__ " Invalid prefix length %u in ctdb_control_traverse_all_filter\n",
+				 c->filter.prefix_len));
+		return -1;
+	}
+
+	ctdb_db = find_ctdb_db(ctdb, c->db_id);
+	if (ctdb_db == NULL) {
+		return -1;
+	}
+
+	if (ctdb_db->unhealthy_reason) {
+		if (ctdb->tunable.allow_unhealthy_db_read == 0) {
+			DEBUG(DEBUG_ERR,("db(%s) unhealty in ctdb_control_traverse_all: %s\n",
+					ctdb_db->db_name, ctdb_db->unhealthy_reason));
+			return -1;
+		}
+		DEBUG(DEBUG_WARNING,("warn: db(%s) unhealty in ctdb_control_traverse_all: %s\n",
+				     ctdb_db->db_name, ctdb_db->unhealthy_reason));
+	}
+
+	state = talloc(ctdb_db, struct traverse_all_state);
+	if (state == NULL) {
+		return -1;
+	}
+
+	state->reqid = c->reqid;
+	state->srcnode = c->pnn;
+	state->ctdb = ctdb;
+	state->client_reqid = c->client_reqid;
+	state->srvid = c->srvid;
+	state->withemptyrecords = c->withemptyrecords;
+	state->filter = talloc_memdup(state, &c->filter, sizeof(c->filter));
+	if (state->filter == NULL) {
+		talloc_free(state);
+		return -1;
+	}
 
 	state->h = ctdb_traverse_local(ctdb_db, traverse_all_callback, state);
 	if (state->h == NULL) {
@@ -545,6 +711,7 @@ int32_t ctdb_control_traverse_all(struct ctdb_context *ctdb, TDB_DATA data, TDB_
 	state->client_reqid = c->client_reqid;
 	state->srvid = c->srvid;
 	state->withemptyrecords = false;
+	state->filter = NULL;
 
 	state->h = ctdb_traverse_local(ctdb_db, traverse_all_callback, state);
 	if (state->h == NULL) {
@@ -603,6 +770,68 @@ int32_t ctdb_control_traverse_data(struct ctdb_context *ctdb, TDB_DATA data, TDB
 	return 0;
 }	
 
+/*
+  called when a CTDB_CONTROL_TRAVERSE_DATA_BATCH control comes in. We
+  then call the traverse_all callback with each of the records
+ */
+int32_t ctdb_control_traverse_data_batch(struct ctdb_context *ctdb, TDB_DATA data, TDB_DATA *outdata)
+{
+	struct ctdb_marshall_buffer *m = (struct ctdb_marshall_buffer *)data.dptr;
+	struct ctdb_traverse_all_handle *state = NULL;
+	struct ctdb_rec_data_old *rec;
+	size_t offset;
+	uint32_t i;
+
+	if (data.dsize < offsetof(struct ctdb_marshall_buffer, data)) {
+		DEBUG(DEBUG_ERR,("Bad data size in ctdb_control_traverse_data_batch\n"));
+		return -1;
+	}
+
+	/* validate all the records before passing any of them on */
+	offset = offsetof(struct ctdb_marshall_buffer, data);
+	for (i=0; i<m->count; i++) {
+		rec = (struct ctdb_rec_data_old *)(data.dptr + offset);
+
+		if (data.dsize - offset < offsetof(struct ctdb_rec_data_old, data) ||
+		    rec->length > data.dsize - offset ||
+		    rec->length < offsetof(struct ctdb_rec_data_old, data) ||
+		    (size_t)rec->keylen + rec->datalen >
+		    rec->length - offsetof(struct ctdb_rec_data_old, data)) {
+			DEBUG(DEBUG_ERR,("Bad record in ctdb_control_traverse_data_batch\n"));
+			return -1;
+		}
+
+		if (state == NULL) {
+			state = reqid_find(ctdb->idr, rec->reqid,
+					   struct ctdb_traverse_all_handle);
+			if (state == NULL || rec->reqid != state->reqid) {
+				/* traverse might have been terminated already */
+				return -1;
+			}
+		} else if (rec->reqid != state->reqid) {
+			DEBUG(DEBUG_ERR,("Mixed reqids in ctdb_control_traverse_data_batch\n"));
+			return -1;
+		}
+
+		offset += rec->length;
+	}
+
+	rec = NULL;
+	for (i=0; i<m->count; i++) {
+		TDB_DATA key;
+
+		rec = ctdb_marshall_loop_next(m, rec, NULL, NULL, &key, &data);
+		if (key.dsize == 0 && data.dsize == 0) {
+			/* end of traverse is only signalled by TRAVERSE_DATA */
+			continue;
+		}
+
+		state->callback(state->private_data, key, data);
+	}
+
+	return 0;
+}
+
 /*
   kill a in-progress traverse, used when a client disconnects
  */
@@ -693,6 +922,66 @@ static void traverse_start_callback(void *p, TDB_DATA key, TDB_DATA data)
 }
 
 
+/*
+  callback which sends batches of records as messages to the client,
+  the end of the traverse is signalled by an empty batch
+ */
+static void traverse_start_filter_callback(void *p, TDB_DATA key, TDB_DATA data)
+{
+	struct traverse_start_state *state;
+	struct ctdb_context *ctdb;
+	bool done;
+
+	state = talloc_get_type(p, struct traverse_start_state);
+	ctdb = state->ctdb;
+
+	done = (key.dsize == 0 && data.dsize == 0);
+
+	if (!done) {
+		state->batch = ctdb_marshall_add(state, state->batch,
+						 state->db_id, state->reqid,
+						 key, NULL, data);
+		if (state->batch == NULL) {
+			DEBUG(DEBUG_ERR, (__location__ " Memory allocation error\n"));
+			return;
+		}
+		state->num_records++;
+
+		if (talloc_get_size(state->batch) <
+		    ctdb->tunable.rec_buffer_size_limit) {
+			return;
+		}
+	}
+
+	if (state->batch != NULL) {
+		srvid_dispatch(ctdb->srv, state->srvid, 0,
+			       ctdb_marshall_finish(state->batch));
+		TALLOC_FREE(state->batch);
+	}
+
+	if (!done) {
+		return;
+	}
+
+	/* Empty batch marks the end of traverse */
+	state->batch = talloc_zero(state, struct ctdb_marshall_buffer);
+	if (state->batch != NULL) {
+		state->batch->db_id = state->db_id;
+		srvid_dispatch(ctdb->srv, state->srvid, 0,
+			       ctdb_marshall_finish(state->batch));
+	}
+
+	DEBUG(DEBUG_NOTICE, ("Ending filtered traverse on DB %s (id %d), records %d\n",
+			     state->h->ctdb_db->db_name, state->h->reqid,
+			     state->num_records));
+
+	if (!state->h->timedout) {
+		/* end of traverse, no need to send TRAVERSE_KILL control */
+		talloc_set_destructor(state, NULL);
+	}
+	talloc_free(state);
+}
+
 /**
  * start a traverse_all - called as a control from a client.
  * extended version to take the "withemptyrecords" parameter.
@@ -744,6 +1033,8 @@ int32_t ctdb_control_traverse_start_ext(struct ctdb_context *ctdb,
 	state->db_id = d->db_id;
 	state->ctdb = ctdb;
 	state->withemptyrecords = d->withemptyrecords;
+	state->filter = NULL;
+	state->batch = NULL;
 	state->num_records = 0;
 
 	state->h = ctdb_daemon_traverse_all(ctdb_db, traverse_start_callback, state);
@@ -781,3 +1072,83 @@ int32_t ctdb_control_traverse_start(struct ctdb_context *ctdb,
 
 	return ctdb_control_traverse_start_ext(ctdb, data2, outdata, srcnode, client_id);
 }
+
+/**
+ * start a filtered traverse_all - called as a control from a client.
+ *
+ * Only the records matching the filter are returned and the records
+ * are sent to the client in batches.
+ */
+int32_t ctdb_control_traverse_start_filter(struct ctdb_context *ctdb,
+					   TDB_DATA data,
+					   TDB_DATA *outdata,
+					   uint32_t srcnode,
+					   uint32_t client_id)
+{
+	struct ctdb_traverse_start_filter *d = (struct ctdb_traverse_start_filter *)data.dptr;
+	struct traverse_start_state *state;
+	struct ctdb_db_context *ctdb_db;
+	struct ctdb_client *client = reqid_find(ctdb->idr, client_id, struct ctdb_client);
+
+	if (client == NULL) {
+		DEBUG(DEBUG_ERR,(__location__ " No client found\n"));
+		return -1;
+	}
+
+	if (data.dsize != sizeof(*d)) {
+		DEBUG(DEBUG_ERR,("Bad record size in ctdb_control_traverse_start_filter\n"));
+		return -1;
+	}
+
+	if (d->filter.prefix_len > CTDB_TRAVERSE_FILTER_PREFIX_MAX) {
+		DEBUG(DEBUG_ERR,("Invalid prefix length %u in ctdb_control_traverse_start_filter\n",
+				 d->filter.prefix_len));
+		return -1;
+	}
+
+	ctdb_db = find_ctdb_db(ctdb, d->db_id);
+	if (ctdb_db == NULL) {
+		return -1;
+	}
+
+	if (ctdb_db->unhealthy_reason) {
+		if (ctdb->tunable.allow_unhealthy_db_read == 0) {
+			DEBUG(DEBUG_ERR,("db(%s) unhealty in ctdb_control_traverse_start: %s\n",
+					ctdb_db->db_name, ctdb_db->unhealthy_reason));
+			return -1;
+		}
+		DEBUG(DEBUG_WARNING,("warn: db(%s) unhealty in ctdb_control_traverse_start: %s\n",
+				     ctdb_db->db_name, ctdb_db->unhealthy_reason));
+	}
+
+	state = talloc(client, struct traverse_start_state);
+	if (state == NULL) {
+		return -1;
+	}
+
+	state->srcnode = srcnode;
+	state->reqid = d->reqid;
+	state->srvid = d->srvid;
+	state->db_id = d->db_id;
+	state->ctdb = ctdb;
+	state->withemptyrecords = d->withemptyrecords;
+	state->batch = NULL;
+	state->num_records = 0;
+	state->filter = talloc_memdup(state, &d->filter, sizeof(d->filter));
+	if (state->filter == NULL) {
+		talloc_free(state);
+		return -1;
+	}
+
+	state->h = ctdb_daemon_traverse_all(ctdb_db,
+					    traverse_start_filter_callback,
+					    state);
+	if (state->h == NULL) {
+		talloc_free(state);
+		return -1;
+	}
+
+	talloc_set_destructor(state, ctdb_traverse_start_destructor);
+
+	return 0;
+}
@@ -53,12 +53,16 @@ struct ctdb_vacuum_child_context {
 	pid_t child_pid;
 	enum vacuum_child_status status;
 	struct timeval start_time;
+	/* child reports the traverse position back */
+	bool incremental;
 };
 
 struct ctdb_vacuum_handle {
 	struct ctdb_db_context *ctdb_db;
 	struct ctdb_vacuum_child_context *child_ctx;
 	uint32_t fast_path_count;
+	/* key the incremental traverse continues after */
+	TDB_DATA traverse_key;
 };
 
 
@@ -752,6 +756,127 @@ static void ctdb_vacuum_traverse_db(struct ctdb_db_context *ctdb_db,
 	return;
 }
 
+struct vacuum_traverse_state {
+	struct vacuum_data *vdata;
+	bool deleted;
+	int ret;
+};
+
+static int vacuum_traverse_parser(TDB_DATA key, TDB_DATA data,
+				  void *private_data)
+{
+	struct vacuum_traverse_state *state =
+		(struct vacuum_traverse_state *)private_data;
+
+	state->deleted = (data.dsize == sizeof(struct ctdb_ltdb_header));
+	state->ret = vacuum_traverse(state->vdata->ctdb_db->ltdb->tdb, key,
+				     data, state->vdata);
+
+	return 0;
+}
+
+/**
+ * read-only traverse of the next VacuumTraverseBudget records of the
+ * database, continuing after traverse_key.
+ *
+ * On return traverse_key holds the key the next run continues after,
+ * or tdb_null if the end of the database has been reached.  The key of
+ * a record that is not a deletion candidate is preferred, because the
+ * deletion candidates are likely to be gone by the next run.
+ *
+ * The churn is tracked by the delete queue, not by dirty hash chains:
+ * tdb does not record which chains changed, and has no per-chain
+ * traverse, so the budget counts records.
+ */
+static void ctdb_vacuum_traverse_db_incremental(struct ctdb_db_context *ctdb_db,
+						struct vacuum_data *vdata,
+						TDB_DATA *traverse_key)
+{
+	struct tdb_context *tdb = ctdb_db->ltdb->tdb;
+	uint32_t budget = ctdb_db->ctdb->tunable.vacuum_traverse_budget;
+	struct vacuum_traverse_state state;
+	TDB_DATA key, next;
+	TDB_DATA live = tdb_null, deleted = tdb_null;
+	bool restart = false;
+	int ret;
+
+	state.vdata = vdata;
+
+	if (traverse_key->dsize == 0) {
+		key = tdb_firstkey(tdb);
+	} else if (!tdb_exists(tdb, *traverse_key)) {
+		/* lost our position, start over */
+		restart = true;
+		key = tdb_firstkey(tdb);
+	} else {
+		key = tdb_nextkey(tdb, *traverse_key);
+	}
+
+	while (key.dptr != NULL &&
+	       vdata->count.db_traverse.total < budget) {
+		state.deleted = false;
+		state.ret = 0;
+		ret = tdb_parse_record(tdb, key, vacuum_traverse_parser,
+				       &state);
+		if ((ret == -1 && tdb_error(tdb) != TDB_ERR_NOEXIST) ||
+		    state.ret != 0) {
+			vdata->traverse_error = true;
+			free(key.dptr);
+			break;
+		}
+
+		next = tdb_nextkey(tdb, key);
+
+		free(deleted.dptr);
+		deleted = tdb_null;
+		if (state.deleted) {
+			deleted = key;
+		} else {
+			free(live.dptr);
+			live = key;
+		}
+		key = next;
+	}
+
+	if (vdata->traverse_error) {
+		DEBUG(DEBUG_ERR, (__location__ " Traverse error in vacuuming "
+				  "'%s'\n", ctdb_db->db_name));
+		free(live.dptr);
+		free(deleted.dptr);
+		return;
+	}
+
+	if (key.dptr == NULL) {
+		/* end of database, the next run starts from the beginning */
+		free(live.dptr);
+		free(deleted.dptr);
+		*traverse_key = tdb_null;
+	} else if (live.dptr != NULL) {
+		free(key.dptr);
+		free(deleted.dptr);
+		*traverse_key = live;
+	} else {
+		free(key.dptr);
+		*traverse_key = deleted;
+	}
+
+	DEBUG(DEBUG_INFO,
+	      (__location__
+	       " incremental vacuuming db traverse statistics: "
+	       "db[%s] "
+	       "total[%u] "
+	       "skp[%u] "
+	       "err[%u] "
+	       "sched[%u]%s%s\n",
+	       ctdb_db->db_name,
+	       (unsigned)vdata->count.db_traverse.total,
+	       (unsigned)vdata->count.db_traverse.skipped,
+	       (unsigned)vdata->count.db_traverse.error,
+	       (unsigned)vdata->count.db_traverse.scheduled,
+	       restart ? " restarted" : "",
+	       traverse_key->dptr == NULL ? " complete" : ""));
+}
+
 /**
  * Process the vacuum fetch lists:
  * For records for which we are not the lmaster, tell the lmaster to
@@ -1257,7 +1382,7 @@ fail:
  * This executes in the child context.
  */
 static int ctdb_vacuum_db(struct ctdb_db_context *ctdb_db,
-			  bool full_vacuum_run)
+			  bool full_vacuum_run, TDB_DATA *traverse_key)
 {
 	struct ctdb_context *ctdb = ctdb_db->ctdb;
 	int ret, pnn;
@@ -1266,7 +1391,8 @@ static int ctdb_vacuum_db(struct ctdb_db_context *ctdb_db,
 
 	DEBUG(DEBUG_INFO, (__location__ " Entering %s vacuum run for db "
 			   "%s db_id[0x%08x]\n",
-			   full_vacuum_run ? "full" : "fast",
+			   full_vacuum_run ? "full" :
+			   traverse_key != NULL ? "incremental" : "fast",
 			   ctdb_db->db_name, ctdb_db->db_id));
 
 	ret = ctdb_ctrl_getvnnmap(ctdb, TIMELIMIT(), CTDB_CURRENT_NODE, ctdb, &ctdb->vnn_map);
@@ -1297,6 +1423,9 @@ static int ctdb_vacuum_db(struct ctdb_db_context *ctdb_db,
 
 	if (full_vacuum_run) {
 		ctdb_vacuum_traverse_db(ctdb_db, vdata);
+	} else if (traverse_key != NULL) {
+		ctdb_vacuum_traverse_db_incremental(ctdb_db, vdata,
+						    traverse_key);
 	}
 
 	ctdb_process_delete_queue(ctdb_db, vdata);
@@ -1318,14 +1447,15 @@ static int ctdb_vacuum_db(struct ctdb_db_context *ctdb_db,
  * called from the child context
  */
 static int ctdb_vacuum_and_repack_db(struct ctdb_db_context *ctdb_db,
-				     bool full_vacuum_run)
+				     bool full_vacuum_run,
+				     TDB_DATA *traverse_key)
 {
 	uint32_t repack_limit = ctdb_db->ctdb->tunable.repack_limit;
 	const char *name = ctdb_db->db_name;
 	int freelist_size = 0;
 	int ret;
 
-	if (ctdb_vacuum_db(ctdb_db, full_vacuum_run) != 0) {
+	if (ctdb_vacuum_db(ctdb_db, full_vacuum_run, traverse_key) != 0) {
 		DEBUG(DEBUG_ERR,(__location__ " Failed to vacuum '%s'\n", name));
 	}
 
@@ -1369,6 +1499,7 @@ static int vacuum_child_destructor(struct ctdb_vacuum_child_context *child_ctx)
 	struct ctdb_context *ctdb = ctdb_db->ctdb;
 
 	CTDB_UPDATE_DB_LATENCY(ctdb_db, "vacuum", vacuum.latency, l);
+	CTDB_UPDATE_DB_HISTOGRAM(ctdb_db, vacuum, l);
 	DEBUG(DEBUG_INFO,("Vacuuming took %.3f seconds for database %s\n", l, ctdb_db->db_name));
 
 	if (child_ctx->child_pid != -1) {
@@ -1404,6 +1535,52 @@ static void vacuum_child_timeout(struct tevent_context *ev,
 }
 
 
+/*
+ * The vacuum child reports the status byte, followed by the length
+ * and the key of the incremental traverse position in incremental
+ * mode.  This is sent with a single write of at most PIPE_BUF bytes,
+ * so the parent gets it in one non-blocking read.
+ */
+#define VACUUM_CHILD_MSG_MAX PIPE_BUF
+#define VACUUM_CHILD_MSG_HDR (1 + sizeof(uint32_t))
+
+/*
+ * Take the position of the incremental traverse from what the child
+ * sent after the status.  On failure the old position is kept.
+ */
+static void vacuum_child_parse_traverse_key(
+			struct ctdb_vacuum_child_context *child_ctx,
+			const uint8_t *buf, size_t buflen)
+{
+	struct ctdb_vacuum_handle *vacuum_handle = child_ctx->vacuum_handle;
+	uint8_t *key = NULL;
+	uint32_t len;
+
+	if (buflen < sizeof(len)) {
+		goto fail;
+	}
+	memcpy(&len, buf, sizeof(len));
+	if (len != buflen - sizeof(len)) {
+		goto fail;
+	}
+
+	if (len > 0) {
+		key = talloc_memdup(vacuum_handle, buf + sizeof(len), len);
+		if (key == NULL) {
+			goto fail;
+		}
+	}
+
+	talloc_free(vacuum_handle->traverse_key.dptr);
+	vacuum_handle->traverse_key.dptr = key;
+	vacuum_handle->traverse_key.dsize = len;
+	return;
+
+fail:
+	DEBUG(DEBUG_ERR, ("Failed to read vacuum traverse position for "
+			  "database %s\n", vacuum_handle->ctdb_db->db_name));
+}
+
 /*
  * this event is generated when a vacuum child process has completed
  */
@@ -1412,20 +1589,28 @@ static void vacuum_child_handler(struct tevent_context *ev,
 				 uint16_t flags, void *private_data)
 {
 	struct ctdb_vacuum_child_context *child_ctx = talloc_get_type(private_data, struct ctdb_vacuum_child_context);
+	uint8_t buf[VACUUM_CHILD_MSG_MAX];
 	char c = 0;
 	int ret;
 
 	DEBUG(DEBUG_INFO,("Vacuuming child process %d finished for db %s\n", child_ctx->child_pid, child_ctx->vacuum_handle->ctdb_db->db_name));
 	child_ctx->child_pid = -1;
 
-	ret = sys_read(child_ctx->fd[0], &c, 1);
-	if (ret != 1 || c != 0) {
+	ret = sys_read(child_ctx->fd[0], buf, sizeof(buf));
+	if (ret >= 1) {
+		c = buf[0];
+	}
+	if (ret < 1 || c != 0) {
 		child_ctx->status = VACUUM_ERROR;
 		DEBUG(DEBUG_ERR, ("A vacuum child process failed with an error for database %s. ret=%d c=%d\n", child_ctx->vacuum_handle->ctdb_db->db_name, ret, c));
 	} else {
 		child_ctx->status = VACUUM_OK;
 	}
 
+	if (child_ctx->status == VACUUM_OK && child_ctx->incremental) {
+		vacuum_child_parse_traverse_key(child_ctx, buf + 1, ret - 1);
+	}
+
 	talloc_free(child_ctx);
 }
 
@@ -1502,9 +1687,13 @@ static void ctdb_vacuum_event(struct tevent_context *ev,
 	}
 
 
+	child_ctx->incremental =
+		(ctdb->tunable.vacuum_traverse_budget > 0);
+
 	if (child_ctx->child_pid == 0) {
 		char cc = 0;
 		bool full_vacuum_run = false;
+		TDB_DATA traverse_key = vacuum_handle->traverse_key;
 		close(child_ctx->fd[0]);
 
 		DEBUG(DEBUG_INFO,("Vacuuming child process %d for db %s started\n", getpid(), ctdb_db->db_name));
@@ -1514,18 +1703,53 @@ static void ctdb_vacuum_event(struct tevent_context *ev,
 			_exit(1);
 		}
 
+		if (child_ctx->incremental) {
+			/*
+			 * Spread the database traverse over the runs
+			 * instead of doing a full vacuum run
+			 */
+			uint8_t buf[VACUUM_CHILD_MSG_MAX];
+			uint32_t len = 0;
+
+			cc = ctdb_vacuum_and_repack_db(ctdb_db, false,
+						       &traverse_key);
+
+			if (traverse_key.dsize <=
+			    sizeof(buf) - VACUUM_CHILD_MSG_HDR) {
+				len = traverse_key.dsize;
+			} else {
+				/* start over with the next run */
+				DEBUG(DEBUG_NOTICE,
+				      ("Vacuum traverse position in %s too "
+				       "long, starting over\n",
+				       ctdb_db->db_name));
+			}
+
+			buf[0] = cc;
+			memcpy(buf + 1, &len, sizeof(len));
+			if (len > 0) {
+				memcpy(buf + VACUUM_CHILD_MSG_HDR,
+				       traverse_key.dptr, len);
+			}
+			sys_write(child_ctx->fd[1], buf,
+				  VACUUM_CHILD_MSG_HDR + len);
+			_exit(0);
+		}
+
 		if ((ctdb->tunable.vacuum_fast_path_count > 0) &&
 		    (vacuum_handle->fast_path_count == 0))
 		{
 			full_vacuum_run = true;
 		}
-		cc = ctdb_vacuum_and_repack_db(ctdb_db, full_vacuum_run);
+		cc = ctdb_vacuum_and_repack_db(ctdb_db, full_vacuum_run,
+					       NULL);
 
 		sys_write(child_ctx->fd[1], &cc, 1);
 		_exit(0);
 	}
 
 	set_close_on_exec(child_ctx->fd[0]);
+	set_nonblocking(child_ctx->fd[0]);
 	close(child_ctx->fd[1]);
 
 	child_ctx->status = VACUUM_RUNNING;
@@ -1586,6 +1810,7 @@ int ctdb_vacuum_init(struct ctdb_db_context *ctdb_db)
 
 	ctdb_db->vacuum_handle->ctdb_db         = ctdb_db;
 	ctdb_db->vacuum_handle->fast_path_count = 0;
+	ctdb_db->vacuum_handle->traverse_key = tdb_null;
 
 	tevent_add_timer(ctdb_db->ctdb->ev, ctdb_db->vacuum_handle,
 			 timeval_current_ofs(get_vacuum_interval(ctdb_db), 0),
@@ -0,0 +1,91 @@
+#!/bin/bash
+
+test_info()
+{
+    cat <<EOF
+Run the ctdb_fetch_hot benchmark and check that hot records are detected.
+
+This doesn't test for performance regressions or similarly anything
+useful.  Only vague sanity checking of results is done.
+
+Prerequisites:
+
+* An active CTDB cluster with at least 2 active nodes.
+
+Steps:
+
+1. Verify that the status on all of the ctdb nodes is 'OK'.
+2. Set HotRecordMigrations to 10 on all nodes.
+3. Run ctdb_fetch_hot on all nodes with default options.
+4. Ensure that the number of locks per second is greater than 10.
+5. Ensure that at least one node has made records sticky.
+6. Ensure that the hot keys show up in the sampled hot keys of
+   'ctdb dbstatistics'.
+
+Expected results:
+
+* ctdb_fetch_hot runs without error, prints reasonable results and
+  the hot records are made sticky and reported as hot keys.
+EOF
+}
+
+. "${TEST_SCRIPTS_DIR}/integration.bash"
+
+ctdb_test_init "$@"
+
+set -e
+
+cluster_is_healthy
+
+# Reset configuration
+ctdb_restart_when_done
+
+try_command_on_node 0 "$CTDB listnodes"
+num_nodes=$(echo "$out" | wc -l)
+
+try_command_on_node all $CTDB setvar HotRecordMigrations 10
+
+echo "Running ctdb_fetch_hot on all $num_nodes nodes."
+try_command_on_node -v -p all $CTDB_TEST_WRAPPER $VALGRIND ctdb_fetch_hot -t 5
+
+pat='^(Locks:[[:digit:]]+|Hot keys: [[:digit:]]+ locks/sec over [[:digit:]]+ keys|Waiting for cluster[[:space:]]?)+$'
+sanity_check_output 1 "$pat" "$out"
+
+# Check the slowest node
+out_hot=$(echo "$out" | egrep '^Hot keys: ' | sort -n -k3 | head -n 1)
+
+# $out_hot should look like this:
+#    Hot keys: 1067 locks/sec over 4 keys
+stuff="${out_hot##*Hot keys: }"
+lps="${stuff% locks/sec*}"
+
+if [ $lps -ge 10 ] ; then
+    echo "OK: $lps locks/sec >= 10 locks/sec"
+else
+    echo "BAD: $lps locks/sec < 10 locks/sec"
+    exit 1
+fi
+
+try_command_on_node -v all "$CTDB statistics | grep total_sticky_records"
+
+sticky=$(echo "$out" | awk '{ n += $2 } END { print n }')
+if [ $sticky -gt 0 ] ; then
+    echo "OK: $sticky records made sticky"
+else
+    echo "BAD: no records made sticky"
+    exit 1
+fi
+
+try_command_on_node -v all "$CTDB dbstatistics fetch_hot.tdb"
+
+# Keys starting with "hotkey" (hex encoded) after "Sampled Hot Keys"
+hot=$(echo "$out" | awk '/Sampled Hot Keys:/ { s = 1 ; next }
+			  /DB Statistics:/ { s = 0 }
+			  s && /Key:686f746b6579/ { n++ }
+			  END { print n + 0 }')
+if [ $hot -gt 0 ] ; then
+    echo "OK: $hot sampled hot keys reported"
+else
+    echo "BAD: no sampled hot keys reported"
+    exit 1
+fi
@@ -14,10 +14,12 @@ Steps:
 1. Create a test database
 2. Add records on different nodes
 3. Run traverse
+4. Run a filtered traverse with a key prefix
 
 Expected results:
 
 * All records are retrieved.
+* Only the records matching the key prefix are retrieved.
 
 EOF
 }
@@ -70,4 +72,23 @@ else
 	status=1
 fi
 
+# Use small batches, so the matching records are sent in several batches
+try_command_on_node all $CTDB setvar RecBufferSizeLimit 1000
+
+# Keys key-0000 to key-00ff match the prefix
+prefix="key-00"
+num_prefix=256
+
+echo "Start a filtered traverse for key prefix \"$prefix\""
+try_command_on_node 0 $CTDB catdb $TESTDB $prefix
+
+num_read=$(echo "$out" | tail -n 1 | cut -d\  -f2)
+num_keys=$(echo "$out" | grep -c "^key(.*) = \"$prefix")
+if [ $num_read -eq $num_prefix -a $num_keys -eq $num_prefix ]; then
+	echo "GOOD: All $num_prefix records with prefix \"$prefix\" retrieved"
+else
+	echo "BAD: $num_read/$num_prefix records with prefix \"$prefix\" retrieved"
+	status=1
+fi
+
 exit $status
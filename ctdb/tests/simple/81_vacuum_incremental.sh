@@ -0,0 +1,130 @@
+#!/bin/bash
+
+test_info()
+{
+    cat <<EOF
+Verify that incremental vacuuming removes empty records spread over
+the whole database.
+
+With VacuumTraverseBudget set, every vacuuming run only traverses a
+few records and the next run continues where the previous one
+stopped.  Empty records stored directly into the local tdbs with
+"ctdb tstore" are not on the delete queue, only the traverse on node
+0, their dmaster, finds them.
+
+Prerequisites:
+
+* An active CTDB cluster with at least 2 active nodes.
+
+Steps:
+
+1. Set a small VacuumTraverseBudget and a short VacuumInterval
+2. Create a test database
+3. Store live records on node 0
+4. Store empty records with dmaster 0 on all nodes
+5. Wait until no node has an empty record left that it is the
+   dmaster of
+
+Expected results:
+
+* All empty records are vacuumed, although each run only traverses a
+  small part of the database.  This fails if every run starts over
+  from the beginning of the database.
+
+EOF
+}
+
+. "${TEST_SCRIPTS_DIR}/integration.bash"
+
+ctdb_test_init "$@"
+
+set -e
+
+cluster_is_healthy
+
+# Reset configuration
+ctdb_restart_when_done
+
+try_command_on_node 0 "$CTDB listnodes"
+num_nodes=$(echo "$out" | wc -l)
+
+budget=10
+
+try_command_on_node all $CTDB setvar VacuumTraverseBudget $budget
+try_command_on_node all $CTDB setvar VacuumInterval 1
+
+
+TESTDB="vacuum_incremental_test.tdb"
+
+echo "create test database $TESTDB"
+try_command_on_node 0 $CTDB attach $TESTDB
+
+echo "wipe test database $TESTDB"
+try_command_on_node 0 $CTDB wipedb $TESTDB
+
+# Vacuuming is already running, store the empty records last so
+# that most of them are behind the first few records of the traverse
+num_live=150
+num_empty=50
+
+echo "Store $num_live live records on node 0"
+i=0
+while [ $i -lt $num_live ]; do
+	db_ctdb_tstore 0 "$TESTDB" "live-$i" "value-$i"
+	i=$[ $i + 1 ]
+done
+
+# The lmaster of a record always has a copy pointing to the dmaster
+echo "Store $num_empty empty records with dmaster 0 on all nodes"
+i=0
+while [ $i -lt $num_empty ]; do
+	n=0
+	while [ $n -lt $num_nodes ]; do
+		db_ctdb_tstore $n "$TESTDB" "empty-$i" '""'
+		n=$[ $n + 1 ]
+	done
+	i=$[ $i + 1 ]
+done
+
+# Empty records on each node that the node is the dmaster of, the
+# traverse is responsible for those
+count_empty_records ()
+{
+    local num=0
+    local n
+    for n in $(seq 0 $(($num_nodes - 1))) ; do
+	try_command_on_node $n $CTDB cattdb $TESTDB
+	num=$(($num + $(echo "$out" |
+		awk -v pnn=$n '/^dmaster: / { dmaster = $2 }
+			       /^data\(0\) = / && dmaster == pnn { n++ }
+			       END { print n + 0 }')))
+    done
+    echo $num
+}
+
+no_empty_records ()
+{
+    local num_empty=$(count_empty_records)
+    echo -n "($num_empty)"
+    [ $num_empty -eq 0 ]
+}
+
+num_left=$(count_empty_records)
+echo "$num_left empty records on their dmaster"
+if [ $num_left -eq 0 ]; then
+	echo "BAD: no empty records to vacuum"
+	exit 1
+fi
+
+echo "Wait until all empty records are vacuumed"
+wait_until 120 no_empty_records
+
+echo "Check that the live records are still there"
+try_command_on_node 0 $CTDB catdb $TESTDB
+num_read=$(echo "$out" | tail -n 1 | cut -d\  -f2)
+if [ $num_read -eq $num_live ]; then
+	echo "GOOD: All $num_live live records retrieved"
+else
+	echo "BAD: Only $num_read/$num_live live records retrieved"
+	exit 1
+fi
@@ -53,6 +53,8 @@ static double end_timer(void)
 static int timelimit = 10;
 static int num_records = 10;
 static int num_nodes;
+static int num_msgs = 1;
+static int msg_size = sizeof(int);
 
 enum my_functions {FUNC_INCR=1, FUNC_FETCH=2};
 
@@ -117,16 +119,23 @@ static void ring_message_handler(uint64_t srvid, TDB_DATA data,
 
 static void send_start_messages(struct ctdb_context *ctdb, int incr)
 {
-	/* two messages are injected into the ring, moving
-	   in opposite directions */
-	int dest;
+	/* num_msgs messages are injected into the ring in each
+	   direction, so that there are many packets in flight */
+	int dest, i;
 	TDB_DATA data;
-		
-	data.dptr = (uint8_t *)&incr;
-	data.dsize = sizeof(incr);
+
+	data.dptr = talloc_zero_size(ctdb, msg_size);
+	if (data.dptr == NULL) {
+		return;
+	}
+	data.dsize = msg_size;
+	memcpy(data.dptr, &incr, sizeof(incr));
 
 	dest = (ctdb_get_pnn(ctdb) + num_nodes + incr) % num_nodes;
-	ctdb_client_send_message(ctdb, dest, 0, data);
+	for (i=0; i<num_msgs; i++) {
+		ctdb_client_send_message(ctdb, dest, 0, data);
+	}
+	talloc_free(data.dptr);
 }
 
 static void each_second(struct tevent_context *ev, struct tevent_timer *te,
@@ -208,6 +217,8 @@ int main(int argc, const char *argv[])
 		{ "timelimit", 't', POPT_ARG_INT, &timelimit, 0, "timelimit", "integer" },
 		{ "num-records", 'r', POPT_ARG_INT, &num_records, 0, "num_records", "integer" },
 		{ NULL, 'n', POPT_ARG_INT, &num_nodes, 0, "num_nodes", "integer" },
+		{ "num-msgs", 'm', POPT_ARG_INT, &num_msgs, 0, "messages in flight in each direction", "integer" },
+		{ "msg-size", 's', POPT_ARG_INT, &msg_size, 0, "message size", "integer" },
 		POPT_TABLEEND
 	};
 	int opt;
@@ -241,6 +252,11 @@ int main(int argc, const char *argv[])
 		exit(1);
 	}
 
+	if (num_msgs <= 0 || msg_size < (int)sizeof(int)) {
+		printf("Invalid number of messages or message size\n");
+		exit(1);
+	}
+
 	ev = tevent_context_init(NULL);
 
 	/* initialise ctdb */
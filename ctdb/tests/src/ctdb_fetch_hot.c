@@ -0,0 +1,184 @@
+/*
+   hot record benchmark
+
+   Run this on all nodes at the same time.  Every instance fetch_locks
+   and updates the same few records in a loop, so the records keep
+   migrating between the nodes.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "system/filesys.h"
+#include "system/network.h"
+
+#include <popt.h>
+#include <talloc.h>
+#include <tevent.h>
+#include <tdb.h>
+
+#include "lib/util/time.h"
+
+#include "ctdb_private.h"
+#include "ctdb_client.h"
+
+#include "common/cmdline.h"
+#include "common/common.h"
+
+static int timelimit = 10;
+static int num_keys = 4;
+static int lock_count = 0;
+static int total_count = 0;
+static int seconds = 0;
+
+static struct ctdb_db_context *ctdb_db;
+
+static void alarm_handler(int sig)
+{
+	printf("Locks:%d\n", lock_count);
+	total_count += lock_count;
+	lock_count = 0;
+	seconds++;
+
+	if (seconds >= timelimit) {
+		printf("Hot keys: %d locks/sec over %d keys\n",
+		       total_count / seconds, num_keys);
+		exit(0);
+	}
+	alarm(1);
+}
+
+/*
+	Lock and update the hot records one after the other
+*/
+static void bench_fetch_hot_loop(struct ctdb_context *ctdb)
+{
+	char keybuf[32];
+	TDB_DATA key, data;
+	uint32_t value;
+	int i = 0;
+
+	while (1) {
+		TALLOC_CTX *tmp_ctx = talloc_new(ctdb);
+		struct ctdb_record_handle *h;
+		int ret;
+
+		snprintf(keybuf, sizeof(keybuf), "hotkey%d", i % num_keys);
+		key.dptr = (uint8_t *)keybuf;
+		key.dsize = strlen(keybuf);
+		i++;
+
+		h = ctdb_fetch_lock(ctdb_db, tmp_ctx, key, &data);
+		if (h == NULL) {
+			printf("Failed to fetch record '%s' on node %d\n",
+			       keybuf, ctdb_get_pnn(ctdb));
+			talloc_free(tmp_ctx);
+			continue;
+		}
+
+		value = 0;
+		if (data.dsize == sizeof(value)) {
+			memcpy(&value, data.dptr, sizeof(value));
+		}
+		value++;
+
+		data.dptr = (uint8_t *)&value;
+		data.dsize = sizeof(value);
+
+		ret = ctdb_record_store(h, data);
+		if (ret != 0) {
+			printf("Failed to store record '%s' on node %d\n",
+			       keybuf, ctdb_get_pnn(ctdb));
+		}
+
+		talloc_free(tmp_ctx);
+		lock_count++;
+	}
+}
+
+/*
+  main program
+*/
+int main(int argc, const char *argv[])
+{
+	struct ctdb_context *ctdb;
+
+	struct poptOption popt_options[] = {
+		POPT_AUTOHELP
+		POPT_CTDB_CMDLINE
+		{ "timelimit", 't', POPT_ARG_INT, &timelimit, 0, "timelimit", "integer" },
+		{ "num-keys", 'k', POPT_ARG_INT, &num_keys, 0, "number of hot keys", "integer" },
+		POPT_TABLEEND
+	};
+	int opt;
+	const char **extra_argv;
+	int extra_argc = 0;
+	poptContext pc;
+	struct tevent_context *ev;
+
+	pc = poptGetContext(argv[0], argc, argv, popt_options, POPT_CONTEXT_KEEP_FIRST);
+
+	while ((opt = poptGetNextOpt(pc)) != -1) {
+		switch (opt) {
+		default:
+			fprintf(stderr, "Invalid option %s: %s\n",
+				poptBadOption(pc, 0), poptStrerror(opt));
+			exit(1);
+		}
+	}
+
+	/* setup the remaining options for the main program to use */
+	extra_argv = poptGetArgs(pc);
+	if (extra_argv) {
+		extra_argv++;
+		while (extra_argv[extra_argc]) extra_argc++;
+	}
+
+	if (timelimit <= 0 || num_keys <= 0) {
+		printf("timelimit and num-keys must be positive\n");
+		exit(1);
+	}
+
+	ev = tevent_context_init(NULL);
+
+	ctdb = ctdb_cmdline_client(ev, timeval_current_ofs(3, 0));
+
+	if (ctdb == NULL) {
+		printf("failed to connect to ctdb daemon.\n");
+		exit(1);
+	}
+
+	/* attach to a specific database */
+	ctdb_db = ctdb_attach(ctdb, timeval_current_ofs(2, 0), "fetch_hot.tdb",
+			      false, 0);
+	if (!ctdb_db) {
+		printf("ctdb_attach failed - %s\n", ctdb_errstr(ctdb));
+		exit(1);
+	}
+
+	printf("Waiting for cluster\n");
+	while (1) {
+		uint32_t recmode=1;
+		ctdb_ctrl_getrecmode(ctdb, ctdb, timeval_zero(), CTDB_CURRENT_NODE, &recmode);
+		if (recmode == 0) break;
+		tevent_loop_once(ev);
+	}
+
+	signal(SIGALRM, alarm_handler);
+	alarm(1);
+
+	bench_fetch_hot_loop(ctdb);
+
+	return 0;
+}
@@ -605,6 +605,54 @@ static void ctdb_test_ipalloc(const char nodestates[],
 	talloc_free(ctdb);
 }
 
+/* IP layout is read from stdin.  Run ipalloc() count times from the
+ * same starting layout and report the time taken.  Set
+ * CTDB_TEST_LOGLEVEL=0, otherwise the time is mostly spent logging.
+ */
+static void ctdb_test_ipalloc_bench(const char nodestates[], int count)
+{
+	struct ctdb_context *ctdb;
+	struct ipalloc_state *ipalloc_state;
+	struct public_ip_list *t;
+	uint32_t *pnns;
+	struct timeval start;
+	double elapsed;
+	int i, numips;
+
+	if (count < 1) {
+		count = 1;
+	}
+
+	ctdb_test_init(nodestates, &ctdb, &ipalloc_state, false);
+
+	numips = 0;
+	for (t = ipalloc_state->all_ips; t != NULL; t = t->next) {
+		numips++;
+	}
+
+	pnns = talloc_array(ctdb, uint32_t, numips);
+	for (i = 0, t = ipalloc_state->all_ips; t != NULL; t = t->next, i++) {
+		pnns[i] = t->pnn;
+	}
+
+	start = timeval_current();
+	for (i = 0; i < count; i++) {
+		int j;
+
+		for (j = 0, t = ipalloc_state->all_ips; t != NULL;
+		     t = t->next, j++) {
+			t->pnn = pnns[j];
+		}
+		ipalloc(ipalloc_state);
+	}
+	elapsed = timeval_elapsed(&start);
+
+	printf("%u nodes, %d addresses: %.6f seconds per run\n",
+	       ipalloc_state->num, numips, elapsed / count);
+
+	talloc_free(ctdb);
+}
+
 static void usage(void)
 {
 	fprintf(stderr, "usage: ctdb_takeover_tests <op>\n");
@@ -645,6 +693,10 @@ int main(int argc, const char *argv[])
 		   strcmp(argv[1], "ipalloc") == 0 &&
 		   strcmp(argv[3], "multi") == 0) {
 		ctdb_test_ipalloc(argv[2], true);
+	} else if (argc >= 3 && argc <= 4 &&
+		   strcmp(argv[1], "ipalloc_bench") == 0) {
+		ctdb_test_ipalloc_bench(argv[2],
+					argc == 4 ? atoi(argv[3]) : 1);
 	} else {
 		usage();
 	}
@@ -656,6 +656,48 @@ static void fill_ctdb_req_control_data(TALLOC_CTX *mem_ctx,
 	case CTDB_CONTROL_DB_TRANSACTION_CANCEL:
 		cd->data.db_id = rand32();
 		break;
+
+	case CTDB_CONTROL_DB_PULL:
+		cd->data.pulldb_ext = talloc(mem_ctx, struct ctdb_pulldb_ext);
+		assert(cd->data.pulldb_ext != NULL);
+		fill_ctdb_pulldb_ext(mem_ctx, cd->data.pulldb_ext);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_START:
+		cd->data.pulldb_ext = talloc(mem_ctx, struct ctdb_pulldb_ext);
+		assert(cd->data.pulldb_ext != NULL);
+		fill_ctdb_pulldb_ext(mem_ctx, cd->data.pulldb_ext);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		cd->data.db_id = rand32();
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		cd->data.db_id = rand32();
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		cd->data.traverse_start_filter = talloc(mem_ctx, struct ctdb_traverse_start_filter);
+		assert(cd->data.traverse_start_filter != NULL);
+		fill_ctdb_traverse_start_filter(mem_ctx, cd->data.traverse_start_filter);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		cd->data.traverse_all_filter = talloc(mem_ctx, struct ctdb_traverse_all_filter);
+		assert(cd->data.traverse_all_filter != NULL);
+		fill_ctdb_traverse_all_filter(mem_ctx, cd->data.traverse_all_filter);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		cd->data.recbuf = talloc(mem_ctx, struct ctdb_rec_buffer);
+		assert(cd->data.recbuf != NULL);
+		fill_ctdb_rec_buffer(mem_ctx, cd->data.recbuf);
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		cd->data.db_id = rand32();
+		break;
 	}
 }
 
@@ -1103,6 +1145,42 @@ static void verify_ctdb_req_control_data(struct ctdb_req_control_data *cd,
 	case CTDB_CONTROL_DB_TRANSACTION_CANCEL:
 		assert(cd->data.db_id == cd2->data.db_id);
 		break;
+
+	case CTDB_CONTROL_DB_PULL:
+		verify_ctdb_pulldb_ext(cd->data.pulldb_ext,
+				       cd2->data.pulldb_ext);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_START:
+		verify_ctdb_pulldb_ext(cd->data.pulldb_ext,
+				       cd2->data.pulldb_ext);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		assert(cd->data.db_id == cd2->data.db_id);
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		assert(cd->data.db_id == cd2->data.db_id);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		verify_ctdb_traverse_start_filter(cd->data.traverse_start_filter,
+						  cd2->data.traverse_start_filter);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		verify_ctdb_traverse_all_filter(cd->data.traverse_all_filter,
+						cd2->data.traverse_all_filter);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		verify_ctdb_rec_buffer(cd->data.recbuf, cd2->data.recbuf);
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		assert(cd->data.db_id == cd2->data.db_id);
+		break;
 	}
 }
 
@@ -1559,6 +1637,33 @@ static void fill_ctdb_reply_control_data(TALLOC_CTX *mem_ctx,
 		fill_ctdb_node_map(mem_ctx, cd->data.nodemap);
 		break;
 
+	case CTDB_CONTROL_DB_PULL:
+		cd->data.num_records = rand32();
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		cd->data.num_records = rand32();
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		cd->data.tdb_flags = rand32();
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		cd->data.dbhist = talloc(mem_ctx, struct ctdb_db_histograms);
+		assert(cd->data.dbhist != NULL);
+		fill_ctdb_db_histograms(mem_ctx, cd->data.dbhist);
+		break;
+
 	}
 }
 
@@ -1942,6 +2047,31 @@ static void verify_ctdb_reply_control_data(struct ctdb_reply_control_data *cd,
 		verify_ctdb_node_map(cd->data.nodemap, cd2->data.nodemap);
 		break;
 
+	case CTDB_CONTROL_DB_PULL:
+		assert(cd->data.num_records == cd2->data.num_records);
+		break;
+
+	case CTDB_CONTROL_DB_PUSH_CONFIRM:
+		assert(cd->data.num_records == cd2->data.num_records);
+		break;
+
+	case CTDB_CONTROL_DB_OPEN_FLAGS:
+		assert(cd->data.tdb_flags == cd2->data.tdb_flags);
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_START_FILTER:
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_ALL_FILTER:
+		break;
+
+	case CTDB_CONTROL_TRAVERSE_DATA_BATCH:
+		break;
+
+	case CTDB_CONTROL_GET_DB_HISTOGRAMS:
+		verify_ctdb_db_histograms(cd->data.dbhist, cd2->data.dbhist);
+		break;
+
 	}
 }
 
@@ -2161,7 +2291,7 @@ static void test_reply_dmaster_test(void)
 	talloc_free(mem_ctx);
 }
 
-#define NUM_CONTROLS	146
+#define NUM_CONTROLS	154
 
 static void test_req_control_data_test(void)
 {
@@ -182,6 +182,22 @@ static void verify_ctdb_pulldb(struct ctdb_pulldb *p1, struct ctdb_pulldb *p2)
 	assert(p1->lmaster == p2->lmaster);
 }
 
+static void fill_ctdb_pulldb_ext(TALLOC_CTX *mem_ctx,
+				 struct ctdb_pulldb_ext *p)
+{
+	p->db_id = rand32();
+	p->lmaster = rand32();
+	p->srvid = rand64();
+}
+
+static void verify_ctdb_pulldb_ext(struct ctdb_pulldb_ext *p1,
+				   struct ctdb_pulldb_ext *p2)
+{
+	assert(p1->db_id == p2->db_id);
+	assert(p1->lmaster == p2->lmaster);
+	assert(p1->srvid == p2->srvid);
+}
+
 static void fill_ctdb_ltdb_header(TALLOC_CTX *mem_ctx,
 				  struct ctdb_ltdb_header *p)
 {
@@ -331,6 +347,70 @@ static void verify_ctdb_traverse_all_ext(struct ctdb_traverse_all_ext *p1,
 	assert(p1->withemptyrecords == p2->withemptyrecords);
 }
 
+static void fill_ctdb_traverse_filter(TALLOC_CTX *mem_ctx,
+				      struct ctdb_traverse_filter *p)
+{
+	p->flags_mask = rand32();
+	p->flags_value = rand32();
+	p->prefix_len = rand_int(CTDB_TRAVERSE_FILTER_PREFIX_MAX);
+	fill_buffer(p->prefix, sizeof(p->prefix));
+}
+
+static void verify_ctdb_traverse_filter(struct ctdb_traverse_filter *p1,
+					struct ctdb_traverse_filter *p2)
+{
+	assert(p1->flags_mask == p2->flags_mask);
+	assert(p1->flags_value == p2->flags_value);
+	assert(p1->prefix_len == p2->prefix_len);
+	verify_buffer(p1->prefix, p2->prefix, sizeof(p1->prefix));
+}
+
+static void fill_ctdb_traverse_start_filter(TALLOC_CTX *mem_ctx,
+					    struct ctdb_traverse_start_filter *p)
+{
+	p->db_id = rand32();
+	p->reqid = rand32();
+	p->srvid = rand64();
+	p->withemptyrecords = rand_int(2);
+	fill_ctdb_traverse_filter(mem_ctx, &p->filter);
+}
+
+static void verify_ctdb_traverse_start_filter(
+				struct ctdb_traverse_start_filter *p1,
+				struct ctdb_traverse_start_filter *p2)
+{
+	assert(p1->db_id == p2->db_id);
+	assert(p1->reqid == p2->reqid);
+	assert(p1->srvid == p2->srvid);
+	assert(p1->withemptyrecords == p2->withemptyrecords);
+	verify_ctdb_traverse_filter(&p1->filter, &p2->filter);
+}
+
+static void fill_ctdb_traverse_all_filter(TALLOC_CTX *mem_ctx,
+					  struct ctdb_traverse_all_filter *p)
+{
+	p->db_id = rand32();
+	p->reqid = rand32();
+	p->pnn = rand32();
+	p->client_reqid = rand32();
+	p->srvid = rand64();
+	p->withemptyrecords = rand_int(2);
+	fill_ctdb_traverse_filter(mem_ctx, &p->filter);
+}
+
+static void verify_ctdb_traverse_all_filter(
+				struct ctdb_traverse_all_filter *p1,
+				struct ctdb_traverse_all_filter *p2)
+{
+	assert(p1->db_id == p2->db_id);
+	assert(p1->reqid == p2->reqid);
+	assert(p1->pnn == p2->pnn);
+	assert(p1->client_reqid == p2->client_reqid);
+	assert(p1->srvid == p2->srvid);
+	assert(p1->withemptyrecords == p2->withemptyrecords);
+	verify_ctdb_traverse_filter(&p1->filter, &p2->filter);
+}
+
 static void fill_ctdb_sock_addr(TALLOC_CTX *mem_ctx, ctdb_sock_addr *p)
 {
 	if (rand_int(2) == 0) {
@@ -918,6 +998,33 @@ static void verify_ctdb_db_statistics(struct ctdb_db_statistics *p1,
 	}
 }
 
+static void fill_ctdb_db_histograms(TALLOC_CTX *mem_ctx,
+				    struct ctdb_db_histograms *p)
+{
+	int i;
+
+	fill_buffer(p, offsetof(struct ctdb_db_histograms, num_hot_keys));
+	p->num_hot_keys = rand_int(MAX_HOT_KEYS+1);
+	for (i=0; i<p->num_hot_keys; i++) {
+		p->hot_keys[i].count = rand32();
+		fill_tdb_data(mem_ctx, &p->hot_keys[i].key);
+	}
+}
+
+static void verify_ctdb_db_histograms(struct ctdb_db_histograms *p1,
+				      struct ctdb_db_histograms *p2)
+{
+	int i;
+
+	verify_buffer(p1, p2, offsetof(struct ctdb_db_histograms,
+				       num_hot_keys));
+	assert(p1->num_hot_keys == p2->num_hot_keys);
+	for (i=0; i<p1->num_hot_keys; i++) {
+		assert(p1->hot_keys[i].count == p2->hot_keys[i].count);
+		verify_tdb_data(&p1->hot_keys[i].key, &p2->hot_keys[i].key);
+	}
+}
+
 #ifndef PROTOCOL_TEST
 
 static void fill_ctdb_election_message(TALLOC_CTX *mem_ctx,
@@ -1177,12 +1284,15 @@ DEFINE_TEST(struct ctdb_statistics, ctdb_statistics);
 DEFINE_TEST(struct ctdb_vnn_map, ctdb_vnn_map);
 DEFINE_TEST(struct ctdb_dbid_map, ctdb_dbid_map);
 DEFINE_TEST(struct ctdb_pulldb, ctdb_pulldb);
+DEFINE_TEST(struct ctdb_pulldb_ext, ctdb_pulldb_ext);
 DEFINE_TEST(struct ctdb_rec_data, ctdb_rec_data);
 DEFINE_TEST(struct ctdb_rec_buffer, ctdb_rec_buffer);
 DEFINE_TEST(struct ctdb_traverse_start, ctdb_traverse_start);
 DEFINE_TEST(struct ctdb_traverse_all, ctdb_traverse_all);
 DEFINE_TEST(struct ctdb_traverse_start_ext, ctdb_traverse_start_ext);
 DEFINE_TEST(struct ctdb_traverse_all_ext, ctdb_traverse_all_ext);
+DEFINE_TEST(struct ctdb_traverse_start_filter, ctdb_traverse_start_filter);
+DEFINE_TEST(struct ctdb_traverse_all_filter, ctdb_traverse_all_filter);
 DEFINE_TEST(ctdb_sock_addr, ctdb_sock_addr);
 DEFINE_TEST(struct ctdb_connection, ctdb_connection);
 DEFINE_TEST(struct ctdb_tunable, ctdb_tunable);
@@ -1213,6 +1323,7 @@ DEFINE_TEST(struct ctdb_key_data, ctdb_key_data);
 DEFINE_TEST(struct ctdb_uint8_array, ctdb_uint8_array);
 DEFINE_TEST(struct ctdb_uint64_array, ctdb_uint64_array);
 DEFINE_TEST(struct ctdb_db_statistics, ctdb_db_statistics);
+DEFINE_TEST(struct ctdb_db_histograms, ctdb_db_histograms);
 DEFINE_TEST(struct ctdb_election_message, ctdb_election_message);
 DEFINE_TEST(struct ctdb_srvid_message, ctdb_srvid_message);
 DEFINE_TEST(struct ctdb_disable_message, ctdb_disable_message);
@@ -1240,12 +1351,15 @@ int main(int argc, char *argv[])
 	TEST_FUNC(ctdb_vnn_map)();
 	TEST_FUNC(ctdb_dbid_map)();
 	TEST_FUNC(ctdb_pulldb)();
+	TEST_FUNC(ctdb_pulldb_ext)();
 	TEST_FUNC(ctdb_rec_data)();
 	TEST_FUNC(ctdb_rec_buffer)();
 	TEST_FUNC(ctdb_traverse_start)();
 	TEST_FUNC(ctdb_traverse_all)();
 	TEST_FUNC(ctdb_traverse_start_ext)();
 	TEST_FUNC(ctdb_traverse_all_ext)();
+	TEST_FUNC(ctdb_traverse_start_filter)();
+	TEST_FUNC(ctdb_traverse_all_filter)();
 	TEST_FUNC(ctdb_sock_addr)();
 	TEST_FUNC(ctdb_connection)();
 	TEST_FUNC(ctdb_tunable)();
@@ -1276,6 +1390,7 @@ int main(int argc, char *argv[])
 	TEST_FUNC(ctdb_uint8_array)();
 	TEST_FUNC(ctdb_uint64_array)();
 	TEST_FUNC(ctdb_db_statistics)();
+	TEST_FUNC(ctdb_db_histograms)();
 	TEST_FUNC(ctdb_election_message)();
 	TEST_FUNC(ctdb_srvid_message)();
 	TEST_FUNC(ctdb_disable_message)();
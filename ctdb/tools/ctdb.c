@@ -452,6 +452,86 @@ static int control_process_exists(struct ctdb_context *ctdb, int argc, const cha
 /*
   display statistics structure
  */
+/*
+ * Labels of the latency buckets, see ctdb_latency_bucket_id() in ctdbd
+ */
+static const char * const latency_bucket_labels[MAX_COUNT_BUCKETS] = {
+	"< 100us", "< 250us", "< 500us", "< 1ms", "< 5ms", "< 10ms",
+	"< 50ms", "< 100ms", "< 500ms", "< 1s", "< 2s", "< 4s", "< 8s",
+	"< 16s", "< 64s", ">= 64s",
+};
+
+static void show_lock_buckets(const uint32_t *buckets)
+{
+	int i;
+
+	printf(" %s", "lock_buckets:");
+	for (i=0; i<MAX_COUNT_BUCKETS; i++) {
+		printf(" %d", buckets[i]);
+	}
+	printf("\n");
+	printf(" %s\n", "lock_latency_histogram");
+	for (i=0; i<MAX_COUNT_BUCKETS; i++) {
+		printf(" %*s%-22s%*s%10u\n", 4, "", latency_bucket_labels[i], 0, "",
+		       buckets[i]);
+	}
+}
+
+/*
+ * The bucket holding the given fraction of the samples, -1 if empty
+ */
+static int latency_bucket_percentile(const uint32_t *buckets, double frac)
+{
+	uint64_t total = 0, sum = 0;
+	int i;
+
+	for (i=0; i<MAX_COUNT_BUCKETS; i++) {
+		total += buckets[i];
+	}
+	if (total == 0) {
+		return -1;
+	}
+
+	for (i=0; i<MAX_COUNT_BUCKETS-1; i++) {
+		sum += buckets[i];
+		if (sum >= frac * total) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static void show_latency_buckets(const char *name, const uint32_t *buckets)
+{
+	int i;
+
+	printf(" %s_buckets:", name);
+	for (i=0; i<MAX_COUNT_BUCKETS; i++) {
+		printf(" %u", buckets[i]);
+	}
+	printf("\n");
+}
+
+static void show_latency_percentiles(const char *name,
+				     const uint32_t *buckets)
+{
+	char title[32];
+	int p50, p99, p999;
+
+	p50 = latency_bucket_percentile(buckets, 0.5);
+	if (p50 == -1) {
+		return;
+	}
+	p99 = latency_bucket_percentile(buckets, 0.99);
+	p999 = latency_bucket_percentile(buckets, 0.999);
+
+	snprintf(title, sizeof(title), "%s_latency", name);
+	printf(" %-18s %-11s     %s/%s/%s\n", title, "P50/P99/P99.9",
+	       latency_bucket_labels[p50], latency_bucket_labels[p99],
+	       latency_bucket_labels[p999]);
+}
+
 static void show_statistics(struct ctdb_statistics *s, int show_header)
 {
 	TALLOC_CTX *tmp_ctx = talloc_new(NULL);
@@ -500,6 +580,8 @@ static void show_statistics(struct ctdb_statistics *s, int show_header)
 		STATISTICS_FIELD(max_hop_count),
 		STATISTICS_FIELD(total_ro_delegations),
 		STATISTICS_FIELD(total_ro_revokes),
+		STATISTICS_FIELD(total_sticky_records),
+		STATISTICS_FIELD(total_pindown_deferrals),
 	};
 	
 	tmp = s->statistics_current_time.tv_sec - s->statistics_start_time.tv_sec;
@@ -597,11 +679,7 @@ static void show_statistics(struct ctdb_statistics *s, int show_header)
 			printf(" %d", s->hop_count_bucket[i]);
 		}
 		printf("\n");
-		printf(" lock_buckets:");
-		for (i=0; i<MAX_COUNT_BUCKETS; i++) {
-			printf(" %d", s->locks.buckets[i]);
-		}
-		printf("\n");
+		show_lock_buckets(s->locks.buckets);
 		printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n", "locks_latency      MIN/AVG/MAX", s->locks.latency.min, s->locks.latency.num?s->locks.latency.total/s->locks.latency.num:0.0, s->locks.latency.max, s->locks.latency.num);
 
 		printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n", "reclock_ctdbd      MIN/AVG/MAX", s->reclock.ctdbd.min, s->reclock.ctdbd.num?s->reclock.ctdbd.total/s->reclock.ctdbd.num:0.0, s->reclock.ctdbd.max, s->reclock.ctdbd.num);
@@ -734,6 +812,7 @@ static int control_dbstatistics(struct ctdb_context *ctdb, int argc, const char
 {
 	TALLOC_CTX *tmp_ctx = talloc_new(ctdb);
 	struct ctdb_db_statistics_old *dbstat;
+	struct ctdb_db_histograms *dbhist;
 	int i;
 	uint32_t db_id;
 	int num_hot_keys;
@@ -773,11 +852,7 @@ static int control_dbstatistics(struct ctdb_context *ctdb, int argc, const char
 		printf(" %d", dbstat->hop_count_bucket[i]);
 	}
 	printf("\n");
-	printf(" %s", "lock_buckets:");
-	for (i=0; i<MAX_COUNT_BUCKETS; i++) {
-		printf(" %d", dbstat->locks.buckets[i]);
-	}
-	printf("\n");
+	show_lock_buckets(dbstat->locks.buckets);
 	printf(" %-30s     %.6f/%.6f/%.6f sec out of %d\n",
 		"locks_latency      MIN/AVG/MAX",
 		dbstat->locks.latency.min,
@@ -812,6 +887,33 @@ static int control_dbstatistics(struct ctdb_context *ctdb, int argc, const char
 		printf("\n");
 	}
 
+	/* Older nodes don't have the histograms */
+	ret = ctdb_ctrl_dbhistograms(ctdb, options.pnn, db_id, tmp_ctx, &dbhist);
+	if (ret != 0) {
+		talloc_free(tmp_ctx);
+		return 0;
+	}
+
+	show_latency_buckets("call", dbhist->call);
+	show_latency_percentiles("call", dbhist->call);
+	show_latency_buckets("migrate", dbhist->migrate);
+	show_latency_percentiles("migrate", dbhist->migrate);
+	/* lock_buckets are part of the db statistics */
+	show_latency_percentiles("lock", dbhist->lock);
+	show_latency_buckets("vacuum", dbhist->vacuum);
+	show_latency_percentiles("vacuum", dbhist->vacuum);
+
+	printf(" Sampled Hot Keys: %u (%u samples, 1 in %u requests)\n",
+	       dbhist->num_hot_keys, dbhist->num_samples, dbhist->sample_rate);
+	for (i = 0; i < dbhist->num_hot_keys; i++) {
+		int j;
+		printf("     Count:%u Key:", dbhist->hot_keys[i].count);
+		for (j = 0; j < dbhist->hot_keys[i].key.dsize; j++) {
+			printf("%02x", dbhist->hot_keys[i].key.dptr[j]&0xff);
+		}
+		printf("\n");
+	}
+
 	talloc_free(tmp_ctx);
 	return 0;
 }
@@ -3797,8 +3899,26 @@ static int control_catdb(struct ctdb_context *ctdb, int argc, const char **argv)
 	c.printhash = (bool)options.printhash;
 	c.printrecordflags = (bool)options.printrecordflags;
 
-	/* traverse and dump the cluster tdb */
-	ret = ctdb_dump_db(ctdb_db, &c);
+	if (argc > 1) {
+		/* only dump the records with the given key prefix */
+		struct ctdb_traverse_filter filter;
+		size_t len = strlen(argv[1]);
+
+		if (len > CTDB_TRAVERSE_FILTER_PREFIX_MAX) {
+			DEBUG(DEBUG_ERR, ("Key prefix too long, at most %d bytes\n",
+					  CTDB_TRAVERSE_FILTER_PREFIX_MAX));
+			return -1;
+		}
+
+		ZERO_STRUCT(filter);
+		filter.prefix_len = len;
+		memcpy(filter.prefix, argv[1], len);
+
+		ret = ctdb_dump_db_filter(ctdb_db, &filter, &c);
+	} else {
+		/* traverse and dump the cluster tdb */
+		ret = ctdb_dump_db(ctdb_db, &c);
+	}
 	if (ret == -1) {
 		DEBUG(DEBUG_ERR, ("Unable to dump database\n"));
 		DEBUG(DEBUG_ERR, ("Maybe try 'ctdb getdbstatus %s'"
@@ -6501,7 +6621,7 @@ static const struct {
 	{ "process-exists",  control_process_exists,    true,	false,  "check if a process exists on a node",  "<pid>"},
 	{ "getdbmap",        control_getdbmap,          true,	false,  "show the database map" },
 	{ "getdbstatus",     control_getdbstatus,       true,	false,  "show the status of a database", "<dbname|dbid>" },
-	{ "catdb",           control_catdb,             true,	false,  "dump a ctdb database" ,                     "<dbname|dbid>"},
+	{ "catdb",           control_catdb,             true,	false,  "dump a ctdb database" ,                     "<dbname|dbid> [<key-prefix>]"},
 	{ "cattdb",          control_cattdb,            true,	false,  "dump a local tdb database" ,                     "<dbname|dbid>"},
 	{ "getmonmode",      control_getmonmode,        true,	false,  "show monitoring mode" },
 	{ "getcapabilities", control_getcapabilities,   true,	false,  "show node capabilities" },
@@ -19,6 +19,13 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+size_t ascii_run_copy(const uint8_t *src, size_t srclen,
+		      uint8_t *dst, size_t dstlen);
+size_t ascii_run_to_utf16le(const uint8_t *src, size_t srclen,
+			    uint8_t *dst, size_t dstlen);
+size_t utf16le_run_to_ascii(const uint8_t *src, size_t srclen,
+			    uint8_t *dst, size_t dstlen);
+
 size_t weird_push(void *cd, const char **inbuf, size_t *inbytesleft,
 		  char **outbuf, size_t *outbytesleft);
 size_t weird_pull(void *cd, const char **inbuf, size_t *inbytesleft,
@@ -16497,6 +16497,7 @@ struct smb_iconv_handle {
 	const char *dos_charset;
 	const char *display_charset;
 	bool use_builtin_handlers;
+	bool unix_is_builtin_utf8;
 	smb_iconv_t conv_handles[NUM_CHARSETS][NUM_CHARSETS];
 };
 
@@ -16601,6 +16602,9 @@ _PUBLIC_ struct smb_iconv_handle *smb_iconv_handle_reinit(TALLOC_CTX *mem_ctx,
 	ret->dos_charset = talloc_strdup(ret->child_ctx, dos_charset);
 	ret->unix_charset = talloc_strdup(ret->child_ctx, unix_charset);
 	ret->use_builtin_handlers = use_builtin_handlers;
+	ret->unix_is_builtin_utf8 = use_builtin_handlers &&
+		((strcasecmp(unix_charset, "UTF8") == 0) ||
+		 (strcasecmp(unix_charset, "UTF-8") == 0));
 
 	return ret;
 }
@@ -16673,6 +16677,29 @@ _PUBLIC_ codepoint_t next_codepoint_handle_ext(
 		return (codepoint_t)str[0];
 	}
 
+	if (((src_charset == CH_UTF8) && ic->use_builtin_handlers) ||
+	    ((src_charset == CH_UNIX) && ic->unix_is_builtin_utf8)) {
+		const uint8_t *c = (const uint8_t *)str;
+
+		/*
+		 * Decode 2 and 3 byte sequences directly, the same way
+		 * the builtin UTF-8 converter does. Everything else
+		 * takes the way through smb_iconv().
+		 */
+		if (((c[0] & 0xe0) == 0xc0) && ((c[1] & 0xc0) == 0x80)) {
+			*bytes_consumed = 2;
+			return ((codepoint_t)(c[0] & 0x1f) << 6) |
+				(c[1] & 0x3f);
+		}
+		if (((c[0] & 0xf0) == 0xe0) && ((c[1] & 0xc0) == 0x80) &&
+		    ((c[2] & 0xc0) == 0x80)) {
+			*bytes_consumed = 3;
+			return ((codepoint_t)(c[0] & 0x0f) << 12) |
+				((codepoint_t)(c[1] & 0x3f) << 6) |
+				(c[2] & 0x3f);
+		}
+	}
+
 	/*
 	 * we assume that no multi-byte character can take more than 5 bytes.
 	 * This is OK as we only support codepoints up to 1M (U+100000)
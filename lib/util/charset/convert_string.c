@@ -23,6 +23,7 @@
 */
 #include "includes.h"
 #include "system/iconv.h"
+#include "charset_proto.h"
 
 /**
  * @file
@@ -139,6 +140,15 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 		unsigned char lastp = '\0';
 		size_t retval = 0;
 
+		if (slen != (size_t)-1) {
+			/* Long runs of ascii go 8 characters at a time */
+			retval = ascii_run_copy(p, slen, q, dlen);
+			p += retval;
+			q += retval;
+			slen -= retval;
+			dlen -= retval;
+		}
+
 		/* If all characters are ascii, fast path here. */
 		while (slen && dlen) {
 			if ((lastp = *p) <= 0x7f) {
@@ -195,6 +205,13 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 			}
 			if (lastp != 0) goto slow_path;
 		} else {
+			/* Long runs of ascii go 8 characters at a time */
+			retval = utf16le_run_to_ascii(p, slen, q, dlen);
+			p += 2*retval;
+			q += retval;
+			slen -= 2*retval;
+			dlen -= retval;
+
 			while (slen >= 2 && dlen &&
 			       (*p <= 0x7f) && (p[1] == 0)) {
 				*q++ = *p;
@@ -238,6 +255,16 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 		size_t dlen = destlen;
 		unsigned char lastp = '\0';
 
+		if (slen != (size_t)-1) {
+			/* Long runs of ascii go 8 characters at a time */
+			size_t n = ascii_run_to_utf16le(p, slen, q, dlen);
+			p += n;
+			q += 2*n;
+			slen -= n;
+			dlen -= 2*n;
+			retval = 2*n;
+		}
+
 		/* If all characters are ascii, fast path here. */
 		while (slen && (dlen >= 1)) {
 			if (dlen >=2 && (lastp = *p) <= 0x7F) {
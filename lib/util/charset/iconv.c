@@ -580,6 +580,115 @@ static size_t iconv_copy(void *cd, const char **inbuf, size_t *inbytesleft,
 	return 0;
 }
 
+/*
+  Runs of ASCII characters are converted 8 characters at a time: One
+  64 bit load tells whether all of them are in the range 0x01-0x7f,
+  which is then a plain widening or narrowing copy. The chunk with the
+  terminating nul or the first non-ASCII character is left to the
+  caller.
+*/
+
+#define ASCII_RUN_ONES UINT64_C(0x0101010101010101)
+#define ASCII_RUN_HIGH UINT64_C(0x8080808080808080)
+
+static inline bool ascii_run_nonzero8(uint64_t w)
+{
+	/* no byte has the high bit set, no byte is 0 */
+	return ((w | ((w - ASCII_RUN_ONES) & ~w)) & ASCII_RUN_HIGH) == 0;
+}
+
+size_t ascii_run_copy(const uint8_t *src, size_t srclen,
+		      uint8_t *dst, size_t dstlen)
+{
+	size_t n = 0;
+
+	while ((srclen - n >= 8) && (dstlen - n >= 8)) {
+		uint64_t w;
+
+		memcpy(&w, src + n, 8);
+		if (!ascii_run_nonzero8(w)) {
+			break;
+		}
+		memcpy(dst + n, &w, 8);
+		n += 8;
+	}
+
+	return n;
+}
+
+static inline size_t pull_ascii_run(const uint8_t *src, size_t srclen,
+				    uint8_t *dst, size_t dstlen)
+{
+	size_t n = 0;
+
+	while ((srclen - n >= 8) && (dstlen - 2*n >= 16)) {
+		uint64_t w;
+		int i;
+
+		memcpy(&w, src + n, 8);
+		if (!ascii_run_nonzero8(w)) {
+			break;
+		}
+		for (i=0; i<8; i++) {
+			dst[2*(n+i)] = src[n+i];
+			dst[2*(n+i)+1] = 0;
+		}
+		n += 8;
+	}
+
+	return n;
+}
+
+static inline size_t push_ascii_run(const uint8_t *src, size_t srclen,
+				    uint8_t *dst, size_t dstlen)
+{
+	static const uint8_t high_bytes[8] = {
+		0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff
+	};
+	const uint64_t lanes_ones = UINT64_C(0x0001000100010001);
+	const uint64_t lanes_high = UINT64_C(0x8000800080008000);
+	uint64_t high;
+	size_t n = 0;
+
+	memcpy(&high, high_bytes, 8);
+
+	while ((srclen - 2*n >= 16) && (dstlen - n >= 8)) {
+		uint64_t w1, w2;
+		int i;
+
+		memcpy(&w1, src + 2*n, 8);
+		memcpy(&w2, src + 2*n + 8, 8);
+
+		/* all characters below 0x80 */
+		if (((w1 | w2) & high) != 0) {
+			break;
+		}
+		/* no character is 0 */
+		if ((((w1 - lanes_ones) & ~w1) |
+		     ((w2 - lanes_ones) & ~w2)) & lanes_high) {
+			break;
+		}
+		for (i=0; i<8; i++) {
+			dst[n+i] = src[2*(n+i)];
+		}
+		n += 8;
+	}
+
+	return n;
+}
+
+size_t ascii_run_to_utf16le(const uint8_t *src, size_t srclen,
+			    uint8_t *dst, size_t dstlen)
+{
+	return pull_ascii_run(src, srclen, dst, dstlen);
+}
+
+size_t utf16le_run_to_ascii(const uint8_t *src, size_t srclen,
+			    uint8_t *dst, size_t dstlen)
+{
+	return push_ascii_run(src, srclen, dst, dstlen);
+}
+
 /*
   this takes a UTF8 sequence and produces a UTF16 sequence
  */
@@ -589,9 +698,23 @@ static size_t utf8_pull(void *cd, const char **inbuf, size_t *inbytesleft,
 	size_t in_left=*inbytesleft, out_left=*outbytesleft;
 	const uint8_t *c = (const uint8_t *)*inbuf;
 	uint8_t *uc = (uint8_t *)*outbuf;
+	const uint8_t *next_run = c;
 
 	while (in_left >= 1 && out_left >= 2) {
 		if ((c[0] & 0x80) == 0) {
+			if (c >= next_run) {
+				size_t n = pull_ascii_run(c, in_left,
+							  uc, out_left);
+				if (n != 0) {
+					c += n;
+					in_left -= n;
+					out_left -= 2*n;
+					uc += 2*n;
+					continue;
+				}
+				/* not worth retrying for the next 8 bytes */
+				next_run = c + 8;
+			}
 			uc[0] = c[0];
 			uc[1] = 0;
 			c  += 1;
@@ -710,12 +833,26 @@ static size_t utf8_push(void *cd, const char **inbuf, size_t *inbytesleft,
 	size_t in_left=*inbytesleft, out_left=*outbytesleft;
 	uint8_t *c = (uint8_t *)*outbuf;
 	const uint8_t *uc = (const uint8_t *)*inbuf;
+	const uint8_t *next_run = uc;
 
 	while (in_left >= 2 && out_left >= 1) {
 		unsigned int codepoint;
 
 		if (uc[1] == 0 && !(uc[0] & 0x80)) {
 			/* simplest case */
+			if (uc >= next_run) {
+				size_t n = push_ascii_run(uc, in_left,
+							  c, out_left);
+				if (n != 0) {
+					in_left -= 2*n;
+					out_left -= n;
+					uc += 2*n;
+					c += n;
+					continue;
+				}
+				/* not worth retrying for the next 8 chars */
+				next_run = uc + 16;
+			}
 			c[0] = uc[0];
 			in_left  -= 2;
 			out_left -= 1;
@@ -44,6 +44,16 @@ _PUBLIC_ int strcasecmp_m_handle(struct smb_iconv_handle *iconv_handle,
 	if (s2 == NULL) return 1;
 
 	while (*s1 && *s2) {
+		if ((((unsigned char)*s1 | (unsigned char)*s2) & 0x80) == 0) {
+			/* both ascii, no need to decode */
+			c1 = (unsigned char)*s1++;
+			c2 = (unsigned char)*s2++;
+			if ((c1 != c2) && (toupper(c1) != toupper(c2))) {
+				return c1 - c2;
+			}
+			continue;
+		}
+
 		c1 = next_codepoint_handle(iconv_handle, s1, &size1);
 		c2 = next_codepoint_handle(iconv_handle, s2, &size2);
 
@@ -93,6 +103,16 @@ _PUBLIC_ int strncasecmp_m_handle(struct smb_iconv_handle *iconv_handle,
 	while (*s1 && *s2 && n) {
 		n--;
 
+		if ((((unsigned char)*s1 | (unsigned char)*s2) & 0x80) == 0) {
+			/* both ascii, no need to decode */
+			c1 = (unsigned char)*s1++;
+			c2 = (unsigned char)*s2++;
+			if ((c1 != c2) && (toupper(c1) != toupper(c2))) {
+				return c1 - c2;
+			}
+			continue;
+		}
+
 		c1 = next_codepoint_handle(iconv_handle, s1, &size1);
 		c2 = next_codepoint_handle(iconv_handle, s2, &size2);
 
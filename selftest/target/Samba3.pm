@@ -598,6 +598,8 @@ sub setup_fileserver($$)
 	push(@dirs,$offline_sharedir);
 
 	my $fileserver_options = "
+	smbd:shared stat cache = yes
+
 [lowercase]
 	path = $lower_case_share_dir
 	comment = smb username is [%U]
@@ -1487,6 +1489,34 @@ sub provision($$$$$$$$)
 	copy = tmp
 	aio read size = 1
 	aio write size = 1
+[access_check_cache]
+	copy = tmp
+	vfs objects =
+	smbd:access check cache = yes
+[dirprefetch]
+	copy = tmp
+	vfs objects = dirprefetch
+	dirprefetch:batch size = 7
+[dir_snapshot]
+	copy = tmp
+	smbd:dir snapshot = yes
+	directory name cache size = 0
+[dir_index]
+	copy = tmp
+	case sensitive = no
+	smbd:dir index = yes
+[dir_index_inotify]
+	copy = tmp
+	case sensitive = no
+	smbd:dir index = yes
+	smbd:dir index kernel change notify = yes
+[dosmode_cache]
+	copy = tmp
+	vfs objects =
+	smbd:dosmode cache = yes
+[dosmode_cache_xattr_tdb]
+	copy = tmp
+	smbd:dosmode cache = yes
 
 [print\$]
 	copy = tmp
@@ -56,6 +56,8 @@ int ctdbd_db_attach(struct ctdbd_connection *conn, const char *name,
 		    uint32_t *db_id, int tdb_flags);
 
 int ctdbd_migrate(struct ctdbd_connection *conn, uint32_t db_id, TDB_DATA key);
+int ctdbd_migrate_multi(struct ctdbd_connection *conn, size_t num_keys,
+			const uint32_t *db_ids, const TDB_DATA *keys);
 
 int ctdbd_parse(struct ctdbd_connection *conn, uint32_t db_id,
 		TDB_DATA key, bool local_copy,
@@ -134,6 +134,9 @@ NTSTATUS messaging_send_iov(struct messaging_context *msg_ctx,
 			    struct server_id server, uint32_t msg_type,
 			    const struct iovec *iov, int iovlen,
 			    const int *fds, size_t num_fds);
+NTSTATUS messaging_send_batch(struct messaging_context *msg_ctx,
+			      struct server_id dst, uint32_t msg_type,
+			      const DATA_BLOB *bufs, size_t num_bufs);
 
 struct tevent_req *messaging_filtered_read_send(
 	TALLOC_CTX *mem_ctx, struct tevent_context *ev,
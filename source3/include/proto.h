@@ -143,6 +143,13 @@ char *escape_rdn_val_string_alloc(const char *s);
 
 int ms_fnmatch(const char *pattern, const char *string, bool translate_pattern,
 	       bool is_case_sensitive);
+struct ms_fnmatch_pattern;
+struct ms_fnmatch_pattern *ms_fnmatch_compile(TALLOC_CTX *mem_ctx,
+					      const char *pattern,
+					      bool translate_pattern,
+					      bool is_case_sensitive);
+int ms_fnmatch_compiled(const struct ms_fnmatch_pattern *pat,
+			const char *string);
 
 /* The following definitions come from lib/recvfile.c  */
 
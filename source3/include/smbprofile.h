@@ -112,6 +112,19 @@ struct tevent_context;
 	SMBPROFILE_STATS_COUNT(statcache_lookups) \
 	SMBPROFILE_STATS_COUNT(statcache_misses) \
 	SMBPROFILE_STATS_COUNT(statcache_hits) \
+	SMBPROFILE_STATS_COUNT(statcache_shared_hits) \
+	SMBPROFILE_STATS_COUNT(statcache_shared_misses) \
+	SMBPROFILE_STATS_COUNT(statcache_shared_stale) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(dosmodecache, "DOS Attribute Cache") \
+	SMBPROFILE_STATS_COUNT(dosmodecache_hits) \
+	SMBPROFILE_STATS_COUNT(dosmodecache_misses) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(accesscache, "Access Check Cache") \
+	SMBPROFILE_STATS_COUNT(accesscache_hits) \
+	SMBPROFILE_STATS_COUNT(accesscache_misses) \
 	SMBPROFILE_STATS_SECTION_END \
 	\
 	SMBPROFILE_STATS_SECTION_START(writecache, "Write Cache") \
@@ -169,6 +169,8 @@
 /* Version 33 - Remove notify_watch_fn */
 /* Bump to version 34 - Samba 4.4 will ship with that */
 /* Version 34 - Remove bool posix_open, add uint64_t posix_flags */
+/* Version 34 - Add bool access_check_cache to connection_struct */
+/* Version 34 - Add bool dosmode_cache to connection_struct */
 
 #define SMB_VFS_INTERFACE_VERSION 34
 
@@ -388,6 +390,10 @@ typedef struct connection_struct {
 	/* Device number of the directory of the share mount.
 	   Used to ensure unique FileIndex returns. */
 	SMB_DEV_T base_share_dev;
+	/* "smbd:access check cache", unless the VFS stack prevents it. */
+	bool access_check_cache;
+	/* "smbd:dosmode cache", unless the VFS stack prevents it. */
+	bool dosmode_cache;
 
 	name_compare_entry *hide_list; /* Per-share list of files to return as hidden. */
 	name_compare_entry *veto_list; /* Per-share list of files to veto (never show). */
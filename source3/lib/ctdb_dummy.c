@@ -81,6 +81,13 @@ struct db_context *db_open_ctdb(TALLOC_CTX *mem_ctx,
 	return NULL;
 }
 
+NTSTATUS dbwrap_ctdb_migrate_records(size_t num_keys,
+				     struct db_context **dbs,
+				     const TDB_DATA *keys)
+{
+	return NT_STATUS_NOT_SUPPORTED;
+}
+
 int messaging_ctdbd_init(struct messaging_context *msg_ctx,
 			 TALLOC_CTX *mem_ctx,
 			      struct messaging_backend **presult)
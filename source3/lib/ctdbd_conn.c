@@ -914,15 +914,14 @@ int ctdbd_db_attach(struct ctdbd_connection *conn,
 }
 
 /*
- * force the migration of a record to this node
+ * send a request to migrate a record to this node
  */
-int ctdbd_migrate(struct ctdbd_connection *conn, uint32_t db_id, TDB_DATA key)
+static uint32_t ctdbd_migrate_send(struct ctdbd_connection *conn,
+				   uint32_t db_id, TDB_DATA key)
 {
 	struct ctdb_req_call_old req;
-	struct ctdb_req_header *hdr;
 	struct iovec iov[2];
 	ssize_t nwritten;
-	int ret;
 
 	ZERO_STRUCT(req);
 
@@ -950,7 +949,21 @@ int ctdbd_migrate(struct ctdbd_connection *conn, uint32_t db_id, TDB_DATA key)
 		cluster_fatal("cluster dispatch daemon msg write error\n");
 	}
 
-	ret = ctdb_read_req(conn, req.hdr.reqid, NULL, &hdr);
+	return req.hdr.reqid;
+}
+
+/*
+ * force the migration of a record to this node
+ */
+int ctdbd_migrate(struct ctdbd_connection *conn, uint32_t db_id, TDB_DATA key)
+{
+	struct ctdb_req_header *hdr;
+	uint32_t reqid;
+	int ret;
+
+	reqid = ctdbd_migrate_send(conn, db_id, key);
+
+	ret = ctdb_read_req(conn, reqid, NULL, &hdr);
 	if (ret != 0) {
 		DEBUG(10, ("ctdb_read_req failed: %s\n", strerror(ret)));
 		goto fail;
@@ -967,6 +980,81 @@ int ctdbd_migrate(struct ctdbd_connection *conn, uint32_t db_id, TDB_DATA key)
 	return ret;
 }
 
+/*
+ * force the migration of several records to this node
+ *
+ * All the requests are sent before waiting for the replies, so the
+ * records are migrated in parallel instead of one after the other.
+ */
+int ctdbd_migrate_multi(struct ctdbd_connection *conn, size_t num_keys,
+			const uint32_t *db_ids, const TDB_DATA *keys)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	uint32_t *reqids;
+	size_t i, num_received;
+	int ret = 0;
+	int err = 0;
+
+	reqids = talloc_array(frame, uint32_t, num_keys);
+	if (reqids == NULL) {
+		TALLOC_FREE(frame);
+		return ENOMEM;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		reqids[i] = ctdbd_migrate_send(conn, db_ids[i], keys[i]);
+	}
+
+	num_received = 0;
+
+	while (num_received < num_keys) {
+		struct ctdb_req_header *hdr;
+
+		ret = ctdb_read_req(conn, 0, frame, &hdr);
+		if (ret != 0) {
+			DEBUG(10, ("ctdb_read_req failed: %s\n",
+				   strerror(ret)));
+			break;
+		}
+
+		for (i=0; i<num_keys; i++) {
+			if (hdr->reqid == reqids[i]) {
+				break;
+			}
+		}
+		if (i == num_keys) {
+			DEBUG(0, ("Discarding mismatched ctdb reqid %u\n",
+				  (unsigned)hdr->reqid));
+			TALLOC_FREE(hdr);
+			continue;
+		}
+
+		if (hdr->operation != CTDB_REPLY_CALL) {
+			DEBUG(0, ("received invalid reply\n"));
+			/*
+			 * Keep reading the other replies, they would
+			 * otherwise be left in the socket
+			 */
+			if (err == 0) {
+				err = EIO;
+			}
+		}
+
+		/* Don't count a duplicate reply twice */
+		reqids[i] = 0;
+
+		TALLOC_FREE(hdr);
+		num_received += 1;
+	}
+
+	TALLOC_FREE(frame);
+
+	if (ret != 0) {
+		return ret;
+	}
+	return err;
+}
+
 /*
  * Fetch a record and parse it
  */
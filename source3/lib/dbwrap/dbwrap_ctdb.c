@@ -1211,6 +1211,81 @@ static struct db_record *db_ctdb_try_fetch_locked(struct db_context *db,
 	return fetch_locked_internal(ctx, mem_ctx, key, true);
 }
 
+static int db_ctdb_local_copy_parser(TDB_DATA key, TDB_DATA data,
+				     void *private_data)
+{
+	bool *local = (bool *)private_data;
+
+	*local = db_ctdb_can_use_local_copy(data, false);
+	return 0;
+}
+
+/*
+ * Migrate a set of records, possibly from different databases, to this
+ * node with a single pipelined exchange with ctdbd. Records that are
+ * already local are skipped, as are databases that are not clustered
+ * or are persistent, so callers can pass whatever they are about to
+ * lock. This is only a hint: a later fetch_locked still migrates the
+ * record again if it has moved away in between.
+ */
+NTSTATUS dbwrap_ctdb_migrate_records(size_t num_keys,
+				     struct db_context **dbs,
+				     const TDB_DATA *keys)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	uint32_t *db_ids;
+	TDB_DATA *mkeys;
+	size_t i, num_migrate = 0;
+	int ret;
+
+	db_ids = talloc_array(frame, uint32_t, num_keys);
+	mkeys = talloc_array(frame, TDB_DATA, num_keys);
+	if ((db_ids == NULL) || (mkeys == NULL)) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		struct db_context *db = dbs[i];
+		struct db_ctdb_ctx *ctx;
+		bool local = false;
+
+		if ((db == NULL) || (db->fetch_locked != db_ctdb_fetch_locked) ||
+		    db->persistent) {
+			continue;
+		}
+		ctx = talloc_get_type_abort(db->private_data,
+					    struct db_ctdb_ctx);
+
+		tdb_parse_record(ctx->wtdb->tdb, keys[i],
+				 db_ctdb_local_copy_parser, &local);
+		if (local) {
+			continue;
+		}
+
+		db_ids[num_migrate] = ctx->db_id;
+		mkeys[num_migrate] = keys[i];
+		num_migrate += 1;
+	}
+
+	if (num_migrate == 0) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_OK;
+	}
+
+	DEBUG(10, ("Migrating %zu of %zu records\n", num_migrate, num_keys));
+
+	ret = ctdbd_migrate_multi(messaging_ctdbd_connection(), num_migrate,
+				  db_ids, mkeys);
+	TALLOC_FREE(frame);
+	if (ret != 0) {
+		DEBUG(5, ("ctdbd_migrate_multi failed: %s\n", strerror(ret)));
+		return map_nt_error_from_unix(ret);
+	}
+
+	return NT_STATUS_OK;
+}
+
 struct db_ctdb_parse_record_state {
 	void (*parser)(TDB_DATA key, TDB_DATA data, void *private_data);
 	void *private_data;
@@ -1552,6 +1627,8 @@ struct db_context *db_open_ctdb(TALLOC_CTX *mem_ctx,
 	struct ctdbd_connection *conn;
 	struct loadparm_context *lp_ctx;
 	struct ctdb_db_priority prio;
+	TDB_DATA outdata;
+	uint32_t ctdb_tdb_flags;
 	int cstatus;
 	int ret;
 
@@ -1603,8 +1680,32 @@ struct db_context *db_open_ctdb(TALLOC_CTX *mem_ctx,
 	result->lock_order = lock_order;
 
 	/* only pass through specific flags */
-	tdb_flags &= TDB_SEQNUM|TDB_VOLATILE|
-		TDB_MUTEX_LOCKING|TDB_CLEAR_IF_FIRST;
+	tdb_flags &= TDB_SEQNUM|TDB_VOLATILE|TDB_CLEAR_IF_FIRST;
+
+	/*
+	 * ctdbd decides whether a database uses mutexes, all openers
+	 * of the tdb have to agree on that.
+	 */
+	ret = ctdbd_control_local(
+		conn, CTDB_CONTROL_DB_OPEN_FLAGS, 0, 0,
+		make_tdb_data((uint8_t *)&db_ctdb->db_id,
+			      sizeof(db_ctdb->db_id)),
+		talloc_tos(), &outdata, &cstatus);
+	if ((ret != 0) || (cstatus != 0) ||
+	    (outdata.dsize != sizeof(ctdb_tdb_flags))) {
+		DEBUG(1, ("CTDB_CONTROL_DB_OPEN_FLAGS failed: %s, %d\n",
+			  strerror(ret), cstatus));
+		TALLOC_FREE(result);
+		return NULL;
+	}
+	memcpy(&ctdb_tdb_flags, outdata.dptr, sizeof(ctdb_tdb_flags));
+	TALLOC_FREE(outdata.dptr);
+
+#ifdef TDB_MUTEX_LOCKING
+	if (ctdb_tdb_flags & TDB_MUTEX_LOCKING) {
+		tdb_flags |= TDB_MUTEX_LOCKING|TDB_CLEAR_IF_FIRST;
+	}
+#endif
 
 	prio.db_id = db_ctdb->db_id;
 	prio.priority = lock_order;
@@ -34,4 +34,8 @@ struct db_context *db_open_ctdb(TALLOC_CTX *mem_ctx,
 				enum dbwrap_lock_order lock_order,
 				uint64_t dbwrap_flags);
 
+NTSTATUS dbwrap_ctdb_migrate_records(size_t num_keys,
+				     struct db_context **dbs,
+				     const TDB_DATA *keys);
+
 #endif /* __DBWRAP_CTDB_H__ */
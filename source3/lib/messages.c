@@ -282,6 +282,26 @@ static int messaging_context_destructor(struct messaging_context *ctx)
 	return 0;
 }
 
+/*
+ * Accept shared memory rings from chatty senders, see messages_dgm.c
+ */
+static void messaging_enable_rings(void)
+{
+	int ring_size, ret;
+
+	ring_size = lp_parm_int(-1, "messaging", "dgm ring size", 0);
+	if (ring_size <= 0) {
+		return;
+	}
+
+	ret = messaging_dgm_enable_rings(ring_size, become_root,
+					 unbecome_root);
+	if (ret != 0) {
+		DEBUG(5, ("%s: messaging_dgm_enable_rings failed: %s\n",
+			  __func__, strerror(ret)));
+	}
+}
+
 static const char *private_path(const char *name)
 {
 	return talloc_asprintf(talloc_tos(), "%s/%s", lp_private_dir(), name);
@@ -348,6 +368,8 @@ struct messaging_context *messaging_init(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
+	messaging_enable_rings();
+
 	talloc_set_destructor(ctx, messaging_context_destructor);
 
 	if (lp_clustering()) {
@@ -410,6 +432,8 @@ NTSTATUS messaging_reinit(struct messaging_context *msg_ctx)
 		return map_nt_error_from_unix(ret);
 	}
 
+	messaging_enable_rings();
+
 	TALLOC_FREE(msg_ctx->remote);
 
 	if (lp_clustering()) {
@@ -579,6 +603,74 @@ NTSTATUS messaging_send_iov(struct messaging_context *msg_ctx,
 	return NT_STATUS_OK;
 }
 
+/*
+  Send several messages of one type to a single destination. Locally
+  they are coalesced into as few datagrams as possible.
+*/
+NTSTATUS messaging_send_batch(struct messaging_context *msg_ctx,
+			      struct server_id dst, uint32_t msg_type,
+			      const DATA_BLOB *bufs, size_t num_bufs)
+{
+	TALLOC_CTX *frame;
+	uint8_t *hdrs;
+	struct iovec *iov;
+	int *iovlens;
+	size_t i;
+	int ret;
+
+	if (server_id_is_disconnected(&dst)) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	if (!procid_is_local(&dst)) {
+		for (i=0; i<num_bufs; i++) {
+			NTSTATUS status;
+
+			status = messaging_send(msg_ctx, dst, msg_type,
+						&bufs[i]);
+			if (!NT_STATUS_IS_OK(status)) {
+				return status;
+			}
+		}
+		return NT_STATUS_OK;
+	}
+
+	frame = talloc_stackframe();
+
+	hdrs = talloc_array(frame, uint8_t, num_bufs * MESSAGE_HDR_LENGTH);
+	iov = talloc_array(frame, struct iovec, num_bufs * 2);
+	iovlens = talloc_array(frame, int, num_bufs);
+	if ((hdrs == NULL) || (iov == NULL) || (iovlens == NULL)) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	for (i=0; i<num_bufs; i++) {
+		uint8_t *hdr = hdrs + i * MESSAGE_HDR_LENGTH;
+
+		message_hdr_put(hdr, msg_type, msg_ctx->id, dst);
+
+		iov[i*2] = (struct iovec) {
+			.iov_base = hdr, .iov_len = MESSAGE_HDR_LENGTH
+		};
+		iov[i*2+1] = (struct iovec) {
+			.iov_base = bufs[i].data, .iov_len = bufs[i].length
+		};
+		iovlens[i] = 2;
+	}
+
+	become_root();
+	ret = messaging_dgm_send_batch(dst.pid, iov, iovlens, num_bufs);
+	unbecome_root();
+
+	TALLOC_FREE(frame);
+
+	if (ret != 0) {
+		return map_nt_error_from_unix(ret);
+	}
+	return NT_STATUS_OK;
+}
+
 static struct messaging_rec *messaging_rec_dup(TALLOC_CTX *mem_ctx,
 					       struct messaging_rec *rec)
 {
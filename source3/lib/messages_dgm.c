@@ -19,6 +19,7 @@
 
 #include "replace.h"
 #include "system/network.h"
+#include "system/select.h"
 #include "system/filesys.h"
 #include <dirent.h>
 #include "lib/util/data_blob.h"
@@ -30,6 +31,8 @@
 #include "poll_funcs/poll_funcs_tevent.h"
 #include "unix_msg/unix_msg.h"
 #include "lib/util/genrand.h"
+#include "lib/util/dlinklist.h"
+#include "lib/msg_ring.h"
 
 struct sun_path_buf {
 	/*
@@ -55,6 +58,103 @@ struct messaging_dgm_context {
 	void *recv_cb_private_data;
 
 	bool *have_dgm_context;
+
+	/*
+	 * Shared memory rings, see messaging_dgm_enable_rings()
+	 */
+	size_t ring_size;
+	void (*become_root_fn)(void);
+	void (*unbecome_root_fn)(void);
+	struct messaging_dgm_peer *peers;
+	unsigned num_peers;
+	struct messaging_dgm_in_ring *in_rings;
+
+	struct messaging_dgm_backlog *backlog;
+	int backlog_pipe[2];
+	struct poll_watch *backlog_watch;
+	bool backlog_armed;
+};
+
+/*
+ * Once a peer has received MESSAGING_DGM_RING_THRESHOLD messages from
+ * us, we create a msg_ring file for it and announce it with an ATTACH
+ * datagram. From then on every message to that peer carries a sequence
+ * number. Small messages go through the ring, a KICK datagram wakes up
+ * the peer if it had drained the ring before. Messages with fds, large
+ * messages and messages that find the ring full go as CARRIER datagrams
+ * carrying their sequence number, so the receiver can restore the
+ * order.
+ *
+ * Control datagrams start with 8 bytes of 0xff. Regular messages start
+ * with the destination pid, so they can't be mistaken for control
+ * datagrams.
+ */
+
+#define MESSAGING_DGM_RING_MAGIC UINT64_MAX
+#define MESSAGING_DGM_RING_THRESHOLD 64
+#define MESSAGING_DGM_MAX_PEERS 32
+
+enum messaging_dgm_ring_op {
+	MESSAGING_DGM_RING_ATTACH = 1,
+	MESSAGING_DGM_RING_KICK,
+	MESSAGING_DGM_RING_CARRIER,
+	MESSAGING_DGM_RING_DETACH
+};
+
+struct messaging_dgm_ring_hdr {
+	uint64_t magic;
+	uint64_t seq;
+	uint32_t src_pid;
+	uint32_t op;
+};
+
+/*
+ * Sending side: Recently used destinations
+ */
+struct messaging_dgm_peer {
+	struct messaging_dgm_peer *prev, *next;
+	pid_t pid;
+	unsigned num_sent;
+	bool no_ring;
+	struct msg_ring *ring;
+	uint64_t seq;
+	bool kick_pending;
+};
+
+/*
+ * Receiving side: Rings we have attached to
+ */
+struct messaging_dgm_in_ring {
+	struct messaging_dgm_in_ring *prev, *next;
+	pid_t pid;
+	struct msg_ring *ring;
+	uint64_t next_seq;
+	bool queued;		/* A BACKLOG_RING entry exists */
+};
+
+/*
+ * Messages received but not yet delivered, see
+ * messaging_dgm_backlog_step()
+ */
+enum messaging_dgm_backlog_type {
+	MESSAGING_DGM_BACKLOG_MSG,
+	MESSAGING_DGM_BACKLOG_CARRIER,
+	MESSAGING_DGM_BACKLOG_BATCH,
+	MESSAGING_DGM_BACKLOG_RING
+};
+
+struct messaging_dgm_backlog {
+	struct messaging_dgm_backlog *prev, *next;
+	enum messaging_dgm_backlog_type type;
+
+	uint8_t *buf;
+	size_t buflen;
+	size_t ofs;		/* BATCH read position */
+	int *fds;
+	size_t num_fds;
+
+	pid_t pid;		/* CARRIER and RING sender */
+	uint64_t seq;		/* CARRIER sequence number */
 };
 
 static struct messaging_dgm_context *global_dgm_context;
@@ -63,6 +163,11 @@ static void messaging_dgm_recv(struct unix_msg_ctx *ctx,
 			       uint8_t *msg, size_t msg_len,
 			       int *fds, size_t num_fds,
 			       void *private_data);
+static void messaging_dgm_recv_batch(struct unix_msg_ctx *ctx,
+				     uint8_t *buf, size_t buflen,
+				     void *private_data);
+static void messaging_dgm_backlog_handler(struct poll_watch *w, int fd,
+					  short events, void *private_data);
 
 static int messaging_dgm_context_destructor(struct messaging_dgm_context *c);
 
@@ -197,6 +302,8 @@ int messaging_dgm_init(struct tevent_context *ev,
 	ctx->pid = getpid();
 	ctx->recv_cb = recv_cb;
 	ctx->recv_cb_private_data = recv_cb_private_data;
+	ctx->backlog_pipe[0] = -1;
+	ctx->backlog_pipe[1] = -1;
 
 	len = strlcpy(ctx->lockfile_dir.buf, lockfile_dir,
 		      sizeof(ctx->lockfile_dir.buf));
@@ -251,6 +358,7 @@ int messaging_dgm_init(struct tevent_context *ev,
 		return ret;
 	}
 	talloc_set_destructor(ctx, messaging_dgm_context_destructor);
+	unix_msg_set_batch_callback(ctx->dgm_ctx, messaging_dgm_recv_batch);
 
 	ctx->have_dgm_context = &have_dgm_context;
 
@@ -270,6 +378,15 @@ static int messaging_dgm_context_destructor(struct messaging_dgm_context *c)
 	 */
 	unix_msg_free(c->dgm_ctx);
 
+	if (c->backlog_watch != NULL) {
+		c->msg_callbacks->watch_free(c->backlog_watch);
+		c->backlog_watch = NULL;
+	}
+	if (c->backlog_pipe[0] != -1) {
+		close(c->backlog_pipe[0]);
+		close(c->backlog_pipe[1]);
+	}
+
 	if (getpid() == c->pid) {
 		struct sun_path_buf name;
 		int ret;
@@ -299,25 +416,317 @@ void messaging_dgm_destroy(void)
 	TALLOC_FREE(global_dgm_context);
 }
 
+static int messaging_dgm_dst(struct messaging_dgm_context *ctx, pid_t pid,
+			     struct sockaddr_un *dst)
+{
+	ssize_t dst_pathlen;
+
+	*dst = (struct sockaddr_un) { .sun_family = AF_UNIX };
+
+	dst_pathlen = snprintf(dst->sun_path, sizeof(dst->sun_path),
+			       "%s/%u", ctx->socket_dir.buf, (unsigned)pid);
+	if (dst_pathlen >= sizeof(dst->sun_path)) {
+		return ENAMETOOLONG;
+	}
+
+	return 0;
+}
+
+static int messaging_dgm_ring_path(struct messaging_dgm_context *ctx,
+				   pid_t dst, pid_t src,
+				   struct sun_path_buf *path)
+{
+	int ret;
+
+	ret = snprintf(path->buf, sizeof(path->buf), "%s/ring.%u.%u",
+		       ctx->socket_dir.buf, (unsigned)dst, (unsigned)src);
+	if (ret >= sizeof(path->buf)) {
+		return ENAMETOOLONG;
+	}
+	return 0;
+}
+
+static int messaging_dgm_ring_ctrl(struct messaging_dgm_context *ctx,
+				   pid_t pid, enum messaging_dgm_ring_op op,
+				   uint64_t seq,
+				   const struct iovec *iov, int iovlen,
+				   const int *fds, size_t num_fds)
+{
+	struct messaging_dgm_ring_hdr hdr = {
+		.magic = MESSAGING_DGM_RING_MAGIC, .seq = seq,
+		.src_pid = ctx->pid, .op = op
+	};
+	struct iovec iov2[iovlen+1];
+	struct sockaddr_un dst;
+	int ret;
+
+	ret = messaging_dgm_dst(ctx, pid, &dst);
+	if (ret != 0) {
+		return ret;
+	}
+
+	iov2[0] = (struct iovec) { .iov_base = &hdr, .iov_len = sizeof(hdr) };
+	if (iovlen > 0) {
+		memcpy(&iov2[1], iov, sizeof(struct iovec) * iovlen);
+	}
+
+	return unix_msg_send(ctx->dgm_ctx, &dst, iov2, iovlen+1,
+			     fds, num_fds);
+}
+
+/*
+ * Control datagrams sent from the receive path need the same privileges
+ * messages.c uses for sending
+ */
+static void messaging_dgm_ring_detach(struct messaging_dgm_context *ctx,
+				      pid_t pid)
+{
+	int ret;
+
+	if (ctx->become_root_fn != NULL) {
+		ctx->become_root_fn();
+	}
+	ret = messaging_dgm_ring_ctrl(ctx, pid, MESSAGING_DGM_RING_DETACH, 0,
+				      NULL, 0, NULL, 0);
+	if (ctx->unbecome_root_fn != NULL) {
+		ctx->unbecome_root_fn();
+	}
+
+	if (ret != 0) {
+		DEBUG(10, ("%s: Could not send detach to %u: %s\n", __func__,
+			   (unsigned)pid, strerror(ret)));
+	}
+}
+
+static bool messaging_dgm_peer_has_rings(struct messaging_dgm_context *ctx,
+					 pid_t pid)
+{
+	struct sun_path_buf lockfile_name;
+	char buf[64];
+	ssize_t nread;
+	int ret, fd;
+
+	ret = snprintf(lockfile_name.buf, sizeof(lockfile_name.buf),
+		       "%s/%u", ctx->lockfile_dir.buf, (unsigned)pid);
+	if (ret >= sizeof(lockfile_name.buf)) {
+		return false;
+	}
+
+	fd = open(lockfile_name.buf, O_NONBLOCK|O_RDONLY, 0);
+	if (fd == -1) {
+		return false;
+	}
+	nread = pread(fd, buf, sizeof(buf)-1, 0);
+	close(fd);
+
+	if (nread <= 0) {
+		return false;
+	}
+	buf[nread] = '\0';
+
+	return (strstr(buf, "\nring\n") != NULL);
+}
+
+static struct messaging_dgm_peer *messaging_dgm_peer_get(
+	struct messaging_dgm_context *ctx, pid_t pid)
+{
+	struct messaging_dgm_peer *peer;
+
+	for (peer = ctx->peers; peer != NULL; peer = peer->next) {
+		if (peer->pid == pid) {
+			DLIST_PROMOTE(ctx->peers, peer);
+			return peer;
+		}
+	}
+
+	if (ctx->num_peers >= MESSAGING_DGM_MAX_PEERS) {
+		/*
+		 * Forget the least recently used peer without a ring
+		 */
+		for (peer = DLIST_TAIL(ctx->peers); peer != NULL;
+		     peer = DLIST_PREV(peer)) {
+			if (peer->ring == NULL) {
+				break;
+			}
+		}
+		if (peer == NULL) {
+			return NULL;
+		}
+		DLIST_REMOVE(ctx->peers, peer);
+		ctx->num_peers -= 1;
+		TALLOC_FREE(peer);
+	}
+
+	peer = talloc_zero(ctx, struct messaging_dgm_peer);
+	if (peer == NULL) {
+		return NULL;
+	}
+	peer->pid = pid;
+
+	DLIST_ADD(ctx->peers, peer);
+	ctx->num_peers += 1;
+
+	return peer;
+}
+
+static void messaging_dgm_peer_ring_setup(struct messaging_dgm_context *ctx,
+					  struct messaging_dgm_peer *peer)
+{
+	struct sun_path_buf path;
+	int ret;
+
+	if (!messaging_dgm_peer_has_rings(ctx, peer->pid)) {
+		peer->no_ring = true;
+		return;
+	}
+
+	ret = messaging_dgm_ring_path(ctx, peer->pid, ctx->pid, &path);
+	if (ret != 0) {
+		peer->no_ring = true;
+		return;
+	}
+
+	ret = msg_ring_create(peer, path.buf, ctx->ring_size, &peer->ring);
+	if (ret != 0) {
+		DEBUG(5, ("%s: msg_ring_create(%s) failed: %s\n", __func__,
+			  path.buf, strerror(ret)));
+		peer->no_ring = true;
+		return;
+	}
+	peer->seq = 0;
+
+	ret = messaging_dgm_ring_ctrl(ctx, peer->pid,
+				      MESSAGING_DGM_RING_ATTACH, peer->seq,
+				      NULL, 0, NULL, 0);
+	if (ret != 0) {
+		DEBUG(5, ("%s: Could not send attach to %u: %s\n", __func__,
+			  (unsigned)peer->pid, strerror(ret)));
+		TALLOC_FREE(peer->ring);
+		peer->no_ring = true;
+		return;
+	}
+
+	DEBUG(10, ("%s: Using ring %s\n", __func__, path.buf));
+}
+
+static int messaging_dgm_ring_send(struct messaging_dgm_context *ctx,
+				   struct messaging_dgm_peer *peer,
+				   const struct iovec *iov, int iovlen,
+				   const int *fds, size_t num_fds)
+{
+	bool kick = false;
+	int ret;
+
+	if (num_fds == 0) {
+		ret = msg_ring_write(peer->ring, peer->seq, iov, iovlen,
+				     &kick);
+		if (ret == 0) {
+			peer->seq += 1;
+			if (!kick && !peer->kick_pending) {
+				return 0;
+			}
+			ret = messaging_dgm_ring_ctrl(
+				ctx, peer->pid, MESSAGING_DGM_RING_KICK,
+				peer->seq - 1, NULL, 0, NULL, 0);
+			if ((ret == ENOENT) || (ret == ECONNREFUSED)) {
+				goto done;
+			}
+			/*
+			 * The message is in the ring already, returning
+			 * an error would make the caller send it twice.
+			 * Kick again with the next message.
+			 */
+			peer->kick_pending = (ret != 0);
+			if (ret != 0) {
+				DEBUG(5, ("%s: KICK to %u failed: %s\n",
+					  __func__, (unsigned)peer->pid,
+					  strerror(ret)));
+			}
+			return 0;
+		}
+		if ((ret != ENOSPC) && (ret != EMSGSIZE)) {
+			return ret;
+		}
+	}
+
+	ret = messaging_dgm_ring_ctrl(ctx, peer->pid,
+				      MESSAGING_DGM_RING_CARRIER, peer->seq,
+				      iov, iovlen, fds, num_fds);
+	if (ret == 0) {
+		/*
+		 * The receiver drains the ring up to the carrier
+		 */
+		peer->seq += 1;
+		peer->kick_pending = false;
+	}
+
+done:
+	if ((ret == ENOENT) || (ret == ECONNREFUSED)) {
+		/*
+		 * The peer is gone
+		 */
+		TALLOC_FREE(peer->ring);
+		peer->kick_pending = false;
+		peer->num_sent = 0;
+	}
+	return ret;
+}
+
+/*
+ * Find the peer entry if messages to pid have to go through its ring
+ */
+static struct messaging_dgm_peer *messaging_dgm_ring_peer(
+	struct messaging_dgm_context *ctx, pid_t pid)
+{
+	struct messaging_dgm_peer *peer;
+
+	if ((ctx->ring_size == 0) || (pid == ctx->pid) ||
+	    (getpid() != ctx->pid)) {
+		return NULL;
+	}
+
+	peer = messaging_dgm_peer_get(ctx, pid);
+	if (peer == NULL) {
+		return NULL;
+	}
+
+	if ((peer->ring == NULL) && !peer->no_ring) {
+		peer->num_sent += 1;
+		if (peer->num_sent >= MESSAGING_DGM_RING_THRESHOLD) {
+			messaging_dgm_peer_ring_setup(ctx, peer);
+		}
+	}
+
+	if (peer->ring == NULL) {
+		return NULL;
+	}
+	return peer;
+}
+
 int messaging_dgm_send(pid_t pid,
 		       const struct iovec *iov, int iovlen,
 		       const int *fds, size_t num_fds)
 {
 	struct messaging_dgm_context *ctx = global_dgm_context;
+	struct messaging_dgm_peer *peer;
 	struct sockaddr_un dst;
-	ssize_t dst_pathlen;
 	int ret;
 
 	if (ctx == NULL) {
 		return ENOTCONN;
 	}
 
-	dst = (struct sockaddr_un) { .sun_family = AF_UNIX };
+	peer = messaging_dgm_ring_peer(ctx, pid);
+	if (peer != NULL) {
+		DEBUG(10, ("%s: Sending message to %u via ring\n", __func__,
+			   (unsigned)pid));
+		return messaging_dgm_ring_send(ctx, peer, iov, iovlen,
+					       fds, num_fds);
+	}
 
-	dst_pathlen = snprintf(dst.sun_path, sizeof(dst.sun_path),
-			       "%s/%u", ctx->socket_dir.buf, (unsigned)pid);
-	if (dst_pathlen >= sizeof(dst.sun_path)) {
-		return ENAMETOOLONG;
+	ret = messaging_dgm_dst(ctx, pid, &dst);
+	if (ret != 0) {
+		return ret;
 	}
 
 	DEBUG(10, ("%s: Sending message to %u\n", __func__, (unsigned)pid));
@@ -327,6 +736,531 @@ int messaging_dgm_send(pid_t pid,
 	return ret;
 }
 
+int messaging_dgm_send_batch(pid_t pid,
+			     const struct iovec *iov, const int *iovlens,
+			     size_t num_msgs)
+{
+	struct messaging_dgm_context *ctx = global_dgm_context;
+	struct messaging_dgm_peer *peer;
+	struct sockaddr_un dst;
+	int ret;
+
+	if (ctx == NULL) {
+		return ENOTCONN;
+	}
+
+	peer = messaging_dgm_ring_peer(ctx, pid);
+	if (peer != NULL) {
+		size_t i;
+
+		/*
+		 * A batch datagram would overtake messages in the ring
+		 */
+		for (i=0; i<num_msgs; i++) {
+			ret = messaging_dgm_ring_send(ctx, peer, iov, iovlens[i],
+						      NULL, 0);
+			if (ret != 0) {
+				return ret;
+			}
+			iov += iovlens[i];
+		}
+		return 0;
+	}
+
+	ret = messaging_dgm_dst(ctx, pid, &dst);
+	if (ret != 0) {
+		return ret;
+	}
+
+	DEBUG(10, ("%s: Sending %zu messages to %u\n", __func__, num_msgs,
+		   (unsigned)pid));
+
+	ret = unix_msg_send_batch(ctx->dgm_ctx, &dst, iov, iovlens, num_msgs);
+
+	return ret;
+}
+
+static struct messaging_dgm_in_ring *messaging_dgm_in_ring_find(
+	struct messaging_dgm_context *ctx, pid_t pid)
+{
+	struct messaging_dgm_in_ring *in;
+
+	for (in = ctx->in_rings; in != NULL; in = in->next) {
+		if (in->pid == pid) {
+			return in;
+		}
+	}
+	return NULL;
+}
+
+static int messaging_dgm_backlog_destructor(struct messaging_dgm_backlog *b)
+{
+	size_t i;
+
+	for (i=0; i<b->num_fds; i++) {
+		if (b->fds[i] != -1) {
+			close(b->fds[i]);
+		}
+	}
+	return 0;
+}
+
+static struct messaging_dgm_backlog *messaging_dgm_backlog_new(
+	struct messaging_dgm_context *ctx,
+	enum messaging_dgm_backlog_type type,
+	const uint8_t *buf, size_t buflen,
+	int *fds, size_t num_fds)
+{
+	struct messaging_dgm_backlog *b;
+	size_t i;
+
+	b = talloc_zero(ctx, struct messaging_dgm_backlog);
+	if (b == NULL) {
+		return NULL;
+	}
+	b->type = type;
+
+	if (buflen > 0) {
+		b->buf = talloc_memdup(b, buf, buflen);
+		if (b->buf == NULL) {
+			TALLOC_FREE(b);
+			return NULL;
+		}
+		b->buflen = buflen;
+	}
+
+	if (num_fds > 0) {
+		b->fds = talloc_array(b, int, num_fds);
+		if (b->fds == NULL) {
+			TALLOC_FREE(b);
+			return NULL;
+		}
+		/*
+		 * Take over the fds, unix_msg closes what's left
+		 */
+		for (i=0; i<num_fds; i++) {
+			b->fds[i] = fds[i];
+			fds[i] = -1;
+		}
+		b->num_fds = num_fds;
+		talloc_set_destructor(b, messaging_dgm_backlog_destructor);
+	}
+
+	return b;
+}
+
+/*
+ * The backlog pipe is only needed once we receive a batch or attach to
+ * a ring, most processes never do
+ */
+
+static int messaging_dgm_backlog_setup(struct messaging_dgm_context *ctx)
+{
+	int ret;
+
+	if (ctx->backlog_watch != NULL) {
+		return 0;
+	}
+
+	if (ctx->backlog_pipe[0] == -1) {
+		ret = pipe(ctx->backlog_pipe);
+		if (ret == -1) {
+			return errno;
+		}
+		ret = fcntl(ctx->backlog_pipe[0], F_GETFL);
+		if (ret != -1) {
+			ret = fcntl(ctx->backlog_pipe[0], F_SETFL,
+				    ret|O_NONBLOCK);
+		}
+		if (ret == -1) {
+			ret = errno;
+			close(ctx->backlog_pipe[0]);
+			close(ctx->backlog_pipe[1]);
+			ctx->backlog_pipe[0] = -1;
+			ctx->backlog_pipe[1] = -1;
+			return ret;
+		}
+	}
+
+	ctx->backlog_watch = ctx->msg_callbacks->watch_new(
+		ctx->msg_callbacks, ctx->backlog_pipe[0], POLLIN,
+		messaging_dgm_backlog_handler, ctx);
+	if (ctx->backlog_watch == NULL) {
+		return ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Keep the backlog pipe readable as long as there's something in the
+ * backlog
+ */
+
+static void messaging_dgm_backlog_update(struct messaging_dgm_context *ctx)
+{
+	char c = 0;
+	ssize_t ret;
+
+	if ((ctx->backlog != NULL) && !ctx->backlog_armed) {
+		ret = write(ctx->backlog_pipe[1], &c, sizeof(c));
+		if (ret != sizeof(c)) {
+			DEBUG(1, ("%s: write failed: %s\n", __func__,
+				  strerror(errno)));
+			return;
+		}
+		ctx->backlog_armed = true;
+	}
+
+	if ((ctx->backlog == NULL) && ctx->backlog_armed) {
+		do {
+			ret = read(ctx->backlog_pipe[0], &c, sizeof(c));
+		} while (ret == sizeof(c));
+		ctx->backlog_armed = false;
+	}
+}
+
+static void messaging_dgm_backlog_step(struct messaging_dgm_context *ctx);
+
+static void messaging_dgm_backlog_add(struct messaging_dgm_context *ctx,
+				      struct messaging_dgm_backlog *b)
+{
+	bool was_empty = (ctx->backlog == NULL);
+	int ret;
+
+	DLIST_ADD_END(ctx->backlog, b, struct messaging_dgm_backlog *);
+
+	ret = messaging_dgm_backlog_setup(ctx);
+	if (ret != 0) {
+		/*
+		 * Without the pipe we can't come back later, hand out
+		 * everything now
+		 */
+		DEBUG(1, ("%s: messaging_dgm_backlog_setup failed: %s\n",
+			  __func__, strerror(ret)));
+		while (ctx->backlog != NULL) {
+			messaging_dgm_backlog_step(ctx);
+		}
+		return;
+	}
+
+	if (was_empty) {
+		/*
+		 * Nothing has been delivered from the current poll
+		 * event, so we can hand out one message right away
+		 */
+		messaging_dgm_backlog_step(ctx);
+	}
+
+	messaging_dgm_backlog_update(ctx);
+}
+
+static void messaging_dgm_backlog_add_ring(struct messaging_dgm_context *ctx,
+					   struct messaging_dgm_in_ring *in)
+{
+	struct messaging_dgm_backlog *b;
+
+	if (in->queued) {
+		return;
+	}
+
+	b = messaging_dgm_backlog_new(ctx, MESSAGING_DGM_BACKLOG_RING,
+				      NULL, 0, NULL, 0);
+	if (b == NULL) {
+		DEBUG(1, ("%s: talloc failed\n", __func__));
+		return;
+	}
+	b->pid = in->pid;
+	in->queued = true;
+
+	messaging_dgm_backlog_add(ctx, b);
+}
+
+/*
+ * Take the next message out of pid's ring if its sequence number is
+ * below "limit". Advances the ring before the message is delivered, so
+ * a nested event loop in the callback sees a consistent state.
+ */
+
+static uint8_t *messaging_dgm_ring_next(struct messaging_dgm_context *ctx,
+					struct messaging_dgm_in_ring *in,
+					uint64_t limit, size_t *plen)
+{
+	uint64_t seq;
+	size_t len;
+	uint8_t *buf;
+	bool ok;
+
+	ok = msg_ring_peek(in->ring, &seq, &len);
+	if (!ok || (seq >= limit)) {
+		return NULL;
+	}
+
+	buf = talloc_array(ctx, uint8_t, len);
+	if (buf == NULL) {
+		return NULL;
+	}
+	msg_ring_consume(in->ring, buf);
+	in->next_seq = seq + 1;
+
+	*plen = len;
+	return buf;
+}
+
+/*
+ * Deliver one message from the head of the backlog.
+ *
+ * messages.c defers the callbacks of messaging_read_send requests to
+ * the next tevent round, so a handler that re-arms its request after
+ * each message would miss a second message delivered from the same
+ * poll event. Batches and rings thus hand out one message per poll
+ * event, the backlog pipe keeps the poll events coming.
+ */
+
+static void messaging_dgm_backlog_step(struct messaging_dgm_context *ctx)
+{
+	struct messaging_dgm_backlog *b;
+
+	while ((b = ctx->backlog) != NULL) {
+		struct messaging_dgm_in_ring *in;
+		size_t ofs, len;
+		uint8_t *buf;
+
+		switch (b->type) {
+		case MESSAGING_DGM_BACKLOG_MSG:
+			DLIST_REMOVE(ctx->backlog, b);
+			ctx->recv_cb(b->buf, b->buflen, b->fds, b->num_fds,
+				     ctx->recv_cb_private_data);
+			TALLOC_FREE(b);
+			return;
+
+		case MESSAGING_DGM_BACKLOG_CARRIER:
+			in = messaging_dgm_in_ring_find(ctx, b->pid);
+			if (in != NULL) {
+				/*
+				 * First what the sender put into the
+				 * ring before the carrier
+				 */
+				buf = messaging_dgm_ring_next(ctx, in, b->seq,
+							      &len);
+				if (buf != NULL) {
+					ctx->recv_cb(
+						buf, len, NULL, 0,
+						ctx->recv_cb_private_data);
+					TALLOC_FREE(buf);
+					return;
+				}
+				in->next_seq = b->seq + 1;
+				messaging_dgm_backlog_add_ring(ctx, in);
+			}
+			DLIST_REMOVE(ctx->backlog, b);
+			ctx->recv_cb(b->buf, b->buflen, b->fds, b->num_fds,
+				     ctx->recv_cb_private_data);
+			TALLOC_FREE(b);
+			return;
+
+		case MESSAGING_DGM_BACKLOG_BATCH:
+			if (!unix_msg_batch_next(b->buf, b->buflen, &b->ofs,
+						 &ofs, &len)) {
+				DLIST_REMOVE(ctx->backlog, b);
+				TALLOC_FREE(b);
+				break;
+			}
+			/*
+			 * A nested event loop in the callback might
+			 * finish and free b
+			 */
+			buf = talloc_memdup(ctx, b->buf + ofs, len);
+			if (buf == NULL) {
+				DEBUG(1, ("%s: talloc failed\n", __func__));
+				break;
+			}
+			ctx->recv_cb(buf, len, NULL, 0,
+				     ctx->recv_cb_private_data);
+			TALLOC_FREE(buf);
+			return;
+
+		case MESSAGING_DGM_BACKLOG_RING:
+			buf = NULL;
+			in = messaging_dgm_in_ring_find(ctx, b->pid);
+			if (in != NULL) {
+				/*
+				 * Stop at a gap, the missing message is
+				 * a CARRIER still in flight
+				 */
+				buf = messaging_dgm_ring_next(
+					ctx, in, in->next_seq + 1, &len);
+			}
+			if (buf == NULL) {
+				if (in != NULL) {
+					in->queued = false;
+				}
+				DLIST_REMOVE(ctx->backlog, b);
+				TALLOC_FREE(b);
+				break;
+			}
+			ctx->recv_cb(buf, len, NULL, 0,
+				     ctx->recv_cb_private_data);
+			TALLOC_FREE(buf);
+			return;
+		}
+	}
+}
+
+static void messaging_dgm_backlog_handler(struct poll_watch *w, int fd,
+					  short events, void *private_data)
+{
+	struct messaging_dgm_context *ctx = talloc_get_type_abort(
+		private_data, struct messaging_dgm_context);
+
+	messaging_dgm_backlog_step(ctx);
+	messaging_dgm_backlog_update(ctx);
+}
+
+static void messaging_dgm_ring_attach(struct messaging_dgm_context *ctx,
+				      pid_t pid, uint64_t seq)
+{
+	struct messaging_dgm_in_ring *in, *next;
+	struct sun_path_buf path;
+	int ret;
+
+	/*
+	 * Forget a previous ring from pid and rings from dead senders
+	 */
+	for (in = ctx->in_rings; in != NULL; in = next) {
+		next = in->next;
+
+		if ((in->pid == pid) ||
+		    ((kill(in->pid, 0) == -1) && (errno == ESRCH))) {
+			DLIST_REMOVE(ctx->in_rings, in);
+			TALLOC_FREE(in);
+		}
+	}
+
+	ret = messaging_dgm_ring_path(ctx, ctx->pid, pid, &path);
+	if (ret != 0) {
+		messaging_dgm_ring_detach(ctx, pid);
+		return;
+	}
+
+	in = talloc_zero(ctx, struct messaging_dgm_in_ring);
+	if (in == NULL) {
+		messaging_dgm_ring_detach(ctx, pid);
+		return;
+	}
+	in->pid = pid;
+	in->next_seq = seq;
+
+	if (ctx->become_root_fn != NULL) {
+		ctx->become_root_fn();
+	}
+	ret = msg_ring_attach(in, path.buf, &in->ring);
+	unlink(path.buf);
+	if (ctx->unbecome_root_fn != NULL) {
+		ctx->unbecome_root_fn();
+	}
+
+	if (ret != 0) {
+		DEBUG(5, ("%s: msg_ring_attach(%s) failed: %s\n", __func__,
+			  path.buf, strerror(ret)));
+		TALLOC_FREE(in);
+		messaging_dgm_ring_detach(ctx, pid);
+		return;
+	}
+
+	DLIST_ADD(ctx->in_rings, in);
+
+	messaging_dgm_backlog_add_ring(ctx, in);
+}
+
+static void messaging_dgm_deliver(struct messaging_dgm_context *ctx,
+				  uint8_t *msg, size_t msg_len,
+				  int *fds, size_t num_fds)
+{
+	struct messaging_dgm_backlog *b;
+
+	if (ctx->backlog == NULL) {
+		ctx->recv_cb(msg, msg_len, fds, num_fds,
+			     ctx->recv_cb_private_data);
+		return;
+	}
+
+	/*
+	 * Don't overtake what's queued
+	 */
+	b = messaging_dgm_backlog_new(ctx, MESSAGING_DGM_BACKLOG_MSG,
+				      msg, msg_len, fds, num_fds);
+	if (b == NULL) {
+		DEBUG(1, ("%s: talloc failed, dropping message\n", __func__));
+		return;
+	}
+	messaging_dgm_backlog_add(ctx, b);
+}
+
+static void messaging_dgm_ring_recv(struct messaging_dgm_context *ctx,
+				    const struct messaging_dgm_ring_hdr *hdr,
+				    uint8_t *msg, size_t msg_len,
+				    int *fds, size_t num_fds)
+{
+	pid_t pid = hdr->src_pid;
+	struct messaging_dgm_in_ring *in;
+	struct messaging_dgm_peer *peer;
+	struct messaging_dgm_backlog *b;
+
+	switch (hdr->op) {
+	case MESSAGING_DGM_RING_ATTACH:
+		messaging_dgm_ring_attach(ctx, pid, hdr->seq);
+		break;
+
+	case MESSAGING_DGM_RING_KICK:
+		in = messaging_dgm_in_ring_find(ctx, pid);
+		if (in == NULL) {
+			messaging_dgm_ring_detach(ctx, pid);
+			break;
+		}
+		messaging_dgm_backlog_add_ring(ctx, in);
+		break;
+
+	case MESSAGING_DGM_RING_CARRIER:
+		in = messaging_dgm_in_ring_find(ctx, pid);
+		if (in == NULL) {
+			messaging_dgm_ring_detach(ctx, pid);
+			messaging_dgm_deliver(ctx, msg, msg_len, fds, num_fds);
+			break;
+		}
+
+		b = messaging_dgm_backlog_new(
+			ctx, MESSAGING_DGM_BACKLOG_CARRIER,
+			msg, msg_len, fds, num_fds);
+		if (b == NULL) {
+			DEBUG(1, ("%s: talloc failed, dropping message\n",
+				  __func__));
+			break;
+		}
+		b->pid = pid;
+		b->seq = hdr->seq;
+
+		messaging_dgm_backlog_add(ctx, b);
+		break;
+
+	case MESSAGING_DGM_RING_DETACH:
+		for (peer = ctx->peers; peer != NULL; peer = peer->next) {
+			if (peer->pid == pid) {
+				TALLOC_FREE(peer->ring);
+				peer->kick_pending = false;
+				peer->num_sent = 0;
+				break;
+			}
+		}
+		break;
+
+	default:
+		DEBUG(1, ("%s: Unknown ring op %u from %u\n", __func__,
+			  (unsigned)hdr->op, (unsigned)pid));
+		break;
+	}
+}
+
 static void messaging_dgm_recv(struct unix_msg_ctx *ctx,
 			       uint8_t *msg, size_t msg_len,
 			       int *fds, size_t num_fds,
@@ -334,9 +1268,38 @@ static void messaging_dgm_recv(struct unix_msg_ctx *ctx,
 {
 	struct messaging_dgm_context *dgm_ctx = talloc_get_type_abort(
 		private_data, struct messaging_dgm_context);
+	struct messaging_dgm_ring_hdr hdr;
 
-	dgm_ctx->recv_cb(msg, msg_len, fds, num_fds,
-			 dgm_ctx->recv_cb_private_data);
+	if (msg_len >= sizeof(hdr)) {
+		memcpy(&hdr, msg, sizeof(hdr));
+
+		if (hdr.magic == MESSAGING_DGM_RING_MAGIC) {
+			messaging_dgm_ring_recv(dgm_ctx, &hdr,
+						msg + sizeof(hdr),
+						msg_len - sizeof(hdr),
+						fds, num_fds);
+			return;
+		}
+	}
+
+	messaging_dgm_deliver(dgm_ctx, msg, msg_len, fds, num_fds);
+}
+
+static void messaging_dgm_recv_batch(struct unix_msg_ctx *ctx,
+				     uint8_t *buf, size_t buflen,
+				     void *private_data)
+{
+	struct messaging_dgm_context *dgm_ctx = talloc_get_type_abort(
+		private_data, struct messaging_dgm_context);
+	struct messaging_dgm_backlog *b;
+
+	b = messaging_dgm_backlog_new(dgm_ctx, MESSAGING_DGM_BACKLOG_BATCH,
+				      buf, buflen, NULL, 0);
+	if (b == NULL) {
+		DEBUG(1, ("%s: talloc failed, dropping batch\n", __func__));
+		return;
+	}
+	messaging_dgm_backlog_add(dgm_ctx, b);
 }
 
 static int messaging_dgm_read_unique(int fd, uint64_t *punique)
@@ -399,6 +1362,52 @@ int messaging_dgm_get_unique(pid_t pid, uint64_t *unique)
 	return ret;
 }
 
+int messaging_dgm_enable_rings(size_t ring_size,
+			       void (*become_root_fn)(void),
+			       void (*unbecome_root_fn)(void))
+{
+	struct messaging_dgm_context *ctx = global_dgm_context;
+	static const char tag[] = "ring\n";
+	struct stat st;
+	ssize_t written;
+	int ret;
+
+	if (ctx == NULL) {
+		return ENOTCONN;
+	}
+	if (!msg_ring_supported()) {
+		return ENOSYS;
+	}
+
+	ctx->become_root_fn = become_root_fn;
+	ctx->unbecome_root_fn = unbecome_root_fn;
+
+	if (ctx->ring_size != 0) {
+		ctx->ring_size = ring_size;
+		return 0;
+	}
+
+	/*
+	 * Tell senders we accept rings. messaging_dgm_read_unique
+	 * ignores anything behind the first line.
+	 */
+
+	ret = fstat(ctx->lockfile_fd, &st);
+	if (ret == -1) {
+		return errno;
+	}
+
+	written = pwrite(ctx->lockfile_fd, tag, strlen(tag), st.st_size);
+	if (written != strlen(tag)) {
+		ret = errno;
+		DEBUG(1, ("%s: write failed: %s\n", __func__, strerror(ret)));
+		return ret;
+	}
+
+	ctx->ring_size = ring_size;
+	return 0;
+}
+
 int messaging_dgm_cleanup(pid_t pid)
 {
 	struct messaging_dgm_context *ctx = global_dgm_context;
@@ -481,6 +1490,24 @@ int messaging_dgm_wipe(void)
 
 	while ((dp = readdir(msgdir)) != NULL) {
 		unsigned long pid;
+		unsigned dst, src;
+
+		if (sscanf(dp->d_name, "ring.%u.%u", &dst, &src) == 2) {
+			struct sun_path_buf path;
+
+			/*
+			 * Ring files not picked up by their receiver
+			 */
+			if (((kill(dst, 0) == -1) && (errno == ESRCH)) ||
+			    ((kill(src, 0) == -1) && (errno == ESRCH))) {
+				ret = messaging_dgm_ring_path(ctx, dst, src,
+							      &path);
+				if (ret == 0) {
+					(void)unlink(path.buf);
+				}
+			}
+			continue;
+		}
 
 		pid = strtoul(dp->d_name, NULL, 10);
 		if (pid == 0) {
@@ -39,6 +39,12 @@ int messaging_dgm_get_unique(pid_t pid, uint64_t *unique);
 int messaging_dgm_send(pid_t pid,
 		       const struct iovec *iov, int iovlen,
 		       const int *fds, size_t num_fds);
+int messaging_dgm_send_batch(pid_t pid,
+			     const struct iovec *iov, const int *iovlens,
+			     size_t num_msgs);
+int messaging_dgm_enable_rings(size_t ring_size,
+			       void (*become_root_fn)(void),
+			       void (*unbecome_root_fn)(void));
 int messaging_dgm_cleanup(pid_t pid);
 int messaging_dgm_wipe(void);
 void *messaging_dgm_register_tevent_context(TALLOC_CTX *mem_ctx,
@@ -145,46 +145,15 @@ static int ms_fnmatch_core(const smb_ucs2_t *p, const smb_ucs2_t *n,
 	return -1;
 }
 
-int ms_fnmatch(const char *pattern, const char *string, bool translate_pattern,
-	       bool is_case_sensitive)
+/*
+  Translate a pattern sent by an old client to a "new style" pattern
+  that exactly matches w2k behaviour, count the '*' and '<' in it.
+*/
+static int ms_fnmatch_prepare(smb_ucs2_t *p, bool translate_pattern)
 {
-	smb_ucs2_t *p = NULL;
-	smb_ucs2_t *s = NULL;
-	int ret, count, i;
-	struct max_n *max_n = NULL;
-	struct max_n *max_n_free = NULL;
-	struct max_n one_max_n;
-	size_t converted_size;
-
-	if (ISDOTDOT(string)) {
-		string = ".";
-	}
-
-	if (strpbrk(pattern, "<>*?\"") == NULL) {
-		/* this is not just an optmisation - it is essential
-		   for LANMAN1 correctness */
-		if (is_case_sensitive) {
-			return strcmp(pattern, string);
-		} else {
-			return strcasecmp_m(pattern, string);
-		}
-	}
-
-	if (!push_ucs2_talloc(talloc_tos(), &p, pattern, &converted_size)) {
-		return -1;
-	}
-
-	if (!push_ucs2_talloc(talloc_tos(), &s, string, &converted_size)) {
-		TALLOC_FREE(p);
-		return -1;
-	}
+	int count, i;
 
 	if (translate_pattern) {
-		/*
-		  for older negotiated protocols it is possible to
-		  translate the pattern to produce a "new style"
-		  pattern that exactly matches w2k behaviour
-		*/
 		for (i=0;p[i];i++) {
 			if (p[i] == UCS2_CHAR('?')) {
 				p[i] = UCS2_CHAR('>');
@@ -202,6 +171,22 @@ int ms_fnmatch(const char *pattern, const char *string, bool translate_pattern,
 	for (count=i=0;p[i];i++) {
 		if (p[i] == UCS2_CHAR('*') || p[i] == UCS2_CHAR('<')) count++;
 	}
+	return count;
+}
+
+static int ms_fnmatch_ucs2(const smb_ucs2_t *p, int count, const char *string,
+			   bool is_case_sensitive)
+{
+	smb_ucs2_t *s = NULL;
+	int ret;
+	struct max_n *max_n = NULL;
+	struct max_n *max_n_free = NULL;
+	struct max_n one_max_n;
+	size_t converted_size;
+
+	if (!push_ucs2_talloc(talloc_tos(), &s, string, &converted_size)) {
+		return -1;
+	}
 
 	if (count != 0) {
 		if (count == 1) {
@@ -214,7 +199,6 @@ int ms_fnmatch(const char *pattern, const char *string, bool translate_pattern,
 		else {
 			max_n = SMB_CALLOC_ARRAY(struct max_n, count);
 			if (!max_n) {
-				TALLOC_FREE(p);
 				TALLOC_FREE(s);
 				return -1;
 			}
@@ -225,7 +209,243 @@ int ms_fnmatch(const char *pattern, const char *string, bool translate_pattern,
 	ret = ms_fnmatch_core(p, s, max_n, strrchr_w(s, UCS2_CHAR('.')), is_case_sensitive);
 
 	SAFE_FREE(max_n_free);
-	TALLOC_FREE(p);
 	TALLOC_FREE(s);
 	return ret;
 }
+
+int ms_fnmatch(const char *pattern, const char *string, bool translate_pattern,
+	       bool is_case_sensitive)
+{
+	smb_ucs2_t *p = NULL;
+	int ret, count;
+	size_t converted_size;
+
+	if (ISDOTDOT(string)) {
+		string = ".";
+	}
+
+	if (strpbrk(pattern, "<>*?\"") == NULL) {
+		/* this is not just an optmisation - it is essential
+		   for LANMAN1 correctness */
+		if (is_case_sensitive) {
+			return strcmp(pattern, string);
+		} else {
+			return strcasecmp_m(pattern, string);
+		}
+	}
+
+	if (!push_ucs2_talloc(talloc_tos(), &p, pattern, &converted_size)) {
+		return -1;
+	}
+
+	count = ms_fnmatch_prepare(p, translate_pattern);
+
+	ret = ms_fnmatch_ucs2(p, count, string, is_case_sensitive);
+
+	TALLOC_FREE(p);
+	return ret;
+}
+
+/*
+  A pattern prepared once for matching many names, as done for every
+  entry of a directory search.
+
+  Patterns of the form "prefix*suffix" with only ASCII characters, the
+  typical "*.docx" or "abc*", are matched against ASCII names by
+  comparing prefix and suffix directly, 8 bytes at a time. Everything
+  else goes to ms_fnmatch_core() with the pattern converted and
+  translated only once.
+*/
+
+enum ms_fnmatch_kind {
+	MS_FNMATCH_LITERAL,
+	MS_FNMATCH_PREFIX_SUFFIX,
+	MS_FNMATCH_FULL
+};
+
+struct ms_fnmatch_pattern {
+	enum ms_fnmatch_kind kind;
+	bool is_case_sensitive;
+	char *literal;
+	char *prefix;		/* lower case if !is_case_sensitive */
+	size_t prefix_len;
+	char *suffix;		/* lower case if !is_case_sensitive */
+	size_t suffix_len;
+	smb_ucs2_t *p;
+	int count;
+};
+
+#define ASCII_ONES UINT64_C(0x0101010101010101)
+#define ASCII_HIGH UINT64_C(0x8080808080808080)
+
+static bool ascii_only(const char *s, size_t len)
+{
+	uint64_t acc = 0;
+	size_t i;
+
+	for (i=0; i+8<=len; i+=8) {
+		uint64_t w;
+		memcpy(&w, s+i, 8);
+		acc |= w;
+	}
+	for (; i<len; i++) {
+		acc |= (uint8_t)s[i];
+	}
+	return (acc & ASCII_HIGH) == 0;
+}
+
+static char ascii_tolower(char c)
+{
+	return ((c >= 'A') && (c <= 'Z')) ? c + ('a' - 'A') : c;
+}
+
+/*
+  Lower case 8 ASCII characters at once: A byte gets 0x20 added if it
+  is in 'A'..'Z'. No byte is >= 0x80, so the additions don't carry.
+*/
+static uint64_t ascii_tolower8(uint64_t w)
+{
+	uint64_t ge_A = w + (0x80 - 'A') * ASCII_ONES;
+	uint64_t gt_Z = w + (0x80 - 'Z' - 1) * ASCII_ONES;
+	uint64_t upper = (ge_A & ~gt_Z) & ASCII_HIGH;
+
+	return w | (upper >> 2);
+}
+
+static bool ascii_equal(const char *s, const char *pat, size_t len,
+			bool is_case_sensitive)
+{
+	size_t i;
+
+	if (is_case_sensitive) {
+		return memcmp(s, pat, len) == 0;
+	}
+
+	for (i=0; i+8<=len; i+=8) {
+		uint64_t w1, w2;
+		memcpy(&w1, s+i, 8);
+		memcpy(&w2, pat+i, 8);
+		if (ascii_tolower8(w1) != w2) {
+			return false;
+		}
+	}
+	for (; i<len; i++) {
+		if (ascii_tolower(s[i]) != pat[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct ms_fnmatch_pattern *ms_fnmatch_compile(TALLOC_CTX *mem_ctx,
+					      const char *pattern,
+					      bool translate_pattern,
+					      bool is_case_sensitive)
+{
+	struct ms_fnmatch_pattern *pat;
+	size_t converted_size;
+	int i, star = -1;
+
+	pat = talloc_zero(mem_ctx, struct ms_fnmatch_pattern);
+	if (pat == NULL) {
+		return NULL;
+	}
+	pat->is_case_sensitive = is_case_sensitive;
+
+	if (strpbrk(pattern, "<>*?\"") == NULL) {
+		pat->kind = MS_FNMATCH_LITERAL;
+		pat->literal = talloc_strdup(pat, pattern);
+		if (pat->literal == NULL) {
+			TALLOC_FREE(pat);
+		}
+		return pat;
+	}
+
+	if (!push_ucs2_talloc(pat, &pat->p, pattern, &converted_size)) {
+		TALLOC_FREE(pat);
+		return NULL;
+	}
+	pat->count = ms_fnmatch_prepare(pat->p, translate_pattern);
+	pat->kind = MS_FNMATCH_FULL;
+
+	for (i=0; pat->p[i]; i++) {
+		smb_ucs2_t c = pat->p[i];
+
+		if (c >= 0x80 ||
+		    c == UCS2_CHAR('<') || c == UCS2_CHAR('>') ||
+		    c == UCS2_CHAR('?') || c == UCS2_CHAR('"')) {
+			return pat;
+		}
+		if (c == UCS2_CHAR('*')) {
+			if (star != -1) {
+				return pat;
+			}
+			star = i;
+		}
+	}
+
+	/* Exactly one '*', all characters ASCII */
+	pat->prefix = talloc_array(pat, char, star + 1);
+	pat->suffix = talloc_array(pat, char, i - star);
+	if ((pat->prefix == NULL) || (pat->suffix == NULL)) {
+		return pat;
+	}
+	for (i=0; pat->p[i]; i++) {
+		char c = (char)pat->p[i];
+		if (!is_case_sensitive) {
+			c = ascii_tolower(c);
+		}
+		if (i < star) {
+			pat->prefix[pat->prefix_len++] = c;
+		} else if (i > star) {
+			pat->suffix[pat->suffix_len++] = c;
+		}
+	}
+	pat->prefix[pat->prefix_len] = '\0';
+	pat->suffix[pat->suffix_len] = '\0';
+	pat->kind = MS_FNMATCH_PREFIX_SUFFIX;
+
+	return pat;
+}
+
+int ms_fnmatch_compiled(const struct ms_fnmatch_pattern *pat,
+			const char *string)
+{
+	size_t len;
+
+	if (ISDOTDOT(string)) {
+		string = ".";
+	}
+
+	switch (pat->kind) {
+	case MS_FNMATCH_LITERAL:
+		if (pat->is_case_sensitive) {
+			return strcmp(pat->literal, string);
+		}
+		return strcasecmp_m(pat->literal, string);
+
+	case MS_FNMATCH_PREFIX_SUFFIX:
+		len = strlen(string);
+		if (!ascii_only(string, len)) {
+			break;
+		}
+		if (len < pat->prefix_len + pat->suffix_len) {
+			return -1;
+		}
+		if (!ascii_equal(string, pat->prefix, pat->prefix_len,
+				 pat->is_case_sensitive)) {
+			return -1;
+		}
+		if (!ascii_equal(string + len - pat->suffix_len, pat->suffix,
+				 pat->suffix_len, pat->is_case_sensitive)) {
+			return -1;
+		}
+		return 0;
+
+	case MS_FNMATCH_FULL:
+		break;
+	}
+
+	return ms_fnmatch_ucs2(pat->p, pat->count, string,
+			       pat->is_case_sensitive);
+}
@@ -0,0 +1,338 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Shared memory single producer/single consumer message ring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replace.h"
+#include "system/filesys.h"
+#include <sys/mman.h>
+#include "lib/util/iov_buf.h"
+#include "msg_ring.h"
+
+/*
+ * The shared file starts with struct msg_ring_shm. head and tail count
+ * bytes ever written and consumed, "data" is used modulo "size". head is
+ * only written by the producer, tail only by the consumer. They live in
+ * separate cache lines.
+ *
+ * Every message is a struct msg_ring_rec followed by the payload, padded
+ * to 8 bytes. Messages wrap around the end of the data area.
+ */
+
+#define MSG_RING_MAGIC UINT64_C(0x676e6952674d7353) /* "SsMgRing" */
+
+struct msg_ring_shm {
+	uint64_t magic;
+	uint64_t size;
+	volatile uint64_t head;
+	uint8_t pad1[40];
+	volatile uint64_t tail;
+	uint8_t pad2[56];
+	uint8_t data[];
+};
+
+struct msg_ring_rec {
+	uint64_t seq;
+	uint32_t len;
+	uint32_t reserved;
+};
+
+struct msg_ring {
+	struct msg_ring_shm *shm;
+	size_t mapsize;
+	uint64_t size;
+
+	/* Creator side: remove the file when done */
+	char *path;
+	pid_t creator;
+
+	/* Consumer side: what msg_ring_peek found */
+	uint64_t peek_len;
+};
+
+#ifdef HAVE___SYNC_FETCH_AND_ADD
+#define msg_ring_barrier() __sync_synchronize()
+#endif
+
+bool msg_ring_supported(void)
+{
+#ifdef msg_ring_barrier
+	return true;
+#else
+	return false;
+#endif
+}
+
+static size_t msg_ring_rec_size(size_t len)
+{
+	return (sizeof(struct msg_ring_rec) + len + 7) & ~(size_t)7;
+}
+
+static int msg_ring_destructor(struct msg_ring *ring)
+{
+	munmap(ring->shm, ring->mapsize);
+	if ((ring->path != NULL) && (ring->creator == getpid())) {
+		unlink(ring->path);
+	}
+	return 0;
+}
+
+static int msg_ring_map(TALLOC_CTX *mem_ctx, int fd, size_t mapsize,
+			struct msg_ring **pring)
+{
+	struct msg_ring *ring;
+	void *ptr;
+
+	ring = talloc_zero(mem_ctx, struct msg_ring);
+	if (ring == NULL) {
+		return ENOMEM;
+	}
+
+	ptr = mmap(NULL, mapsize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED) {
+		int ret = errno;
+		TALLOC_FREE(ring);
+		return ret;
+	}
+
+	ring->shm = ptr;
+	ring->mapsize = mapsize;
+	talloc_set_destructor(ring, msg_ring_destructor);
+
+	*pring = ring;
+	return 0;
+}
+
+int msg_ring_create(TALLOC_CTX *mem_ctx, const char *path, size_t size,
+		    struct msg_ring **pring)
+{
+	struct msg_ring *ring;
+	uint64_t ringsize = 4096;
+	size_t mapsize;
+	int fd, ret;
+
+	if (!msg_ring_supported()) {
+		return ENOSYS;
+	}
+
+	while (ringsize < size) {
+		ringsize *= 2;
+	}
+	mapsize = sizeof(struct msg_ring_shm) + ringsize;
+
+	unlink(path);
+
+	fd = open(path, O_RDWR|O_CREAT|O_EXCL, 0600);
+	if (fd == -1) {
+		return errno;
+	}
+
+	ret = ftruncate(fd, mapsize);
+	if (ret == -1) {
+		ret = errno;
+		goto fail;
+	}
+
+	ret = msg_ring_map(mem_ctx, fd, mapsize, &ring);
+	if (ret != 0) {
+		goto fail;
+	}
+	close(fd);
+
+	ring->path = talloc_strdup(ring, path);
+	if (ring->path == NULL) {
+		TALLOC_FREE(ring);
+		unlink(path);
+		return ENOMEM;
+	}
+	ring->creator = getpid();
+
+	ring->size = ringsize;
+	ring->shm->size = ringsize;
+	ring->shm->head = 0;
+	ring->shm->tail = 0;
+	msg_ring_barrier();
+	ring->shm->magic = MSG_RING_MAGIC;
+
+	*pring = ring;
+	return 0;
+
+fail:
+	close(fd);
+	unlink(path);
+	return ret;
+}
+
+int msg_ring_attach(TALLOC_CTX *mem_ctx, const char *path,
+		    struct msg_ring **pring)
+{
+	struct msg_ring *ring;
+	struct stat st;
+	int fd, ret;
+
+	if (!msg_ring_supported()) {
+		return ENOSYS;
+	}
+
+	fd = open(path, O_RDWR, 0);
+	if (fd == -1) {
+		return errno;
+	}
+
+	ret = fstat(fd, &st);
+	if (ret == -1) {
+		ret = errno;
+		close(fd);
+		return ret;
+	}
+	if (st.st_size < sizeof(struct msg_ring_shm)) {
+		close(fd);
+		return EINVAL;
+	}
+
+	ret = msg_ring_map(mem_ctx, fd, st.st_size, &ring);
+	close(fd);
+	if (ret != 0) {
+		return ret;
+	}
+
+	msg_ring_barrier();
+
+	if ((ring->shm->magic != MSG_RING_MAGIC) ||
+	    (ring->shm->size + sizeof(struct msg_ring_shm) != st.st_size) ||
+	    ((ring->shm->size & (ring->shm->size - 1)) != 0)) {
+		TALLOC_FREE(ring);
+		return EINVAL;
+	}
+	ring->size = ring->shm->size;
+
+	*pring = ring;
+	return 0;
+}
+
+size_t msg_ring_max_msg(const struct msg_ring *ring)
+{
+	return ring->size / 4;
+}
+
+static void msg_ring_put(struct msg_ring *ring, uint64_t pos,
+			 const void *buf, size_t len)
+{
+	size_t ofs = pos & (ring->size - 1);
+	size_t chunk = MIN(len, ring->size - ofs);
+
+	memcpy(ring->shm->data + ofs, buf, chunk);
+	memcpy(ring->shm->data, (const uint8_t *)buf + chunk, len - chunk);
+}
+
+static void msg_ring_get(struct msg_ring *ring, uint64_t pos,
+			 void *buf, size_t len)
+{
+	size_t ofs = pos & (ring->size - 1);
+	size_t chunk = MIN(len, ring->size - ofs);
+
+	memcpy(buf, ring->shm->data + ofs, chunk);
+	memcpy((uint8_t *)buf + chunk, ring->shm->data, len - chunk);
+}
+
+int msg_ring_write(struct msg_ring *ring, uint64_t seq,
+		   const struct iovec *iov, int iovlen, bool *pkick)
+{
+	struct msg_ring_rec rec;
+	uint64_t head, tail, pos;
+	ssize_t len;
+	size_t needed;
+	int i;
+
+	len = iov_buflen(iov, iovlen);
+	if ((len == -1) || (len > msg_ring_max_msg(ring))) {
+		return EMSGSIZE;
+	}
+	needed = msg_ring_rec_size(len);
+
+	head = ring->shm->head;
+	msg_ring_barrier();
+	tail = ring->shm->tail;
+
+	if (ring->size - (head - tail) < needed) {
+		return ENOSPC;
+	}
+
+	rec = (struct msg_ring_rec) { .seq = seq, .len = len };
+
+	pos = head;
+	msg_ring_put(ring, pos, &rec, sizeof(rec));
+	pos += sizeof(rec);
+
+	for (i=0; i<iovlen; i++) {
+		msg_ring_put(ring, pos, iov[i].iov_base, iov[i].iov_len);
+		pos += iov[i].iov_len;
+	}
+
+	/*
+	 * Publish the message, then check whether the consumer has
+	 * seen everything before it. The consumer does the reverse,
+	 * so one of us will notice the other.
+	 */
+	msg_ring_barrier();
+	ring->shm->head = head + needed;
+	msg_ring_barrier();
+	tail = ring->shm->tail;
+
+	*pkick = (tail == head);
+	return 0;
+}
+
+bool msg_ring_peek(struct msg_ring *ring, uint64_t *pseq, size_t *plen)
+{
+	struct msg_ring_rec rec;
+	uint64_t head, tail;
+
+	tail = ring->shm->tail;
+	msg_ring_barrier();
+	head = ring->shm->head;
+	msg_ring_barrier();
+
+	if ((head == tail) ||
+	    (head - tail < sizeof(rec)) ||
+	    (head - tail > ring->size)) {
+		return false;
+	}
+
+	msg_ring_get(ring, tail, &rec, sizeof(rec));
+
+	if (msg_ring_rec_size(rec.len) > head - tail) {
+		/* Corrupt */
+		return false;
+	}
+
+	ring->peek_len = rec.len;
+	*pseq = rec.seq;
+	*plen = rec.len;
+	return true;
+}
+
+void msg_ring_consume(struct msg_ring *ring, uint8_t *buf)
+{
+	uint64_t tail = ring->shm->tail;
+
+	msg_ring_get(ring, tail + sizeof(struct msg_ring_rec), buf,
+		     ring->peek_len);
+
+	msg_ring_barrier();
+	ring->shm->tail = tail + msg_ring_rec_size(ring->peek_len);
+	msg_ring_barrier();
+}
@@ -0,0 +1,106 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Shared memory single producer/single consumer message ring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MSG_RING_H__
+#define __MSG_RING_H__
+
+#include "replace.h"
+#include "system/filesys.h"
+#include <talloc.h>
+
+/**
+ * @file msg_ring.h
+ *
+ * @brief Pass messages between two processes through a mmap'ed file
+ *
+ * A msg_ring is a byte ring in a shared file mapping, written by exactly
+ * one process and read by exactly one other process. Every message is
+ * tagged with a sequence number chosen by the writer. There is no
+ * notification mechanism, msg_ring_write tells the writer whether the
+ * reader had consumed everything before, in which case the writer has to
+ * wake up the reader by other means.
+ */
+
+struct msg_ring;
+
+/**
+ * @brief Is the msg_ring implementation available on this platform?
+ */
+bool msg_ring_supported(void);
+
+/**
+ * @brief Create a msg_ring file and map it for writing
+ *
+ * @param[in] mem_ctx The talloc context for the result
+ * @param[in] path The file to create, an existing file is replaced
+ *                 The file is removed again when the ring is freed
+ * @param[in] size The data size, rounded up to a power of 2
+ * @param[out] pring The new ring
+ * @return 0 on success, errno on failure
+ */
+int msg_ring_create(TALLOC_CTX *mem_ctx, const char *path, size_t size,
+		    struct msg_ring **pring);
+
+/**
+ * @brief Map a msg_ring file created by msg_ring_create for reading
+ *
+ * @param[in] mem_ctx The talloc context for the result
+ * @param[in] path The ring file
+ * @param[out] pring The ring
+ * @return 0 on success, errno on failure
+ */
+int msg_ring_attach(TALLOC_CTX *mem_ctx, const char *path,
+		    struct msg_ring **pring);
+
+/**
+ * @brief The largest message that can be put into the ring
+ */
+size_t msg_ring_max_msg(const struct msg_ring *ring);
+
+/**
+ * @brief Append a message to the ring
+ *
+ * @param[in] ring The ring
+ * @param[in] seq The sequence number to tag the message with
+ * @param[in] iov The message
+ * @param[in] iovlen The number of iov structs
+ * @param[out] pkick Set to true if the reader has to be woken up
+ * @return 0 on success, ENOSPC if the message does not fit right now
+ */
+int msg_ring_write(struct msg_ring *ring, uint64_t seq,
+		   const struct iovec *iov, int iovlen, bool *pkick);
+
+/**
+ * @brief Look at the next message in the ring
+ *
+ * @param[in] ring The ring
+ * @param[out] pseq The message's sequence number
+ * @param[out] plen The message's length
+ * @return true if there is a message, false if the ring is empty
+ */
+bool msg_ring_peek(struct msg_ring *ring, uint64_t *pseq, size_t *plen);
+
+/**
+ * @brief Copy out and remove the message found by msg_ring_peek
+ *
+ * @param[in] ring The ring
+ * @param[out] buf Space for the message length returned by msg_ring_peek
+ */
+void msg_ring_consume(struct msg_ring *ring, uint8_t *buf);
+
+#endif
@@ -193,6 +193,56 @@ int main(void)
 
 	expect_messages(ev, &state, 5);
 
+	printf("sending a batch of small messages\n");
+
+	{
+		struct iovec iovs[20];
+		int iovlens[ARRAY_SIZE(iovs)];
+
+		for (i=0; i<ARRAY_SIZE(iovs); i++) {
+			iovs[i].iov_base = buf;
+			iovs[i].iov_len = 10;
+			iovlens[i] = 1;
+		}
+		state.buf = buf;
+		state.buflen = 10;
+
+		ret = unix_msg_send_batch(ctx1, &addr2, iovs, iovlens,
+					  ARRAY_SIZE(iovs));
+		if (ret != 0) {
+			fprintf(stderr, "unix_msg_send_batch failed: %s\n",
+				strerror(ret));
+			return 1;
+		}
+
+		expect_messages(ev, &state, ARRAY_SIZE(iovs));
+	}
+
+	printf("sending a batch of large messages\n");
+
+	{
+		struct iovec iovs[3];
+		int iovlens[ARRAY_SIZE(iovs)];
+
+		for (i=0; i<ARRAY_SIZE(iovs); i++) {
+			iovs[i].iov_base = buf;
+			iovs[i].iov_len = sizeof(buf);
+			iovlens[i] = 1;
+		}
+		state.buf = buf;
+		state.buflen = sizeof(buf);
+
+		ret = unix_msg_send_batch(ctx1, &addr2, iovs, iovlens,
+					  ARRAY_SIZE(iovs));
+		if (ret != 0) {
+			fprintf(stderr, "unix_msg_send_batch failed: %s\n",
+				strerror(ret));
+			return 1;
+		}
+
+		expect_messages(ev, &state, ARRAY_SIZE(iovs));
+	}
+
 	printf("Filling send queues before freeing\n");
 
 	for (i=0; i<5; i++) {
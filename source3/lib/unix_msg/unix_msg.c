@@ -705,7 +705,19 @@ static int unix_dgram_free(struct unix_dgram_ctx *ctx)
  * Every multi-fragment message has a cookie != 0 and starts with a cookie
  * followed by a struct unix_msg_header and then the data. The pid and sock
  * fields are used to assure uniqueness on the receiver side.
+ *
+ * A cookie value of UNIX_MSG_COOKIE_BATCH indicates a datagram carrying
+ * several complete messages, each prefixed by its uint32_t length. Batches
+ * never carry file descriptors. Multi-fragment cookies skip this value.
+ */
+
+#define UNIX_MSG_COOKIE_BATCH UINT64_MAX
+
+/*
+ * Upper bound for the iovecs a batch datagram is put together from, well
+ * below any system's IOV_MAX.
  */
+#define UNIX_MSG_BATCH_MAX_IOV 128
 
 struct unix_msg_hdr {
 	size_t msglen;
@@ -734,6 +746,10 @@ struct unix_msg_ctx {
 			      void *private_data);
 	void *private_data;
 
+	void (*batch_callback)(struct unix_msg_ctx *ctx,
+			       uint8_t *buf, size_t buflen,
+			       void *private_data);
+
 	struct unix_msg *msgs;
 };
 
@@ -888,13 +904,184 @@ int unix_msg_send(struct unix_msg_ctx *ctx, const struct sockaddr_un *dst,
 	}
 
 	ctx->cookie += 1;
-	if (ctx->cookie == 0) {
-		ctx->cookie += 1;
+	if ((ctx->cookie == 0) || (ctx->cookie == UNIX_MSG_COOKIE_BATCH)) {
+		ctx->cookie = 1;
+	}
+
+	return ret;
+}
+
+struct unix_msg_batch {
+	struct iovec iov[UNIX_MSG_BATCH_MAX_IOV];
+	uint32_t lens[UNIX_MSG_BATCH_MAX_IOV];
+	uint64_t cookie;
+	int iovlen;
+	size_t num_msgs;
+	size_t len;
+
+	/* For a batch with a single message we don't frame it */
+	const struct iovec *first_iov;
+	int first_iovlen;
+};
+
+static void unix_msg_batch_reset(struct unix_msg_batch *b)
+{
+	b->cookie = UNIX_MSG_COOKIE_BATCH;
+	b->iov[0] = (struct iovec) {
+		.iov_base = &b->cookie, .iov_len = sizeof(b->cookie)
+	};
+	b->iovlen = 1;
+	b->num_msgs = 0;
+	b->len = sizeof(b->cookie);
+}
+
+static int unix_msg_batch_flush(struct unix_msg_ctx *ctx,
+				const struct sockaddr_un *dst,
+				struct unix_msg_batch *b)
+{
+	int ret = 0;
+
+	if (b->num_msgs == 1) {
+		ret = unix_msg_send(ctx, dst, b->first_iov, b->first_iovlen,
+				    NULL, 0);
+	} else if (b->num_msgs > 1) {
+		ret = unix_dgram_send(ctx->dgram, dst, b->iov, b->iovlen,
+				      NULL, 0);
 	}
 
+	unix_msg_batch_reset(b);
 	return ret;
 }
 
+int unix_msg_send_batch(struct unix_msg_ctx *ctx,
+			const struct sockaddr_un *dst,
+			const struct iovec *iov, const int *iovlens,
+			size_t num_msgs)
+{
+	struct unix_msg_batch b;
+	size_t i;
+	int ret;
+
+	unix_msg_batch_reset(&b);
+
+	for (i=0; i<num_msgs; i++) {
+		int iovlen = iovlens[i];
+		ssize_t msglen;
+		size_t needed;
+
+		if (iovlen < 0) {
+			return EINVAL;
+		}
+
+		msglen = iov_buflen(iov, iovlen);
+		if ((msglen == -1) || (msglen > UINT32_MAX)) {
+			return EINVAL;
+		}
+		needed = sizeof(uint32_t) + msglen;
+
+		if ((b.len + needed > ctx->fragment_len) ||
+		    (b.iovlen + 1 + iovlen > UNIX_MSG_BATCH_MAX_IOV)) {
+			ret = unix_msg_batch_flush(ctx, dst, &b);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+
+		if ((b.len + needed > ctx->fragment_len) ||
+		    (b.iovlen + 1 + iovlen > UNIX_MSG_BATCH_MAX_IOV)) {
+			/*
+			 * Does not fit into a batch datagram on its own,
+			 * send it separately.
+			 */
+			ret = unix_msg_send(ctx, dst, iov, iovlen, NULL, 0);
+			if (ret != 0) {
+				return ret;
+			}
+			iov += iovlen;
+			continue;
+		}
+
+		if (b.num_msgs == 0) {
+			b.first_iov = iov;
+			b.first_iovlen = iovlen;
+		}
+
+		b.lens[b.num_msgs] = msglen;
+		b.iov[b.iovlen] = (struct iovec) {
+			.iov_base = &b.lens[b.num_msgs],
+			.iov_len = sizeof(uint32_t)
+		};
+		if (iovlen > 0) {
+			memcpy(&b.iov[b.iovlen+1], iov,
+			       sizeof(struct iovec) * iovlen);
+		}
+		b.iovlen += 1 + iovlen;
+		b.num_msgs += 1;
+		b.len += needed;
+
+		iov += iovlen;
+	}
+
+	return unix_msg_batch_flush(ctx, dst, &b);
+}
+
+bool unix_msg_batch_next(const uint8_t *buf, size_t buflen, size_t *pofs,
+			 size_t *pmsg_ofs, size_t *pmsg_len)
+{
+	size_t ofs = *pofs;
+	uint32_t msglen;
+
+	if ((ofs > buflen) || (buflen - ofs < sizeof(msglen))) {
+		return false;
+	}
+	memcpy(&msglen, buf + ofs, sizeof(msglen));
+	ofs += sizeof(msglen);
+
+	if (msglen > buflen - ofs) {
+		return false;
+	}
+
+	*pmsg_ofs = ofs;
+	*pmsg_len = msglen;
+	*pofs = ofs + msglen;
+	return true;
+}
+
+void unix_msg_set_batch_callback(
+	struct unix_msg_ctx *ctx,
+	void (*batch_callback)(struct unix_msg_ctx *ctx,
+			       uint8_t *buf, size_t buflen,
+			       void *private_data))
+{
+	ctx->batch_callback = batch_callback;
+}
+
+static void unix_msg_recv_batch(struct unix_msg_ctx *ctx,
+				const uint8_t *buf, size_t buflen)
+{
+	uint8_t *copy;
+	size_t ofs, msg_ofs, msg_len;
+
+	/*
+	 * The callback might run a nested event loop reusing the
+	 * dgram receive buffer, so work on a copy.
+	 */
+	copy = malloc(buflen);
+	if (copy == NULL) {
+		return;
+	}
+	memcpy(copy, buf, buflen);
+
+	ofs = 0;
+
+	while (unix_msg_batch_next(copy, buflen, &ofs, &msg_ofs, &msg_len)) {
+		ctx->recv_callback(ctx, copy + msg_ofs, msg_len, NULL, 0,
+				   ctx->private_data);
+	}
+
+	free(copy);
+}
+
 static void unix_msg_recv(struct unix_dgram_ctx *dgram_ctx,
 			  uint8_t *buf, size_t buflen,
 			  int *fds, size_t num_fds,
@@ -921,6 +1108,17 @@ static void unix_msg_recv(struct unix_dgram_ctx *dgram_ctx,
 		return;
 	}
 
+	if (cookie == UNIX_MSG_COOKIE_BATCH) {
+		close_fd_array(fds, num_fds);
+		if (ctx->batch_callback != NULL) {
+			ctx->batch_callback(ctx, buf, buflen,
+					    ctx->private_data);
+			return;
+		}
+		unix_msg_recv_batch(ctx, buf, buflen);
+		return;
+	}
+
 	if (buflen < sizeof(hdr)) {
 		goto close_fds;
 	}
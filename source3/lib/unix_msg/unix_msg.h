@@ -108,6 +108,59 @@ int unix_msg_send(struct unix_msg_ctx *ctx, const struct sockaddr_un *dst,
 		  const struct iovec *iov, int iovlen,
 		  const int *fds, size_t num_fds);
 
+/**
+ * @brief Send several messages to one destination
+ *
+ * Small messages are coalesced into as few datagrams as possible, each
+ * one is delivered to the receiver's recv_callback individually and in
+ * order. Messages not fitting into a single datagram are sent as with
+ * unix_msg_send. Batched messages can't pass file descriptors.
+ *
+ * @param[in] ctx The context to send across
+ * @param[in] dst The destination socket path
+ * @param[in] iov The iovecs of all messages, one after the other
+ * @param[in] iovlens The number of iov structs for each message
+ * @param[in] num_msgs The number of messages
+ * @return 0 on success, errno on failure
+ */
+
+int unix_msg_send_batch(struct unix_msg_ctx *ctx,
+			const struct sockaddr_un *dst,
+			const struct iovec *iov, const int *iovlens,
+			size_t num_msgs);
+
+/**
+ * @brief Take over received batches
+ *
+ * By default all messages of a batch are passed to recv_callback one
+ * after the other from within a single poll event. A caller that can't
+ * deal with that can set a batch_callback. It gets the whole batch and
+ * walks it with unix_msg_batch_next.
+ *
+ * @param[in] ctx The message context
+ * @param[in] batch_callback The function to call for a batch
+ */
+
+void unix_msg_set_batch_callback(
+	struct unix_msg_ctx *ctx,
+	void (*batch_callback)(struct unix_msg_ctx *ctx,
+			       uint8_t *buf, size_t buflen,
+			       void *private_data));
+
+/**
+ * @brief Find the next message in a batch
+ *
+ * @param[in] buf The batch passed to the batch_callback
+ * @param[in] buflen The batch length
+ * @param[in,out] pofs The read position, start with 0
+ * @param[out] pmsg_ofs The message's offset into buf
+ * @param[out] pmsg_len The message's length
+ * @return true if there was another message
+ */
+
+bool unix_msg_batch_next(const uint8_t *buf, size_t buflen, size_t *pofs,
+			 size_t *pmsg_ofs, size_t *pmsg_len);
+
 /**
  * @brief Free a unix_msg_ctx
  *
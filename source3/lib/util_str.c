@@ -36,6 +36,51 @@ static const char toupper_ascii_fast_table[128] = {
 	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f
 };
 
+/*
+  Change the case of 8 ascii characters at once: a byte gets 0x20
+  flipped if it is in the range first..last. No byte is >= 0x80, so
+  the additions don't carry into the next byte.
+*/
+
+#define ASCII_CASE_ONES UINT64_C(0x0101010101010101)
+#define ASCII_CASE_HIGH UINT64_C(0x8080808080808080)
+
+static uint64_t ascii_flip_case8(uint64_t w, uint8_t first, uint8_t last)
+{
+	uint64_t ge_first = w + (0x80 - first) * ASCII_CASE_ONES;
+	uint64_t gt_last = w + (0x80 - last - 1) * ASCII_CASE_ONES;
+	uint64_t in_range = (ge_first & ~gt_last) & ASCII_CASE_HIGH;
+
+	return w ^ (in_range >> 2);
+}
+
+/*
+  Change the case of the leading ascii characters of s in chunks of 8,
+  return the number of bytes done.
+*/
+static size_t ascii_change_case(char *s, size_t len, bool upper)
+{
+	size_t n = 0;
+
+	while (len - n >= 8) {
+		uint64_t w;
+
+		memcpy(&w, s + n, 8);
+		if ((w & ASCII_CASE_HIGH) != 0) {
+			break;
+		}
+		if (upper) {
+			w = ascii_flip_case8(w, 'a', 'z');
+		} else {
+			w = ascii_flip_case8(w, 'A', 'Z');
+		}
+		memcpy(s + n, &w, 8);
+		n += 8;
+	}
+
+	return n;
+}
+
 /**
  * Compare 2 strings up to and including the nth char.
  *
@@ -471,6 +516,8 @@ bool strlower_m(char *s)
 	   supported multi-byte character sets are ascii-compatible
 	   (ie. they match for the first 128 chars) */
 
+	s += ascii_change_case(s, strlen(s), false);
+
 	while (*s && !(((unsigned char)s[0]) & 0x80)) {
 		*s = tolower_m((unsigned char)*s);
 		s++;
@@ -558,6 +605,8 @@ bool strupper_m(char *s)
 	   supported multi-byte character sets are ascii-compatible
 	   (ie. they match for the first 128 chars) */
 
+	s += ascii_change_case(s, strlen(s), true);
+
 	while (*s && !(((unsigned char)s[0]) & 0x80)) {
 		*s = toupper_ascii_fast_table[(unsigned char)s[0]];
 		s++;
@@ -33,6 +33,7 @@
 #include "serverid.h"
 #include "messages.h"
 #include "util_tdb.h"
+#include "lib/util/tsort.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_LOCKING
@@ -43,6 +44,32 @@
 
 static struct db_context *brlock_db;
 
+/*
+ * Readonly byte range lock records are cached in fsp->brlock_rec and
+ * used for every strict locking check on read and write. Once such a
+ * record has a lot of locks and has been looked at more than once we
+ * build an in-memory interval index over it, so that I/O checks only
+ * look at locks that can actually overlap the I/O range. The
+ * brlock.tdb record format is unchanged.
+ */
+
+#define BRL_RANGE_INDEX_MIN_LOCKS 32
+#define BRL_RANGE_INDEX_MIN_USES 2
+
+struct brl_range {
+	br_off start;
+	br_off end;
+	br_off max_end;		/* Largest end in the implicit subtree */
+	unsigned int idx;	/* Index into lock_data */
+};
+
+struct brl_range_index {
+	unsigned int num_ranges;
+	struct brl_range *ranges;	/* Sorted by start */
+	unsigned int num_wide;
+	unsigned int *wide;		/* Locks reaching beyond 2^64 */
+};
+
 struct byte_range_lock {
 	struct files_struct *fsp;
 	unsigned int num_locks;
@@ -50,6 +77,8 @@ struct byte_range_lock {
 	uint32_t num_read_oplocks;
 	struct lock_struct *lock_data;
 	struct db_record *record;
+	unsigned int num_uses;
+	struct brl_range_index *range_index;
 };
 
 /****************************************************************************
@@ -1380,6 +1409,180 @@ bool brl_unlock(struct messaging_context *msg_ctx,
 	}
 }
 
+/****************************************************************************
+ Does a lock range reach beyond the end of the 64 bit file space ? For those
+ brl_overlap() has special rules, they are never put into the range index.
+****************************************************************************/
+
+static bool brl_range_wraps(br_off start, br_off size)
+{
+	return (start + size < start);
+}
+
+static int brl_range_cmp(const struct brl_range *r1,
+			 const struct brl_range *r2)
+{
+	if (r1->start != r2->start) {
+		return (r1->start < r2->start) ? -1 : 1;
+	}
+	if (r1->idx != r2->idx) {
+		return (r1->idx < r2->idx) ? -1 : 1;
+	}
+	return 0;
+}
+
+/****************************************************************************
+ Fill in max_end for the implicit balanced tree over the sorted ranges
+ [lo, hi), rooted at the middle element.
+****************************************************************************/
+
+static br_off brl_range_index_fill(struct brl_range *ranges,
+				   unsigned int lo, unsigned int hi)
+{
+	unsigned int mid;
+	br_off max_end, sub;
+
+	if (lo >= hi) {
+		return 0;
+	}
+
+	mid = lo + (hi - lo) / 2;
+	max_end = ranges[mid].end;
+
+	sub = brl_range_index_fill(ranges, lo, mid);
+	max_end = MAX(max_end, sub);
+	sub = brl_range_index_fill(ranges, mid + 1, hi);
+	max_end = MAX(max_end, sub);
+
+	ranges[mid].max_end = max_end;
+	return max_end;
+}
+
+static struct brl_range_index *brl_range_index_create(
+	TALLOC_CTX *mem_ctx, const struct lock_struct *locks,
+	unsigned int num_locks)
+{
+	struct brl_range_index *ri;
+	unsigned int i;
+
+	ri = talloc_zero(mem_ctx, struct brl_range_index);
+	if (ri == NULL) {
+		return NULL;
+	}
+	ri->ranges = talloc_array(ri, struct brl_range, num_locks);
+	ri->wide = talloc_array(ri, unsigned int, num_locks);
+	if ((ri->ranges == NULL) || (ri->wide == NULL)) {
+		TALLOC_FREE(ri);
+		return NULL;
+	}
+
+	for (i=0; i<num_locks; i++) {
+		const struct lock_struct *lock = &locks[i];
+
+		if (brl_range_wraps(lock->start, lock->size)) {
+			ri->wide[ri->num_wide++] = i;
+			continue;
+		}
+		ri->ranges[ri->num_ranges++] = (struct brl_range) {
+			.start = lock->start,
+			.end = lock->start + lock->size,
+			.idx = i,
+		};
+	}
+
+	TYPESAFE_QSORT(ri->ranges, ri->num_ranges, brl_range_cmp);
+	brl_range_index_fill(ri->ranges, 0, ri->num_ranges);
+
+	return ri;
+}
+
+/****************************************************************************
+ Search the implicit tree over ranges [lo, hi) for a lock conflicting with
+ rw_probe. Only ranges with start < end && range end > start can overlap.
+****************************************************************************/
+
+static bool brl_range_index_conflict(const struct brl_range *ranges,
+				     unsigned int lo, unsigned int hi,
+				     const struct lock_struct *locks,
+				     const struct lock_struct *rw_probe)
+{
+	br_off start = rw_probe->start;
+	br_off end = rw_probe->start + rw_probe->size;
+	unsigned int mid;
+
+	if (lo >= hi) {
+		return false;
+	}
+
+	mid = lo + (hi - lo) / 2;
+
+	if (ranges[mid].max_end <= start) {
+		/* Nothing in this subtree reaches into the probe */
+		return false;
+	}
+
+	if (brl_range_index_conflict(ranges, lo, mid, locks, rw_probe)) {
+		return true;
+	}
+
+	if (ranges[mid].start >= end) {
+		/* mid and everything right of it starts behind the probe */
+		return false;
+	}
+
+	if ((ranges[mid].end > start) &&
+	    brl_conflict_other(&locks[ranges[mid].idx], rw_probe)) {
+		return true;
+	}
+
+	return brl_range_index_conflict(ranges, mid + 1, hi, locks, rw_probe);
+}
+
+/****************************************************************************
+ Readonly variant of the conflict loop in brl_locktest(). Returns -1 if the
+ index can't be used, 1 on conflict, 0 otherwise.
+****************************************************************************/
+
+static int brl_locktest_indexed(struct byte_range_lock *br_lck,
+				const struct lock_struct *rw_probe)
+{
+	struct brl_range_index *ri;
+	unsigned int i;
+
+	if ((br_lck->record != NULL) ||
+	    (br_lck->num_locks < BRL_RANGE_INDEX_MIN_LOCKS) ||
+	    brl_range_wraps(rw_probe->start, rw_probe->size)) {
+		return -1;
+	}
+
+	if (br_lck->range_index == NULL) {
+		br_lck->num_uses += 1;
+		if (br_lck->num_uses < BRL_RANGE_INDEX_MIN_USES) {
+			return -1;
+		}
+		br_lck->range_index = brl_range_index_create(
+			br_lck, br_lck->lock_data, br_lck->num_locks);
+		if (br_lck->range_index == NULL) {
+			return -1;
+		}
+	}
+	ri = br_lck->range_index;
+
+	for (i=0; i<ri->num_wide; i++) {
+		if (brl_conflict_other(&br_lck->lock_data[ri->wide[i]],
+				       rw_probe)) {
+			return 1;
+		}
+	}
+
+	if (brl_range_index_conflict(ri->ranges, 0, ri->num_ranges,
+				     br_lck->lock_data, rw_probe)) {
+		return 1;
+	}
+
+	return 0;
+}
+
 /****************************************************************************
  Test if we could add a lock if we wanted to.
  Returns True if the region required is currently unlocked, False if locked.
@@ -1392,9 +1595,15 @@ bool brl_locktest(struct byte_range_lock *br_lck,
 	unsigned int i;
 	struct lock_struct *locks = br_lck->lock_data;
 	files_struct *fsp = br_lck->fsp;
+	int conflict;
+
+	conflict = brl_locktest_indexed(br_lck, rw_probe);
+	if (conflict == 1) {
+		return false;
+	}
 
 	/* Make sure existing locks don't conflict */
-	for (i=0; i < br_lck->num_locks; i++) {
+	for (i=0; (conflict == -1) && (i < br_lck->num_locks); i++) {
 		/*
 		 * Our own locks don't conflict.
 		 */
@@ -2081,6 +2290,8 @@ struct byte_range_lock *brl_get_locks_readonly(files_struct *fsp)
 		br_lock->num_read_oplocks = 0;
 		br_lock->num_locks = 0;
 		br_lock->lock_data = NULL;
+		br_lock->num_uses = 0;
+		br_lock->range_index = NULL;
 
 	} else if (!NT_STATUS_IS_OK(status)) {
 		DEBUG(3, ("Could not parse byte range lock record: "
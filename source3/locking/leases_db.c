@@ -89,6 +89,28 @@ static bool leases_db_key(TALLOC_CTX *mem_ctx,
 	return true;
 }
 
+/*
+ * Return the database and key of a lease record, so that it can be
+ * migrated together with the share mode record
+ */
+bool leases_db_record_key(TALLOC_CTX *mem_ctx,
+			  const struct GUID *client_guid,
+			  const struct smb2_lease_key *lease_key,
+			  struct db_context **db,
+			  TDB_DATA *key)
+{
+	if (!leases_db_init(false)) {
+		return false;
+	}
+
+	if (!leases_db_key(mem_ctx, client_guid, lease_key, key)) {
+		return false;
+	}
+
+	*db = leases_db;
+	return true;
+}
+
 NTSTATUS leases_db_add(const struct GUID *client_guid,
 		       const struct smb2_lease_key *lease_key,
 		       const struct file_id *id,
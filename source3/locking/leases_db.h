@@ -21,12 +21,21 @@
 #ifndef _LEASES_DB_H_
 #define _LEASES_DB_H_
 
+#include <talloc.h>
+#include "tdb.h"
+
 struct GUID;
 struct smb2_lease_key;
 struct file_id;
 struct leases_db_file;
+struct db_context;
 
 bool leases_db_init(bool read_only);
+bool leases_db_record_key(TALLOC_CTX *mem_ctx,
+			  const struct GUID *client_guid,
+			  const struct smb2_lease_key *lease_key,
+			  struct db_context **db,
+			  TDB_DATA *key);
 NTSTATUS leases_db_add(const struct GUID *client_guid,
 		       const struct smb2_lease_key *lease_key,
 		       const struct file_id *id,
@@ -145,6 +145,9 @@ bool locking_end(void);
 char *share_mode_str(TALLOC_CTX *ctx, int num, const struct share_mode_entry *e);
 struct share_mode_lock *get_existing_share_mode_lock(TALLOC_CTX *mem_ctx,
 						     struct file_id id);
+void share_mode_lock_prefetch(struct file_id id,
+			      const struct GUID *client_guid,
+			      const struct smb2_lease_key *lease_key);
 struct share_mode_lock *get_share_mode_lock(
 	TALLOC_CTX *mem_ctx,
 	struct file_id id,
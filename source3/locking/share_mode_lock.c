@@ -48,6 +48,7 @@
 #include "../librpc/gen_ndr/ndr_open_files.h"
 #include "source3/lib/dbwrap/dbwrap_watch.h"
 #include "locking/leases_db.h"
+#include "lib/dbwrap/dbwrap_ctdb.h"
 #include "../lib/util/memcache.h"
 
 #undef DBGC_CLASS
@@ -498,6 +499,48 @@ fail:
 	return NULL;
 }
 
+/*******************************************************************
+ With clustering, bring the share mode record of a file and, if given,
+ the lease record of an open to this node in one round trip to ctdbd.
+ The following get_share_mode_lock() and leases_db_add() then find
+ their records local instead of migrating them one after the other.
+********************************************************************/
+
+void share_mode_lock_prefetch(struct file_id id,
+			      const struct GUID *client_guid,
+			      const struct smb2_lease_key *lease_key)
+{
+	TALLOC_CTX *frame;
+	struct db_context *dbs[2];
+	TDB_DATA keys[2];
+	size_t num_keys = 0;
+	NTSTATUS status;
+
+	if (!lp_clustering() || (lock_db == NULL)) {
+		return;
+	}
+
+	frame = talloc_stackframe();
+
+	dbs[num_keys] = lock_db;
+	keys[num_keys] = locking_key(&id);
+	num_keys += 1;
+
+	if ((client_guid != NULL) && (lease_key != NULL) &&
+	    leases_db_record_key(frame, client_guid, lease_key,
+				 &dbs[num_keys], &keys[num_keys])) {
+		num_keys += 1;
+	}
+
+	status = dbwrap_ctdb_migrate_records(num_keys, dbs, keys);
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(10, ("dbwrap_ctdb_migrate_records failed: %s\n",
+			   nt_errstr(status)));
+	}
+
+	TALLOC_FREE(frame);
+}
+
 /*******************************************************************
  Either fetch a share mode from the database, or allocate a fresh
  one if the record doesn't exist.
@@ -609,13 +652,55 @@ fail:
 	return NULL;
 }
 
+/*******************************************************************
+ Unlocked readers never modify the share_mode_data they fetched, so
+ hand it back to the memcache when they're done with it. Subsequent
+ locked or unlocked fetches with an unchanged sequence number then
+ skip the NDR parse. Don't overwrite an entry someone else has put
+ into the cache in the meantime, it's at least as fresh as ours.
+********************************************************************/
+
+static int share_mode_data_unlocked_destructor(struct share_mode_data *d)
+{
+	const DATA_BLOB key = memcache_key(&d->id);
+	void *ptr;
+
+	if (d->modified) {
+		return 0;
+	}
+
+	ptr = memcache_lookup_talloc(NULL,
+			SHARE_MODE_LOCK_CACHE,
+			key);
+	if (ptr != NULL) {
+		return 0;
+	}
+
+	share_mode_memcache_store(d);
+	return -1;
+}
+
 static void fetch_share_mode_unlocked_parser(
 	TDB_DATA key, TDB_DATA data, void *private_data)
 {
 	struct share_mode_lock *lck = talloc_get_type_abort(
 		private_data, struct share_mode_lock);
 
+	lck->data = NULL;
+
+	if (key.dsize != sizeof(struct file_id)) {
+		DEBUG(1, ("Invalid key length %zu\n", key.dsize));
+		return;
+	}
+
 	lck->data = parse_share_modes(lck, key, data);
+	if (lck->data == NULL) {
+		return;
+	}
+
+	memcpy(&lck->data->id, key.dptr, key.dsize);
+	talloc_set_destructor(lck->data,
+			      share_mode_data_unlocked_destructor);
 }
 
 /*******************************************************************
@@ -0,0 +1,704 @@
+/*
+ * VFS module to prefetch stat and DOS attributes of directory entries
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Listing a directory makes smbd stat every entry and fetch its DOS
+ * attribute xattr, one entry after the other. On file systems with a
+ * high per-operation latency this dominates the listing time.
+ *
+ * This module reads directory entries in batches and does the stat
+ * and getxattr calls for a whole batch in parallel in a thread pool,
+ * with the credentials of the current user set on each worker thread.
+ * While smbd works through one batch, the next one is already being
+ * fetched. The stat result is handed to smbd via the sbuf argument of
+ * readdir, which makes smbd skip its own stat call, the same way
+ * vfs_default does with fstatat. The DOS attribute of the entry last
+ * returned is served from getxattr.
+ *
+ * The workers use the plain syscalls, VFS modules are not thread
+ * safe. So this module only prefetches if it is directly on top of
+ * vfs_default, that is last in the "vfs objects" list.
+ */
+
+#include "includes.h"
+#include "smbd/smbd.h"
+#include "system/filesys.h"
+#include "lib/util/dlinklist.h"
+#include "lib/pthreadpool/pthreadpool.h"
+
+/*
+ * Don't hand out prefetched data older than this
+ */
+#define DIRPREFETCH_MAX_AGE_NSEC 1000000000
+
+struct dirprefetch_batch {
+	struct dirprefetch_batch *prev, *next;
+	int id;
+
+	struct dirprefetch_entry *entries;
+	unsigned num_entries;
+	struct timespec fetched;
+
+	/*
+	 * Jobs handed to the pool and finished. The workers write
+	 * into entries until num_done == num_jobs.
+	 */
+	unsigned num_jobs;
+	unsigned num_done;
+
+	const struct security_unix_token *ux_tok;
+	bool fake_dir_create_times;
+	bool posix_pathnames;
+	bool dos_attributes;
+};
+
+struct dirprefetch_entry {
+	struct dirent de;
+	long offset;
+	char *path;
+	const struct dirprefetch_batch *batch;
+
+	bool have_stat;
+	SMB_STRUCT_STAT st;
+
+	bool have_dosattr;
+	ssize_t dosattr_len;
+	int dosattr_errno;
+	char dosattr[sizeof(fstring)];
+};
+
+struct dirprefetch_dir {
+	struct dirprefetch_dir *prev, *next;
+	DIR *dirp;
+	char *path;
+
+	/*
+	 * The batch readdir hands out entries from and the one after
+	 * it, still being fetched
+	 */
+	struct dirprefetch_batch *cur;
+	struct dirprefetch_batch *ahead;
+	unsigned pos;
+};
+
+struct dirprefetch_config {
+	struct dirprefetch_dir *dirs;
+	unsigned batch_size;
+	unsigned num_threads;
+	bool dos_attributes;
+
+	/*
+	 * The entry readdir returned last if its DOS attribute can be
+	 * served
+	 */
+	struct dirprefetch_entry *last;
+};
+
+static int dirprefetch_connect(struct vfs_handle_struct *handle,
+			       const char *service, const char *user)
+{
+	struct dirprefetch_config *config;
+	int ret;
+
+	ret = SMB_VFS_NEXT_CONNECT(handle, service, user);
+	if (ret < 0) {
+		return ret;
+	}
+
+	config = talloc_zero(handle->conn, struct dirprefetch_config);
+	if (config == NULL) {
+		SMB_VFS_NEXT_DISCONNECT(handle);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	config->batch_size = lp_parm_int(SNUM(handle->conn), "dirprefetch",
+					 "batch size", 128);
+	config->num_threads = lp_parm_int(SNUM(handle->conn), "dirprefetch",
+					  "threads", 8);
+	config->dos_attributes =
+		lp_store_dos_attributes(SNUM(handle->conn)) &&
+		lp_parm_bool(SNUM(handle->conn), "dirprefetch",
+			     "dos attributes", true);
+
+	if (config->batch_size == 0) {
+		config->batch_size = 1;
+	}
+
+	/*
+	 * vfs_default is always at the bottom of the stack. Anything
+	 * between it and us would be bypassed by the workers.
+	 */
+	if ((handle->next == NULL) || (handle->next->next != NULL)) {
+		DEBUG(1, ("dirprefetch: not the last module in \"vfs "
+			  "objects\" for service %s, not prefetching\n",
+			  service));
+		config->batch_size = 0;
+	}
+
+	SMB_VFS_HANDLE_SET_DATA(handle, config, NULL,
+				struct dirprefetch_config, return -1);
+
+	return 0;
+}
+
+static struct dirprefetch_dir *dirprefetch_find(
+	struct dirprefetch_config *config, DIR *dirp)
+{
+	struct dirprefetch_dir *d;
+
+	for (d = config->dirs; d != NULL; d = d->next) {
+		if (d->dirp == dirp) {
+			return d;
+		}
+	}
+	return NULL;
+}
+
+static void dirprefetch_drop(struct dirprefetch_config *config,
+			     struct dirprefetch_dir *d)
+{
+	config->last = NULL;
+	TALLOC_FREE(d->cur);
+	TALLOC_FREE(d->ahead);
+	d->pos = 0;
+}
+
+static DIR *dirprefetch_add(struct vfs_handle_struct *handle, DIR *dirp,
+			    const char *path)
+{
+	struct dirprefetch_config *config;
+	struct dirprefetch_dir *d;
+
+	if (dirp == NULL) {
+		return NULL;
+	}
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dirprefetch_config,
+				return dirp);
+
+	if (config->batch_size == 0) {
+		return dirp;
+	}
+
+	d = talloc_zero(config, struct dirprefetch_dir);
+	if (d == NULL) {
+		/*
+		 * Just don't prefetch
+		 */
+		return dirp;
+	}
+	d->dirp = dirp;
+	d->path = talloc_strdup(d, path);
+	if (d->path == NULL) {
+		TALLOC_FREE(d);
+		return dirp;
+	}
+
+	DLIST_ADD(config->dirs, d);
+	return dirp;
+}
+
+static DIR *dirprefetch_opendir(vfs_handle_struct *handle,
+				const char *fname, const char *mask,
+				uint32_t attr)
+{
+	DIR *dirp;
+
+	dirp = SMB_VFS_NEXT_OPENDIR(handle, fname, mask, attr);
+	return dirprefetch_add(handle, dirp, fname);
+}
+
+static DIR *dirprefetch_fdopendir(vfs_handle_struct *handle,
+				  files_struct *fsp, const char *mask,
+				  uint32_t attr)
+{
+	DIR *dirp;
+
+	dirp = SMB_VFS_NEXT_FDOPENDIR(handle, fsp, mask, attr);
+	return dirprefetch_add(handle, dirp, fsp->fsp_name->base_name);
+}
+
+#ifdef USE_LINUX_THREAD_CREDENTIALS
+
+/*
+ * Shared over all instances of this module in this process, together
+ * with the batches that have jobs in the pool
+ */
+static struct pthreadpool *dirprefetch_pool;
+static struct dirprefetch_batch *dirprefetch_inflight;
+static int dirprefetch_next_id;
+
+static void dirprefetch_worker(void *private_data)
+{
+	struct dirprefetch_entry *e = private_data;
+	const struct dirprefetch_batch *b = e->batch;
+	const struct security_unix_token *tok = b->ux_tok;
+	int ret;
+
+	ret = set_thread_credentials(tok->uid, tok->gid,
+				     (size_t)tok->ngroups, tok->groups);
+	if (ret != 0) {
+		return;
+	}
+
+	/*
+	 * What vfswrap_readdir's fstatat would return
+	 */
+	if (b->posix_pathnames) {
+		ret = sys_lstat(e->path, &e->st, b->fake_dir_create_times);
+	} else {
+		ret = sys_stat(e->path, &e->st, b->fake_dir_create_times);
+	}
+	e->have_stat = (ret == 0);
+
+	if (!b->dos_attributes) {
+		return;
+	}
+
+	e->dosattr_len = getxattr(e->path, SAMBA_XATTR_DOS_ATTRIB,
+				  e->dosattr, sizeof(e->dosattr));
+	if (e->dosattr_len != -1) {
+		e->have_dosattr = true;
+	} else if (errno == ENOATTR) {
+		/*
+		 * Leave everything else like ENOTSUP to smbd, it
+		 * needs to see those
+		 */
+		e->dosattr_errno = errno;
+		e->have_dosattr = true;
+	}
+}
+
+/*
+ * Collect finished jobs until all jobs of b are done. Jobs of other
+ * batches can finish first, they are accounted to their batch.
+ */
+static void dirprefetch_wait(struct dirprefetch_batch *b)
+{
+	while (b->num_done < b->num_jobs) {
+		int jobids[64];
+		int i, ret;
+
+		ret = pthreadpool_finished_jobs(dirprefetch_pool, jobids,
+						ARRAY_SIZE(jobids));
+		if (ret < 0) {
+			smb_panic("dirprefetch: pthreadpool_finished_jobs "
+				  "failed");
+		}
+
+		for (i=0; i<ret; i++) {
+			struct dirprefetch_batch *f;
+
+			for (f = dirprefetch_inflight; f != NULL;
+			     f = f->next) {
+				if (f->id == jobids[i]) {
+					break;
+				}
+			}
+			if (f == NULL) {
+				smb_panic("dirprefetch: unknown job finished");
+			}
+
+			f->num_done += 1;
+			if (f->num_done == f->num_jobs) {
+				DLIST_REMOVE(dirprefetch_inflight, f);
+			}
+		}
+	}
+}
+
+/*
+ * The workers write into the entries, don't free them under their
+ * feet
+ */
+static int dirprefetch_batch_destructor(struct dirprefetch_batch *b)
+{
+	dirprefetch_wait(b);
+	return 0;
+}
+
+static void dirprefetch_start(struct vfs_handle_struct *handle,
+			      struct dirprefetch_config *config,
+			      struct dirprefetch_batch *b)
+{
+	unsigned i;
+	int ret;
+
+	if (dirprefetch_pool == NULL) {
+		ret = pthreadpool_init(config->num_threads,
+				       &dirprefetch_pool);
+		if (ret != 0) {
+			DEBUG(1, ("%s: pthreadpool_init failed: %s\n",
+				  __func__, strerror(ret)));
+			return;
+		}
+	}
+
+	b->ux_tok = copy_unix_token(b, get_current_utok(handle->conn));
+	if (b->ux_tok == NULL) {
+		return;
+	}
+	b->fake_dir_create_times =
+		lp_fake_directory_create_times(SNUM(handle->conn));
+	b->posix_pathnames = lp_posix_pathnames();
+	b->dos_attributes = config->dos_attributes;
+
+	b->id = dirprefetch_next_id;
+	dirprefetch_next_id = (dirprefetch_next_id + 1) & INT_MAX;
+
+	for (i=0; i<b->num_entries; i++) {
+		struct dirprefetch_entry *e = &b->entries[i];
+
+		e->batch = b;
+
+		ret = pthreadpool_add_job(dirprefetch_pool, b->id,
+					  dirprefetch_worker, e);
+		if (ret != 0) {
+			DEBUG(1, ("%s: pthreadpool_add_job failed: %s\n",
+				  __func__, strerror(ret)));
+			break;
+		}
+		b->num_jobs += 1;
+	}
+
+	if (b->num_jobs != 0) {
+		DLIST_ADD(dirprefetch_inflight, b);
+		talloc_set_destructor(b, dirprefetch_batch_destructor);
+	}
+
+	DEBUG(10, ("%s: prefetching %u entries\n", __func__, b->num_jobs));
+}
+
+#else
+
+static void dirprefetch_wait(struct dirprefetch_batch *b)
+{
+	return;
+}
+
+static void dirprefetch_start(struct vfs_handle_struct *handle,
+			      struct dirprefetch_config *config,
+			      struct dirprefetch_batch *b)
+{
+	return;
+}
+
+#endif
+
+/*
+ * Read the next batch of entries and start fetching their data
+ */
+static struct dirprefetch_batch *dirprefetch_fill(
+	struct vfs_handle_struct *handle,
+	struct dirprefetch_config *config,
+	struct dirprefetch_dir *d)
+{
+	bool path_is_dot = ISDOT(d->path);
+	struct dirprefetch_batch *b;
+	unsigned i;
+
+	b = talloc_zero(d, struct dirprefetch_batch);
+	if (b == NULL) {
+		return NULL;
+	}
+	b->entries = talloc_zero_array(b, struct dirprefetch_entry,
+				       config->batch_size);
+	if (b->entries == NULL) {
+		TALLOC_FREE(b);
+		return NULL;
+	}
+
+	for (i=0; i<config->batch_size; i++) {
+		struct dirprefetch_entry *e = &b->entries[i];
+		struct dirent *de;
+
+		de = SMB_VFS_NEXT_READDIR(handle, d->dirp, NULL);
+		if (de == NULL) {
+			break;
+		}
+		e->de = *de;
+		e->offset = SMB_VFS_NEXT_TELLDIR(handle, d->dirp);
+
+		/*
+		 * The way smbd_dirptr_get_entry builds the name we
+		 * see in getxattr
+		 */
+		if (path_is_dot) {
+			e->path = talloc_strdup(b->entries, de->d_name);
+		} else {
+			e->path = talloc_asprintf(b->entries, "%s/%s",
+						  d->path, de->d_name);
+		}
+		if (e->path == NULL) {
+			/*
+			 * Hand out what we have without prefetching
+			 */
+			b->num_entries = i + 1;
+			return b;
+		}
+	}
+	b->num_entries = i;
+
+	if (b->num_entries == 0) {
+		return b;
+	}
+
+	clock_gettime_mono(&b->fetched);
+	dirprefetch_start(handle, config, b);
+	return b;
+}
+
+/*
+ * Make the batch fetched ahead the current one and start fetching
+ * the one after it while waiting for the current one
+ */
+static void dirprefetch_advance(struct vfs_handle_struct *handle,
+				struct dirprefetch_config *config,
+				struct dirprefetch_dir *d)
+{
+	config->last = NULL;
+	TALLOC_FREE(d->cur);
+	d->pos = 0;
+
+	if (d->ahead != NULL) {
+		d->cur = d->ahead;
+		d->ahead = NULL;
+	} else {
+		d->cur = dirprefetch_fill(handle, config, d);
+		if (d->cur == NULL) {
+			return;
+		}
+	}
+
+	if (d->cur->num_entries == config->batch_size) {
+		d->ahead = dirprefetch_fill(handle, config, d);
+	}
+
+	dirprefetch_wait(d->cur);
+}
+
+static struct dirent *dirprefetch_readdir(vfs_handle_struct *handle,
+					  DIR *dirp,
+					  SMB_STRUCT_STAT *sbuf)
+{
+	struct dirprefetch_config *config;
+	struct dirprefetch_dir *d;
+	struct dirprefetch_entry *e;
+	struct timespec now;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dirprefetch_config,
+				return NULL);
+
+	d = dirprefetch_find(config, dirp);
+	if (d == NULL) {
+		return SMB_VFS_NEXT_READDIR(handle, dirp, sbuf);
+	}
+
+	config->last = NULL;
+
+	if ((d->cur == NULL) || (d->pos == d->cur->num_entries)) {
+		dirprefetch_advance(handle, config, d);
+		if (d->cur == NULL) {
+			/*
+			 * Out of memory, nothing was read ahead
+			 */
+			return SMB_VFS_NEXT_READDIR(handle, dirp, sbuf);
+		}
+		if (d->cur->num_entries == 0) {
+			return NULL;
+		}
+	}
+
+	e = &d->cur->entries[d->pos++];
+
+	if (sbuf != NULL) {
+		SET_STAT_INVALID(*sbuf);
+	}
+
+	clock_gettime_mono(&now);
+	if (nsec_time_diff(&now, &d->cur->fetched) >
+	    DIRPREFETCH_MAX_AGE_NSEC) {
+		return &e->de;
+	}
+
+	if ((sbuf != NULL) && e->have_stat) {
+		*sbuf = e->st;
+	}
+	if (e->have_dosattr) {
+		config->last = e;
+	}
+
+	return &e->de;
+}
+
+static bool dirprefetch_find_offset(struct dirprefetch_batch *b,
+				    long offset, unsigned *pidx)
+{
+	unsigned i;
+
+	if (b == NULL) {
+		return false;
+	}
+	for (i=0; i<b->num_entries; i++) {
+		if (b->entries[i].offset == offset) {
+			*pidx = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void dirprefetch_seekdir(vfs_handle_struct *handle, DIR *dirp,
+				long offset)
+{
+	struct dirprefetch_config *config;
+	struct dirprefetch_dir *d;
+	unsigned i;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dirprefetch_config,
+				return);
+
+	d = dirprefetch_find(config, dirp);
+	if (d == NULL) {
+		SMB_VFS_NEXT_SEEKDIR(handle, dirp, offset);
+		return;
+	}
+
+	config->last = NULL;
+
+	/*
+	 * telldir returned entries[i].offset after handing out
+	 * entries[i]
+	 */
+	if (dirprefetch_find_offset(d->cur, offset, &i)) {
+		d->pos = i+1;
+		return;
+	}
+	if (dirprefetch_find_offset(d->ahead, offset, &i)) {
+		dirprefetch_advance(handle, config, d);
+		d->pos = i+1;
+		return;
+	}
+
+	dirprefetch_drop(config, d);
+	SMB_VFS_NEXT_SEEKDIR(handle, dirp, offset);
+}
+
+static long dirprefetch_telldir(vfs_handle_struct *handle, DIR *dirp)
+{
+	struct dirprefetch_config *config;
+	struct dirprefetch_dir *d;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dirprefetch_config,
+				return -1);
+
+	d = dirprefetch_find(config, dirp);
+	if ((d == NULL) || (d->cur == NULL) || (d->pos == 0)) {
+		return SMB_VFS_NEXT_TELLDIR(handle, dirp);
+	}
+	return d->cur->entries[d->pos-1].offset;
+}
+
+static void dirprefetch_rewinddir(vfs_handle_struct *handle, DIR *dirp)
+{
+	struct dirprefetch_config *config;
+	struct dirprefetch_dir *d;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dirprefetch_config,
+				return);
+
+	d = dirprefetch_find(config, dirp);
+	if (d != NULL) {
+		dirprefetch_drop(config, d);
+	}
+	SMB_VFS_NEXT_REWINDDIR(handle, dirp);
+}
+
+static int dirprefetch_closedir(vfs_handle_struct *handle, DIR *dirp)
+{
+	struct dirprefetch_config *config;
+	struct dirprefetch_dir *d;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dirprefetch_config,
+				return -1);
+
+	d = dirprefetch_find(config, dirp);
+	if (d != NULL) {
+		dirprefetch_drop(config, d);
+		DLIST_REMOVE(config->dirs, d);
+		TALLOC_FREE(d);
+	}
+	return SMB_VFS_NEXT_CLOSEDIR(handle, dirp);
+}
+
+static ssize_t dirprefetch_getxattr(struct vfs_handle_struct *handle,
+				    const char *path, const char *name,
+				    void *value, size_t size)
+{
+	struct dirprefetch_config *config;
+	struct dirprefetch_entry *e;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dirprefetch_config,
+				return -1);
+
+	e = config->last;
+
+	if ((e == NULL) ||
+	    (strcmp(name, SAMBA_XATTR_DOS_ATTRIB) != 0) ||
+	    (strcmp(path, e->path) != 0)) {
+		return SMB_VFS_NEXT_GETXATTR(handle, path, name, value, size);
+	}
+
+	/*
+	 * Only once, the next fetch might be after a change
+	 */
+	config->last = NULL;
+
+	if (e->dosattr_len == -1) {
+		errno = e->dosattr_errno;
+		return -1;
+	}
+	if (size == 0) {
+		return e->dosattr_len;
+	}
+	if (size < e->dosattr_len) {
+		errno = ERANGE;
+		return -1;
+	}
+	memcpy(value, e->dosattr, e->dosattr_len);
+	return e->dosattr_len;
+}
+
+static struct vfs_fn_pointers vfs_dirprefetch_fns = {
+	.connect_fn = dirprefetch_connect,
+	.opendir_fn = dirprefetch_opendir,
+	.fdopendir_fn = dirprefetch_fdopendir,
+	.readdir_fn = dirprefetch_readdir,
+	.seekdir_fn = dirprefetch_seekdir,
+	.telldir_fn = dirprefetch_telldir,
+	.rewind_dir_fn = dirprefetch_rewinddir,
+	.closedir_fn = dirprefetch_closedir,
+	.getxattr_fn = dirprefetch_getxattr,
+};
+
+static_decl_vfs;
+NTSTATUS vfs_dirprefetch_init(void)
+{
+	return smb_register_vfs(SMB_VFS_INTERFACE_VERSION, "dirprefetch",
+				&vfs_dirprefetch_fns);
+}
@@ -48,6 +48,42 @@ struct name_cache_entry {
 	long offset;
 };
 
+/*
+ * With "smbd:dir snapshot = yes" search handles read the whole directory
+ * once into a snapshot: The names in the order the VFS returned them in
+ * one arena, plus the stat information that came with them, and an index
+ * sorted by strcmp() to resume searches by name. Snapshots are shared
+ * by all handles on the same directory in this process and reused while
+ * the directory's mtime does not change, so reopening or restarting a
+ * search on a large directory does not read it again. Offsets into a
+ * snapshot are entry indexes plus one.
+ */
+
+struct smb_Dir_snapshot_entry {
+	const char *name;
+	const SMB_STRUCT_STAT *st;
+};
+
+struct smb_Dir_snapshot {
+	struct smb_Dir_snapshot *prev, *next;
+	struct file_id id;
+	int snum;
+	struct timespec mtime;
+	struct timespec built;
+	bool cached;
+	unsigned int refcount;
+	size_t num_entries;
+	struct smb_Dir_snapshot_entry *entries;
+	const struct smb_Dir_snapshot_entry **by_name;
+	char *names;
+	SMB_STRUCT_STAT *stats;
+};
+
+#define DIR_SNAPSHOT_CACHE_SIZE 16
+
+static struct smb_Dir_snapshot *dir_snapshots;
+static unsigned int num_dir_snapshots;
+
 struct smb_Dir {
 	connection_struct *conn;
 	DIR *dir;
@@ -59,6 +95,10 @@ struct smb_Dir {
 	unsigned int file_number;
 	files_struct *fsp; /* Back pointer to containing fsp, only
 			      set from OpenDir_fsp(). */
+	bool use_snapshot;
+	struct smb_Dir_snapshot *snapshot;
+	char *mask;	/* To open dir late if a snapshot goes stale */
+	uint32_t attr;
 };
 
 struct dptr_struct {
@@ -76,14 +116,22 @@ struct dptr_struct {
 	bool priv;     /* Directory handle opened with privilege. */
 	uint32_t counter;
 	struct memcache *dptr_cache;
+
+	/* Search mask prepared for matching many names */
+	struct ms_fnmatch_pattern *mask_pattern;
+	char *mask_pattern_src;
+	bool mask_pattern_translate;
+	bool mask_pattern_case_sensitive;
 };
 
 static struct smb_Dir *OpenDir_fsp(TALLOC_CTX *mem_ctx, connection_struct *conn,
 			files_struct *fsp,
 			const char *mask,
-			uint32_t attr);
+			uint32_t attr,
+			bool snapshot);
 
 static void DirCacheAdd(struct smb_Dir *dirp, const char *name, long offset);
+static bool smb_Dir_snapshot_enabled(connection_struct *conn);
 
 #define INVALID_DPTR_KEY (-3)
 
@@ -173,6 +221,8 @@ static struct dptr_struct *dptr_get(struct smbd_server_connection *sconn,
 						strerror(errno)));
 					return NULL;
 				}
+				dptr->dir_hnd->use_snapshot =
+					smb_Dir_snapshot_enabled(dptr->conn);
 			}
 			DLIST_PROMOTE(sconn->searches.dirptrs,dptr);
 			return dptr;
@@ -473,7 +523,8 @@ NTSTATUS dptr_create(connection_struct *conn,
 				path));
 			return NT_STATUS_ACCESS_DENIED;
 		}
-		dir_hnd = OpenDir_fsp(NULL, conn, fsp, wcard, attr);
+		dir_hnd = OpenDir_fsp(NULL, conn, fsp, wcard, attr,
+				      smb_Dir_snapshot_enabled(conn));
 	} else {
 		int ret;
 		bool backup_intent = (req && req->priv_paths);
@@ -511,6 +562,10 @@ NTSTATUS dptr_create(connection_struct *conn,
 						attr);
 		} else {
 			dir_hnd = OpenDir(NULL, conn, path, wcard, attr);
+			if (dir_hnd != NULL) {
+				dir_hnd->use_snapshot =
+					smb_Dir_snapshot_enabled(conn);
+			}
 		}
 	}
 
@@ -853,6 +908,10 @@ bool dptr_SearchDir(struct dptr_struct *dptr, const char *name, long *poffset, S
 ****************************************************************************/
 void dptr_init_search_op(struct dptr_struct *dptr)
 {
+	if (dptr->dir_hnd->dir == NULL) {
+		/* Served from a snapshot */
+		return;
+	}
 	SMB_VFS_INIT_SEARCH_OP(dptr->conn, dptr->dir_hnd->dir);
 }
 
@@ -1032,16 +1091,53 @@ struct dptr_struct *dptr_fetch_lanman2(struct smbd_server_connection *sconn,
 	return(dptr);
 }
 
-static bool mangle_mask_match(connection_struct *conn,
+/****************************************************************************
+ mask_match() for the names found by a search. The mask is prepared once
+ and kept with the dptr for the following names.
+****************************************************************************/
+
+bool dptr_mask_match(struct dptr_struct *dptr, const char *string,
+		     const char *mask, bool translate_pattern,
+		     bool is_case_sensitive)
+{
+	if (ISDOT(mask)) {
+		return false;
+	}
+
+	if ((dptr->mask_pattern == NULL) ||
+	    (dptr->mask_pattern_translate != translate_pattern) ||
+	    (dptr->mask_pattern_case_sensitive != is_case_sensitive) ||
+	    (strcmp(dptr->mask_pattern_src, mask) != 0)) {
+		TALLOC_FREE(dptr->mask_pattern);
+		TALLOC_FREE(dptr->mask_pattern_src);
+
+		dptr->mask_pattern = ms_fnmatch_compile(
+			dptr, mask, translate_pattern, is_case_sensitive);
+		dptr->mask_pattern_src = talloc_strdup(dptr, mask);
+		if ((dptr->mask_pattern == NULL) ||
+		    (dptr->mask_pattern_src == NULL)) {
+			TALLOC_FREE(dptr->mask_pattern);
+			TALLOC_FREE(dptr->mask_pattern_src);
+			return ms_fnmatch(mask, string, translate_pattern,
+					  is_case_sensitive) == 0;
+		}
+		dptr->mask_pattern_translate = translate_pattern;
+		dptr->mask_pattern_case_sensitive = is_case_sensitive;
+	}
+
+	return ms_fnmatch_compiled(dptr->mask_pattern, string) == 0;
+}
+
+static bool mangle_mask_match(struct dptr_struct *dptr,
 		const char *filename,
 		const char *mask)
 {
 	char mname[13];
 
-	if (!name_to_8_3(filename,mname,False,conn->params)) {
+	if (!name_to_8_3(filename,mname,False,dptr->conn->params)) {
 		return False;
 	}
-	return mask_match_search(mname,mask,False);
+	return dptr_mask_match(dptr, mname, mask, true, false);
 }
 
 bool smbd_dirptr_get_entry(TALLOC_CTX *ctx,
@@ -1215,11 +1311,12 @@ static bool smbd_dirptr_8_3_match_fn(TALLOC_CTX *ctx,
 				     const char *mask,
 				     char **_fname)
 {
-	connection_struct *conn = (connection_struct *)private_data;
+	struct dptr_struct *dptr = (struct dptr_struct *)private_data;
+	connection_struct *conn = dptr->conn;
 
 	if ((strcmp(mask,"*.*") == 0) ||
-	    mask_match_search(dname, mask, false) ||
-	    mangle_mask_match(conn, dname, mask)) {
+	    dptr_mask_match(dptr, dname, mask, true, false) ||
+	    mangle_mask_match(dptr, dname, mask)) {
 		char mname[13];
 		const char *fname;
 		/*
@@ -1274,7 +1371,8 @@ static bool smbd_dirptr_8_3_mode_fn(TALLOC_CTX *ctx,
 				    struct smb_filename *smb_fname,
 				    uint32_t *_mode)
 {
-	connection_struct *conn = (connection_struct *)private_data;
+	struct dptr_struct *dptr = (struct dptr_struct *)private_data;
+	connection_struct *conn = dptr->conn;
 
 	if (!VALID_STAT(smb_fname->st)) {
 		if ((SMB_VFS_STAT(conn, smb_fname)) != 0) {
@@ -1317,7 +1415,7 @@ bool get_dir_entry(TALLOC_CTX *ctx,
 				   ask_sharemode,
 				   smbd_dirptr_8_3_match_fn,
 				   smbd_dirptr_8_3_mode_fn,
-				   conn,
+				   dirptr,
 				   &fname,
 				   &smb_fname,
 				   &mode,
@@ -1559,8 +1657,358 @@ bool is_visible_file(connection_struct *conn, const char *dir_path,
 	return ret;
 }
 
+/*******************************************************************
+ Directory snapshots.
+********************************************************************/
+
+static bool smb_Dir_snapshot_enabled(connection_struct *conn)
+{
+	return lp_parm_bool(SNUM(conn), "smbd", "dir snapshot", false);
+}
+
+static void smb_Dir_snapshot_uncache(struct smb_Dir_snapshot *snap)
+{
+	DLIST_REMOVE(dir_snapshots, snap);
+	num_dir_snapshots -= 1;
+	snap->cached = false;
+	if (snap->refcount == 0) {
+		TALLOC_FREE(snap);
+	}
+}
+
+static void smb_Dir_snapshot_release(struct smb_Dir *dirp)
+{
+	struct smb_Dir_snapshot *snap = dirp->snapshot;
+
+	if (snap == NULL) {
+		return;
+	}
+	dirp->snapshot = NULL;
+
+	snap->refcount -= 1;
+	if ((snap->refcount == 0) && !snap->cached) {
+		TALLOC_FREE(snap);
+	}
+}
+
+static void smb_Dir_snapshot_attach(struct smb_Dir *dirp,
+				    struct smb_Dir_snapshot *snap)
+{
+	smb_Dir_snapshot_release(dirp);
+	snap->refcount += 1;
+	dirp->snapshot = snap;
+}
+
+static bool smb_Dir_stat(struct smb_Dir *dirp, SMB_STRUCT_STAT *st)
+{
+	struct smb_filename smb_dname = { .base_name = dirp->dir_path };
+
+	if (SMB_VFS_STAT(dirp->conn, &smb_dname) != 0) {
+		return false;
+	}
+	*st = smb_dname.st;
+	return true;
+}
+
+/*
+ * Find a cached snapshot still matching the directory, throwing away a
+ * stale one.
+ */
+
+static struct smb_Dir_snapshot *smb_Dir_snapshot_find(
+	connection_struct *conn, const SMB_STRUCT_STAT *dir_st)
+{
+	struct file_id id = vfs_file_id_from_sbuf(conn, dir_st);
+	struct smb_Dir_snapshot *snap;
+
+	for (snap = dir_snapshots; snap != NULL; snap = snap->next) {
+		if ((snap->snum != SNUM(conn)) ||
+		    !file_id_equal(&snap->id, &id)) {
+			continue;
+		}
+		if (timespec_compare(&snap->mtime,
+				     &dir_st->st_ex_mtime) != 0) {
+			smb_Dir_snapshot_uncache(snap);
+			return NULL;
+		}
+		DLIST_PROMOTE(dir_snapshots, snap);
+		return snap;
+	}
+	return NULL;
+}
+
+static int smb_Dir_snapshot_entry_cmp(
+	const struct smb_Dir_snapshot_entry * const *e1,
+	const struct smb_Dir_snapshot_entry * const *e2)
+{
+	return strcmp((*e1)->name, (*e2)->name);
+}
+
+/*
+ * Read the whole directory. Names are collected as offsets into the arena
+ * first, the arena moves while it grows.
+ */
+
+static struct smb_Dir_snapshot *smb_Dir_snapshot_build(
+	struct smb_Dir *dirp, const SMB_STRUCT_STAT *dir_st)
+{
+	connection_struct *conn = dirp->conn;
+	struct smb_Dir_snapshot *snap;
+	size_t *name_ofs = NULL;
+	size_t *stat_idx = NULL;
+	size_t num_alloc = 0, names_len = 0, names_alloc = 0, num_stats = 0;
+	SMB_STRUCT_STAT st;
+	const char *n;
+	char *talloced = NULL;
+	size_t i;
+
+	snap = talloc_zero(NULL, struct smb_Dir_snapshot);
+	if (snap == NULL) {
+		return NULL;
+	}
+	snap->id = vfs_file_id_from_sbuf(conn, dir_st);
+	snap->snum = SNUM(conn);
+	snap->mtime = dir_st->st_ex_mtime;
+	snap->built = timespec_current();
+
+	SMB_VFS_REWINDDIR(conn, dirp->dir);
+
+	while ((n = vfs_readdirname(conn, dirp->dir, &st, &talloced))) {
+		size_t len;
+
+		if ((n[0] == '.') &&
+		    ((n[1] == '\0') || (n[1] == '.' && n[2] == '\0'))) {
+			TALLOC_FREE(talloced);
+			continue;
+		}
+
+		if (snap->num_entries == num_alloc) {
+			num_alloc = MAX(num_alloc * 2, 64);
+			name_ofs = talloc_realloc(snap, name_ofs, size_t,
+						  num_alloc);
+			stat_idx = talloc_realloc(snap, stat_idx, size_t,
+						  num_alloc);
+			if ((name_ofs == NULL) || (stat_idx == NULL)) {
+				goto nomem;
+			}
+		}
+
+		len = strlen(n) + 1;
+		if (names_len + len > names_alloc) {
+			names_alloc = MAX((names_len + len) * 2, 4096);
+			snap->names = talloc_realloc(snap, snap->names, char,
+						     names_alloc);
+			if (snap->names == NULL) {
+				goto nomem;
+			}
+		}
+		memcpy(snap->names + names_len, n, len);
+		name_ofs[snap->num_entries] = names_len;
+		names_len += len;
+		TALLOC_FREE(talloced);
+
+		stat_idx[snap->num_entries] = SIZE_MAX;
+		if (VALID_STAT(st)) {
+			if ((num_stats % 64) == 0) {
+				snap->stats = talloc_realloc(
+					snap, snap->stats, SMB_STRUCT_STAT,
+					num_stats + 64);
+				if (snap->stats == NULL) {
+					goto nomem;
+				}
+			}
+			snap->stats[num_stats] = st;
+			stat_idx[snap->num_entries] = num_stats;
+			num_stats += 1;
+		}
+
+		snap->num_entries += 1;
+	}
+
+	snap->entries = talloc_array(snap, struct smb_Dir_snapshot_entry,
+				     snap->num_entries);
+	snap->by_name = talloc_array(snap,
+				     const struct smb_Dir_snapshot_entry *,
+				     snap->num_entries);
+	if ((snap->entries == NULL) || (snap->by_name == NULL)) {
+		goto nomem;
+	}
+	for (i=0; i<snap->num_entries; i++) {
+		struct smb_Dir_snapshot_entry *e = &snap->entries[i];
+		e->name = snap->names + name_ofs[i];
+		e->st = (stat_idx[i] == SIZE_MAX) ?
+			NULL : &snap->stats[stat_idx[i]];
+		snap->by_name[i] = e;
+	}
+	TALLOC_FREE(name_ofs);
+	TALLOC_FREE(stat_idx);
+
+	/*
+	 * Listings keep the VFS order, only the index is sorted, e.g.
+	 * vfs_dirsort's order must survive.
+	 */
+	TYPESAFE_QSORT(snap->by_name, snap->num_entries,
+		       smb_Dir_snapshot_entry_cmp);
+
+	DEBUG(10, ("%s: %zu entries in %s\n", __func__, snap->num_entries,
+		   dirp->dir_path));
+
+	/*
+	 * A directory changed within the same second as we read it might
+	 * change again without a visible mtime change. Only the handle
+	 * reading it uses such a snapshot.
+	 */
+	if (snap->built.tv_sec > snap->mtime.tv_sec + 1) {
+		if (num_dir_snapshots >= DIR_SNAPSHOT_CACHE_SIZE) {
+			smb_Dir_snapshot_uncache(DLIST_TAIL(dir_snapshots));
+		}
+		DLIST_ADD(dir_snapshots, snap);
+		num_dir_snapshots += 1;
+		snap->cached = true;
+	}
+
+	return snap;
+
+nomem:
+	TALLOC_FREE(talloced);
+	TALLOC_FREE(snap);
+	return NULL;
+}
+
+/*
+ * Make sure dirp has a snapshot. Returns false if the directory has to be
+ * read directly.
+ */
+
+static bool smb_Dir_snapshot_get(struct smb_Dir *dirp)
+{
+	struct smb_Dir_snapshot *snap;
+	SMB_STRUCT_STAT dir_st;
+
+	if (dirp->snapshot != NULL) {
+		return true;
+	}
+	if (!dirp->use_snapshot) {
+		return false;
+	}
+
+	if (!smb_Dir_stat(dirp, &dir_st)) {
+		goto fail;
+	}
+
+	snap = smb_Dir_snapshot_find(dirp->conn, &dir_st);
+	if (snap != NULL) {
+		smb_Dir_snapshot_attach(dirp, snap);
+		return true;
+	}
+
+	if (dirp->dir == NULL) {
+		dirp->dir = SMB_VFS_OPENDIR(dirp->conn, dirp->dir_path,
+					    dirp->mask, dirp->attr);
+		if (dirp->dir == NULL) {
+			DEBUG(5, ("%s: Can't open %s. %s\n", __func__,
+				  dirp->dir_path, strerror(errno)));
+			goto fail;
+		}
+	}
+
+	snap = smb_Dir_snapshot_build(dirp, &dir_st);
+	if (snap == NULL) {
+		goto fail;
+	}
+	smb_Dir_snapshot_attach(dirp, snap);
+	return true;
+
+fail:
+	dirp->use_snapshot = false;
+	if (dirp->dir != NULL) {
+		SMB_VFS_REWINDDIR(dirp->conn, dirp->dir);
+	}
+	return false;
+}
+
+static const char *smb_Dir_snapshot_read(struct smb_Dir *dirp,
+					 long *poffset,
+					 SMB_STRUCT_STAT *sbuf)
+{
+	struct smb_Dir_snapshot *snap = dirp->snapshot;
+	const struct smb_Dir_snapshot_entry *e;
+	long pos = *poffset;
+
+	if ((pos == START_OF_DIRECTORY_OFFSET) ||
+	    (pos == DOT_DOT_DIRECTORY_OFFSET)) {
+		pos = 0;
+	}
+	if ((pos < 0) || ((size_t)pos >= snap->num_entries)) {
+		*poffset = dirp->offset = END_OF_DIRECTORY_OFFSET;
+		return NULL;
+	}
+	e = &snap->entries[pos];
+
+	if (sbuf != NULL) {
+		struct timespec now = timespec_current();
+
+		/*
+		 * The stat information only describes the directory
+		 * entries when the snapshot was read.
+		 */
+		if ((e->st != NULL) &&
+		    (now.tv_sec - snap->built.tv_sec < 1)) {
+			*sbuf = *e->st;
+		} else {
+			SET_STAT_INVALID(*sbuf);
+		}
+	}
+
+	*poffset = dirp->offset = pos + 1;
+	dirp->file_number++;
+	return e->name;
+}
+
+static bool smb_Dir_snapshot_search(struct smb_Dir *dirp, const char *name,
+				    long *poffset)
+{
+	struct smb_Dir_snapshot *snap = dirp->snapshot;
+	connection_struct *conn = dirp->conn;
+	size_t lo = 0, hi = snap->num_entries;
+	size_t i;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(name, snap->by_name[mid]->name);
+
+		if (cmp == 0) {
+			i = snap->by_name[mid] - snap->entries;
+			goto found;
+		}
+		if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	if (!conn->case_sensitive) {
+		for (i=0; i<snap->num_entries; i++) {
+			if (strequal(snap->entries[i].name, name)) {
+				goto found;
+			}
+		}
+	}
+
+	*poffset = dirp->offset = END_OF_DIRECTORY_OFFSET;
+	return false;
+
+found:
+	*poffset = dirp->offset = i + 1;
+	dirp->file_number = i + 3;
+	return true;
+}
+
 static int smb_Dir_destructor(struct smb_Dir *dirp)
 {
+	smb_Dir_snapshot_release(dirp);
+
 	if (dirp->dir != NULL) {
 		SMB_VFS_CLOSEDIR(dirp->conn,dirp->dir);
 		if (dirp->fsp != NULL) {
@@ -1634,7 +2082,8 @@ struct smb_Dir *OpenDir(TALLOC_CTX *mem_ctx, connection_struct *conn,
 static struct smb_Dir *OpenDir_fsp(TALLOC_CTX *mem_ctx, connection_struct *conn,
 			files_struct *fsp,
 			const char *mask,
-			uint32_t attr)
+			uint32_t attr,
+			bool snapshot)
 {
 	struct smb_Dir *dirp = talloc_zero(mem_ctx, struct smb_Dir);
 	struct smbd_server_connection *sconn = conn->sconn;
@@ -1657,6 +2106,33 @@ static struct smb_Dir *OpenDir_fsp(TALLOC_CTX *mem_ctx, connection_struct *conn,
 	}
 	talloc_set_destructor(dirp, smb_Dir_destructor);
 
+	if (snapshot) {
+		SMB_STRUCT_STAT dir_st;
+		struct smb_Dir_snapshot *snap;
+
+		dirp->use_snapshot = true;
+		dirp->attr = attr;
+		if (mask != NULL) {
+			dirp->mask = talloc_strdup(dirp, mask);
+			if (dirp->mask == NULL) {
+				errno = ENOMEM;
+				goto fail;
+			}
+		}
+
+		/*
+		 * With a current snapshot we don't need to open the
+		 * directory at all.
+		 */
+		if (smb_Dir_stat(dirp, &dir_st)) {
+			snap = smb_Dir_snapshot_find(conn, &dir_st);
+			if (snap != NULL) {
+				smb_Dir_snapshot_attach(dirp, snap);
+				return dirp;
+			}
+		}
+	}
+
 	if (fsp->is_directory && fsp->fh->fd != -1) {
 		dirp->dir = SMB_VFS_FDOPENDIR(fsp, mask, attr);
 		if (dirp->dir != NULL) {
@@ -1725,6 +2201,17 @@ const char *ReadDirName(struct smb_Dir *dirp, long *poffset,
 		return NULL;
 	}
 
+	if (smb_Dir_snapshot_get(dirp)) {
+		*ptalloced = NULL;
+		return smb_Dir_snapshot_read(dirp, poffset, sbuf);
+	}
+
+	if (dirp->dir == NULL) {
+		*poffset = dirp->offset = END_OF_DIRECTORY_OFFSET;
+		*ptalloced = NULL;
+		return NULL;
+	}
+
 	/* A real offset, seek to it. */
 	SeekDir(dirp, *poffset);
 
@@ -1752,7 +2239,19 @@ const char *ReadDirName(struct smb_Dir *dirp, long *poffset,
 
 void RewindDir(struct smb_Dir *dirp, long *poffset)
 {
-	SMB_VFS_REWINDDIR(dirp->conn, dirp->dir);
+	if (dirp->snapshot != NULL) {
+		SMB_STRUCT_STAT dir_st;
+
+		/* Restarting the search must show changes */
+		if (!smb_Dir_stat(dirp, &dir_st) ||
+		    (smb_Dir_snapshot_find(dirp->conn, &dir_st) !=
+		     dirp->snapshot)) {
+			smb_Dir_snapshot_release(dirp);
+		}
+	}
+	if ((dirp->snapshot == NULL) && (dirp->dir != NULL)) {
+		SMB_VFS_REWINDDIR(dirp->conn, dirp->dir);
+	}
 	dirp->file_number = 0;
 	dirp->offset = START_OF_DIRECTORY_OFFSET;
 	*poffset = START_OF_DIRECTORY_OFFSET;
@@ -1784,6 +2283,8 @@ void SeekDir(struct smb_Dir *dirp, long offset)
 			dirp->file_number = 2;
 		} else if (offset == END_OF_DIRECTORY_OFFSET) {
 			; /* Don't seek in this case. */
+		} else if (dirp->snapshot != NULL) {
+			; /* ReadDirName() uses the offset directly. */
 		} else {
 			SMB_VFS_SEEKDIR(dirp->conn, dirp->dir, offset);
 		}
@@ -1861,6 +2362,15 @@ bool SearchDir(struct smb_Dir *dirp, const char *name, long *poffset)
 		}
 	}
 
+	if (smb_Dir_snapshot_get(dirp)) {
+		return smb_Dir_snapshot_search(dirp, name, poffset);
+	}
+
+	if (dirp->dir == NULL) {
+		*poffset = dirp->offset = END_OF_DIRECTORY_OFFSET;
+		return False;
+	}
+
 	/* Not found in the name cache. Rewind directory and start from scratch. */
 	SMB_VFS_REWINDDIR(conn, dirp->dir);
 	dirp->file_number = 0;
@@ -2003,7 +2513,8 @@ NTSTATUS can_delete_directory_fsp(files_struct *fsp)
 					conn,
 					fsp,
 					NULL,
-					0);
+					0,
+					false);
 
 	if (!dir_hnd) {
 		return map_nt_error_from_unix(errno);
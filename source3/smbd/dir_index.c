@@ -0,0 +1,913 @@
+/*
+   Unix SMB/CIFS implementation.
+   Case-insensitive directory name index
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * With "case sensitive = no" on a case sensitive file system every
+ * name that does not stat directly makes get_real_filename() read the
+ * whole directory. Creating files in a directory with 100.000 entries
+ * means reading 100.000 entries per create.
+ *
+ * This keeps an index of upper-cased names for large directories that
+ * were scanned once. An index is only used as long as we know the
+ * directory did not change behind our back: With inotify we follow
+ * creates, deletes and renames from the event queue, which the kernel
+ * fills before the modifying syscall returns. Without inotify we
+ * compare the directory's mtime, and only trust mtimes old enough to
+ * not be "racy" with respect to the file system timestamp granularity.
+ *
+ * Enable with "smbd:dir index = yes" per share. Whether to use inotify
+ * follows "kernel change notify", "smbd:dir index kernel change notify"
+ * overrides that per share.
+ */
+
+#include "includes.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "system/filesys.h"
+#include "lib/util/dlinklist.h"
+#include "util_tdb.h"
+
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+/*
+ * Smaller directories are cheap enough to scan
+ */
+#define DIR_INDEX_MIN_NAMES 256
+
+#define DIR_INDEX_MAX_DIRS 128
+#define DIR_INDEX_MAX_SMALL 1024
+#define DIR_INDEX_MAX_NAMES (1024*1024)
+
+/*
+ * Events queued for an index before it is used again. More than that
+ * and it's cheaper to throw the index away.
+ */
+#define DIR_INDEX_MAX_PENDING 4096
+
+struct dir_index_name {
+	struct dir_index_name *next;
+	uint32_t hash;
+	const char *upper;
+	char name[];
+};
+
+struct dir_index_event {
+	struct dir_index_event *prev, *next;
+	uint32_t mask;
+	char name[];
+};
+
+struct dir_index {
+	struct dir_index *prev, *next;
+
+	char *path;
+	int snum;
+	uid_t uid;
+	struct file_id id;
+	struct timespec mtime;
+
+	/*
+	 * inotify watch descriptor, -1 if we validate by mtime
+	 */
+	int wd;
+	struct dir_index_event *pending;
+	size_t num_pending;
+
+	struct dir_index_name **buckets;
+	size_t num_buckets;
+	size_t num_names;
+};
+
+/*
+ * A directory found too small to index. Until its mtime changes
+ * lookups in it go to get_real_filename_full_scan() directly, without
+ * setting up an inotify watch for a scan that we throw away anyway.
+ */
+
+struct dir_index_small {
+	struct dir_index_small *prev, *next;
+	char *path;
+	int snum;
+	struct file_id id;
+	struct timespec mtime;
+};
+
+struct dir_index_state {
+	struct dir_index *indexes;
+	size_t num_indexes;
+	size_t num_names;
+
+	struct dir_index_small *small;
+	size_t num_small;
+
+	int inotify_fd;
+	struct tevent_fd *fde;
+};
+
+static struct dir_index_state *dir_index_state;
+
+static struct dir_index_state *dir_index_get_state(void)
+{
+	struct dir_index_state *state = dir_index_state;
+
+	if (state != NULL) {
+		return state;
+	}
+
+	state = talloc_zero(NULL, struct dir_index_state);
+	if (state == NULL) {
+		return NULL;
+	}
+	state->inotify_fd = -1;
+
+	dir_index_state = state;
+	return state;
+}
+
+static uint32_t dir_index_hash(const char *upper)
+{
+	TDB_DATA key = string_tdb_data(upper);
+	return tdb_jenkins_hash(&key);
+}
+
+static struct dir_index_name *dir_index_find(struct dir_index *idx,
+					     const char *upper,
+					     uint32_t hash)
+{
+	struct dir_index_name *n;
+
+	for (n = idx->buckets[hash & (idx->num_buckets-1)];
+	     n != NULL;
+	     n = n->next) {
+		if ((n->hash == hash) && (strcmp(n->upper, upper) == 0)) {
+			return n;
+		}
+	}
+	return NULL;
+}
+
+static bool dir_index_grow(struct dir_index *idx)
+{
+	struct dir_index_name **buckets;
+	size_t i, num_buckets;
+
+	num_buckets = idx->num_buckets * 2;
+
+	buckets = talloc_zero_array(idx, struct dir_index_name *,
+				    num_buckets);
+	if (buckets == NULL) {
+		return false;
+	}
+
+	for (i=0; i<idx->num_buckets; i++) {
+		struct dir_index_name *n, *next;
+
+		for (n = idx->buckets[i]; n != NULL; n = next) {
+			struct dir_index_name **b;
+
+			next = n->next;
+			b = &buckets[n->hash & (num_buckets-1)];
+			n->next = *b;
+			*b = n;
+		}
+	}
+
+	TALLOC_FREE(idx->buckets);
+	idx->buckets = buckets;
+	idx->num_buckets = num_buckets;
+	return true;
+}
+
+static bool dir_index_add_name(struct dir_index *idx, const char *name)
+{
+	struct dir_index_name *n, **b;
+	char *upper;
+	size_t namelen, upperlen;
+	uint32_t hash;
+
+	upper = talloc_strdup_upper(talloc_tos(), name);
+	if (upper == NULL) {
+		return false;
+	}
+	hash = dir_index_hash(upper);
+
+	for (n = idx->buckets[hash & (idx->num_buckets-1)];
+	     n != NULL;
+	     n = n->next) {
+		if (strcmp(n->name, name) == 0) {
+			/*
+			 * Seen both by the scan and by inotify
+			 */
+			TALLOC_FREE(upper);
+			return true;
+		}
+	}
+
+	if ((idx->num_names >= idx->num_buckets * 2) &&
+	    !dir_index_grow(idx)) {
+		TALLOC_FREE(upper);
+		return false;
+	}
+
+	namelen = strlen(name) + 1;
+	upperlen = strlen(upper) + 1;
+
+	n = talloc_size(idx, sizeof(struct dir_index_name) +
+			namelen + upperlen);
+	if (n == NULL) {
+		TALLOC_FREE(upper);
+		return false;
+	}
+	talloc_set_name_const(n, "struct dir_index_name");
+
+	memcpy(n->name, name, namelen);
+	memcpy(n->name + namelen, upper, upperlen);
+	n->upper = n->name + namelen;
+	n->hash = hash;
+	TALLOC_FREE(upper);
+
+	b = &idx->buckets[hash & (idx->num_buckets-1)];
+	n->next = *b;
+	*b = n;
+
+	idx->num_names += 1;
+	if (dir_index_state != NULL) {
+		dir_index_state->num_names += 1;
+	}
+	return true;
+}
+
+static void dir_index_del_name(struct dir_index *idx, const char *name)
+{
+	struct dir_index_name *n, **pn;
+	char *upper;
+	uint32_t hash;
+
+	upper = talloc_strdup_upper(talloc_tos(), name);
+	if (upper == NULL) {
+		return;
+	}
+	hash = dir_index_hash(upper);
+	TALLOC_FREE(upper);
+
+	for (pn = &idx->buckets[hash & (idx->num_buckets-1)];
+	     (n = *pn) != NULL;
+	     pn = &n->next) {
+		if (strcmp(n->name, name) == 0) {
+			*pn = n->next;
+			TALLOC_FREE(n);
+			idx->num_names -= 1;
+			if (dir_index_state != NULL) {
+				dir_index_state->num_names -= 1;
+			}
+			return;
+		}
+	}
+}
+
+static int dir_index_destructor(struct dir_index *idx)
+{
+	struct dir_index_state *state = dir_index_state;
+	struct dir_index *other;
+
+	if (state == NULL) {
+		return 0;
+	}
+
+	DLIST_REMOVE(state->indexes, idx);
+	state->num_indexes -= 1;
+	state->num_names -= idx->num_names;
+
+	if (idx->wd == -1) {
+		return 0;
+	}
+
+	/*
+	 * inotify hands out the same wd for the same directory, which
+	 * we might see under different paths or for different users
+	 */
+	for (other = state->indexes; other != NULL; other = other->next) {
+		if (other->wd == idx->wd) {
+			return 0;
+		}
+	}
+
+#ifdef HAVE_INOTIFY
+	inotify_rm_watch(state->inotify_fd, idx->wd);
+#endif
+	return 0;
+}
+
+#ifdef HAVE_INOTIFY
+
+static void dir_index_queue_event(struct dir_index *idx,
+				  const struct inotify_event *e)
+{
+	struct dir_index_event *ev;
+	size_t len;
+
+	if (idx->num_pending >= DIR_INDEX_MAX_PENDING) {
+		TALLOC_FREE(idx);
+		return;
+	}
+
+	len = strlen(e->name) + 1;
+
+	ev = talloc_size(idx, sizeof(struct dir_index_event) + len);
+	if (ev == NULL) {
+		TALLOC_FREE(idx);
+		return;
+	}
+	talloc_set_name_const(ev, "struct dir_index_event");
+	ev->mask = e->mask;
+	memcpy(ev->name, e->name, len);
+
+	DLIST_ADD_END(idx->pending, ev, struct dir_index_event *);
+	idx->num_pending += 1;
+}
+
+/*
+ * Move everything the kernel has for us into the indexes' pending
+ * lists. The names can only be translated with a connection at hand,
+ * see dir_index_apply_pending().
+ */
+
+static void dir_index_read_events(struct dir_index_state *state)
+{
+	uint8_t buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+
+	if (state->inotify_fd == -1) {
+		return;
+	}
+
+	while (true) {
+		ssize_t nread;
+		size_t ofs = 0;
+
+		nread = read(state->inotify_fd, buf, sizeof(buf));
+		if (nread == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				DEBUG(1, ("%s: read failed: %s\n", __func__,
+					  strerror(errno)));
+			}
+			return;
+		}
+
+		while (ofs + sizeof(struct inotify_event) <= (size_t)nread) {
+			struct inotify_event *e =
+				(struct inotify_event *)(buf + ofs);
+			struct dir_index *idx, *next;
+
+			ofs += sizeof(struct inotify_event) + e->len;
+
+			if (e->mask & IN_Q_OVERFLOW) {
+				DEBUG(5, ("%s: inotify queue overflow, "
+					  "dropping all indexes\n",
+					  __func__));
+				while (state->indexes != NULL) {
+					idx = state->indexes;
+					TALLOC_FREE(idx);
+				}
+				continue;
+			}
+
+			for (idx = state->indexes; idx != NULL; idx = next) {
+				next = idx->next;
+
+				if (idx->wd != e->wd) {
+					continue;
+				}
+				if ((e->mask & (IN_CREATE|IN_DELETE|
+						IN_MOVED_FROM|IN_MOVED_TO))
+				    && (e->len > 0)) {
+					dir_index_queue_event(idx, e);
+					continue;
+				}
+				/*
+				 * IN_DELETE_SELF, IN_MOVE_SELF,
+				 * IN_UNMOUNT, IN_IGNORED
+				 */
+				TALLOC_FREE(idx);
+			}
+		}
+	}
+}
+
+static void dir_index_inotify_handler(struct tevent_context *ev,
+				      struct tevent_fd *fde,
+				      uint16_t flags, void *private_data)
+{
+	struct dir_index_state *state = talloc_get_type_abort(
+		private_data, struct dir_index_state);
+
+	dir_index_read_events(state);
+}
+
+static bool dir_index_apply_pending(connection_struct *conn,
+				    struct dir_index *idx)
+{
+	struct dir_index_event *ev;
+
+	while ((ev = idx->pending) != NULL) {
+		const char *name = ev->name;
+		char *translated = NULL;
+		NTSTATUS status;
+		bool ok = true;
+
+		/*
+		 * The index has the names as vfs_readdirname shows them
+		 */
+		status = SMB_VFS_TRANSLATE_NAME(conn, ev->name,
+						vfs_translate_to_windows,
+						talloc_tos(), &translated);
+		if (NT_STATUS_IS_OK(status)) {
+			name = translated;
+		} else if (!NT_STATUS_EQUAL(status, NT_STATUS_NONE_MAPPED)) {
+			return false;
+		}
+
+		if (ev->mask & (IN_CREATE|IN_MOVED_TO)) {
+			ok = dir_index_add_name(idx, name);
+		} else {
+			dir_index_del_name(idx, name);
+		}
+		TALLOC_FREE(translated);
+
+		if (!ok) {
+			return false;
+		}
+
+		DLIST_REMOVE(idx->pending, ev);
+		idx->num_pending -= 1;
+		TALLOC_FREE(ev);
+	}
+
+	return true;
+}
+
+static int dir_index_watch(struct dir_index_state *state,
+			   struct tevent_context *ev, const char *path)
+{
+	if (state->inotify_fd == -1) {
+		int fd;
+
+		fd = inotify_init();
+		if (fd == -1) {
+			DEBUG(3, ("%s: inotify_init failed: %s\n", __func__,
+				  strerror(errno)));
+			return -1;
+		}
+		if (set_blocking(fd, false) == -1) {
+			close(fd);
+			return -1;
+		}
+		state->fde = tevent_add_fd(ev, state, fd, TEVENT_FD_READ,
+					   dir_index_inotify_handler, state);
+		if (state->fde == NULL) {
+			close(fd);
+			return -1;
+		}
+		tevent_fd_set_auto_close(state->fde);
+		state->inotify_fd = fd;
+	}
+
+	return inotify_add_watch(state->inotify_fd, path,
+				 IN_CREATE|IN_DELETE|IN_MOVED_FROM|
+				 IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|
+				 IN_ONLYDIR);
+}
+
+#else
+
+static void dir_index_read_events(struct dir_index_state *state)
+{
+	return;
+}
+
+static bool dir_index_apply_pending(connection_struct *conn,
+				    struct dir_index *idx)
+{
+	return true;
+}
+
+static int dir_index_watch(struct dir_index_state *state,
+			   struct tevent_context *ev, const char *path)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
+
+static struct dir_index_small *dir_index_small_find(
+	struct dir_index_state *state, int snum, const char *abspath)
+{
+	struct dir_index_small *s;
+
+	for (s = state->small; s != NULL; s = s->next) {
+		if ((s->snum == snum) && (strcmp(s->path, abspath) == 0)) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+static void dir_index_small_forget(struct dir_index_state *state,
+				   struct dir_index_small *s)
+{
+	DLIST_REMOVE(state->small, s);
+	state->num_small -= 1;
+	TALLOC_FREE(s);
+}
+
+static void dir_index_small_remember(struct dir_index_state *state,
+				     struct dir_index_small *s,
+				     int snum, const char *abspath,
+				     const struct file_id *id,
+				     const struct timespec *mtime)
+{
+	if (s == NULL) {
+		if (state->num_small >= DIR_INDEX_MAX_SMALL) {
+			dir_index_small_forget(state,
+					       DLIST_TAIL(state->small));
+		}
+
+		s = talloc_zero(state, struct dir_index_small);
+		if (s == NULL) {
+			return;
+		}
+		s->path = talloc_strdup(s, abspath);
+		if (s->path == NULL) {
+			TALLOC_FREE(s);
+			return;
+		}
+		s->snum = snum;
+		DLIST_ADD(state->small, s);
+		state->num_small += 1;
+	}
+
+	s->id = *id;
+	s->mtime = *mtime;
+	DLIST_PROMOTE(state->small, s);
+}
+
+/*
+ * Without inotify we need to be sure that any change after our scan
+ * modifies the directory's mtime. With a coarse file system clock a
+ * change within the same tick would leave it untouched.
+ */
+
+static bool dir_index_mtime_racy(const struct timespec *mtime,
+				 const struct timespec *scan_start)
+{
+	struct timespec limit = *scan_start;
+
+	limit.tv_sec -= 2;
+	return (timespec_compare(mtime, &limit) >= 0);
+}
+
+static struct dir_index *dir_index_build(connection_struct *conn,
+					 struct smb_filename *smb_dname,
+					 const char *abspath,
+					 bool watch)
+{
+	struct dir_index_state *state = dir_index_state;
+	struct dir_index *idx;
+	struct smb_Dir *dir;
+	struct timespec scan_start;
+	const char *dname;
+	char *talloced = NULL;
+	long offset = 0;
+	bool use_inotify;
+
+	idx = talloc_zero(state, struct dir_index);
+	if (idx == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	idx->snum = SNUM(conn);
+	idx->uid = get_current_uid(conn);
+	idx->id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+	idx->mtime = smb_dname->st.st_ex_mtime;
+	idx->wd = -1;
+
+	idx->path = talloc_strdup(idx, abspath);
+	if (idx->path == NULL) {
+		TALLOC_FREE(idx);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	idx->num_buckets = 1024;
+	idx->buckets = talloc_zero_array(idx, struct dir_index_name *,
+					 idx->num_buckets);
+	if (idx->buckets == NULL) {
+		TALLOC_FREE(idx);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/*
+	 * In the cluster case other nodes don't show up in our inotify
+	 * queue
+	 */
+	use_inotify = watch && !lp_clustering() &&
+		lp_parm_bool(SNUM(conn), "smbd", "dir index kernel change notify",
+			     lp_kernel_change_notify());
+
+	if (use_inotify) {
+		/*
+		 * Before reading, so that we don't miss anything
+		 * happening while we read
+		 */
+		idx->wd = dir_index_watch(state, conn->sconn->ev_ctx,
+					  smb_dname->base_name);
+		if (idx->wd == -1) {
+			DEBUG(5, ("%s: Could not watch %s: %s\n", __func__,
+				  abspath, strerror(errno)));
+		}
+	}
+
+	DLIST_ADD(state->indexes, idx);
+	state->num_indexes += 1;
+	talloc_set_destructor(idx, dir_index_destructor);
+
+	scan_start = timespec_current();
+
+	dir = OpenDir(talloc_tos(), conn, smb_dname->base_name, NULL, 0);
+	if (dir == NULL) {
+		int err = errno;
+		DEBUG(3, ("%s: OpenDir(%s) failed: %s\n", __func__,
+			  smb_dname->base_name, strerror(err)));
+		TALLOC_FREE(idx);
+		errno = err;
+		return NULL;
+	}
+
+	while ((dname = ReadDirName(dir, &offset, NULL, &talloced))) {
+		bool ok = true;
+
+		if (!ISDOT(dname) && !ISDOTDOT(dname)) {
+			ok = dir_index_add_name(idx, dname);
+		}
+		TALLOC_FREE(talloced);
+
+		if (!ok) {
+			TALLOC_FREE(dir);
+			TALLOC_FREE(idx);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+	TALLOC_FREE(dir);
+
+	if (idx->wd != -1) {
+		return idx;
+	}
+
+	/*
+	 * mtime validation: The directory must not have changed while
+	 * we read it, and a later change must be visible in the mtime
+	 */
+	if ((SMB_VFS_STAT(conn, smb_dname) == -1) ||
+	    (timespec_compare(&smb_dname->st.st_ex_mtime, &idx->mtime) != 0) ||
+	    dir_index_mtime_racy(&idx->mtime, &scan_start)) {
+		/*
+		 * Don't keep it, but the result of this scan is as good
+		 * as what get_real_filename_full_scan would have found
+		 */
+		idx->mtime = (struct timespec) { .tv_sec = 0 };
+	}
+
+	return idx;
+}
+
+static bool dir_index_keep(const struct dir_index *idx)
+{
+	if ((idx->wd == -1) && (idx->mtime.tv_sec == 0)) {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Find a valid index for smb_dname. The caller has stat'ed smb_dname.
+ */
+
+static struct dir_index *dir_index_get(connection_struct *conn,
+				       const struct smb_filename *smb_dname,
+				       const char *abspath)
+{
+	struct dir_index_state *state = dir_index_state;
+	struct dir_index *idx;
+	struct file_id id;
+	int snum = SNUM(conn);
+	uid_t uid = get_current_uid(conn);
+
+	dir_index_read_events(state);
+
+	id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+
+	for (idx = state->indexes; idx != NULL; idx = idx->next) {
+		if ((idx->snum == snum) && (idx->uid == uid) &&
+		    (strcmp(idx->path, abspath) == 0)) {
+			break;
+		}
+	}
+	if (idx == NULL) {
+		return NULL;
+	}
+
+	if (!file_id_equal(&idx->id, &id)) {
+		/*
+		 * Someone renamed a parent directory
+		 */
+		TALLOC_FREE(idx);
+		return NULL;
+	}
+
+	if (idx->wd == -1) {
+		if (timespec_compare(&idx->mtime,
+				     &smb_dname->st.st_ex_mtime) != 0) {
+			TALLOC_FREE(idx);
+			return NULL;
+		}
+	} else if (!dir_index_apply_pending(conn, idx)) {
+		TALLOC_FREE(idx);
+		return NULL;
+	}
+
+	DLIST_PROMOTE(state->indexes, idx);
+	return idx;
+}
+
+static void dir_index_shrink(struct dir_index_state *state,
+			     struct dir_index *keep)
+{
+	while ((state->num_indexes > DIR_INDEX_MAX_DIRS) ||
+	       (state->num_names > DIR_INDEX_MAX_NAMES)) {
+		struct dir_index *idx = DLIST_TAIL(state->indexes);
+
+		if (idx == keep) {
+			idx = DLIST_PREV(idx);
+		}
+		if (idx == NULL) {
+			break;
+		}
+		TALLOC_FREE(idx);
+	}
+}
+
+/****************************************************************************
+ Case-insensitive lookup of "name" in directory "path" via the index.
+ Returns 0 and the name as found in the directory, or -1 with errno.
+ errno==EOPNOTSUPP means the index is not in use for this share.
+****************************************************************************/
+
+int dir_index_lookup(connection_struct *conn, const char *path,
+		     const char *name, TALLOC_CTX *mem_ctx,
+		     char **found_name)
+{
+	struct dir_index_state *state;
+	struct smb_filename *smb_dname;
+	struct dir_index_small *small;
+	struct dir_index *idx;
+	struct dir_index_name *n;
+	struct file_id id;
+	struct timespec mtime;
+	char *abspath, *upper;
+	bool unwatched = false;
+	int ret = -1;
+
+	if (!lp_parm_bool(SNUM(conn), "smbd", "dir index", false)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	state = dir_index_get_state();
+	if (state == NULL) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if ((path == NULL) || (*path == '\0')) {
+		path = ".";
+	}
+
+	upper = talloc_strdup_upper(talloc_tos(), name);
+	if (upper == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (ISDOT(path)) {
+		abspath = talloc_strdup(upper, conn->connectpath);
+	} else {
+		abspath = talloc_asprintf(upper, "%s/%s", conn->connectpath,
+					  path);
+	}
+	if (abspath == NULL) {
+		TALLOC_FREE(upper);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	smb_dname = synthetic_smb_fname(upper, path, NULL, NULL);
+	if (smb_dname == NULL) {
+		TALLOC_FREE(upper);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (SMB_VFS_STAT(conn, smb_dname) == -1) {
+		int err = errno;
+		TALLOC_FREE(upper);
+		errno = err;
+		return -1;
+	}
+
+	id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+	mtime = smb_dname->st.st_ex_mtime;
+
+	small = dir_index_small_find(state, SNUM(conn), abspath);
+	if ((small != NULL) && file_id_equal(&small->id, &id) &&
+	    (timespec_compare(&small->mtime, &mtime) == 0)) {
+		DLIST_PROMOTE(state->small, small);
+		TALLOC_FREE(upper);
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	idx = dir_index_get(conn, smb_dname, abspath);
+	if (idx == NULL) {
+		/*
+		 * A directory that was small before most likely still
+		 * is. Scan it without a watch, if it has grown the next
+		 * lookup sets one up.
+		 */
+		unwatched = (small != NULL);
+		idx = dir_index_build(conn, smb_dname, abspath, !unwatched);
+		if (idx == NULL) {
+			int err = errno;
+			TALLOC_FREE(upper);
+			errno = err;
+			return -1;
+		}
+		DEBUG(10, ("%s: indexed %s with %zu names\n", __func__,
+			   abspath, idx->num_names));
+	}
+
+	n = dir_index_find(idx, upper, dir_index_hash(upper));
+	if (n == NULL) {
+		errno = ENOENT;
+	} else {
+		*found_name = talloc_strdup(mem_ctx, n->name);
+		if (*found_name == NULL) {
+			errno = ENOMEM;
+		} else {
+			ret = 0;
+		}
+	}
+
+	if (idx->num_names < DIR_INDEX_MIN_NAMES) {
+		dir_index_small_remember(state, small, SNUM(conn), abspath,
+					 &id, &mtime);
+		TALLOC_FREE(idx);
+	} else {
+		if (small != NULL) {
+			/*
+			 * It has grown
+			 */
+			dir_index_small_forget(state, small);
+		}
+		if (unwatched || !dir_index_keep(idx)) {
+			TALLOC_FREE(idx);
+		} else {
+			dir_index_shrink(state, idx);
+		}
+	}
+
+	TALLOC_FREE(upper);
+	return ret;
+}
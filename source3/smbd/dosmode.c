@@ -25,6 +25,8 @@
 #include "../libcli/security/security.h"
 #include "smbd/smbd.h"
 #include "lib/param/loadparm.h"
+#include "../lib/util/memcache.h"
+#include "smbprofile.h"
 
 static NTSTATUS get_file_handle_for_metadata(connection_struct *conn,
 				struct smb_filename *smb_fname,
@@ -252,6 +254,141 @@ static uint32_t dos_mode_from_sbuf(connection_struct *conn,
 	return result;
 }
 
+/****************************************************************************
+ Cache of what get_ea_dos_attribute() found, keyed by file_id.
+
+ Entries are only used while the file's ctime is unchanged: Changing an
+ EA updates the ctime, also when done by another process. Files changed
+ within the last second are not cached, the ctime might not tell apart
+ two changes that quickly after each other.
+****************************************************************************/
+
+/*
+ * Modules keeping EAs away from the file, changing them leaves the ctime
+ * alone.
+ */
+static const char * const dosmode_cache_incompatible[] = {
+	"xattr_tdb",
+};
+
+struct dosmode_cache_key {
+	struct file_id id;
+	uid_t uid;
+	int snum;
+};
+
+struct dosmode_cache_entry {
+	struct timespec ctime;
+	struct timespec create_time;
+	uint32_t dosattr;
+	bool have_attr;
+	bool have_create_time;
+};
+
+/****************************************************************************
+ Decide at tree connect whether conn uses the dosmode cache.
+****************************************************************************/
+
+void dosmode_cache_connect(connection_struct *conn)
+{
+	const char *module;
+
+	conn->dosmode_cache = false;
+
+	if (!lp_parm_bool(SNUM(conn), "smbd", "dosmode cache", false)) {
+		return;
+	}
+
+	module = vfs_find_module_in_stack(
+		conn, dosmode_cache_incompatible,
+		ARRAY_SIZE(dosmode_cache_incompatible));
+	if (module != NULL) {
+		DEBUG(1, ("%s: Not using \"smbd:dosmode cache\" on share %s, "
+			  "%s does not update the ctime on EA changes\n",
+			  __func__, lp_servicename(talloc_tos(), SNUM(conn)),
+			  module));
+		return;
+	}
+
+	conn->dosmode_cache = true;
+}
+
+static bool dosmode_cache_key(connection_struct *conn,
+			      const struct smb_filename *smb_fname,
+			      struct dosmode_cache_key *key)
+{
+	if (!conn->dosmode_cache) {
+		return false;
+	}
+	if (smb_fname->stream_name != NULL) {
+		return false;
+	}
+
+	ZERO_STRUCTP(key);
+	key->id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+	key->uid = get_current_uid(conn);
+	key->snum = SNUM(conn);
+	return true;
+}
+
+static bool dosmode_cache_fetch(const struct dosmode_cache_key *key,
+				const struct smb_filename *smb_fname,
+				struct dosmode_cache_entry *entry)
+{
+	DATA_BLOB val;
+
+	if (!memcache_lookup(smbd_memcache(), DOSMODE_CACHE,
+			     data_blob_const(key, sizeof(*key)), &val)) {
+		return false;
+	}
+	if (val.length != sizeof(*entry)) {
+		return false;
+	}
+	memcpy(entry, val.data, sizeof(*entry));
+
+	if (timespec_compare(&entry->ctime,
+			     &smb_fname->st.st_ex_ctime) != 0) {
+		memcache_delete(smbd_memcache(), DOSMODE_CACHE,
+				data_blob_const(key, sizeof(*key)));
+		return false;
+	}
+	return true;
+}
+
+static void dosmode_cache_store(const struct dosmode_cache_key *key,
+				const struct smb_filename *smb_fname,
+				struct dosmode_cache_entry *entry)
+{
+	struct timespec now = timespec_current();
+
+	if ((now.tv_sec - smb_fname->st.st_ex_ctime.tv_sec) < 2) {
+		return;
+	}
+
+	entry->ctime = smb_fname->st.st_ex_ctime;
+	memcache_add(smbd_memcache(), DOSMODE_CACHE,
+		     data_blob_const(key, sizeof(*key)),
+		     data_blob_const(entry, sizeof(*entry)));
+}
+
+/*
+ * Forget what we know about a file whose DOS attributes or times we
+ * change ourselves.
+ */
+
+static void dosmode_cache_delete(connection_struct *conn,
+				 const struct smb_filename *smb_fname)
+{
+	struct dosmode_cache_key key;
+
+	if (!VALID_STAT(smb_fname->st) ||
+	    !dosmode_cache_key(conn, smb_fname, &key)) {
+		return;
+	}
+	memcache_delete(smbd_memcache(), DOSMODE_CACHE,
+			data_blob_const(&key, sizeof(key)));
+}
+
 /****************************************************************************
  Get DOS attributes from an EA.
  This can also pull the create time into the stat struct inside smb_fname.
@@ -267,11 +404,32 @@ static bool get_ea_dos_attribute(connection_struct *conn,
 	ssize_t sizeret;
 	fstring attrstr;
 	uint32_t dosattr;
+	struct dosmode_cache_key key;
+	struct dosmode_cache_entry entry = { .have_attr = false };
+	bool cacheable;
 
 	if (!lp_store_dos_attributes(SNUM(conn))) {
 		return False;
 	}
 
+	cacheable = dosmode_cache_key(conn, smb_fname, &key);
+
+	if (cacheable && dosmode_cache_fetch(&key, smb_fname, &entry)) {
+		DO_PROFILE_INC(dosmodecache_hits);
+		if (!entry.have_attr) {
+			return false;
+		}
+		if (entry.have_create_time) {
+			update_stat_ex_create_time(&smb_fname->st,
+						   entry.create_time);
+		}
+		dosattr = entry.dosattr;
+		goto done;
+	}
+	if (cacheable) {
+		DO_PROFILE_INC(dosmodecache_misses);
+	}
+
 	/* Don't reset pattr to zero as we may already have filename-based attributes we
 	   need to preserve. */
 
@@ -279,6 +437,11 @@ static bool get_ea_dos_attribute(connection_struct *conn,
 				   SAMBA_XATTR_DOS_ATTRIB, attrstr,
 				   sizeof(attrstr));
 	if (sizeret == -1) {
+#if defined(ENOATTR)
+		if (cacheable && (errno == ENOATTR)) {
+			dosmode_cache_store(&key, smb_fname, &entry);
+		}
+#endif
 		if (errno == ENOSYS
 #if defined(ENOTSUP)
 			|| errno == ENOTSUP) {
@@ -324,6 +487,8 @@ static bool get_ea_dos_attribute(connection_struct *conn,
 
 				update_stat_ex_create_time(&smb_fname->st,
 							create_time);
+				entry.create_time = create_time;
+				entry.have_create_time = true;
 
 				DEBUG(10,("get_ea_dos_attribute: file %s case 1 "
 					"set btime %s\n",
@@ -346,6 +511,8 @@ static bool get_ea_dos_attribute(connection_struct *conn,
 
 				update_stat_ex_create_time(&smb_fname->st,
 							create_time);
+				entry.create_time = create_time;
+				entry.have_create_time = true;
 
 				DEBUG(10,("get_ea_dos_attribute: file %s case 3 "
 					"set btime %s\n",
@@ -361,6 +528,13 @@ static bool get_ea_dos_attribute(connection_struct *conn,
 	                return false;
 	}
 
+	if (cacheable) {
+		entry.dosattr = dosattr;
+		entry.have_attr = true;
+		dosmode_cache_store(&key, smb_fname, &entry);
+	}
+
+done:
 	if (S_ISDIR(smb_fname->st.st_ex_mode)) {
 		dosattr |= FILE_ATTRIBUTE_DIRECTORY;
 	}
@@ -388,6 +562,8 @@ static bool set_ea_dos_attribute(connection_struct *conn,
 	ZERO_STRUCT(dosattrib);
 	ZERO_STRUCT(blob);
 
+	dosmode_cache_delete(conn, smb_fname);
+
 	dosattrib.version = 3;
 	dosattrib.info.info3.valid_flags = XATTR_DOSINFO_ATTRIB|
 					XATTR_DOSINFO_CREATE_TIME;
@@ -960,6 +1136,8 @@ int file_ntimes(connection_struct *conn, const struct smb_filename *smb_fname,
 		return 0;
 	}
 
+	dosmode_cache_delete(conn, smb_fname);
+
 	if(SMB_VFS_NTIMES(conn, smb_fname, ft) == 0) {
 		return 0;
 	}
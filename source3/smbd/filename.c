@@ -466,8 +466,8 @@ NTSTATUS unix_convert(TALLOC_CTX *ctx,
 				goto fail;
 			}
 			/* Add the path (not including the stream) to the cache. */
-			stat_cache_add(orig_path, smb_fname->base_name,
-				       conn->case_sensitive);
+			stat_cache_add(conn, orig_path, smb_fname->base_name,
+				       &smb_fname->st);
 			DEBUG(5,("conversion of base_name finished %s -> %s\n",
 				 orig_path, smb_fname->base_name));
 			goto done;
@@ -974,8 +974,7 @@ NTSTATUS unix_convert(TALLOC_CTX *ctx,
 		 * or wildcard components as this can change the size.
 		 */
 		if(!component_was_mangled && !name_has_wildcard) {
-			stat_cache_add(orig_path, dirpath,
-					conn->case_sensitive);
+			stat_cache_add(conn, orig_path, dirpath, NULL);
 		}
 
 		/*
@@ -992,8 +991,8 @@ NTSTATUS unix_convert(TALLOC_CTX *ctx,
 	 */
 
 	if(!component_was_mangled && !name_has_wildcard) {
-		stat_cache_add(orig_path, smb_fname->base_name,
-			       conn->case_sensitive);
+		stat_cache_add(conn, orig_path, smb_fname->base_name,
+			       &smb_fname->st);
 	}
 
 	/*
@@ -1173,6 +1172,16 @@ static int get_real_filename_full_scan(connection_struct *conn,
 		}
 	}
 
+	if (!mangled && !conn->case_sensitive) {
+		int ret;
+
+		ret = dir_index_lookup(conn, path, name, mem_ctx, found_name);
+		if ((ret == 0) || (errno != EOPNOTSUPP)) {
+			TALLOC_FREE(unmangled_name);
+			return ret;
+		}
+	}
+
 	/* open the directory */
 	if (!(cur_dir = OpenDir(talloc_tos(), conn, path, NULL, 0))) {
 		DEBUG(3,("scan dir didn't open dir [%s]\n",path));
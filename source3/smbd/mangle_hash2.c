@@ -68,6 +68,7 @@
 #include "smbd/globals.h"
 #include "../lib/util/memcache.h"
 #include "mangle.h"
+#include <sys/mman.h>
 
 #if 1
 #define M_DEBUG(level, x) DEBUG(level, x)
@@ -307,6 +308,194 @@ static unsigned int mangle_hash(const char *key, unsigned int length)
 	return value & ~0x80000000;  
 }
 
+/*
+  The shared prefix cache.
+
+  The prefix cache only lives in the smbd that created a mangled name.
+  Another smbd asked for the same 8.3 name has to scan the directory,
+  mangling every entry until it finds a match. With
+  "smbd:shared mangle cache = yes" the parent maps a table that all
+  children inherit, lookups missing the local cache try that table
+  before giving up.
+
+  A mangled name is derived from the hash of the long name's prefix
+  only, independent of directory and share, so the table is keyed by
+  that hash just like the local cache. It is direct mapped, a slot's
+  "seq" is odd while a writer fills it. Readers copy the slot and
+  treat it as a miss if "seq" changed meanwhile, writers finding a
+  slot busy drop their entry.
+*/
+
+#define MANGLE_SHARED_MAGIC 0x4d616e67 /* "Mang" */
+#define MANGLE_SHARED_SLOT_SIZE 256
+
+struct mangle_shared_slot {
+	volatile uint32_t seq;
+	uint32_t hash;
+	uint16_t length;
+	char prefix[MANGLE_SHARED_SLOT_SIZE - 10];
+};
+
+struct mangle_shared {
+	uint32_t magic;
+	uint32_t num_slots;
+	uint8_t pad[56];
+	struct mangle_shared_slot slots[];
+};
+
+static struct mangle_shared *mangle_shared;
+
+#ifdef HAVE___SYNC_FETCH_AND_ADD
+#define mangle_shared_barrier() __sync_synchronize()
+#endif
+
+/**
+ * Set up the shared prefix cache in the parent smbd, before any child
+ * is forked.
+ */
+
+bool mangle_hash2_shared_init(void)
+{
+	struct mangle_shared *shm;
+	int num_slots;
+	size_t size;
+	void *ptr;
+
+	if (!lp_parm_bool(-1, "smbd", "shared mangle cache", false)) {
+		return true;
+	}
+
+#ifndef mangle_shared_barrier
+	DEBUG(1, ("shared mangle cache not supported on this platform\n"));
+	return true;
+#else
+	if (mangle_shared != NULL) {
+		return true;
+	}
+
+	num_slots = lp_parm_int(-1, "smbd", "shared mangle cache size", 65536);
+	if (num_slots < 1 || num_slots > (1<<22)) {
+		DEBUG(1, ("Invalid shared mangle cache size %d\n", num_slots));
+		return false;
+	}
+
+	size = sizeof(struct mangle_shared) +
+		num_slots * sizeof(struct mangle_shared_slot);
+
+	ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+		   -1, 0);
+	if (ptr == MAP_FAILED) {
+		DEBUG(0, ("Could not map shared mangle cache: %s\n",
+			  strerror(errno)));
+		return false;
+	}
+
+	/* Anonymous mappings are zeroed, length 0 marks an empty slot */
+	shm = (struct mangle_shared *)ptr;
+	shm->magic = MANGLE_SHARED_MAGIC;
+	shm->num_slots = num_slots;
+
+	mangle_shared = shm;
+
+	DEBUG(3, ("shared mangle cache with %d entries (%zu bytes)\n",
+		  num_slots, size));
+	return true;
+#endif
+}
+
+#ifdef mangle_shared_barrier
+
+static void mangle_shared_store(const char *prefix, int length,
+				unsigned int hash)
+{
+	struct mangle_shared_slot *slot;
+	uint32_t seq;
+
+	if ((mangle_shared == NULL) || (length <= 0) ||
+	    (length >= sizeof(slot->prefix))) {
+		return;
+	}
+
+	slot = &mangle_shared->slots[hash % mangle_shared->num_slots];
+
+	/*
+	 * Directory listings mangle the same names over and over
+	 * again. Don't dirty the cache line if the entry is there.
+	 */
+	if ((slot->hash == hash) && (slot->length == length) &&
+	    (memcmp(slot->prefix, prefix, length) == 0)) {
+		return;
+	}
+
+	seq = slot->seq;
+	if ((seq & 1) != 0) {
+		return;
+	}
+	if (!__sync_bool_compare_and_swap(&slot->seq, seq, seq + 1)) {
+		return;
+	}
+
+	slot->hash = hash;
+	slot->length = length;
+	memcpy(slot->prefix, prefix, length);
+	slot->prefix[length] = '\0';
+
+	mangle_shared_barrier();
+	slot->seq += 1;
+}
+
+static bool mangle_shared_fetch(unsigned int hash, char *prefix,
+				size_t *plength)
+{
+	struct mangle_shared_slot *slot;
+	uint32_t seq;
+	size_t length;
+
+	if (mangle_shared == NULL) {
+		return false;
+	}
+
+	slot = &mangle_shared->slots[hash % mangle_shared->num_slots];
+
+	seq = slot->seq;
+	if ((seq & 1) != 0) {
+		return false;
+	}
+	mangle_shared_barrier();
+
+	length = slot->length;
+	if ((slot->hash != hash) || (length == 0) ||
+	    (length >= sizeof(slot->prefix))) {
+		return false;
+	}
+	memcpy(prefix, slot->prefix, length);
+	prefix[length] = '\0';
+
+	mangle_shared_barrier();
+	if (slot->seq != seq) {
+		return false;
+	}
+
+	*plength = length;
+	return true;
+}
+
+#else
+
+static void mangle_shared_store(const char *prefix, int length,
+				unsigned int hash)
+{
+	return;
+}
+
+static bool mangle_shared_fetch(unsigned int hash, char *prefix,
+				size_t *plength)
+{
+	return false;
+}
+
+#endif
+
 /*
   insert an entry into the prefix cache. The string might not be null
   terminated */
@@ -322,6 +511,8 @@ static void cache_insert(const char *prefix, int length, unsigned int hash)
 		     data_blob_const(&hash, sizeof(hash)),
 		     data_blob_const(str, length+1));
 	SAFE_FREE(str);
+
+	mangle_shared_store(prefix, length, hash);
 }
 
 /*
@@ -330,10 +521,19 @@ static void cache_insert(const char *prefix, int length, unsigned int hash)
 static char *cache_lookup(TALLOC_CTX *mem_ctx, unsigned int hash)
 {
 	DATA_BLOB value;
+	char prefix[MANGLE_SHARED_SLOT_SIZE];
+	size_t length;
 
 	if (!memcache_lookup(smbd_memcache(), MANGLE_HASH2_CACHE,
 			     data_blob_const(&hash, sizeof(hash)), &value)) {
-		return NULL;
+		if (!mangle_shared_fetch(hash, prefix, &length)) {
+			return NULL;
+		}
+		/* Remember it locally, the next lookup is cheaper */
+		memcache_add(smbd_memcache(), MANGLE_HASH2_CACHE,
+			     data_blob_const(&hash, sizeof(hash)),
+			     data_blob_const(prefix, length+1));
+		return talloc_strndup(mem_ctx, prefix, length);
 	}
 
 	SMB_ASSERT((value.length > 0)
@@ -65,6 +65,15 @@ struct notifyd_state {
 	 */
 	struct db_context *entries;
 
+	/*
+	 * Path trie over the keys of "entries". notifyd_trigger walks
+	 * it along the triggering path and only looks into "entries"
+	 * where the filters registered for a directory can match. This
+	 * avoids a database lookup per path component and stops the
+	 * walk where no directory below is watched.
+	 */
+	struct notifyd_index *index;
+
 	/*
 	 * In the cluster case, this is the place where we store a log
 	 * of all MSG_SMB_NOTIFY_REC_CHANGE messages. We just 1:1
@@ -113,6 +122,29 @@ struct notifyd_instance {
 	uint32_t internal_subdir_filter;
 };
 
+/*
+ * One path component in notifyd_state->index
+ */
+struct notifyd_index {
+	char *name;
+	size_t namelen;
+	struct notifyd_index *parent;
+
+	/*
+	 * Sorted by notifyd_index_cmp for binary search, home
+	 * directory servers have lots of children of /home.
+	 */
+	struct notifyd_index **children;
+	size_t num_children;
+
+	/*
+	 * Union of all filters registered for exactly this
+	 * directory. 0 if there's no entry.
+	 */
+	uint32_t filter;
+	uint32_t subdir_filter;
+};
+
 struct notifyd_peer {
 	struct notifyd_state *state;
 	struct server_id pid;
@@ -214,6 +246,11 @@ struct tevent_req *notifyd_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 		return tevent_req_post(req, ev);
 	}
 
+	state->index = talloc_zero(state, struct notifyd_index);
+	if (tevent_req_nomem(state->index, req)) {
+		return tevent_req_post(req, ev);
+	}
+
 	subreq = messaging_handler_send(state, ev, msg_ctx,
 					MSG_SMB_NOTIFY_REC_CHANGE,
 					notifyd_rec_change, state);
@@ -362,11 +399,205 @@ static bool notifyd_parse_entry(uint8_t *buf, size_t buflen,
 	return true;
 }
 
+static int notifyd_index_cmp(const char *name, size_t namelen,
+			     const struct notifyd_index *node)
+{
+	int cmp;
+
+	cmp = memcmp(name, node->name, MIN(namelen, node->namelen));
+	if (cmp != 0) {
+		return cmp;
+	}
+	if (namelen == node->namelen) {
+		return 0;
+	}
+	return (namelen < node->namelen) ? -1 : 1;
+}
+
+/*
+ * Binary search for a child. Returns the insert position in *pidx if
+ * not found.
+ */
+
+static struct notifyd_index *notifyd_index_child(struct notifyd_index *node,
+						 const char *name,
+						 size_t namelen,
+						 size_t *pidx)
+{
+	size_t lo = 0;
+	size_t hi = node->num_children;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp;
+
+		cmp = notifyd_index_cmp(name, namelen, node->children[mid]);
+		if (cmp == 0) {
+			return node->children[mid];
+		}
+		if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	if (pidx != NULL) {
+		*pidx = lo;
+	}
+	return NULL;
+}
+
+static struct notifyd_index *notifyd_index_add_child(
+	struct notifyd_index *node, const char *name, size_t namelen)
+{
+	struct notifyd_index *child, **tmp;
+	size_t idx = 0;
+
+	child = notifyd_index_child(node, name, namelen, &idx);
+	if (child != NULL) {
+		return child;
+	}
+
+	tmp = talloc_realloc(node, node->children, struct notifyd_index *,
+			     node->num_children + 1);
+	if (tmp == NULL) {
+		return NULL;
+	}
+	node->children = tmp;
+
+	child = talloc_zero(node, struct notifyd_index);
+	if (child == NULL) {
+		return NULL;
+	}
+	child->name = talloc_strndup(child, name, namelen);
+	if (child->name == NULL) {
+		TALLOC_FREE(child);
+		return NULL;
+	}
+	child->namelen = namelen;
+	child->parent = node;
+
+	memmove(&node->children[idx+1], &node->children[idx],
+		sizeof(struct notifyd_index *) * (node->num_children - idx));
+	node->children[idx] = child;
+	node->num_children += 1;
+
+	return child;
+}
+
+/*
+ * Remove nodes that neither carry filters nor have children anymore
+ */
+
+static void notifyd_index_prune(struct notifyd_index *node)
+{
+	while ((node->parent != NULL) &&
+	       (node->num_children == 0) &&
+	       (node->filter == 0) && (node->subdir_filter == 0)) {
+		struct notifyd_index *parent = node->parent;
+		size_t idx;
+
+		for (idx=0; idx<parent->num_children; idx++) {
+			if (parent->children[idx] == node) {
+				break;
+			}
+		}
+		if (idx == parent->num_children) {
+			DEBUG(1, ("%s: node %s not found in parent\n",
+				  __func__, node->name));
+			return;
+		}
+
+		memmove(&parent->children[idx], &parent->children[idx+1],
+			sizeof(struct notifyd_index *) *
+			(parent->num_children - idx - 1));
+		parent->num_children -= 1;
+
+		TALLOC_FREE(node);
+		node = parent;
+	}
+}
+
+/*
+ * Reflect the instances now stored under "key" in the index
+ */
+
+static bool notifyd_index_update(struct notifyd_index *index,
+				 TDB_DATA key,
+				 const struct notifyd_instance *instances,
+				 size_t num_instances)
+{
+	const char *path = (const char *)key.dptr;
+	const char *end = path + key.dsize;
+	const char *name, *p;
+	struct notifyd_index *node = index;
+	uint32_t filter = 0;
+	uint32_t subdir_filter = 0;
+	size_t i;
+
+	if ((key.dsize == 0) || (path[0] != '/')) {
+		/*
+		 * notifyd_trigger ignores those anyway
+		 */
+		return true;
+	}
+
+	for (i=0; i<num_instances; i++) {
+		const struct notifyd_instance *instance = &instances[i];
+
+		filter |= instance->instance.filter;
+		filter |= instance->internal_filter;
+		subdir_filter |= instance->instance.subdir_filter;
+		subdir_filter |= instance->internal_subdir_filter;
+	}
+
+	for (name = path+1; name <= end; name = p+1) {
+		p = memchr(name, '/', end - name);
+		if (p == NULL) {
+			p = end;
+		}
+
+		if (num_instances == 0) {
+			node = notifyd_index_child(node, name, p - name,
+						   NULL);
+			if (node == NULL) {
+				/*
+				 * Not indexed anyway
+				 */
+				return true;
+			}
+		} else {
+			struct notifyd_index *child;
+
+			child = notifyd_index_add_child(node, name, p - name);
+			if (child == NULL) {
+				DEBUG(1, ("%s: notifyd_index_add_child "
+					  "failed\n", __func__));
+				/*
+				 * Drop what we added so far
+				 */
+				notifyd_index_prune(node);
+				return false;
+			}
+			node = child;
+		}
+	}
+
+	node->filter = filter;
+	node->subdir_filter = subdir_filter;
+
+	notifyd_index_prune(node);
+
+	return true;
+}
+
 static bool notifyd_apply_rec_change(
 	const struct server_id *client,
 	const char *path, size_t pathlen,
 	const struct notify_instance *chg,
 	struct db_context *entries,
+	struct notifyd_index *index,
 	sys_notify_watch_fn sys_notify_watch,
 	struct sys_notify_context *sys_notify_ctx,
 	struct messaging_context *msg_ctx)
@@ -376,7 +607,8 @@ static bool notifyd_apply_rec_change(
 	size_t num_instances;
 	size_t i;
 	struct notifyd_instance *instance;
-	TDB_DATA value;
+	TDB_DATA key, value, old_value;
+	size_t num_old_instances;
 	NTSTATUS status;
 	bool ok = false;
 
@@ -394,9 +626,9 @@ static bool notifyd_apply_rec_change(
 		   (unsigned)chg->filter, (unsigned)chg->subdir_filter,
 		   chg->private_data));
 
-	rec = dbwrap_fetch_locked(
-		entries, entries,
-		make_tdb_data((const uint8_t *)path, pathlen-1));
+	key = make_tdb_data((const uint8_t *)path, pathlen-1);
+
+	rec = dbwrap_fetch_locked(entries, entries, key);
 
 	if (rec == NULL) {
 		DEBUG(1, ("%s: dbwrap_fetch_locked failed\n", __func__));
@@ -413,6 +645,9 @@ static bool notifyd_apply_rec_change(
 		}
 	}
 
+	old_value = value;
+	num_old_instances = num_instances;
+
 	/*
 	 * Overallocate by one instance to avoid a realloc when adding
 	 */
@@ -489,7 +724,26 @@ static bool notifyd_apply_rec_change(
 				  __func__, nt_errstr(status)));
 			goto fail;
 		}
+
+		/*
+		 * Only after the record is gone: Pruning can't fail, but
+		 * putting pruned nodes back could.
+		 */
+		if (index != NULL) {
+			notifyd_index_update(index, key, NULL, 0);
+		}
 	} else {
+		/*
+		 * Adding to the index can fail allocating nodes, so do it
+		 * before storing. Going back to the old instances only
+		 * touches nodes that exist by now.
+		 */
+		if ((index != NULL) &&
+		    !notifyd_index_update(index, key, instances,
+					  num_instances)) {
+			goto fail;
+		}
+
 		value = make_tdb_data(
 			(uint8_t *)instances,
 			sizeof(struct notifyd_instance) * num_instances);
@@ -498,6 +752,14 @@ static bool notifyd_apply_rec_change(
 		if (!NT_STATUS_IS_OK(status)) {
 			DEBUG(1, ("%s: dbwrap_record_store returned %s\n",
 				  __func__, nt_errstr(status)));
+			if ((index != NULL) &&
+			    !notifyd_index_update(
+				    index, key,
+				    (struct notifyd_instance *)old_value.dptr,
+				    num_old_instances)) {
+				DEBUG(0, ("%s: could not restore the index "
+					  "for %s\n", __func__, path));
+			}
 			goto fail;
 		}
 	}
@@ -585,7 +847,8 @@ static bool notifyd_rec_change(struct messaging_context *msg_ctx,
 
 	ok = notifyd_apply_rec_change(
 		&rec->src, msg->path, pathlen, &msg->instance,
-		state->entries, state->sys_notify_watch, state->sys_notify_ctx,
+		state->entries, state->index,
+		state->sys_notify_watch, state->sys_notify_ctx,
 		state->msg_ctx);
 	if (!ok) {
 		DEBUG(1, ("%s: notifyd_apply_rec_change failed, ignoring\n",
@@ -649,8 +912,9 @@ static bool notifyd_trigger(struct messaging_context *msg_ctx,
 	struct server_id my_id = messaging_server_id(msg_ctx);
 	struct messaging_rec *rec = *prec;
 	struct notifyd_trigger_state tstate;
+	struct notifyd_index *node;
 	const char *path;
-	const char *p, *next_p;
+	const char *name, *p, *next_p;
 
 	if (rec->buf.length < offsetof(struct notify_trigger_msg, path) + 1) {
 		DEBUG(1, ("message too short, ignoring: %u\n",
@@ -680,6 +944,9 @@ static bool notifyd_trigger(struct messaging_context *msg_ctx,
 		return true;
 	}
 
+	node = state->index;
+	name = path+1;
+
 	for (p = strchr(path+1, '/'); p != NULL; p = next_p) {
 		ptrdiff_t path_len = p - path;
 		TDB_DATA key;
@@ -694,10 +961,29 @@ static bool notifyd_trigger(struct messaging_context *msg_ctx,
 		key = (TDB_DATA) { .dptr = discard_const_p(uint8_t, path),
 				   .dsize = path_len };
 
-		dbwrap_parse_record(state->entries, key,
-				    notifyd_trigger_parser, &tstate);
+		if (node != NULL) {
+			node = notifyd_index_child(node, name, p - name, NULL);
+		}
+		name = p+1;
+
+		if (node != NULL) {
+			uint32_t filter = tstate.recursive ?
+				node->subdir_filter : node->filter;
+
+			if ((filter & tstate.msg->filter) != 0) {
+				dbwrap_parse_record(state->entries, key,
+						    notifyd_trigger_parser,
+						    &tstate);
+			}
+		}
 
 		if (state->peers == NULL) {
+			if (node == NULL) {
+				/*
+				 * Nothing watched below here
+				 */
+				break;
+			}
 			continue;
 		}
 
@@ -730,11 +1016,15 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 {
 	struct notifyd_trigger_state *tstate = private_data;
 	struct notify_event_msg msg = { .action = tstate->msg->action };
-	struct iovec iov[2];
-	size_t path_len = key.dsize;
+	const char *path = tstate->msg->path + key.dsize + 1;
+	size_t hdrlen = offsetof(struct notify_event_msg, path);
+	size_t msglen = hdrlen + strlen(path) + 1;
 	struct notifyd_instance *instances = NULL;
 	size_t num_instances = 0;
-	size_t i;
+	TALLOC_CTX *frame;
+	size_t *matching, *group;
+	DATA_BLOB *bufs;
+	size_t i, j, num_matching;
 
 	if (!notifyd_parse_entry(data.dptr, data.dsize, &instances,
 				 &num_instances)) {
@@ -746,16 +1036,22 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 		   (unsigned)num_instances, (int)key.dsize,
 		   (char *)key.dptr));
 
-	iov[0].iov_base = &msg;
-	iov[0].iov_len = offsetof(struct notify_event_msg, path);
-	iov[1].iov_base = tstate->msg->path + path_len + 1;
-	iov[1].iov_len = strlen((char *)(iov[1].iov_base)) + 1;
+	frame = talloc_stackframe();
+
+	matching = talloc_array(frame, size_t, num_instances);
+	group = talloc_array(frame, size_t, num_instances);
+	bufs = talloc_array(frame, DATA_BLOB, num_instances);
+	if ((matching == NULL) || (group == NULL) || (bufs == NULL)) {
+		DEBUG(1, ("%s: talloc failed\n", __func__));
+		TALLOC_FREE(frame);
+		return;
+	}
+
+	num_matching = 0;
 
 	for (i=0; i<num_instances; i++) {
 		struct notifyd_instance *instance = &instances[i];
-		struct server_id_buf idbuf;
 		uint32_t i_filter;
-		NTSTATUS status;
 
 		if (tstate->covered_by_sys_notify) {
 			if (tstate->recursive) {
@@ -775,31 +1071,87 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 			continue;
 		}
 
-		msg.private_data = instance->instance.private_data;
+		matching[num_matching++] = i;
+	}
+
+	/*
+	 * An smbd often has several handles watching the same
+	 * directory. Send all events for one smbd in a single batch,
+	 * keeping their order.
+	 */
+
+	for (i=0; i<num_matching; i++) {
+		struct server_id dst;
+		struct server_id_buf idbuf;
+		size_t num_bufs;
+		NTSTATUS status;
+
+		if (matching[i] == SIZE_MAX) {
+			/*
+			 * Already sent with an earlier batch
+			 */
+			continue;
+		}
+		dst = instances[matching[i]].client;
+		num_bufs = 0;
+
+		for (j=i; j<num_matching; j++) {
+			struct notifyd_instance *instance;
+			uint8_t *buf;
 
-		status = messaging_send_iov(
-			tstate->msg_ctx, instance->client,
-			MSG_PVFS_NOTIFY, iov, ARRAY_SIZE(iov), NULL, 0);
+			if (matching[j] == SIZE_MAX) {
+				continue;
+			}
+			instance = &instances[matching[j]];
+			if (!server_id_equal(&instance->client, &dst)) {
+				continue;
+			}
 
-		DEBUG(10, ("%s: messaging_send_iov to %s returned %s\n",
-			   __func__,
-			   server_id_str_buf(instance->client, &idbuf),
-			   nt_errstr(status)));
+			buf = talloc_array(bufs, uint8_t, msglen);
+			if (buf == NULL) {
+				DEBUG(1, ("%s: talloc failed\n", __func__));
+				TALLOC_FREE(frame);
+				return;
+			}
+			msg.private_data = instance->instance.private_data;
+			memcpy(buf, &msg, hdrlen);
+			memcpy(buf + hdrlen, path, msglen - hdrlen);
+
+			bufs[num_bufs++] = data_blob_const(buf, msglen);
+			group[num_bufs-1] = matching[j];
+			matching[j] = SIZE_MAX;
+		}
+
+		status = messaging_send_batch(tstate->msg_ctx, dst,
+					      MSG_PVFS_NOTIFY, bufs, num_bufs);
+
+		DEBUG(10, ("%s: messaging_send_batch of %zu to %s "
+			   "returned %s\n", __func__, num_bufs,
+			   server_id_str_buf(dst, &idbuf), nt_errstr(status)));
+
+		for (j=0; j<num_bufs; j++) {
+			TALLOC_FREE(bufs[j].data);
+		}
 
 		if (NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_NOT_FOUND) &&
-		    procid_is_local(&instance->client)) {
+		    procid_is_local(&dst)) {
 			/*
 			 * That process has died
 			 */
-			notifyd_send_delete(tstate->msg_ctx, key, instance);
+			for (j=0; j<num_bufs; j++) {
+				notifyd_send_delete(tstate->msg_ctx, key,
+						    &instances[group[j]]);
+			}
 			continue;
 		}
 
 		if (!NT_STATUS_IS_OK(status)) {
-			DEBUG(1, ("%s: messaging_send_iov returned %s\n",
+			DEBUG(1, ("%s: messaging_send_batch returned %s\n",
 				  __func__, nt_errstr(status)));
 		}
 	}
+
+	TALLOC_FREE(frame);
 }
 
 /*
@@ -1341,7 +1693,7 @@ static void notifyd_apply_reclog(struct notifyd_peer *peer,
 		}
 
 		ok = notifyd_apply_rec_change(&r->src, chg->path, pathlen,
-					      &chg->instance, peer->db,
+					      &chg->instance, peer->db, NULL,
 					      state->sys_notify_watch,
 					      state->sys_notify_ctx,
 					      state->msg_ctx);
@@ -22,6 +22,246 @@
 #include "messages.h"
 #include "lib/util/server_id_db.h"
 
+static bool notifyd_test_watch(struct messaging_context *msg_ctx,
+			       struct server_id notifyd, const char *path,
+			       uint32_t filter, uint32_t subdir_filter,
+			       void *private_data)
+{
+	struct notify_rec_change_msg msg = {
+		.instance.filter = filter,
+		.instance.subdir_filter = subdir_filter,
+		.instance.private_data = private_data
+	};
+	struct iovec iov[2];
+	NTSTATUS status;
+
+	iov[0].iov_base = &msg;
+	iov[0].iov_len = offsetof(struct notify_rec_change_msg, path);
+	iov[1].iov_base = discard_const_p(char, path);
+	iov[1].iov_len = strlen(path)+1;
+
+	status = messaging_send_iov(
+		msg_ctx, notifyd, MSG_SMB_NOTIFY_REC_CHANGE,
+		iov, ARRAY_SIZE(iov), NULL, 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "messaging_send_iov returned %s\n",
+			nt_errstr(status));
+		return false;
+	}
+	return true;
+}
+
+static bool notifyd_test_send_trigger(struct messaging_context *msg_ctx,
+				      struct server_id notifyd,
+				      const char *path, uint32_t action,
+				      uint32_t filter)
+{
+	struct notify_trigger_msg msg = {
+		.action = action,
+		.filter = filter
+	};
+	struct iovec iov[2];
+	NTSTATUS status;
+
+	iov[0].iov_base = &msg;
+	iov[0].iov_len = offsetof(struct notify_trigger_msg, path);
+	iov[1].iov_base = discard_const_p(char, path);
+	iov[1].iov_len = strlen(path)+1;
+
+	status = messaging_send_iov(
+		msg_ctx, notifyd, MSG_SMB_NOTIFY_TRIGGER,
+		iov, ARRAY_SIZE(iov), NULL, 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "messaging_send_iov returned %s\n",
+			nt_errstr(status));
+		return false;
+	}
+	return true;
+}
+
+static int notifyd_test_read_event(TALLOC_CTX *mem_ctx,
+				   struct tevent_context *ev,
+				   struct messaging_context *msg_ctx,
+				   uint32_t timeout_msec,
+				   struct messaging_rec **prec)
+{
+	struct tevent_req *req;
+	struct messaging_rec *rec;
+	int ret;
+
+	req = messaging_read_send(mem_ctx, ev, msg_ctx, MSG_PVFS_NOTIFY);
+	if (req == NULL) {
+		return ENOMEM;
+	}
+	if (!tevent_req_set_endtime(req, ev,
+				    timeval_current_ofs_msec(timeout_msec))) {
+		TALLOC_FREE(req);
+		return ENOMEM;
+	}
+	if (!tevent_req_poll(req, ev)) {
+		TALLOC_FREE(req);
+		return errno;
+	}
+
+	ret = messaging_read_recv(req, mem_ctx, &rec);
+	TALLOC_FREE(req);
+	if (ret != 0) {
+		return ret;
+	}
+
+	if (rec->buf.length < offsetof(struct notify_event_msg, path) + 1) {
+		fprintf(stderr, "short notify event: %u\n",
+			(unsigned)rec->buf.length);
+		TALLOC_FREE(rec);
+		return EINVAL;
+	}
+
+	*prec = rec;
+	return 0;
+}
+
+/*
+ * Only the watches whose filter matches the trigger may fire. Both
+ * watches on /notifyd-test/a are ours, notifyd sends their events in
+ * one batch.
+ */
+
+static bool notifyd_test_trigger(struct tevent_context *ev,
+				 struct messaging_context *msg_ctx,
+				 struct server_id notifyd)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	const char *path = "/notifyd-test/a/file";
+	struct notify_event_msg *event;
+	struct messaging_rec *rec = NULL;
+	unsigned i, num_added, num_removed;
+	void *prev = NULL;
+	int ret;
+	bool ok;
+
+	ok = notifyd_test_watch(msg_ctx, notifyd, "/notifyd-test",
+				0, FILE_NOTIFY_CHANGE_ATTRIBUTES,
+				(void *)1);
+	ok &= notifyd_test_watch(msg_ctx, notifyd, "/notifyd-test/a",
+				 FILE_NOTIFY_CHANGE_FILE_NAME, 0,
+				 (void *)2);
+	ok &= notifyd_test_watch(msg_ctx, notifyd, "/notifyd-test/a/file",
+				 FILE_NOTIFY_CHANGE_FILE_NAME, 0,
+				 (void *)3);
+	ok &= notifyd_test_watch(msg_ctx, notifyd, "/notifyd-test/a",
+				 FILE_NOTIFY_CHANGE_FILE_NAME, 0,
+				 (void *)4);
+	if (!ok) {
+		goto fail;
+	}
+
+	/*
+	 * notifyd handles watches and triggers in separate handlers,
+	 * so the first triggers might overtake the watches. Repeat
+	 * until an event shows up.
+	 */
+	for (i=0; i<100; i++) {
+		ok = notifyd_test_send_trigger(
+			msg_ctx, notifyd, path, NOTIFY_ACTION_ADDED,
+			FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (!ok) {
+			goto fail;
+		}
+		ret = notifyd_test_read_event(frame, ev, msg_ctx, 100, &rec);
+		if (ret == 0) {
+			break;
+		}
+		if (ret != ETIMEDOUT) {
+			fprintf(stderr, "notifyd_test_read_event returned "
+				"%s\n", strerror(ret));
+			goto fail;
+		}
+	}
+	if (rec == NULL) {
+		fprintf(stderr, "no notify event\n");
+		goto fail;
+	}
+
+	/*
+	 * notifyd sends the events of one trigger in one go, and we
+	 * get them in order. So everything the ADDED triggers cause
+	 * arrives before the events for this REMOVED trigger.
+	 */
+	ok = notifyd_test_send_trigger(
+		msg_ctx, notifyd, path, NOTIFY_ACTION_REMOVED,
+		FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (!ok) {
+		goto fail;
+	}
+
+	num_added = 0;
+	num_removed = 0;
+
+	while (true) {
+		event = (struct notify_event_msg *)rec->buf.data;
+
+		if ((event->private_data != (void *)2) &&
+		    (event->private_data != (void *)4)) {
+			fprintf(stderr, "notify event for %p, expected %p "
+				"or %p\n", event->private_data, (void *)2,
+				(void *)4);
+			goto fail;
+		}
+		if ((event->private_data == (void *)2) ==
+		    (prev == (void *)2)) {
+			fprintf(stderr, "notify event for %p after %p\n",
+				event->private_data, prev);
+			goto fail;
+		}
+		prev = event->private_data;
+
+		if (strcmp(event->path, "file") != 0) {
+			fprintf(stderr, "notify event path %s, expected "
+				"file\n", event->path);
+			goto fail;
+		}
+		if (event->action == NOTIFY_ACTION_REMOVED) {
+			num_removed += 1;
+			if (num_removed == 2) {
+				break;
+			}
+		} else {
+			num_added += 1;
+		}
+
+		TALLOC_FREE(rec);
+
+		ret = notifyd_test_read_event(frame, ev, msg_ctx, 10000,
+					      &rec);
+		if (ret != 0) {
+			fprintf(stderr, "notifyd_test_read_event returned "
+				"%s\n", strerror(ret));
+			goto fail;
+		}
+	}
+
+	if (num_added == 0) {
+		fprintf(stderr, "no event for the ADDED trigger\n");
+		goto fail;
+	}
+
+	ok = notifyd_test_watch(msg_ctx, notifyd, "/notifyd-test",
+				0, 0, (void *)1);
+	ok &= notifyd_test_watch(msg_ctx, notifyd, "/notifyd-test/a",
+				 0, 0, (void *)2);
+	ok &= notifyd_test_watch(msg_ctx, notifyd, "/notifyd-test/a/file",
+				 0, 0, (void *)3);
+	ok &= notifyd_test_watch(msg_ctx, notifyd, "/notifyd-test/a",
+				 0, 0, (void *)4);
+
+	TALLOC_FREE(frame);
+	return ok;
+
+fail:
+	TALLOC_FREE(frame);
+	return false;
+}
+
 int main(int argc, const char *argv[])
 {
 	TALLOC_CTX *frame = talloc_stackframe();
@@ -113,6 +353,11 @@ int main(int argc, const char *argv[])
 		exit(1);
 	}
 
+	ok = notifyd_test_trigger(ev, msg_ctx, notifyd);
+	if (!ok) {
+		exit(1);
+	}
+
 	TALLOC_FREE(frame);
 	return 0;
 }
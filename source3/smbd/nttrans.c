@@ -929,6 +929,7 @@ NTSTATUS set_sd(files_struct *fsp, struct security_descriptor *psd,
 	}
 
 	status = SMB_VFS_FSET_NT_ACL(fsp, security_info_sent, psd);
+	access_check_cache_flush();
 
 	TALLOC_FREE(psd);
 
@@ -37,6 +37,8 @@
 #include "source3/lib/dbwrap/dbwrap_watch.h"
 #include "locking/leases_db.h"
 #include "librpc/gen_ndr/ndr_leases_db.h"
+#include "../lib/util/memcache.h"
+#include "smbprofile.h"
 
 extern const struct generic_mapping file_generic_mapping;
 
@@ -65,6 +67,200 @@ static bool parent_override_delete(connection_struct *conn,
 	return false;
 }
 
+/****************************************************************************
+ Cache of se_file_access_check() results, keyed by file_id, share, the
+ user's token and the access mask checked.
+
+ Like the DOS attribute cache entries are only used while the file's
+ ctime is unchanged: Storing an ACL in an EA, changing a POSIX ACL, the
+ mode or the owner all update the ctime, also when done by another
+ process. Files changed within the last second are not cached. ACLs
+ set through smbd flush the whole cache.
+
+ Modules storing ACLs away from the file, vfs_acl_tdb for example,
+ change no ctime. access_check_cache_connect() turns the cache off for
+ shares using them.
+****************************************************************************/
+
+struct access_check_cache_key {
+	struct file_id id;
+	int snum;
+	uint32_t access_desired;
+	uint32_t use_privs;
+	uint32_t num_sids;
+	uint64_t privilege_mask;
+	/* followed by the token's SIDs */
+};
+
+struct access_check_cache_entry {
+	struct timespec ctime;
+	NTSTATUS status;
+	uint32_t access_granted;
+};
+
+/*
+ * Modules keeping ACLs, or the EAs ACLs are stored in, away from the
+ * file. Other smbds can't see ACL changes through them in the ctime.
+ */
+static const char * const access_check_cache_incompatible[] = {
+	"acl_tdb",
+	"afsacl",
+	"xattr_tdb",
+};
+
+/****************************************************************************
+ Decide at tree connect whether conn uses the access check cache.
+****************************************************************************/
+
+void access_check_cache_connect(connection_struct *conn)
+{
+	const char *module;
+
+	conn->access_check_cache = false;
+
+	if (!lp_parm_bool(SNUM(conn), "smbd", "access check cache", false)) {
+		return;
+	}
+
+	module = vfs_find_module_in_stack(
+		conn, access_check_cache_incompatible,
+		ARRAY_SIZE(access_check_cache_incompatible));
+	if (module != NULL) {
+		DEBUG(1, ("%s: Not using \"smbd:access check cache\" on "
+			  "share %s, %s does not update the ctime on ACL "
+			  "changes\n", __func__,
+			  lp_servicename(talloc_tos(), SNUM(conn)), module));
+		return;
+	}
+
+	conn->access_check_cache = true;
+}
+
+static DATA_BLOB access_check_cache_key(TALLOC_CTX *mem_ctx,
+					connection_struct *conn,
+					const struct smb_filename *smb_fname,
+					bool use_privs,
+					uint32_t access_desired)
+{
+	const struct security_token *token = get_current_nttok(conn);
+	struct access_check_cache_key key;
+	size_t sids_len;
+	DATA_BLOB blob;
+
+	if (!conn->access_check_cache) {
+		return data_blob_null;
+	}
+	if ((token == NULL) || !VALID_STAT(smb_fname->st) ||
+	    (smb_fname->stream_name != NULL)) {
+		return data_blob_null;
+	}
+
+	ZERO_STRUCT(key);
+	key.id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+	key.snum = SNUM(conn);
+	key.access_desired = access_desired;
+	key.use_privs = use_privs;
+	key.num_sids = token->num_sids;
+	key.privilege_mask = token->privilege_mask;
+
+	sids_len = token->num_sids * sizeof(struct dom_sid);
+
+	blob = data_blob_talloc(mem_ctx, NULL, sizeof(key) + sids_len);
+	if (blob.data == NULL) {
+		return data_blob_null;
+	}
+	memcpy(blob.data, &key, sizeof(key));
+	if (sids_len != 0) {
+		memcpy(blob.data + sizeof(key), token->sids, sids_len);
+	}
+	return blob;
+}
+
+static bool access_check_cache_fetch(connection_struct *conn,
+				     const struct smb_filename *smb_fname,
+				     bool use_privs,
+				     uint32_t access_desired,
+				     NTSTATUS *pstatus,
+				     uint32_t *paccess_granted)
+{
+	struct access_check_cache_entry entry;
+	DATA_BLOB key, val;
+	bool found;
+
+	key = access_check_cache_key(talloc_tos(), conn, smb_fname,
+				     use_privs, access_desired);
+	if (key.data == NULL) {
+		return false;
+	}
+
+	found = memcache_lookup(smbd_memcache(), ACCESS_CHECK_CACHE, key,
+				&val);
+	if (found && (val.length == sizeof(entry))) {
+		memcpy(&entry, val.data, sizeof(entry));
+		if (timespec_compare(&entry.ctime,
+				     &smb_fname->st.st_ex_ctime) == 0) {
+			DO_PROFILE_INC(accesscache_hits);
+			data_blob_free(&key);
+			*pstatus = entry.status;
+			*paccess_granted = entry.access_granted;
+			return true;
+		}
+		memcache_delete(smbd_memcache(), ACCESS_CHECK_CACHE, key);
+	}
+
+	DO_PROFILE_INC(accesscache_misses);
+	data_blob_free(&key);
+	return false;
+}
+
+static void access_check_cache_store(connection_struct *conn,
+				     const struct smb_filename *smb_fname,
+				     bool use_privs,
+				     uint32_t access_desired,
+				     NTSTATUS status,
+				     uint32_t access_granted)
+{
+	struct access_check_cache_entry entry;
+	struct timespec now;
+	DATA_BLOB key;
+
+	if (!NT_STATUS_IS_OK(status) &&
+	    !NT_STATUS_EQUAL(status, NT_STATUS_ACCESS_DENIED)) {
+		return;
+	}
+
+	key = access_check_cache_key(talloc_tos(), conn, smb_fname,
+				     use_privs, access_desired);
+	if (key.data == NULL) {
+		return;
+	}
+
+	now = timespec_current();
+	if ((now.tv_sec - smb_fname->st.st_ex_ctime.tv_sec) < 2) {
+		data_blob_free(&key);
+		return;
+	}
+
+	ZERO_STRUCT(entry);
+	entry.ctime = smb_fname->st.st_ex_ctime;
+	entry.status = status;
+	entry.access_granted = access_granted;
+
+	memcache_add(smbd_memcache(), ACCESS_CHECK_CACHE, key,
+		     data_blob_const(&entry, sizeof(entry)));
+	data_blob_free(&key);
+}
+
+/*
+ * Called after we changed an ACL. Entries are not findable by file_id,
+ * this is rare enough to just drop all of them.
+ */
+
+void access_check_cache_flush(void)
+{
+	memcache_flush(smbd_memcache(), ACCESS_CHECK_CACHE);
+}
+
 /****************************************************************************
  Check if we have open rights.
 ****************************************************************************/
@@ -119,25 +315,7 @@ NTSTATUS smbd_check_access_rights(struct connection_struct *conn,
 		return NT_STATUS_OK;
 	}
 
-	status = SMB_VFS_GET_NT_ACL(conn, smb_fname->base_name,
-			(SECINFO_OWNER |
-			SECINFO_GROUP |
-			 SECINFO_DACL), talloc_tos(), &sd);
-
-	if (!NT_STATUS_IS_OK(status)) {
-		DEBUG(10, ("smbd_check_access_rights: Could not get acl "
-			"on %s: %s\n",
-			smb_fname_str_dbg(smb_fname),
-			nt_errstr(status)));
-
-		if (NT_STATUS_EQUAL(status, NT_STATUS_ACCESS_DENIED)) {
-			goto access_denied;
-		}
-
-		return status;
-	}
-
- 	/*
+	/*
 	 * If we can access the path to this file, by
 	 * default we have FILE_READ_ATTRIBUTES from the
 	 * containing directory. See the section:
@@ -160,12 +338,40 @@ NTSTATUS smbd_check_access_rights(struct connection_struct *conn,
 		do_not_check_mask |= FILE_EXECUTE;
 	}
 
+	if (access_check_cache_fetch(conn, smb_fname, use_privs,
+				     (access_mask & ~do_not_check_mask),
+				     &status, &rejected_mask)) {
+		goto checked;
+	}
+
+	status = SMB_VFS_GET_NT_ACL(conn, smb_fname->base_name,
+			(SECINFO_OWNER |
+			SECINFO_GROUP |
+			 SECINFO_DACL), talloc_tos(), &sd);
+
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(10, ("smbd_check_access_rights: Could not get acl "
+			"on %s: %s\n",
+			smb_fname_str_dbg(smb_fname),
+			nt_errstr(status)));
+
+		if (NT_STATUS_EQUAL(status, NT_STATUS_ACCESS_DENIED)) {
+			goto access_denied;
+		}
+
+		return status;
+	}
+
 	status = se_file_access_check(sd,
 				get_current_nttok(conn),
 				use_privs,
 				(access_mask & ~do_not_check_mask),
 				&rejected_mask);
 
+	access_check_cache_store(conn, smb_fname, use_privs,
+				 (access_mask & ~do_not_check_mask),
+				 status, rejected_mask);
+
 	DEBUG(10,("smbd_check_access_rights: file %s requesting "
 		"0x%x returning 0x%x (%s)\n",
 		smb_fname_str_dbg(smb_fname),
@@ -183,6 +389,8 @@ NTSTATUS smbd_check_access_rights(struct connection_struct *conn,
 
 	TALLOC_FREE(sd);
 
+  checked:
+
 	if (NT_STATUS_IS_OK(status) ||
 			!NT_STATUS_EQUAL(status, NT_STATUS_ACCESS_DENIED)) {
 		return status;
@@ -2170,6 +2378,12 @@ static NTSTATUS smbd_calculate_maximum_allowed_access(
 		return NT_STATUS_OK;
 	}
 
+	if (access_check_cache_fetch(conn, smb_fname, use_privs,
+				     (*p_access_mask & ~FILE_READ_ATTRIBUTES),
+				     &status, &access_granted)) {
+		goto checked;
+	}
+
 	status = SMB_VFS_GET_NT_ACL(conn, smb_fname->base_name,
 				    (SECINFO_OWNER |
 				     SECINFO_GROUP |
@@ -2208,6 +2422,11 @@ static NTSTATUS smbd_calculate_maximum_allowed_access(
 
 	TALLOC_FREE(sd);
 
+	access_check_cache_store(conn, smb_fname, use_privs,
+				 (*p_access_mask & ~FILE_READ_ATTRIBUTES),
+				 status, access_granted);
+
+checked:
 	if (!NT_STATUS_IS_OK(status)) {
 		DEBUG(10, ("Access denied on file %s: "
 			   "when calculating maximum access\n",
@@ -2847,6 +3066,15 @@ static NTSTATUS open_file_ntcreate(connection_struct *conn,
 
 	id = fsp->file_id;
 
+	/*
+	 * Granting a lease needs the lease record locked as well, get
+	 * both records with one round trip in a cluster.
+	 */
+	if ((oplock_request == LEASE_OPLOCK) && (lease != NULL)) {
+		share_mode_lock_prefetch(id, fsp_client_guid(fsp),
+					 &lease->lease_key);
+	}
+
 	lck = get_share_mode_lock(talloc_tos(), id,
 				  conn->connectpath,
 				  smb_fname, &old_write_time);
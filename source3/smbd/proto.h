@@ -200,6 +200,9 @@ void dptr_CloseDir(files_struct *fsp);
 void dptr_SeekDir(struct dptr_struct *dptr, long offset);
 long dptr_TellDir(struct dptr_struct *dptr);
 bool dptr_has_wild(struct dptr_struct *dptr);
+bool dptr_mask_match(struct dptr_struct *dptr, const char *string,
+		     const char *mask, bool translate_pattern,
+		     bool is_case_sensitive);
 int dptr_dnum(struct dptr_struct *dptr);
 bool dptr_get_priv(struct dptr_struct *dptr);
 void dptr_set_priv(struct dptr_struct *dptr);
@@ -249,6 +252,12 @@ bool smbd_setup_mdns_registration(struct tevent_context *ev,
 				  TALLOC_CTX *mem_ctx,
 				  uint16_t port);
 
+/* The following definitions come from smbd/dir_index.c  */
+
+int dir_index_lookup(connection_struct *conn, const char *path,
+		     const char *name, TALLOC_CTX *mem_ctx,
+		     char **found_name);
+
 /* The following definitions come from smbd/dosmode.c  */
 
 mode_t unix_mode(connection_struct *conn, int dosmode,
@@ -257,6 +266,7 @@ mode_t unix_mode(connection_struct *conn, int dosmode,
 uint32_t dos_mode_msdfs(connection_struct *conn,
 		      const struct smb_filename *smb_fname);
 int dos_attributes_to_stat_dos_flags(uint32_t dosmode);
+void dosmode_cache_connect(connection_struct *conn);
 uint32_t dos_mode(connection_struct *conn, struct smb_filename *smb_fname);
 int file_set_dosmode(connection_struct *conn, struct smb_filename *smb_fname,
 		     uint32_t dosmode, const char *parent_dir, bool newfile);
@@ -442,6 +452,7 @@ const struct mangle_fns *mangle_hash_init(void);
 
 /* The following definitions come from smbd/mangle_hash2.c  */
 
+bool mangle_hash2_shared_init(void);
 const struct mangle_fns *mangle_hash2_init(void);
 const struct mangle_fns *posix_mangle_init(void);
 
@@ -611,6 +622,8 @@ void reply_nttranss(struct smb_request *req);
 
 /* The following definitions come from smbd/open.c  */
 
+void access_check_cache_connect(connection_struct *conn);
+void access_check_cache_flush(void);
 NTSTATUS smbd_check_access_rights(struct connection_struct *conn,
 				const struct smb_filename *smb_fname,
 				bool use_privs,
@@ -1057,9 +1070,11 @@ ssize_t message_push_string(uint8_t **outbuf, const char *str, int flags);
 
 /* The following definitions come from smbd/statcache.c  */
 
-void stat_cache_add( const char *full_orig_name,
+bool stat_cache_shared_init(void);
+void stat_cache_add(connection_struct *conn,
+		const char *full_orig_name,
 		char *translated_path,
-		bool case_sensitive);
+		const SMB_STRUCT_STAT *psbuf);
 bool stat_cache_lookup(connection_struct *conn,
 			bool posix_paths,
 			char **pp_name,
@@ -1160,6 +1175,9 @@ void sys_utmp_yield(const char *username, const char *hostname,
 
 bool vfs_init_custom(connection_struct *conn, const char *vfs_object);
 bool smbd_vfs_init(connection_struct *conn);
+const char *vfs_find_module_in_stack(connection_struct *conn,
+				     const char * const *names,
+				     size_t num_names);
 NTSTATUS vfs_file_exist(connection_struct *conn, struct smb_filename *smb_fname);
 ssize_t vfs_read_data(files_struct *fsp, char *buf, size_t byte_count);
 ssize_t vfs_write_data(struct smb_request *req,
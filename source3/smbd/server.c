@@ -1575,6 +1575,15 @@ extern void build_options(bool screen);
 	if (!locking_init())
 		exit_daemon("Samba cannot init locking", EACCES);
 
+	if (!stat_cache_shared_init()) {
+		exit_daemon("Samba cannot init the shared stat cache", ENOMEM);
+	}
+
+	if (!mangle_hash2_shared_init()) {
+		exit_daemon("Samba cannot init the shared mangle cache",
+			    ENOMEM);
+	}
+
 	if (!leases_db_init(false)) {
 		exit_daemon("Samba cannot init leases", EACCES);
 	}
@@ -30,6 +30,7 @@
 #include "auth.h"
 #include "messages.h"
 #include "lib/param/loadparm.h"
+#include "../lib/util/memcache.h"
 
 /*
  * The persistent pcap cache is populated by the background print process. Per
@@ -164,6 +165,8 @@ bool reload_services(struct smbd_server_connection *sconn,
 
 	mangle_reset_cache();
 	reset_stat_cache();
+	memcache_flush(smbd_memcache(), DOSMODE_CACHE);
+	memcache_flush(smbd_memcache(), ACCESS_CHECK_CACHE);
 
 	/* this forces service parameters to be flushed */
 	set_current_service(NULL,0,True);
@@ -644,6 +644,9 @@ static NTSTATUS make_connection_snum(struct smbXsrv_connection *xconn,
 		goto err_root_exit;
 	}
 
+	access_check_cache_connect(conn);
+	dosmode_cache_connect(conn);
+
 /* ROOT Activities: */
 	/* explicitly check widelinks here so that we can correctly warn
 	 * in the logs. */
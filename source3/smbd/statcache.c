@@ -26,6 +26,356 @@
 #include "messages.h"
 #include "smbprofile.h"
 #include <tdb.h>
+#include <sys/mman.h>
+
+/****************************************************************************
+ Shared stat cache.
+
+ With "smbd:shared stat cache = yes" the parent smbd maps an anonymous
+ shared table that all forked smbd processes inherit. Hits found by one
+ client's smbd are then available to all others on the node.
+
+ The table is direct mapped, every slot holds one name -> path entry
+ together with the file_id the translated path had when the entry was
+ stored. Readers never lock: a slot's "seq" is odd while a writer fills
+ it, readers copy the slot and discard the copy if "seq" changed
+ meanwhile. Writers that find a slot busy simply drop their entry.
+
+ Entries are only valid for the table's current generation, bumping it
+ invalidates everything at once. Entries are validated against the file
+ system by stat_cache_lookup() anyway, a changed file_id makes them stale.
+*****************************************************************************/
+
+#define STAT_CACHE_SHARED_MAGIC 0x53686443 /* "ShdC" */
+#define STAT_CACHE_SHARED_SLOT_SIZE 1024
+
+struct stat_cache_shared_slot {
+	volatile uint32_t seq;
+	uint32_t generation;
+	uint32_t hash;
+	uint16_t keylen;
+	uint16_t pathlen;
+	uint64_t devid;
+	uint64_t inode;
+	uint64_t extid;
+	char data[STAT_CACHE_SHARED_SLOT_SIZE - 40];
+};
+
+struct stat_cache_shared {
+	uint32_t magic;
+	uint32_t num_slots;
+	volatile uint32_t generation;
+	uint8_t pad[52];
+	struct stat_cache_shared_slot slots[];
+};
+
+static struct stat_cache_shared *stat_cache_shared;
+
+#ifdef HAVE___SYNC_FETCH_AND_ADD
+#define stat_cache_shared_barrier() __sync_synchronize()
+#endif
+
+/**
+ * Set up the shared stat cache in the parent smbd, before any child
+ * is forked.
+ */
+
+bool stat_cache_shared_init(void)
+{
+	struct stat_cache_shared *shm;
+	int num_slots;
+	size_t size;
+	void *ptr;
+
+	if (!lp_stat_cache() ||
+	    !lp_parm_bool(-1, "smbd", "shared stat cache", false)) {
+		return true;
+	}
+
+#ifndef stat_cache_shared_barrier
+	DEBUG(1, ("shared stat cache not supported on this platform\n"));
+	return true;
+#else
+	if (stat_cache_shared != NULL) {
+		return true;
+	}
+
+	num_slots = lp_parm_int(-1, "smbd", "shared stat cache size", 8192);
+	if (num_slots < 1 || num_slots > (1<<20)) {
+		DEBUG(1, ("Invalid shared stat cache size %d\n", num_slots));
+		return false;
+	}
+
+	size = sizeof(struct stat_cache_shared) +
+		num_slots * sizeof(struct stat_cache_shared_slot);
+
+	ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+		   -1, 0);
+	if (ptr == MAP_FAILED) {
+		DEBUG(0, ("Could not map shared stat cache: %s\n",
+			  strerror(errno)));
+		return false;
+	}
+
+	/* Anonymous mappings are zeroed, generation 0 is never valid */
+	shm = (struct stat_cache_shared *)ptr;
+	shm->magic = STAT_CACHE_SHARED_MAGIC;
+	shm->num_slots = num_slots;
+	shm->generation = 1;
+
+	stat_cache_shared = shm;
+
+	DEBUG(3, ("shared stat cache with %d entries (%zu bytes)\n",
+		  num_slots, size));
+	return true;
+#endif
+}
+
+#ifdef stat_cache_shared_barrier
+
+/*
+ * The key contains the share's root and whether names are case sensitive:
+ * The same name means different things in different shares.
+ */
+
+static uint8_t *stat_cache_shared_key(TALLOC_CTX *mem_ctx,
+				      connection_struct *conn,
+				      const char *name, size_t namelen,
+				      size_t *pkeylen)
+{
+	size_t pathlen = strlen(conn->connectpath);
+	size_t keylen = 1 + pathlen + 1 + namelen;
+	uint8_t *key;
+
+	if (keylen >= sizeof(((struct stat_cache_shared_slot *)0)->data)) {
+		return NULL;
+	}
+
+	key = talloc_array(mem_ctx, uint8_t, keylen);
+	if (key == NULL) {
+		return NULL;
+	}
+	key[0] = conn->case_sensitive ? 'S' : 'I';
+	memcpy(&key[1], conn->connectpath, pathlen);
+	key[1 + pathlen] = '\0';
+	memcpy(&key[2 + pathlen], name, namelen);
+
+	*pkeylen = keylen;
+	return key;
+}
+
+static uint32_t stat_cache_shared_hash(const uint8_t *key, size_t keylen)
+{
+	TDB_DATA data = { .dptr = discard_const_p(uint8_t, key),
+			  .dsize = keylen };
+	return tdb_jenkins_hash(&data);
+}
+
+static struct stat_cache_shared_slot *stat_cache_shared_lock(uint32_t hash)
+{
+	struct stat_cache_shared_slot *slot;
+	uint32_t seq;
+
+	slot = &stat_cache_shared->slots[hash % stat_cache_shared->num_slots];
+
+	seq = slot->seq;
+	if ((seq & 1) != 0) {
+		return NULL;
+	}
+	if (!__sync_bool_compare_and_swap(&slot->seq, seq, seq + 1)) {
+		return NULL;
+	}
+	return slot;
+}
+
+static void stat_cache_shared_unlock(struct stat_cache_shared_slot *slot)
+{
+	stat_cache_shared_barrier();
+	slot->seq += 1;
+}
+
+static void stat_cache_shared_store(connection_struct *conn,
+				    const char *name, size_t namelen,
+				    const char *path, size_t pathlen,
+				    const SMB_STRUCT_STAT *psbuf)
+{
+	struct stat_cache_shared_slot *slot;
+	struct file_id id;
+	uint8_t *key;
+	size_t keylen;
+	uint32_t hash;
+
+	key = stat_cache_shared_key(talloc_tos(), conn, name, namelen,
+				    &keylen);
+	if (key == NULL) {
+		return;
+	}
+	if (keylen + pathlen + 1 > sizeof(slot->data)) {
+		TALLOC_FREE(key);
+		return;
+	}
+	hash = stat_cache_shared_hash(key, keylen);
+	id = vfs_file_id_from_sbuf(conn, psbuf);
+
+	slot = stat_cache_shared_lock(hash);
+	if (slot == NULL) {
+		TALLOC_FREE(key);
+		return;
+	}
+
+	slot->generation = stat_cache_shared->generation;
+	slot->hash = hash;
+	slot->keylen = keylen;
+	slot->pathlen = pathlen;
+	slot->devid = id.devid;
+	slot->inode = id.inode;
+	slot->extid = id.extid;
+	memcpy(slot->data, key, keylen);
+	memcpy(slot->data + keylen, path, pathlen);
+	slot->data[keylen + pathlen] = '\0';
+
+	stat_cache_shared_unlock(slot);
+	TALLOC_FREE(key);
+}
+
+/*
+ * Copy out the entry for "name". Returns the translated path talloc'ed
+ * off mem_ctx and the file_id it had when stored.
+ */
+
+static char *stat_cache_shared_fetch(TALLOC_CTX *mem_ctx,
+				     connection_struct *conn,
+				     const char *name, size_t namelen,
+				     struct file_id *pid)
+{
+	struct stat_cache_shared_slot *slot;
+	struct stat_cache_shared_slot copy;
+	uint8_t *key;
+	size_t keylen;
+	uint32_t hash, seq;
+	char *path = NULL;
+
+	key = stat_cache_shared_key(talloc_tos(), conn, name, namelen,
+				    &keylen);
+	if (key == NULL) {
+		return NULL;
+	}
+	hash = stat_cache_shared_hash(key, keylen);
+	slot = &stat_cache_shared->slots[hash % stat_cache_shared->num_slots];
+
+	seq = slot->seq;
+	if ((seq & 1) != 0) {
+		goto done;
+	}
+	stat_cache_shared_barrier();
+
+	copy.generation = slot->generation;
+	copy.hash = slot->hash;
+	copy.keylen = slot->keylen;
+	copy.pathlen = slot->pathlen;
+
+	if ((copy.generation != stat_cache_shared->generation) ||
+	    (copy.hash != hash) || (copy.keylen != keylen) ||
+	    (copy.keylen + copy.pathlen + 1 > sizeof(copy.data))) {
+		goto done;
+	}
+
+	copy.devid = slot->devid;
+	copy.inode = slot->inode;
+	copy.extid = slot->extid;
+	memcpy(copy.data, slot->data, copy.keylen + copy.pathlen);
+
+	stat_cache_shared_barrier();
+	if (slot->seq != seq) {
+		goto done;
+	}
+
+	if (memcmp(copy.data, key, keylen) != 0) {
+		goto done;
+	}
+
+	path = talloc_strndup(mem_ctx, copy.data + keylen, copy.pathlen);
+	if (path == NULL) {
+		goto done;
+	}
+	*pid = (struct file_id) { .devid = copy.devid, .inode = copy.inode,
+				  .extid = copy.extid };
+done:
+	TALLOC_FREE(key);
+	return path;
+}
+
+static void stat_cache_shared_remove(connection_struct *conn,
+				     const char *name, size_t namelen)
+{
+	struct stat_cache_shared_slot *slot;
+	uint8_t *key;
+	size_t keylen;
+	uint32_t hash;
+
+	key = stat_cache_shared_key(talloc_tos(), conn, name, namelen,
+				    &keylen);
+	if (key == NULL) {
+		return;
+	}
+	hash = stat_cache_shared_hash(key, keylen);
+	TALLOC_FREE(key);
+
+	slot = stat_cache_shared_lock(hash);
+	if (slot == NULL) {
+		return;
+	}
+	if (slot->hash == hash) {
+		slot->generation = 0;
+	}
+	stat_cache_shared_unlock(slot);
+}
+
+/*
+ * Invalidate all entries. Used when a directory goes away: Entries below
+ * it can't be found by name.
+ */
+
+static void stat_cache_shared_invalidate(void)
+{
+	uint32_t gen;
+
+	gen = __sync_add_and_fetch(&stat_cache_shared->generation, 1);
+	if (gen == 0) {
+		__sync_add_and_fetch(&stat_cache_shared->generation, 1);
+	}
+}
+
+#else
+
+static void stat_cache_shared_store(connection_struct *conn,
+				    const char *name, size_t namelen,
+				    const char *path, size_t pathlen,
+				    const SMB_STRUCT_STAT *psbuf)
+{
+	return;
+}
+
+static char *stat_cache_shared_fetch(TALLOC_CTX *mem_ctx,
+				     connection_struct *conn,
+				     const char *name, size_t namelen,
+				     struct file_id *pid)
+{
+	return NULL;
+}
+
+static void stat_cache_shared_remove(connection_struct *conn,
+				     const char *name, size_t namelen)
+{
+	return;
+}
+
+static void stat_cache_shared_invalidate(void)
+{
+	return;
+}
+
+#endif
 
 /****************************************************************************
  Stat cache code used in unix_convert.
@@ -34,8 +384,11 @@
 /**
  * Add an entry into the stat cache.
  *
+ * @param conn                 The connection the name was translated for
  * @param full_orig_name       The original name as specified by the client
  * @param orig_translated_path The name on our filesystem.
+ * @param psbuf                Stat of translated_path if available, only
+ *                             such entries go into the shared stat cache.
  *
  * @note Only the first strlen(orig_translated_path) characters are stored
  *       into the cache.  This means that full_orig_name will be internally
@@ -43,10 +396,12 @@
  *
  */
 
-void stat_cache_add( const char *full_orig_name,
+void stat_cache_add(connection_struct *conn,
+		const char *full_orig_name,
 		char *translated_path,
-		bool case_sensitive)
+		const SMB_STRUCT_STAT *psbuf)
 {
+	bool case_sensitive = conn->case_sensitive;
 	size_t translated_path_length;
 	char *original_path;
 	size_t original_path_length;
@@ -136,6 +491,15 @@ void stat_cache_add( const char *full_orig_name,
 		data_blob_const(original_path, original_path_length),
 		data_blob_const(translated_path, translated_path_length + 1));
 
+	if ((stat_cache_shared != NULL) && (psbuf != NULL) &&
+	    VALID_STAT(*psbuf)) {
+		stat_cache_shared_store(conn, original_path,
+					original_path_length,
+					translated_path,
+					translated_path_length,
+					psbuf);
+	}
+
 	DEBUG(5,("stat_cache_add: Added entry (%lx:size %x) %s -> %s\n",
 		 (unsigned long)translated_path,
 		 (unsigned int)translated_path_length,
@@ -179,6 +543,8 @@ bool stat_cache_lookup(connection_struct *conn,
 	unsigned int num_components = 0;
 	char *translated_path;
 	size_t translated_path_length;
+	char *shared_path = NULL;
+	struct file_id shared_id;
 	DATA_BLOB data_val;
 	char *name;
 	TALLOC_CTX *ctx = talloc_tos();
@@ -240,6 +606,17 @@ bool stat_cache_lookup(connection_struct *conn,
 			break;
 		}
 
+		if (stat_cache_shared != NULL) {
+			shared_path = stat_cache_shared_fetch(
+				ctx, conn, chk_name, strlen(chk_name),
+				&shared_id);
+			if (shared_path != NULL) {
+				DO_PROFILE_INC(statcache_shared_hits);
+				break;
+			}
+			DO_PROFILE_INC(statcache_shared_misses);
+		}
+
 		DEBUG(10,("stat_cache_lookup: lookup failed for name [%s]\n",
 				chk_name ));
 		/*
@@ -273,11 +650,16 @@ bool stat_cache_lookup(connection_struct *conn,
 		}
 	}
 
-	translated_path = talloc_strdup(ctx,(char *)data_val.data);
-	if (!translated_path) {
-		smb_panic("talloc failed");
+	if (shared_path != NULL) {
+		translated_path = shared_path;
+		translated_path_length = strlen(shared_path);
+	} else {
+		translated_path = talloc_strdup(ctx,(char *)data_val.data);
+		if (!translated_path) {
+			smb_panic("talloc failed");
+		}
+		translated_path_length = data_val.length - 1;
 	}
-	translated_path_length = data_val.length - 1;
 
 	DEBUG(10,("stat_cache_lookup: lookup succeeded for name [%s] "
 		  "-> [%s]\n", chk_name, translated_path ));
@@ -296,10 +678,36 @@ bool stat_cache_lookup(connection_struct *conn,
 		/* Discard this entry - it doesn't exist in the filesystem. */
 		memcache_delete(smbd_memcache(), STAT_CACHE,
 				data_blob_const(chk_name, strlen(chk_name)));
+		if (stat_cache_shared != NULL) {
+			stat_cache_shared_remove(conn, chk_name,
+						 strlen(chk_name));
+		}
 		TALLOC_FREE(chk_name);
 		TALLOC_FREE(translated_path);
 		return False;
 	}
+
+	if (shared_path != NULL) {
+		struct file_id id = vfs_file_id_from_sbuf(conn, &smb_fname.st);
+
+		if (!file_id_equal(&id, &shared_id)) {
+			/* Something else lives there now */
+			DEBUG(10, ("stat_cache_lookup: shared entry for [%s] "
+				   "is stale\n", chk_name));
+			DO_PROFILE_INC(statcache_shared_stale);
+			stat_cache_shared_remove(conn, chk_name,
+						 strlen(chk_name));
+			TALLOC_FREE(chk_name);
+			TALLOC_FREE(translated_path);
+			return False;
+		}
+
+		memcache_add(
+			smbd_memcache(), STAT_CACHE,
+			data_blob_const(chk_name, strlen(chk_name)),
+			data_blob_const(translated_path,
+					translated_path_length + 1));
+	}
 	*pst = smb_fname.st;
 
 	if (!sizechanged) {
@@ -352,6 +760,9 @@ bool stat_cache_lookup(connection_struct *conn,
 void smbd_send_stat_cache_delete_message(struct messaging_context *msg_ctx,
 					 const char *name)
 {
+	if (stat_cache_shared != NULL) {
+		stat_cache_shared_invalidate();
+	}
 #ifdef DEVELOPER
 	message_send_all(msg_ctx,
 			MSG_SMB_STAT_CACHE_DELETE,
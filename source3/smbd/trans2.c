@@ -1454,6 +1454,7 @@ static bool check_msdfs_link(connection_struct *conn,
 
 struct smbd_dirptr_lanman2_state {
 	connection_struct *conn;
+	struct dptr_struct *dirptr;
 	uint32_t info_level;
 	bool check_mangled_names;
 	bool has_wild;
@@ -1515,8 +1516,9 @@ static bool smbd_dirptr_lanman2_match_fn(TALLOC_CTX *ctx,
 				fname, mask);
 	state->got_exact_match = got_match;
 	if (!got_match) {
-		got_match = mask_match(fname, mask,
-				       state->conn->case_sensitive);
+		got_match = dptr_mask_match(state->dirptr, fname, mask,
+					    get_Protocol() <= PROTOCOL_LANMAN2,
+					    state->conn->case_sensitive);
 	}
 
 	if(!got_match && state->check_mangled_names &&
@@ -1539,8 +1541,10 @@ static bool smbd_dirptr_lanman2_match_fn(TALLOC_CTX *ctx,
 					mangled_name, mask);
 		state->got_exact_match = got_match;
 		if (!got_match) {
-			got_match = mask_match(mangled_name, mask,
-					       state->conn->case_sensitive);
+			got_match = dptr_mask_match(
+				state->dirptr, mangled_name, mask,
+				get_Protocol() <= PROTOCOL_LANMAN2,
+				state->conn->case_sensitive);
 		}
 	}
 
@@ -2325,6 +2329,7 @@ NTSTATUS smbd_dirptr_lanman2_entry(TALLOC_CTX *ctx,
 
 	ZERO_STRUCT(state);
 	state.conn = conn;
+	state.dirptr = dirptr;
 	state.info_level = info_level;
 	state.check_mangled_names = lp_mangled_names(conn->params);
 	state.has_wild = dptr_has_wild(dirptr);
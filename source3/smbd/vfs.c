@@ -353,6 +353,46 @@ bool smbd_vfs_init(connection_struct *conn)
 	return True;
 }
 
+/*****************************************************************
+ Return the first of "names" that is in the share's VFS stack, or
+ NULL if none of them is.
+******************************************************************/
+
+const char *vfs_find_module_in_stack(connection_struct *conn,
+				     const char * const *names,
+				     size_t num_names)
+{
+	const char **vfs_objects;
+	size_t i, j;
+
+	vfs_objects = lp_vfs_objects(SNUM(conn));
+
+	for (i=0; (vfs_objects != NULL) && (vfs_objects[i] != NULL); i++) {
+		const char *name = vfs_objects[i];
+		const char *p;
+		size_t len;
+
+		/*
+		 * Same forms as vfs_init_custom() accepts:
+		 * [/path/to/]module[.so][:param]
+		 */
+		p = strrchr(name, '/');
+		if (p != NULL) {
+			name = p+1;
+		}
+		len = strcspn(name, ".:");
+
+		for (j=0; j<num_names; j++) {
+			if ((strlen(names[j]) == len) &&
+			    (strncmp(name, names[j], len) == 0)) {
+				return names[j];
+			}
+		}
+	}
+
+	return NULL;
+}
+
 /*******************************************************************
  Check if a file exists in the vfs.
 ********************************************************************/
@@ -0,0 +1,265 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Little character set conversion and case handling benchmarks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "proto.h"
+
+extern int torture_numops;
+
+/*
+ * File names as they show up in directory listings, converted one by
+ * one like smbd does.
+ */
+static const char *bench_ascii_names[] = {
+	"Quarterly Report 2015.docx",
+	"IMG_20150712_134522.jpg",
+	"setup-x86_64-installer.exe",
+	"Thumbs.db",
+	"project_plan_final_v3_reviewed.xlsx",
+	"README.txt",
+};
+
+static const char *bench_ascii_paths[] = {
+	"Projects\\2015\\Customer Accounts\\Contracts\\"
+	"Master Services Agreement - signed copy (final).pdf",
+	"Users\\Administrator\\AppData\\Roaming\\Microsoft\\"
+	"Windows\\Start Menu\\Programs\\Accessories\\Notepad.lnk",
+	"Engineering\\build-artifacts\\release-4.4.0\\x86_64\\"
+	"packages\\samba-common-libs-4.4.0-1.x86_64.rpm",
+};
+
+static const char *bench_latin1_names[] = {
+	"Gr\303\266\303\237enverh\303\244ltnisse \303\234bersicht.docx",
+	"R\303\251sum\303\251 Fran\303\247ois M\303\274ller.pdf",
+	"Espa\303\261a A\303\261o Se\303\261or.txt",
+	"\303\205rsrapport f\303\266r \303\266stra regionen.xlsx",
+};
+
+static const char *bench_cjk_names[] = {
+	"\346\226\207\344\273\266\345\220\215\347\247\260.txt",
+	"\344\274\232\350\255\260\350\263\207\346\226\231 "
+	"\344\272\214\351\233\266\344\270\200\344\272\224.pdf",
+	"\343\203\206\343\202\271\343\203\210\343\203\225\343\202\241"
+	"\343\202\244\343\203\253.docx",
+	"\355\225\234\352\265\255\354\226\264 \353\254\270\354\204\234.hwp",
+};
+
+static bool bench_charcnv_names(const char *label, const char **names,
+				size_t num_names)
+{
+	char utf16[1024];
+	char unix_str[1024];
+	struct timeval start;
+	double seconds;
+	size_t total = 0;
+	int i;
+
+	start = timeval_current();
+
+	for (i=0; i<torture_numops; i++) {
+		const char *name = names[i % num_names];
+		size_t len = strlen(name) + 1;
+		size_t utf16_len, unix_len;
+		bool ok;
+
+		ok = convert_string(CH_UNIX, CH_UTF16LE, name, len,
+				    utf16, sizeof(utf16), &utf16_len);
+		if (!ok) {
+			d_fprintf(stderr, "convert_string(%s) to UTF16 "
+				  "failed\n", name);
+			return false;
+		}
+		ok = convert_string(CH_UTF16LE, CH_UNIX, utf16, utf16_len,
+				    unix_str, sizeof(unix_str), &unix_len);
+		if (!ok) {
+			d_fprintf(stderr, "convert_string(%s) from UTF16 "
+				  "failed\n", name);
+			return false;
+		}
+		if ((unix_len != len) || (memcmp(name, unix_str, len) != 0)) {
+			d_fprintf(stderr, "%s did not round-trip\n", name);
+			return false;
+		}
+		total += len;
+	}
+
+	seconds = timeval_elapsed(&start);
+
+	printf("%-8s %d names, %.2f MB in %.2f seconds: %.1f MB/s\n",
+	       label, torture_numops, total / 1e6, seconds,
+	       total / 1e6 / seconds);
+
+	return true;
+}
+
+static bool bench_charcnv_talloc(const char *label, const char **names,
+				 size_t num_names)
+{
+	struct timeval start;
+	double seconds;
+	size_t total = 0;
+	int i;
+
+	start = timeval_current();
+
+	for (i=0; i<torture_numops; i++) {
+		const char *name = names[i % num_names];
+		smb_ucs2_t *utf16;
+		char *unix_str;
+		size_t converted_size;
+
+		if (!push_ucs2_talloc(talloc_tos(), &utf16, name,
+				      &converted_size)) {
+			d_fprintf(stderr, "push_ucs2_talloc(%s) failed\n",
+				  name);
+			return false;
+		}
+		if (!pull_ucs2_talloc(talloc_tos(), &unix_str, utf16,
+				      &converted_size)) {
+			d_fprintf(stderr, "pull_ucs2_talloc(%s) failed\n",
+				  name);
+			return false;
+		}
+		if (strcmp(name, unix_str) != 0) {
+			d_fprintf(stderr, "%s did not round-trip\n", name);
+			return false;
+		}
+		TALLOC_FREE(unix_str);
+		TALLOC_FREE(utf16);
+		total += strlen(name) + 1;
+	}
+
+	seconds = timeval_elapsed(&start);
+
+	printf("%-8s %d names, %.2f MB in %.2f seconds: %.1f MB/s "
+	       "(talloc)\n",
+	       label, torture_numops, total / 1e6, seconds,
+	       total / 1e6 / seconds);
+
+	return true;
+}
+
+bool run_bench_charcnv(int dummy)
+{
+	bool ok = true;
+
+	ok &= bench_charcnv_names("ASCII", bench_ascii_names,
+				  ARRAY_SIZE(bench_ascii_names));
+	ok &= bench_charcnv_names("paths", bench_ascii_paths,
+				  ARRAY_SIZE(bench_ascii_paths));
+	ok &= bench_charcnv_names("Latin-1", bench_latin1_names,
+				  ARRAY_SIZE(bench_latin1_names));
+	ok &= bench_charcnv_names("CJK", bench_cjk_names,
+				  ARRAY_SIZE(bench_cjk_names));
+
+	ok &= bench_charcnv_talloc("ASCII", bench_ascii_names,
+				   ARRAY_SIZE(bench_ascii_names));
+	ok &= bench_charcnv_talloc("paths", bench_ascii_paths,
+				   ARRAY_SIZE(bench_ascii_paths));
+	ok &= bench_charcnv_talloc("Latin-1", bench_latin1_names,
+				   ARRAY_SIZE(bench_latin1_names));
+	ok &= bench_charcnv_talloc("CJK", bench_cjk_names,
+				   ARRAY_SIZE(bench_cjk_names));
+
+	return ok;
+}
+
+/*
+ * The case insensitive compares and case changes done for every name
+ * lookup.
+ */
+static bool bench_string_case(const char *label, const char **names,
+			      size_t num_names)
+{
+	char **upper;
+	struct timeval start;
+	double cmp_secs, upper_secs, lower_secs;
+	size_t total = 0;
+	char buf[1024];
+	int i;
+
+	upper = talloc_array(talloc_tos(), char *, num_names);
+	if (upper == NULL) {
+		d_fprintf(stderr, "talloc_array failed\n");
+		return false;
+	}
+
+	for (i=0; i<num_names; i++) {
+		upper[i] = talloc_strdup(upper, names[i]);
+		if ((upper[i] == NULL) || !strupper_m(upper[i])) {
+			d_fprintf(stderr, "strupper_m(%s) failed\n",
+				  names[i]);
+			TALLOC_FREE(upper);
+			return false;
+		}
+		total += strlen(names[i]);
+	}
+	total = total * torture_numops / num_names;
+
+	start = timeval_current();
+	for (i=0; i<torture_numops; i++) {
+		int j = i % num_names;
+
+		if ((strcasecmp_m(names[j], upper[j]) != 0) ||
+		    (strncasecmp_m(names[j], upper[j], 8) != 0)) {
+			d_fprintf(stderr, "%s and %s differ\n",
+				  names[j], upper[j]);
+			TALLOC_FREE(upper);
+			return false;
+		}
+	}
+	cmp_secs = timeval_elapsed(&start);
+
+	start = timeval_current();
+	for (i=0; i<torture_numops; i++) {
+		strlcpy(buf, names[i % num_names], sizeof(buf));
+		strupper_m(buf);
+	}
+	upper_secs = timeval_elapsed(&start);
+
+	start = timeval_current();
+	for (i=0; i<torture_numops; i++) {
+		strlcpy(buf, names[i % num_names], sizeof(buf));
+		strlower_m(buf);
+	}
+	lower_secs = timeval_elapsed(&start);
+
+	printf("%-8s strcasecmp_m: %.1f MB/s, strupper_m: %.1f MB/s, "
+	       "strlower_m: %.1f MB/s\n", label,
+	       total / 1e6 / cmp_secs, total / 1e6 / upper_secs,
+	       total / 1e6 / lower_secs);
+
+	TALLOC_FREE(upper);
+	return true;
+}
+
+bool run_bench_string_case(int dummy)
+{
+	bool ok = true;
+
+	ok &= bench_string_case("ASCII", bench_ascii_names,
+				ARRAY_SIZE(bench_ascii_names));
+	ok &= bench_string_case("paths", bench_ascii_paths,
+				ARRAY_SIZE(bench_ascii_paths));
+	ok &= bench_string_case("Latin-1", bench_latin1_names,
+				ARRAY_SIZE(bench_latin1_names));
+	ok &= bench_string_case("CJK", bench_cjk_names,
+				ARRAY_SIZE(bench_cjk_names));
+
+	return ok;
+}
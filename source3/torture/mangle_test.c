@@ -225,3 +225,130 @@ bool torture_mangle(int dummy)
 	printf("mangle test finished\n");
 	return (ret && (failures == 0));
 }
+
+/*
+ * Lookups by 8.3 name from smbd processes that did not create the
+ * mangled names. Without a shared prefix cache every new process has
+ * to scan the directory to resolve them.
+ */
+
+#define MANGLE_BENCH_ROUNDS 10
+#define MANGLE_BENCH_LOOKUPS 20
+
+bool torture_mangle_bench(int dummy)
+{
+	struct cli_state *cli;
+	fstring *shortnames;
+	struct timeval start;
+	double seconds = 0;
+	NTSTATUS status;
+	bool ret = false;
+	int i, j;
+
+	printf("starting mangle bench\n");
+
+	if (torture_numops < 1) {
+		printf("ERROR: need at least one file\n");
+		return false;
+	}
+
+	shortnames = talloc_zero_array(talloc_tos(), fstring, torture_numops);
+	if (shortnames == NULL) {
+		printf("ERROR: talloc failed\n");
+		return false;
+	}
+
+	if (!torture_open_connection(&cli, 0)) {
+		TALLOC_FREE(shortnames);
+		return false;
+	}
+
+	cli_unlink(cli, "\\mangle_bench\\*", FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	cli_rmdir(cli, "\\mangle_bench");
+
+	status = cli_mkdir(cli, "\\mangle_bench");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("ERROR: Failed to make directory: %s\n",
+		       nt_errstr(status));
+		goto done;
+	}
+
+	for (i=0; i<torture_numops; i++) {
+		fstring name;
+		uint16_t fnum;
+
+		fstr_sprintf(name, "\\mangle_bench\\long file name %05d.txt",
+			     i);
+
+		status = cli_openx(cli, name, O_RDWR|O_CREAT|O_EXCL,
+				   DENY_NONE, &fnum);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("open of %s failed (%s)\n", name,
+			       nt_errstr(status));
+			goto done;
+		}
+		cli_close(cli, fnum);
+
+		status = cli_qpathinfo_alt_name(cli, name, shortnames[i]);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("query altname of %s failed (%s)\n", name,
+			       nt_errstr(status));
+			goto done;
+		}
+	}
+
+	for (i=0; i<MANGLE_BENCH_ROUNDS; i++) {
+		struct cli_state *cli2;
+		struct timeval round_start;
+
+		if (!torture_open_connection(&cli2, 1)) {
+			goto done;
+		}
+
+		round_start = timeval_current();
+
+		for (j=0; j<MANGLE_BENCH_LOOKUPS; j++) {
+			fstring name;
+			uint16_t attr;
+
+			fstr_sprintf(name, "\\mangle_bench\\%s",
+				     shortnames[random() % torture_numops]);
+
+			status = cli_getatr(cli2, name, &attr, NULL, NULL);
+			if (!NT_STATUS_IS_OK(status)) {
+				printf("getatr of %s failed (%s)\n", name,
+				       nt_errstr(status));
+				torture_close_connection(cli2);
+				goto done;
+			}
+		}
+
+		seconds += timeval_elapsed(&round_start);
+		torture_close_connection(cli2);
+	}
+
+	start = timeval_current();
+	for (j=0; j<MANGLE_BENCH_LOOKUPS; j++) {
+		fstring name;
+		uint16_t attr;
+
+		fstr_sprintf(name, "\\mangle_bench\\%s",
+			     shortnames[random() % torture_numops]);
+		cli_getatr(cli, name, &attr, NULL, NULL);
+	}
+
+	printf("%d lookups by 8.3 name in %d new connections, %d files: "
+	       "%.3f ms per lookup (%.3f ms in the creating connection)\n",
+	       MANGLE_BENCH_ROUNDS * MANGLE_BENCH_LOOKUPS,
+	       MANGLE_BENCH_ROUNDS, torture_numops,
+	       seconds * 1000 / (MANGLE_BENCH_ROUNDS * MANGLE_BENCH_LOOKUPS),
+	       timeval_elapsed(&start) * 1000 / MANGLE_BENCH_LOOKUPS);
+
+	ret = true;
+done:
+	cli_unlink(cli, "\\mangle_bench\\*", FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	cli_rmdir(cli, "\\mangle_bench");
+	torture_close_connection(cli);
+	TALLOC_FREE(shortnames);
+	return ret;
+}
@@ -96,6 +96,8 @@ struct prcount_state {
 	struct tevent_context *ev;
 	struct timeval interval;
 	unsigned *counter;
+	unsigned last_count;
+	struct timeval last_time;
 };
 
 static void prcount_waited(struct tevent_req *subreq);
@@ -115,6 +117,8 @@ static struct tevent_req *prcount_send(TALLOC_CTX *mem_ctx,
 	state->ev = ev;
 	state->interval = interval;
 	state->counter = counter;
+	state->last_count = *counter;
+	state->last_time = timeval_current();
 
 	subreq = tevent_wakeup_send(
 		state, state->ev,
@@ -133,6 +137,8 @@ static void prcount_waited(struct tevent_req *subreq)
 		subreq, struct tevent_req);
 	struct prcount_state *state = tevent_req_data(
 		req, struct prcount_state);
+	struct timeval now;
+	double seconds;
 	bool ok;
 
 	ok = tevent_wakeup_recv(subreq);
@@ -142,7 +148,14 @@ static void prcount_waited(struct tevent_req *subreq)
 		return;
 	}
 
-	printf("%u\n", *state->counter);
+	now = timeval_current();
+	seconds = timeval_elapsed2(&state->last_time, &now);
+
+	printf("%u (%.0f msgs/sec)\n", *state->counter,
+	       (*state->counter - state->last_count) / seconds);
+
+	state->last_count = *state->counter;
+	state->last_time = now;
 
 	subreq = tevent_wakeup_send(
 		state, state->ev,
@@ -29,6 +29,7 @@ struct source_state {
 	int msg_type;
 	struct timeval interval;
 	struct server_id dst;
+	size_t batch;
 };
 
 static void source_waited(struct tevent_req *subreq);
@@ -38,7 +39,8 @@ static struct tevent_req *source_send(TALLOC_CTX *mem_ctx,
 				      struct messaging_context *msg_ctx,
 				      int msg_type,
 				      struct timeval interval,
-				      struct server_id dst)
+				      struct server_id dst,
+				      size_t batch)
 {
 	struct tevent_req *req, *subreq;
 	struct source_state *state;
@@ -52,6 +54,7 @@ static struct tevent_req *source_send(TALLOC_CTX *mem_ctx,
 	state->msg_type = msg_type;
 	state->interval = interval;
 	state->dst = dst;
+	state->batch = batch;
 
 	subreq = tevent_wakeup_send(
 		state, state->ev,
@@ -80,8 +83,19 @@ static void source_waited(struct tevent_req *subreq)
 		return;
 	}
 
-	messaging_send_buf(state->msg_ctx, state->dst, state->msg_type,
-			   buf, sizeof(buf));
+	if (state->batch > 1) {
+		DATA_BLOB blobs[state->batch];
+		size_t i;
+
+		for (i=0; i<state->batch; i++) {
+			blobs[i] = data_blob_const(buf, sizeof(buf));
+		}
+		messaging_send_batch(state->msg_ctx, state->dst,
+				     state->msg_type, blobs, state->batch);
+	} else {
+		messaging_send_buf(state->msg_ctx, state->dst,
+				   state->msg_type, buf, sizeof(buf));
+	}
 
 	subreq = tevent_wakeup_send(
 		state, state->ev,
@@ -111,11 +125,19 @@ int main(int argc, const char *argv[])
 	struct tevent_req *req;
 	int ret;
 	struct server_id id;
+	size_t batch = 1;
 
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s <dst>\n", argv[0]);
+	if ((argc != 2) && (argc != 3)) {
+		fprintf(stderr, "Usage: %s <dst> [batchsize]\n", argv[0]);
 		return -1;
 	}
+	if (argc == 3) {
+		batch = strtoul(argv[2], NULL, 10);
+		if (batch == 0) {
+			fprintf(stderr, "invalid batchsize %s\n", argv[2]);
+			return -1;
+		}
+	}
 
 	lp_load_global(get_dyn_CONFIGFILE());
 
@@ -138,7 +160,7 @@ int main(int argc, const char *argv[])
 	}
 
 	req = source_send(ev, ev, msg_ctx, MSG_SMB_NOTIFY,
-			  timeval_set(0, 10000), id);
+			  timeval_set(0, 10000), id, batch);
 	if (req == NULL) {
 		perror("source_send failed");
 		return -1;
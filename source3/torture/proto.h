@@ -33,6 +33,7 @@ bool torture_denytest2(int dummy);
 /* The following definitions come from torture/mangle_test.c  */
 
 bool torture_mangle(int dummy);
+bool torture_mangle_bench(int dummy);
 
 /* The following definitions come from torture/nbio.c  */
 
@@ -110,8 +111,11 @@ bool run_notify_bench3(int dummy);
 bool run_dbwrap_watch1(int dummy);
 bool run_idmap_tdb_common_test(int dummy);
 bool run_local_dbwrap_ctdb(int dummy);
+bool run_local_dbwrap_ctdb_migrate(int dummy);
 bool run_qpathinfo_bufsize(int dummy);
 bool run_bench_pthreadpool(int dummy);
+bool run_bench_charcnv(int dummy);
+bool run_bench_string_case(int dummy);
 bool run_messaging_read1(int dummy);
 bool run_messaging_read2(int dummy);
 bool run_messaging_read3(int dummy);
@@ -120,6 +124,13 @@ bool run_messaging_fdpass1(int dummy);
 bool run_messaging_fdpass2(int dummy);
 bool run_messaging_fdpass2a(int dummy);
 bool run_messaging_fdpass2b(int dummy);
+bool run_messaging_ring1(int dummy);
+bool run_messaging_ring2(int dummy);
 bool run_oplock_cancel(int dummy);
+bool run_dirprefetch(int dummy);
+bool run_dir_snapshot(int dummy);
+bool run_dir_index(int dummy);
+bool run_shared_stat_cache(int dummy);
+bool run_dosmode_cache(int dummy);
 
 #endif /* __TORTURE_H__ */
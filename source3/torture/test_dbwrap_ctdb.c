@@ -22,6 +22,9 @@
 #include "system/filesys.h"
 #include "lib/dbwrap/dbwrap.h"
 #include "lib/dbwrap/dbwrap_ctdb.h"
+#include "util_tdb.h"
+
+extern int torture_numops;
 
 bool run_local_dbwrap_ctdb(int dummy)
 {
@@ -147,3 +150,116 @@ fail:
 	TALLOC_FREE(db);
 	return ret;
 }
+
+/*
+ * Lock one record in each of two databases, either migrating each
+ * record on its own or migrating both with a single round trip first
+ */
+static bool dbwrap_ctdb_lock_pair(struct db_context **dbs, const char *prefix,
+				  int i, bool batched)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct db_record *rec[2] = { NULL, NULL };
+	TDB_DATA keys[2];
+	uint32_t val = i;
+	NTSTATUS status;
+	bool ret = false;
+	int j;
+
+	for (j=0; j<2; j++) {
+		keys[j] = string_term_tdb_data(
+			talloc_asprintf(frame, "%s-%d-%d", prefix, j, i));
+		if (keys[j].dptr == NULL) {
+			fprintf(stderr, "talloc_asprintf failed\n");
+			goto fail;
+		}
+	}
+
+	if (batched) {
+		status = dbwrap_ctdb_migrate_records(2, dbs, keys);
+		if (!NT_STATUS_IS_OK(status)) {
+			fprintf(stderr, "dbwrap_ctdb_migrate_records failed: "
+				"%s\n", nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	for (j=0; j<2; j++) {
+		rec[j] = dbwrap_fetch_locked(dbs[j], frame, keys[j]);
+		if (rec[j] == NULL) {
+			fprintf(stderr, "dbwrap_fetch_locked failed\n");
+			goto fail;
+		}
+	}
+
+	for (j=0; j<2; j++) {
+		status = dbwrap_record_store(
+			rec[j], make_tdb_data((uint8_t *)&val, sizeof(val)), 0);
+		if (!NT_STATUS_IS_OK(status)) {
+			fprintf(stderr, "dbwrap_record_store failed: %s\n",
+				nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(rec[1]);
+	TALLOC_FREE(rec[0]);
+	TALLOC_FREE(frame);
+	return ret;
+}
+
+bool run_local_dbwrap_ctdb_migrate(int dummy)
+{
+	struct db_context *dbs[2] = { NULL, NULL };
+	struct timeval start;
+	double seq_secs, batch_secs;
+	bool ret = false;
+	int i;
+
+	dbs[0] = db_open_ctdb(talloc_tos(), "torture_migrate1.tdb", 0,
+			      TDB_CLEAR_IF_FIRST|TDB_INCOMPATIBLE_HASH,
+			      O_RDWR|O_CREAT, 0600, DBWRAP_LOCK_ORDER_1,
+			      DBWRAP_FLAG_NONE);
+	dbs[1] = db_open_ctdb(talloc_tos(), "torture_migrate2.tdb", 0,
+			      TDB_CLEAR_IF_FIRST|TDB_INCOMPATIBLE_HASH,
+			      O_RDWR|O_CREAT, 0600, DBWRAP_LOCK_ORDER_2,
+			      DBWRAP_FLAG_NONE);
+	if ((dbs[0] == NULL) || (dbs[1] == NULL)) {
+		perror("db_open_ctdb failed");
+		goto fail;
+	}
+
+	/*
+	 * Every iteration uses new keys, so every record has to be
+	 * migrated to this node by ctdbd
+	 */
+
+	start = timeval_current();
+	for (i=0; i<torture_numops; i++) {
+		if (!dbwrap_ctdb_lock_pair(dbs, "seq", i, false)) {
+			goto fail;
+		}
+	}
+	seq_secs = timeval_elapsed(&start);
+
+	start = timeval_current();
+	for (i=0; i<torture_numops; i++) {
+		if (!dbwrap_ctdb_lock_pair(dbs, "batch", i, true)) {
+			goto fail;
+		}
+	}
+	batch_secs = timeval_elapsed(&start);
+
+	printf("sequential: %d record pairs in %.2f seconds: %.1f us/pair\n",
+	       torture_numops, seq_secs, seq_secs * 1e6 / torture_numops);
+	printf("batched:    %d record pairs in %.2f seconds: %.1f us/pair\n",
+	       torture_numops, batch_secs, batch_secs * 1e6 / torture_numops);
+
+	ret = true;
+fail:
+	TALLOC_FREE(dbs[1]);
+	TALLOC_FREE(dbs[0]);
+	return ret;
+}
@@ -0,0 +1,328 @@
+/*
+   Unix SMB/CIFS implementation.
+   Test case-insensitive lookups with "smbd:dir index"
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+
+/*
+ * Run this against a share with "smbd:dir index = yes" and "case
+ * sensitive = no". The first connection looks up names in a case
+ * different from the one on disk, so it goes through its smbd's index
+ * of the directory, while the second connection changes the directory
+ * from another smbd. A stale index shows as a wrong "not found", or as
+ * a second file with the same name in a different case.
+ *
+ * With "kernel change notify = no" the index is validated by the
+ * directory's mtime. Only mtimes two seconds older than the scan are
+ * trusted, so we wait before each lookup that builds an index.
+ */
+
+#define DIR_INDEX_DIR "dir_index"
+#define DIR_INDEX_NUM_FILES 300
+
+/*
+ * More than smbd queues for an index before throwing it away
+ */
+#define DIR_INDEX_NUM_BURST 4200
+
+static bool dir_index_expect(struct cli_state *cli, const char *name,
+			     NTSTATUS expected)
+{
+	fstring fname;
+	NTSTATUS status;
+
+	fstr_sprintf(fname, "%s\\%s", DIR_INDEX_DIR, name);
+
+	status = cli_getatr(cli, fname, NULL, NULL, NULL);
+	if (!NT_STATUS_EQUAL(status, expected)) {
+		printf("getatr of %s returned %s, expected %s\n", fname,
+		       nt_errstr(status), nt_errstr(expected));
+		return false;
+	}
+	return true;
+}
+
+static NTSTATUS dir_index_create(struct cli_state *cli, const char *name)
+{
+	fstring fname;
+	uint16_t fnum;
+	NTSTATUS status;
+
+	fstr_sprintf(fname, "%s\\%s", DIR_INDEX_DIR, name);
+
+	status = cli_openx(cli, fname, O_RDWR|O_CREAT|O_EXCL, DENY_NONE,
+			   &fnum);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+	return cli_close(cli, fnum);
+}
+
+struct dir_index_list_state {
+	char **names;
+	size_t num_names;
+};
+
+static NTSTATUS dir_index_list_fn(const char *mnt, struct file_info *finfo,
+				  const char *mask, void *private_data)
+{
+	struct dir_index_list_state *state = private_data;
+	char **tmp;
+
+	tmp = talloc_realloc(state, state->names, char *,
+			     state->num_names + 1);
+	if (tmp == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	state->names = tmp;
+
+	tmp[state->num_names] = talloc_strdup_upper(tmp, finfo->name);
+	if (tmp[state->num_names] == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	state->num_names += 1;
+	return NT_STATUS_OK;
+}
+
+static int dir_index_cmp(char * const *n1, char * const *n2)
+{
+	return strcmp(*n1, *n2);
+}
+
+/*
+ * No two names in the directory may differ only in case
+ */
+static bool dir_index_check_unique(struct cli_state *cli)
+{
+	struct dir_index_list_state *state;
+	NTSTATUS status;
+	size_t i;
+	bool ret = false;
+
+	state = talloc_zero(talloc_tos(), struct dir_index_list_state);
+	if (state == NULL) {
+		return false;
+	}
+
+	status = cli_list(cli, DIR_INDEX_DIR "\\*",
+			  FILE_ATTRIBUTE_DIRECTORY|FILE_ATTRIBUTE_HIDDEN|
+			  FILE_ATTRIBUTE_SYSTEM,
+			  dir_index_list_fn, state);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_list failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	TYPESAFE_QSORT(state->names, state->num_names, dir_index_cmp);
+
+	for (i=1; i<state->num_names; i++) {
+		if (strcmp(state->names[i-1], state->names[i]) == 0) {
+			printf("%s exists twice\n", state->names[i]);
+			goto fail;
+		}
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(state);
+	return ret;
+}
+
+static void dir_index_cleanup(struct cli_state *cli)
+{
+	cli_unlink(cli, DIR_INDEX_DIR "\\*",
+		   FILE_ATTRIBUTE_SYSTEM|FILE_ATTRIBUTE_HIDDEN);
+	cli_rmdir(cli, DIR_INDEX_DIR);
+}
+
+bool run_dir_index(int dummy)
+{
+	struct cli_state *cli1 = NULL;
+	struct cli_state *cli2 = NULL;
+	unsigned i;
+	NTSTATUS status;
+	bool ret = false;
+
+	printf("Starting DIR-INDEX\n");
+
+	if (!torture_open_connection(&cli1, 0) ||
+	    !torture_open_connection(&cli2, 1)) {
+		goto fail;
+	}
+
+	dir_index_cleanup(cli1);
+
+	status = cli_mkdir(cli1, DIR_INDEX_DIR);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	for (i=0; i<DIR_INDEX_NUM_FILES; i++) {
+		fstring name;
+
+		fstr_sprintf(name, "File_%03u", i);
+		status = dir_index_create(cli1, name);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("create of %s failed: %s\n", name,
+			       nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	printf("Creating through the second connection\n");
+
+	sleep(3);
+
+	if (!dir_index_expect(cli1, "FILE_001", NT_STATUS_OK) ||
+	    !dir_index_expect(cli1, "FILE_NEW",
+			      NT_STATUS_OBJECT_NAME_NOT_FOUND)) {
+		goto fail;
+	}
+
+	status = dir_index_create(cli2, "File_New");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("create of File_New failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	if (!dir_index_expect(cli1, "file_new", NT_STATUS_OK)) {
+		goto fail;
+	}
+
+	printf("Renaming through the second connection\n");
+
+	sleep(3);
+
+	if (!dir_index_expect(cli1, "FILE_002", NT_STATUS_OK)) {
+		goto fail;
+	}
+
+	status = cli_rename(cli2, DIR_INDEX_DIR "\\File_003",
+			    DIR_INDEX_DIR "\\File_Moved");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("rename failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	if (!dir_index_expect(cli1, "FILE_MOVED", NT_STATUS_OK) ||
+	    !dir_index_expect(cli1, "FILE_003",
+			      NT_STATUS_OBJECT_NAME_NOT_FOUND)) {
+		goto fail;
+	}
+
+	printf("Deleting through the second connection\n");
+
+	sleep(3);
+
+	if (!dir_index_expect(cli1, "FILE_004", NT_STATUS_OK)) {
+		goto fail;
+	}
+
+	status = cli_unlink(cli2, DIR_INDEX_DIR "\\File_005", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("unlink failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	if (!dir_index_expect(cli1, "file_005",
+			      NT_STATUS_OBJECT_NAME_NOT_FOUND)) {
+		goto fail;
+	}
+
+	/*
+	 * Creating the names the other connection created in a
+	 * different case must find them
+	 */
+	status = dir_index_create(cli1, "FILE_NEW");
+	if (!NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_COLLISION)) {
+		printf("create of FILE_NEW returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+	status = dir_index_create(cli1, "file_moved");
+	if (!NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_COLLISION)) {
+		printf("create of file_moved returned %s\n",
+		       nt_errstr(status));
+		goto fail;
+	}
+	status = dir_index_create(cli1, "FILE_005");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("create of FILE_005 failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	printf("Changing more than the index can follow\n");
+
+	sleep(3);
+
+	if (!dir_index_expect(cli1, "FILE_006", NT_STATUS_OK)) {
+		goto fail;
+	}
+
+	for (i=0; i<DIR_INDEX_NUM_BURST; i++) {
+		fstring name;
+
+		fstr_sprintf(name, "Burst_%04u", i);
+		status = dir_index_create(cli2, name);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("create of %s failed: %s\n", name,
+			       nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	if (!dir_index_expect(cli1, "BURST_0000", NT_STATUS_OK) ||
+	    !dir_index_expect(cli1, "burst_4199", NT_STATUS_OK) ||
+	    !dir_index_expect(cli1, "FILE_003",
+			      NT_STATUS_OBJECT_NAME_NOT_FOUND)) {
+		goto fail;
+	}
+
+	status = cli_unlink(cli2, DIR_INDEX_DIR "\\Burst_0001", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("unlink failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	if (!dir_index_expect(cli1, "BURST_0001",
+			      NT_STATUS_OBJECT_NAME_NOT_FOUND)) {
+		goto fail;
+	}
+	status = dir_index_create(cli1, "BURST_0002");
+	if (!NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_COLLISION)) {
+		printf("create of BURST_0002 returned %s\n",
+		       nt_errstr(status));
+		goto fail;
+	}
+
+	if (!dir_index_check_unique(cli1)) {
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	if (cli1 != NULL) {
+		dir_index_cleanup(cli1);
+		torture_close_connection(cli1);
+	}
+	if (cli2 != NULL) {
+		torture_close_connection(cli2);
+	}
+	return ret;
+}
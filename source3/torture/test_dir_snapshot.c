@@ -0,0 +1,580 @@
+/*
+   Unix SMB/CIFS implementation.
+   Test directory searches with "smbd:dir snapshot"
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "system/dir.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "libcli/security/security.h"
+
+extern fstring host, workgroup, share, password, username, myname;
+extern const char *local_path;
+
+/*
+ * Run this against a share with "smbd:dir snapshot = yes", ideally with
+ * "directory name cache size = 0" so that SMB1 resumes by name hit the
+ * snapshot. The results must be the same as without snapshots: Listings
+ * in the order of the file system, continuing and restarting searches
+ * loses or duplicates no entries, and changes to the directory show up
+ * in new and restarted searches.
+ */
+
+#define DIR_SNAPSHOT_DIR "dir_snapshot"
+#define DIR_SNAPSHOT_PREFIX "entry_with_a_name_long_enough_to_fill_buffers_"
+#define DIR_SNAPSHOT_NUM_FILES 500
+
+struct dir_snapshot_list {
+	char **names;
+	size_t num_names;
+};
+
+static bool dir_snapshot_add(struct dir_snapshot_list *l, const char *name)
+{
+	char **tmp;
+
+	if (ISDOT(name) || ISDOTDOT(name)) {
+		return true;
+	}
+
+	tmp = talloc_realloc(l, l->names, char *, l->num_names + 1);
+	if (tmp == NULL) {
+		return false;
+	}
+	l->names = tmp;
+
+	l->names[l->num_names] = talloc_strdup(l->names, name);
+	if (l->names[l->num_names] == NULL) {
+		return false;
+	}
+	l->num_names += 1;
+	return true;
+}
+
+static NTSTATUS dir_snapshot_list_fn(const char *mnt, struct file_info *finfo,
+				     const char *mask, void *private_data)
+{
+	struct dir_snapshot_list *l = private_data;
+
+	if (!dir_snapshot_add(l, finfo->name)) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	return NT_STATUS_OK;
+}
+
+static int dir_snapshot_index(const char *name)
+{
+	size_t len = strlen(DIR_SNAPSHOT_PREFIX);
+
+	if (strncmp(name, DIR_SNAPSHOT_PREFIX, len) != 0) {
+		return -1;
+	}
+	return atoi(name + len);
+}
+
+static NTSTATUS dir_snapshot_create(struct cli_state *cli, unsigned idx)
+{
+	fstring fname;
+	uint16_t fnum;
+	NTSTATUS status;
+
+	fstr_sprintf(fname, "%s\\%s%04u", DIR_SNAPSHOT_DIR,
+		     DIR_SNAPSHOT_PREFIX, idx);
+
+	status = cli_openx(cli, fname, O_RDWR|O_CREAT|O_EXCL, DENY_NONE,
+			   &fnum);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_openx(%s) failed: %s\n", fname, nt_errstr(status));
+		return status;
+	}
+	return cli_close(cli, fnum);
+}
+
+static NTSTATUS dir_snapshot_unlink(struct cli_state *cli, unsigned idx)
+{
+	fstring fname;
+
+	fstr_sprintf(fname, "%s\\%s%04u", DIR_SNAPSHOT_DIR,
+		     DIR_SNAPSHOT_PREFIX, idx);
+
+	return cli_unlink(cli, fname, 0);
+}
+
+/*
+ * Every name in "before" and "after" must be listed exactly once, names
+ * in only one of them at most once, nothing else at all.
+ */
+static bool dir_snapshot_check(const struct dir_snapshot_list *l,
+			       const bool *before, const bool *after)
+{
+	uint8_t seen[DIR_SNAPSHOT_NUM_FILES + 2] = { 0 };
+	size_t i;
+
+	for (i=0; i<l->num_names; i++) {
+		int idx = dir_snapshot_index(l->names[i]);
+
+		if ((idx < 0) || ((size_t)idx >= ARRAY_SIZE(seen)) ||
+		    (!before[idx] && !after[idx])) {
+			printf("Unexpected entry %s\n", l->names[i]);
+			return false;
+		}
+		if (seen[idx] != 0) {
+			printf("Entry %s listed twice\n", l->names[i]);
+			return false;
+		}
+		seen[idx] = 1;
+	}
+
+	for (i=0; i<ARRAY_SIZE(seen); i++) {
+		if (before[i] && after[i] && (seen[i] == 0)) {
+			printf("Entry %s%04zu missing\n", DIR_SNAPSHOT_PREFIX,
+			       i);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool dir_snapshot_parse(struct dir_snapshot_list *l,
+			       const uint8_t *dir_data,
+			       uint32_t dir_data_length)
+{
+	uint32_t ofs = 0;
+
+	while (ofs + 12 <= dir_data_length) {
+		uint32_t next = IVAL(dir_data, ofs);
+		uint32_t name_len = IVAL(dir_data, ofs + 8);
+		char *name;
+		size_t converted;
+		bool ok;
+
+		if (name_len > dir_data_length - ofs - 12) {
+			printf("Invalid name length %u\n", name_len);
+			return false;
+		}
+		if (!convert_string_talloc(talloc_tos(), CH_UTF16LE, CH_UNIX,
+					   dir_data + ofs + 12, name_len,
+					   &name, &converted)) {
+			return false;
+		}
+		ok = dir_snapshot_add(l, name);
+		TALLOC_FREE(name);
+		if (!ok) {
+			return false;
+		}
+
+		if (next == 0) {
+			break;
+		}
+		ofs += next;
+	}
+	return true;
+}
+
+/*
+ * Read entries from an SMB2 directory handle, all of them or only one
+ * buffer full
+ */
+static bool dir_snapshot_smb2_read(struct cli_state *cli,
+				   uint64_t fid_persistent,
+				   uint64_t fid_volatile,
+				   uint8_t flags, bool all,
+				   struct dir_snapshot_list *l)
+{
+	do {
+		TALLOC_CTX *frame = talloc_stackframe();
+		uint8_t *dir_data;
+		uint32_t dir_data_length;
+		NTSTATUS status;
+		bool ok;
+
+		status = smb2cli_query_directory(
+			cli->conn, cli->timeout, cli->smb2.session,
+			cli->smb2.tcon, SMB2_FIND_NAME_INFO, flags, 0,
+			fid_persistent, fid_volatile, "*", 512,
+			frame, &dir_data, &dir_data_length);
+		if (NT_STATUS_EQUAL(status, STATUS_NO_MORE_FILES)) {
+			TALLOC_FREE(frame);
+			return true;
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("smb2cli_query_directory returned %s\n",
+			       nt_errstr(status));
+			TALLOC_FREE(frame);
+			return false;
+		}
+		flags = 0;
+
+		ok = dir_snapshot_parse(l, dir_data, dir_data_length);
+		TALLOC_FREE(frame);
+		if (!ok) {
+			return false;
+		}
+	} while (all);
+
+	return true;
+}
+
+static bool dir_snapshot_smb2_list(struct cli_state *cli,
+				   struct dir_snapshot_list *l)
+{
+	uint64_t fid_persistent, fid_volatile;
+	NTSTATUS status;
+	bool ok;
+
+	status = smb2cli_create(cli->conn, cli->timeout, cli->smb2.session,
+			cli->smb2.tcon, DIR_SNAPSHOT_DIR,
+			SMB2_OPLOCK_LEVEL_NONE, /* oplock_level, */
+			SMB2_IMPERSONATION_IMPERSONATION, /* impersonation_level, */
+			SEC_STD_SYNCHRONIZE|
+			SEC_DIR_LIST|
+			SEC_DIR_READ_ATTRIBUTE, /* desired_access, */
+			0, /* file_attributes, */
+			FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, /* share_access, */
+			FILE_OPEN, /* create_disposition, */
+			FILE_DIRECTORY_FILE, /* create_options, */
+			NULL, /* smb2_create_blobs *blobs */
+			&fid_persistent,
+			&fid_volatile,
+			NULL, NULL, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smb2cli_create returned %s\n", nt_errstr(status));
+		return false;
+	}
+
+	ok = dir_snapshot_smb2_read(cli, fid_persistent, fid_volatile, 0,
+				    true, l);
+
+	smb2cli_close(cli->conn, cli->timeout, cli->smb2.session,
+		      cli->smb2.tcon, 0, fid_persistent, fid_volatile);
+	return ok;
+}
+
+/*
+ * Snapshots must not reorder the listing, it has to come in the order
+ * of readdir() on the share.
+ */
+static bool dir_snapshot_check_order(const struct dir_snapshot_list *l)
+{
+	char *path;
+	DIR *d;
+	struct dirent *de;
+	size_t i = 0;
+	bool ret = false;
+
+	if (local_path == NULL) {
+		printf("No local path given, not checking the order\n");
+		return true;
+	}
+
+	path = talloc_asprintf(talloc_tos(), "%s/%s", local_path,
+			       DIR_SNAPSHOT_DIR);
+	if (path == NULL) {
+		return false;
+	}
+	d = opendir(path);
+	if (d == NULL) {
+		printf("opendir(%s) failed: %s\n", path, strerror(errno));
+		TALLOC_FREE(path);
+		return false;
+	}
+
+	while ((de = readdir(d)) != NULL) {
+		if (ISDOT(de->d_name) || ISDOTDOT(de->d_name)) {
+			continue;
+		}
+		if ((i >= l->num_names) ||
+		    (strcmp(de->d_name, l->names[i]) != 0)) {
+			printf("Entry %zu is %s, readdir returned %s\n", i,
+			       (i < l->num_names) ? l->names[i] : "missing",
+			       de->d_name);
+			goto fail;
+		}
+		i += 1;
+	}
+	if (i != l->num_names) {
+		printf("Listed %zu entries, readdir returned %zu\n",
+		       l->num_names, i);
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	closedir(d);
+	TALLOC_FREE(path);
+	return ret;
+}
+
+static void dir_snapshot_cleanup(struct cli_state *cli)
+{
+	unsigned i;
+
+	for (i=0; i<DIR_SNAPSHOT_NUM_FILES + 2; i++) {
+		dir_snapshot_unlink(cli, i);
+	}
+	cli_rmdir(cli, DIR_SNAPSHOT_DIR);
+}
+
+bool run_dir_snapshot(int dummy)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct cli_state *cli = NULL;
+	struct cli_state *cli2 = NULL;
+	struct dir_snapshot_list *l;
+	bool before[DIR_SNAPSHOT_NUM_FILES + 2] = { false };
+	bool after[DIR_SNAPSHOT_NUM_FILES + 2] = { false };
+	uint64_t fid_persistent, fid_volatile;
+	bool dir_open = false;
+	unsigned i, deleted;
+	NTSTATUS status;
+	bool ret = false;
+
+	printf("Starting DIR-SNAPSHOT\n");
+
+	if (!torture_open_connection(&cli, 0)) {
+		goto fail;
+	}
+
+	if (!torture_init_connection(&cli2)) {
+		goto fail;
+	}
+	status = smbXcli_negprot(cli2->conn, cli2->timeout,
+				 PROTOCOL_SMB2_02, PROTOCOL_SMB2_02);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smbXcli_negprot returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+	status = cli_session_setup(cli2, username,
+				   password, strlen(password),
+				   password, strlen(password),
+				   workgroup);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_session_setup returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+	status = cli_tree_connect(cli2, share, "?????", "", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_tree_connect returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	dir_snapshot_cleanup(cli);
+
+	status = cli_mkdir(cli, DIR_SNAPSHOT_DIR);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	/*
+	 * Create the files out of name order, so that sorting the
+	 * listing is noticed also on file systems returning entries in
+	 * creation order
+	 */
+	for (i=0; i<DIR_SNAPSHOT_NUM_FILES; i++) {
+		unsigned idx = (i * 7) % DIR_SNAPSHOT_NUM_FILES;
+
+		status = dir_snapshot_create(cli, idx);
+		if (!NT_STATUS_IS_OK(status)) {
+			goto fail;
+		}
+		before[idx] = after[idx] = true;
+	}
+
+	/*
+	 * Snapshots of directories changed within the last second are
+	 * not kept for other searches
+	 */
+	sleep(2);
+
+	printf("Listing the directory\n");
+
+	l = talloc_zero(frame, struct dir_snapshot_list);
+	if (l == NULL) {
+		goto fail;
+	}
+	status = cli_list(cli, DIR_SNAPSHOT_DIR "\\*",
+			  FILE_ATTRIBUTE_DIRECTORY|FILE_ATTRIBUTE_HIDDEN|
+			  FILE_ATTRIBUTE_SYSTEM,
+			  dir_snapshot_list_fn, l);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_list failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	if (!dir_snapshot_check(l, before, after) ||
+	    !dir_snapshot_check_order(l)) {
+		printf("SMB1 listing failed\n");
+		goto fail;
+	}
+	TALLOC_FREE(l);
+
+	l = talloc_zero(frame, struct dir_snapshot_list);
+	if ((l == NULL) || !dir_snapshot_smb2_list(cli2, l)) {
+		goto fail;
+	}
+	if (!dir_snapshot_check(l, before, after) ||
+	    !dir_snapshot_check_order(l)) {
+		printf("SMB2 listing failed\n");
+		goto fail;
+	}
+	TALLOC_FREE(l);
+
+	printf("Changing the directory between searches\n");
+
+	/*
+	 * The snapshot of the listing above must not be used anymore
+	 */
+	status = dir_snapshot_unlink(cli, 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("unlink failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	before[0] = after[0] = false;
+	status = dir_snapshot_create(cli, DIR_SNAPSHOT_NUM_FILES);
+	if (!NT_STATUS_IS_OK(status)) {
+		goto fail;
+	}
+	before[DIR_SNAPSHOT_NUM_FILES] = after[DIR_SNAPSHOT_NUM_FILES] = true;
+
+	l = talloc_zero(frame, struct dir_snapshot_list);
+	if ((l == NULL) || !dir_snapshot_smb2_list(cli2, l)) {
+		goto fail;
+	}
+	if (!dir_snapshot_check(l, before, after) ||
+	    !dir_snapshot_check_order(l)) {
+		printf("Listing after the change failed\n");
+		goto fail;
+	}
+
+	/*
+	 * Delete the entry that would be listed last, by now it has not
+	 * been listed
+	 */
+	deleted = dir_snapshot_index(l->names[l->num_names - 1]);
+	TALLOC_FREE(l);
+
+	printf("Changing the directory during a search\n");
+
+	sleep(2);
+
+	status = smb2cli_create(cli2->conn, cli2->timeout, cli2->smb2.session,
+			cli2->smb2.tcon, DIR_SNAPSHOT_DIR,
+			SMB2_OPLOCK_LEVEL_NONE, /* oplock_level, */
+			SMB2_IMPERSONATION_IMPERSONATION, /* impersonation_level, */
+			SEC_STD_SYNCHRONIZE|
+			SEC_DIR_LIST|
+			SEC_DIR_READ_ATTRIBUTE, /* desired_access, */
+			0, /* file_attributes, */
+			FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, /* share_access, */
+			FILE_OPEN, /* create_disposition, */
+			FILE_DIRECTORY_FILE, /* create_options, */
+			NULL, /* smb2_create_blobs *blobs */
+			&fid_persistent,
+			&fid_volatile,
+			NULL, NULL, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smb2cli_create returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+	dir_open = true;
+
+	l = talloc_zero(frame, struct dir_snapshot_list);
+	if ((l == NULL) ||
+	    !dir_snapshot_smb2_read(cli2, fid_persistent, fid_volatile, 0,
+				    false, l)) {
+		goto fail;
+	}
+
+	status = dir_snapshot_unlink(cli, deleted);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("unlink failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	after[deleted] = false;
+	status = dir_snapshot_create(cli, DIR_SNAPSHOT_NUM_FILES + 1);
+	if (!NT_STATUS_IS_OK(status)) {
+		goto fail;
+	}
+	after[DIR_SNAPSHOT_NUM_FILES + 1] = true;
+
+	/*
+	 * Continuing may or may not show the changes, but all other
+	 * entries have to be there once
+	 */
+	if (!dir_snapshot_smb2_read(cli2, fid_persistent, fid_volatile, 0,
+				    true, l)) {
+		goto fail;
+	}
+	if (!dir_snapshot_check(l, before, after)) {
+		printf("Continued listing failed\n");
+		goto fail;
+	}
+	TALLOC_FREE(l);
+
+	/*
+	 * Restarting must show the changes
+	 */
+	l = talloc_zero(frame, struct dir_snapshot_list);
+	if ((l == NULL) ||
+	    !dir_snapshot_smb2_read(cli2, fid_persistent, fid_volatile,
+				    SMB2_CONTINUE_FLAG_RESTART, true, l)) {
+		goto fail;
+	}
+	if (!dir_snapshot_check(l, after, after) ||
+	    !dir_snapshot_check_order(l)) {
+		printf("Restarted listing failed\n");
+		goto fail;
+	}
+	TALLOC_FREE(l);
+
+	l = talloc_zero(frame, struct dir_snapshot_list);
+	if (l == NULL) {
+		goto fail;
+	}
+	status = cli_list(cli, DIR_SNAPSHOT_DIR "\\*",
+			  FILE_ATTRIBUTE_DIRECTORY|FILE_ATTRIBUTE_HIDDEN|
+			  FILE_ATTRIBUTE_SYSTEM,
+			  dir_snapshot_list_fn, l);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_list failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	if (!dir_snapshot_check(l, after, after) ||
+	    !dir_snapshot_check_order(l)) {
+		printf("SMB1 listing after the changes failed\n");
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	if (dir_open) {
+		smb2cli_close(cli2->conn, cli2->timeout, cli2->smb2.session,
+			      cli2->smb2.tcon, 0, fid_persistent,
+			      fid_volatile);
+	}
+	if (cli != NULL) {
+		dir_snapshot_cleanup(cli);
+		torture_close_connection(cli);
+	}
+	if (cli2 != NULL) {
+		torture_close_connection(cli2);
+	}
+	TALLOC_FREE(frame);
+	return ret;
+}
@@ -0,0 +1,307 @@
+/*
+   Unix SMB/CIFS implementation.
+   Test directory listings through vfs_dirprefetch
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+#include "libsmb/clirap.h"
+
+/*
+ * Run this against a share with "vfs objects = dirprefetch" and a
+ * small "dirprefetch:batch size", so that the listing spans many
+ * batches. Every entry a listing returns must look the same as when
+ * queried by name, also for symlinks. Without POSIX pathnames smbd
+ * follows them, with POSIX pathnames it reports the link itself.
+ */
+
+#define DIRPREFETCH_DIR "dirprefetch"
+#define DIRPREFETCH_NUM_FILES 50
+#define DIRPREFETCH_LINK_TARGET "file_3"
+
+struct dirprefetch_list_state {
+	struct file_info *finfos;
+	size_t num_finfos;
+};
+
+static NTSTATUS dirprefetch_list_fn(const char *mnt, struct file_info *finfo,
+				    const char *mask, void *private_data)
+{
+	struct dirprefetch_list_state *state = private_data;
+	struct file_info *tmp;
+
+	if (ISDOT(finfo->name) || ISDOTDOT(finfo->name)) {
+		return NT_STATUS_OK;
+	}
+
+	tmp = talloc_realloc(state, state->finfos, struct file_info,
+			     state->num_finfos + 1);
+	if (tmp == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	state->finfos = tmp;
+
+	tmp[state->num_finfos] = *finfo;
+	tmp[state->num_finfos].name = talloc_strdup(state->finfos,
+						    finfo->name);
+	if (tmp[state->num_finfos].name == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	state->num_finfos += 1;
+
+	return NT_STATUS_OK;
+}
+
+/*
+ * List the directory and compare every entry with what a
+ * QUERY_PATH_INFO on its name returns
+ */
+static bool dirprefetch_check_listing(struct cli_state *cli, char sep,
+				      uint64_t link_size)
+{
+	struct dirprefetch_list_state *state;
+	char *mask;
+	size_t i;
+	bool link_seen = false;
+	NTSTATUS status;
+	bool ret = false;
+
+	state = talloc_zero(talloc_tos(), struct dirprefetch_list_state);
+	if (state == NULL) {
+		return false;
+	}
+
+	mask = talloc_asprintf(state, "%s%c*", DIRPREFETCH_DIR, sep);
+	if (mask == NULL) {
+		goto fail;
+	}
+
+	status = cli_list(cli, mask,
+			  FILE_ATTRIBUTE_DIRECTORY|FILE_ATTRIBUTE_HIDDEN|
+			  FILE_ATTRIBUTE_SYSTEM,
+			  dirprefetch_list_fn, state);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_list failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	if (state->num_finfos < DIRPREFETCH_NUM_FILES + 3) {
+		printf("Expected at least %u entries, got %zu\n",
+		       DIRPREFETCH_NUM_FILES + 3, state->num_finfos);
+		goto fail;
+	}
+
+	for (i=0; i<state->num_finfos; i++) {
+		struct file_info *f = &state->finfos[i];
+		struct timespec write_time;
+		off_t size;
+		uint16_t mode;
+		char *path;
+
+		path = talloc_asprintf(state, "%s%c%s", DIRPREFETCH_DIR, sep,
+				       f->name);
+		if (path == NULL) {
+			goto fail;
+		}
+
+		if (strequal(f->name, "link_file")) {
+			if (f->size != link_size) {
+				printf("%s: size %ju, expected %ju\n", path,
+				       (uintmax_t)f->size,
+				       (uintmax_t)link_size);
+				goto fail;
+			}
+			link_seen = true;
+		}
+
+		/*
+		 * QUERY_PATH_INFO follows symlinks also with POSIX
+		 * pathnames
+		 */
+		if ((sep == '/') && (strncmp(f->name, "link_", 5) == 0)) {
+			continue;
+		}
+
+		status = cli_qpathinfo2(cli, path, NULL, NULL, &write_time,
+					NULL, &size, &mode, NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("cli_qpathinfo2(%s) failed: %s\n", path,
+			       nt_errstr(status));
+			goto fail;
+		}
+
+		if ((f->size != size) || (f->mode != mode) ||
+		    (timespec_compare(&f->mtime_ts, &write_time) != 0)) {
+			printf("%s: listed size %ju mode 0x%x mtime %s, "
+			       "queried size %ju mode 0x%x mtime %s\n",
+			       path, (uintmax_t)f->size, (unsigned)f->mode,
+			       timestring(state, f->mtime_ts.tv_sec),
+			       (uintmax_t)size, (unsigned)mode,
+			       timestring(state, write_time.tv_sec));
+			goto fail;
+		}
+	}
+
+	if (!link_seen) {
+		printf("link_file not listed\n");
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(state);
+	return ret;
+}
+
+static void dirprefetch_cleanup(struct cli_state *cli,
+				struct cli_state *posix_cli)
+{
+	unsigned i;
+
+	for (i=0; i<DIRPREFETCH_NUM_FILES; i++) {
+		fstring fname;
+
+		fstr_sprintf(fname, "%s\\file_%u", DIRPREFETCH_DIR, i);
+		cli_setatr(cli, fname, FILE_ATTRIBUTE_NORMAL, 0);
+		cli_unlink(cli, fname,
+			   FILE_ATTRIBUTE_SYSTEM|FILE_ATTRIBUTE_HIDDEN);
+	}
+	cli_posix_unlink(posix_cli, DIRPREFETCH_DIR "/link_file");
+	cli_posix_unlink(posix_cli, DIRPREFETCH_DIR "/link_dir");
+	cli_posix_unlink(posix_cli, DIRPREFETCH_DIR "/link_dangling");
+	cli_rmdir(cli, DIRPREFETCH_DIR "\\sub");
+	cli_rmdir(cli, DIRPREFETCH_DIR);
+}
+
+bool run_dirprefetch(int dummy)
+{
+	struct cli_state *cli = NULL;
+	struct cli_state *posix_cli = NULL;
+	uint8_t buf[DIRPREFETCH_NUM_FILES];
+	unsigned i;
+	NTSTATUS status;
+	bool ret = false;
+
+	printf("Starting DIRPREFETCH\n");
+
+	if (!torture_open_connection(&cli, 0) ||
+	    !torture_open_connection(&posix_cli, 1)) {
+		return false;
+	}
+
+	status = torture_setup_unix_extensions(posix_cli);
+	if (!NT_STATUS_IS_OK(status)) {
+		goto fail;
+	}
+
+	dirprefetch_cleanup(cli, posix_cli);
+
+	status = cli_mkdir(cli, DIRPREFETCH_DIR);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	status = cli_mkdir(cli, DIRPREFETCH_DIR "\\sub");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	memset(buf, 'x', sizeof(buf));
+
+	/*
+	 * Different sizes and attributes, so that handing out the
+	 * data of another entry is noticed
+	 */
+	for (i=0; i<DIRPREFETCH_NUM_FILES; i++) {
+		fstring fname;
+		uint16_t fnum;
+		uint16_t attr = 0;
+
+		fstr_sprintf(fname, "%s\\file_%u", DIRPREFETCH_DIR, i);
+
+		status = cli_openx(cli, fname, O_RDWR|O_CREAT|O_TRUNC,
+				   DENY_NONE, &fnum);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("cli_openx(%s) failed: %s\n", fname,
+			       nt_errstr(status));
+			goto fail;
+		}
+		status = cli_writeall(cli, fnum, 0, buf, 0, i, NULL);
+		cli_close(cli, fnum);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("cli_writeall failed: %s\n",
+			       nt_errstr(status));
+			goto fail;
+		}
+
+		if ((i % 3) == 0) {
+			attr |= FILE_ATTRIBUTE_HIDDEN;
+		}
+		if ((i % 5) == 0) {
+			attr |= FILE_ATTRIBUTE_READONLY;
+		}
+		if ((i % 7) == 0) {
+			attr |= FILE_ATTRIBUTE_SYSTEM;
+		}
+		if (attr != 0) {
+			status = cli_setatr(cli, fname, attr, 0);
+			if (!NT_STATUS_IS_OK(status)) {
+				printf("cli_setatr(%s) failed: %s\n", fname,
+				       nt_errstr(status));
+				goto fail;
+			}
+		}
+	}
+
+	status = cli_posix_symlink(posix_cli, DIRPREFETCH_LINK_TARGET,
+				   DIRPREFETCH_DIR "/link_file");
+	if (NT_STATUS_IS_OK(status)) {
+		status = cli_posix_symlink(posix_cli, "sub",
+					   DIRPREFETCH_DIR "/link_dir");
+	}
+	if (NT_STATUS_IS_OK(status)) {
+		status = cli_posix_symlink(posix_cli, "does_not_exist",
+					   DIRPREFETCH_DIR "/link_dangling");
+	}
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_posix_symlink failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	/*
+	 * file_3 is 3 bytes, the symlink itself is as long as its
+	 * target's name
+	 */
+	if (!dirprefetch_check_listing(cli, '\\', 3)) {
+		printf("Windows listing failed\n");
+		goto fail;
+	}
+	if (!dirprefetch_check_listing(posix_cli, '/',
+				       strlen(DIRPREFETCH_LINK_TARGET))) {
+		printf("POSIX listing failed\n");
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	dirprefetch_cleanup(cli, posix_cli);
+	torture_close_connection(cli);
+	torture_close_connection(posix_cli);
+	return ret;
+}
@@ -0,0 +1,230 @@
+/*
+   Unix SMB/CIFS implementation.
+   Test DOS attributes with "smbd:dosmode cache"
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+
+/*
+ * Run this against a share with "smbd:dosmode cache = yes". The first
+ * connection changes the DOS attributes, the second one reads them and
+ * must never see an old value from its smbd's cache.
+ *
+ * smbd only caches attributes of files whose ctime is at least two
+ * seconds old, so we wait before reading what we want cached. Changes
+ * made right after each other can end up with the same ctime, the last
+ * part of the test makes such changes within the two seconds.
+ */
+
+extern const char *local_path;
+
+#define DOSMODE_CACHE_DIR "dosmode_cache"
+#define DOSMODE_CACHE_FILE DOSMODE_CACHE_DIR "\\file"
+#define DOSMODE_CACHE_LOCAL_FILE DOSMODE_CACHE_DIR "\\local"
+
+#define DOSMODE_CACHE_ATTRS (FILE_ATTRIBUTE_READONLY|FILE_ATTRIBUTE_HIDDEN|\
+			     FILE_ATTRIBUTE_SYSTEM)
+
+#define DOSMODE_CACHE_NUM_TOGGLES 50
+
+static bool dosmode_cache_expect(struct cli_state *cli, const char *fname,
+				 uint16_t expected)
+{
+	uint16_t attr;
+	NTSTATUS status;
+
+	status = cli_getatr(cli, fname, &attr, NULL, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("getatr of %s failed: %s\n", fname, nt_errstr(status));
+		return false;
+	}
+	if ((attr & DOSMODE_CACHE_ATTRS) != expected) {
+		printf("%s has attributes 0x%x, expected 0x%x\n", fname,
+		       (unsigned)(attr & DOSMODE_CACHE_ATTRS),
+		       (unsigned)expected);
+		return false;
+	}
+	return true;
+}
+
+static bool dosmode_cache_set(struct cli_state *cli, const char *fname,
+			      uint16_t attr)
+{
+	NTSTATUS status;
+
+	status = cli_setatr(cli, fname, attr|FILE_ATTRIBUTE_ARCHIVE, 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("setatr of %s failed: %s\n", fname, nt_errstr(status));
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Create a file smbd has never stored DOS attributes for
+ */
+
+static bool dosmode_cache_create_local(void)
+{
+	char *path;
+	int fd;
+
+	path = talloc_asprintf(talloc_tos(), "%s/%s/local", local_path,
+			       DOSMODE_CACHE_DIR);
+	if (path == NULL) {
+		return false;
+	}
+	fd = open(path, O_RDWR|O_CREAT|O_EXCL, 0644);
+	if (fd == -1) {
+		printf("open(%s) failed: %s\n", path, strerror(errno));
+		TALLOC_FREE(path);
+		return false;
+	}
+	close(fd);
+	TALLOC_FREE(path);
+	return true;
+}
+
+static void dosmode_cache_cleanup(struct cli_state *cli)
+{
+	cli_setatr(cli, DOSMODE_CACHE_FILE, FILE_ATTRIBUTE_NORMAL, 0);
+	cli_setatr(cli, DOSMODE_CACHE_LOCAL_FILE, FILE_ATTRIBUTE_NORMAL, 0);
+	cli_unlink(cli, DOSMODE_CACHE_DIR "\\*",
+		   FILE_ATTRIBUTE_SYSTEM|FILE_ATTRIBUTE_HIDDEN);
+	cli_rmdir(cli, DOSMODE_CACHE_DIR);
+}
+
+bool run_dosmode_cache(int dummy)
+{
+	struct cli_state *cli1 = NULL;
+	struct cli_state *cli2 = NULL;
+	uint16_t fnum;
+	unsigned i;
+	NTSTATUS status;
+	bool ret = false;
+
+	printf("Starting DOSMODE-CACHE\n");
+
+	if (!torture_open_connection(&cli1, 0) ||
+	    !torture_open_connection(&cli2, 1)) {
+		goto fail;
+	}
+
+	dosmode_cache_cleanup(cli1);
+
+	status = cli_mkdir(cli1, DOSMODE_CACHE_DIR);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_openx(cli1, DOSMODE_CACHE_FILE, O_RDWR|O_CREAT|O_EXCL,
+			   DENY_NONE, &fnum);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("create of %s failed: %s\n", DOSMODE_CACHE_FILE,
+		       nt_errstr(status));
+		goto fail;
+	}
+	cli_close(cli1, fnum);
+
+	if ((local_path != NULL) && !dosmode_cache_create_local()) {
+		goto fail;
+	}
+
+	printf("Changing cached attributes through the first connection\n");
+
+	sleep(3);
+
+	/*
+	 * Read twice, the second read comes from the cache
+	 */
+	if (!dosmode_cache_expect(cli2, DOSMODE_CACHE_FILE, 0) ||
+	    !dosmode_cache_expect(cli2, DOSMODE_CACHE_FILE, 0)) {
+		goto fail;
+	}
+	if (!dosmode_cache_set(cli1, DOSMODE_CACHE_FILE,
+			       FILE_ATTRIBUTE_HIDDEN)) {
+		goto fail;
+	}
+	if (!dosmode_cache_expect(cli2, DOSMODE_CACHE_FILE,
+				  FILE_ATTRIBUTE_HIDDEN)) {
+		goto fail;
+	}
+
+	sleep(3);
+
+	if (!dosmode_cache_expect(cli2, DOSMODE_CACHE_FILE,
+				  FILE_ATTRIBUTE_HIDDEN) ||
+	    !dosmode_cache_expect(cli2, DOSMODE_CACHE_FILE,
+				  FILE_ATTRIBUTE_HIDDEN)) {
+		goto fail;
+	}
+	if (!dosmode_cache_set(cli1, DOSMODE_CACHE_FILE,
+			       FILE_ATTRIBUTE_SYSTEM|
+			       FILE_ATTRIBUTE_READONLY)) {
+		goto fail;
+	}
+	if (!dosmode_cache_expect(cli2, DOSMODE_CACHE_FILE,
+				  FILE_ATTRIBUTE_SYSTEM|
+				  FILE_ATTRIBUTE_READONLY)) {
+		goto fail;
+	}
+
+	if (local_path != NULL) {
+		/*
+		 * The second connection caches that there are no stored
+		 * attributes at all
+		 */
+		if (!dosmode_cache_expect(cli2, DOSMODE_CACHE_LOCAL_FILE, 0) ||
+		    !dosmode_cache_expect(cli2, DOSMODE_CACHE_LOCAL_FILE, 0)) {
+			goto fail;
+		}
+		if (!dosmode_cache_set(cli1, DOSMODE_CACHE_LOCAL_FILE,
+				       FILE_ATTRIBUTE_HIDDEN)) {
+			goto fail;
+		}
+		if (!dosmode_cache_expect(cli2, DOSMODE_CACHE_LOCAL_FILE,
+					  FILE_ATTRIBUTE_HIDDEN)) {
+			goto fail;
+		}
+	}
+
+	printf("Changing attributes within two seconds\n");
+
+	for (i=0; i<DOSMODE_CACHE_NUM_TOGGLES; i++) {
+		uint16_t attr = (i % 2) ?
+			FILE_ATTRIBUTE_HIDDEN : FILE_ATTRIBUTE_SYSTEM;
+
+		if (!dosmode_cache_set(cli1, DOSMODE_CACHE_FILE, attr) ||
+		    !dosmode_cache_expect(cli2, DOSMODE_CACHE_FILE, attr)) {
+			goto fail;
+		}
+	}
+
+	ret = true;
+fail:
+	if (cli1 != NULL) {
+		dosmode_cache_cleanup(cli1);
+		torture_close_connection(cli1);
+	}
+	if (cli2 != NULL) {
+		torture_close_connection(cli2);
+	}
+	return ret;
+}
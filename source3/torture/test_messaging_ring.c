@@ -0,0 +1,472 @@
+/*
+   Unix SMB/CIFS implementation.
+   Test messaging through shared memory rings
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "lib/util/tevent_unix.h"
+#include "messages.h"
+
+#define MSG_TORTURE_RING 0xF201
+
+/*
+ * Small enough to fill up quickly, messages_dgm.c falls back to the
+ * socket then
+ */
+#define RING_TEST_RING_SIZE "4096"
+#define RING_TEST_MSG_SIZE 200
+
+struct ring_child_state {
+	unsigned num_expected;
+	unsigned num_received;
+	bool failed;
+};
+
+static void ring_child_msg(struct messaging_context *msg_ctx,
+			   void *private_data,
+			   uint32_t msg_type,
+			   struct server_id server_id,
+			   DATA_BLOB *data)
+{
+	struct ring_child_state *state =
+		(struct ring_child_state *)private_data;
+	uint32_t num;
+
+	if (data->length != RING_TEST_MSG_SIZE) {
+		fprintf(stderr, "child: got %u bytes, expected %u\n",
+			(unsigned)data->length, (unsigned)RING_TEST_MSG_SIZE);
+		state->failed = true;
+		return;
+	}
+
+	num = IVAL(data->data, 0);
+	if (num != state->num_received) {
+		fprintf(stderr, "child: got message %u, expected %u\n",
+			(unsigned)num, state->num_received);
+		state->failed = true;
+		return;
+	}
+
+	state->num_received += 1;
+}
+
+/*
+ * Tell the parent we're ready, wait for the go and then collect
+ * num_expected messages. The result goes back through ready_fd.
+ */
+static bool ring_child(int ready_fd, int go_fd, unsigned num_expected)
+{
+	struct tevent_context *ev = NULL;
+	struct messaging_context *msg_ctx = NULL;
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct ring_child_state state = { .num_expected = num_expected };
+	bool retval = false;
+	uint8_t c = 1;
+	ssize_t bytes;
+	NTSTATUS status;
+	int ret;
+
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		fprintf(stderr, "child: tevent_context_init failed\n");
+		goto done;
+	}
+
+	msg_ctx = messaging_init(ev, ev);
+	if (msg_ctx == NULL) {
+		fprintf(stderr, "child: messaging_init failed\n");
+		goto done;
+	}
+
+	status = messaging_register(msg_ctx, &state, MSG_TORTURE_RING,
+				    ring_child_msg);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "child: messaging_register failed: %s\n",
+			nt_errstr(status));
+		goto done;
+	}
+
+	bytes = write(ready_fd, &c, 1);
+	if (bytes != 1) {
+		perror("child: failed to write to ready_fd");
+		goto done;
+	}
+
+	/*
+	 * Don't look at the messages before the parent tells us, so
+	 * the ring overflows
+	 */
+	bytes = read(go_fd, &c, 1);
+	if (bytes != 1) {
+		perror("child: failed to read from go_fd");
+		goto done;
+	}
+
+	while (!state.failed && (state.num_received < state.num_expected)) {
+		ret = tevent_loop_once(ev);
+		if (ret != 0) {
+			fprintf(stderr, "child: tevent_loop_once failed\n");
+			goto done;
+		}
+	}
+
+	if (state.failed) {
+		goto done;
+	}
+
+	printf("child: received %u messages\n", state.num_received);
+
+	retval = true;
+
+done:
+	c = retval ? 1 : 0;
+	bytes = write(ready_fd, &c, 1);
+	if (bytes != 1) {
+		perror("child: failed to write to ready_fd");
+	}
+	TALLOC_FREE(frame);
+	return retval;
+}
+
+struct ring_child_done_state {
+	int fd;
+	bool done;
+	bool ok;
+};
+
+static void ring_child_done_cb(struct tevent_context *ev,
+			       struct tevent_fd *fde,
+			       uint16_t flags,
+			       void *private_data)
+{
+	struct ring_child_done_state *state =
+		(struct ring_child_done_state *)private_data;
+	uint8_t c = 0;
+	ssize_t bytes;
+
+	bytes = read(state->fd, &c, 1);
+	if (bytes != 1) {
+		perror("parent: read from ready_fd failed");
+	}
+
+	state->ok = (c == 1);
+	state->done = true;
+}
+
+/*
+ * Wait for the child's result, sends to the child that did not fit
+ * into its socket are still queued in our event loop
+ */
+static bool ring_wait_child(struct tevent_context *ev, int ready_fd)
+{
+	struct ring_child_done_state state = { .fd = ready_fd };
+	struct tevent_fd *fde;
+	int ret;
+
+	fde = tevent_add_fd(ev, ev, ready_fd, TEVENT_FD_READ,
+			    ring_child_done_cb, &state);
+	if (fde == NULL) {
+		fprintf(stderr, "parent: tevent_add_fd failed\n");
+		return false;
+	}
+
+	while (!state.done) {
+		ret = tevent_loop_once(ev);
+		if (ret != 0) {
+			fprintf(stderr, "parent: tevent_loop_once failed\n");
+			break;
+		}
+	}
+
+	TALLOC_FREE(fde);
+	return state.ok;
+}
+
+static NTSTATUS ring_send_msg(struct messaging_context *msg_ctx,
+			      struct server_id dst, uint32_t num,
+			      const int *fds, size_t num_fds)
+{
+	uint8_t buf[RING_TEST_MSG_SIZE];
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+
+	memset(buf, 0, sizeof(buf));
+	SIVAL(buf, 0, num);
+
+	return messaging_send_iov(msg_ctx, dst, MSG_TORTURE_RING, &iov, 1,
+				  fds, num_fds);
+}
+
+static bool ring_start_child(unsigned num_msgs, pid_t *pchild,
+			     int *pready_fd, int *pgo_fd)
+{
+	int ready_pipe[2];
+	int go_pipe[2];
+	pid_t child;
+	uint8_t c;
+	ssize_t bytes;
+
+	if ((pipe(ready_pipe) != 0) || (pipe(go_pipe) != 0)) {
+		perror("pipe failed");
+		return false;
+	}
+
+	child = fork();
+	if (child == -1) {
+		perror("fork failed");
+		return false;
+	}
+
+	if (child == 0) {
+		bool ok;
+
+		close(ready_pipe[0]);
+		close(go_pipe[1]);
+		ok = ring_child(ready_pipe[1], go_pipe[0], num_msgs);
+		exit(ok ? 0 : 1);
+	}
+
+	close(ready_pipe[1]);
+	close(go_pipe[0]);
+
+	bytes = read(ready_pipe[0], &c, 1);
+	if (bytes != 1) {
+		perror("parent: read from ready_fd failed");
+		return false;
+	}
+
+	*pchild = child;
+	*pready_fd = ready_pipe[0];
+	*pgo_fd = go_pipe[1];
+	return true;
+}
+
+/**
+ * ring1:
+ *
+ * Send more messages than the ring can take to a child that is not
+ * reading yet, then let the child read while we send the rest. Some
+ * messages carry a fd, they always go through the socket. The child
+ * has to see all of them in order.
+ */
+
+bool run_messaging_ring1(int dummy)
+{
+	struct tevent_context *ev = NULL;
+	struct messaging_context *msg_ctx = NULL;
+	TALLOC_CTX *frame = talloc_stackframe();
+	const unsigned num_msgs = 1000;
+	bool retval = false;
+	pid_t child = -1;
+	int ready_fd = -1;
+	int go_fd = -1;
+	int pipe_fds[2] = { -1, -1 };
+	struct server_id dst;
+	NTSTATUS status;
+	unsigned i;
+	uint8_t c = 1;
+	ssize_t bytes;
+	int ret, wstatus;
+	bool ok;
+
+	lp_set_cmdline("messaging:dgm ring size", RING_TEST_RING_SIZE);
+
+	ok = ring_start_child(num_msgs, &child, &ready_fd, &go_fd);
+	if (!ok) {
+		goto fail;
+	}
+
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		fprintf(stderr, "parent: tevent_context_init failed\n");
+		goto fail;
+	}
+	msg_ctx = messaging_init(ev, ev);
+	if (msg_ctx == NULL) {
+		fprintf(stderr, "parent: messaging_init failed\n");
+		goto fail;
+	}
+
+	ret = pipe(pipe_fds);
+	if (ret != 0) {
+		perror("pipe failed");
+		goto fail;
+	}
+
+	dst = messaging_server_id(msg_ctx);
+	dst.pid = child;
+
+	for (i=0; i<num_msgs; i++) {
+		size_t num_fds = ((i % 97) == 96) ? 1 : 0;
+
+		if (i == num_msgs/2) {
+			bytes = write(go_fd, &c, 1);
+			if (bytes != 1) {
+				perror("parent: write to go_fd failed");
+				goto fail;
+			}
+		}
+
+		status = ring_send_msg(msg_ctx, dst, i, pipe_fds, num_fds);
+		if (!NT_STATUS_IS_OK(status)) {
+			fprintf(stderr, "parent: sending message %u "
+				"failed: %s\n", i, nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	printf("parent: sent %u messages\n", num_msgs);
+
+	ok = ring_wait_child(ev, ready_fd);
+	if (!ok) {
+		fprintf(stderr, "parent: child failed\n");
+		goto fail;
+	}
+
+	retval = true;
+fail:
+	if (child != -1) {
+		if (!retval) {
+			kill(child, SIGTERM);
+		}
+		ret = waitpid(child, &wstatus, 0);
+		if ((ret == -1) || !WIFEXITED(wstatus) ||
+		    (WEXITSTATUS(wstatus) != 0)) {
+			retval = false;
+		}
+	}
+	if (pipe_fds[0] != -1) {
+		close(pipe_fds[0]);
+		close(pipe_fds[1]);
+	}
+	if (ready_fd != -1) {
+		close(ready_fd);
+	}
+	if (go_fd != -1) {
+		close(go_fd);
+	}
+	TALLOC_FREE(frame);
+	lp_set_cmdline("messaging:dgm ring size", "0");
+	return retval;
+}
+
+/**
+ * ring2:
+ *
+ * Send enough messages to a child to set up a ring, let the child exit
+ * and make sure further sends to it fail instead of silently going
+ * into the dead ring.
+ */
+
+bool run_messaging_ring2(int dummy)
+{
+	struct tevent_context *ev = NULL;
+	struct messaging_context *msg_ctx = NULL;
+	TALLOC_CTX *frame = talloc_stackframe();
+	const unsigned num_msgs = 200;
+	bool retval = false;
+	pid_t child = -1;
+	int ready_fd = -1;
+	int go_fd = -1;
+	struct server_id dst;
+	NTSTATUS status;
+	unsigned i;
+	uint8_t c = 1;
+	ssize_t bytes;
+	int ret, wstatus;
+	bool ok;
+
+	lp_set_cmdline("messaging:dgm ring size", RING_TEST_RING_SIZE);
+
+	ok = ring_start_child(num_msgs, &child, &ready_fd, &go_fd);
+	if (!ok) {
+		goto fail;
+	}
+
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		fprintf(stderr, "parent: tevent_context_init failed\n");
+		goto fail;
+	}
+	msg_ctx = messaging_init(ev, ev);
+	if (msg_ctx == NULL) {
+		fprintf(stderr, "parent: messaging_init failed\n");
+		goto fail;
+	}
+
+	dst = messaging_server_id(msg_ctx);
+	dst.pid = child;
+
+	bytes = write(go_fd, &c, 1);
+	if (bytes != 1) {
+		perror("parent: write to go_fd failed");
+		goto fail;
+	}
+
+	for (i=0; i<num_msgs; i++) {
+		status = ring_send_msg(msg_ctx, dst, i, NULL, 0);
+		if (!NT_STATUS_IS_OK(status)) {
+			fprintf(stderr, "parent: sending message %u "
+				"failed: %s\n", i, nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	ok = ring_wait_child(ev, ready_fd);
+	if (!ok) {
+		fprintf(stderr, "parent: child failed\n");
+		goto fail;
+	}
+
+	ret = waitpid(child, &wstatus, 0);
+	child = -1;
+	if ((ret == -1) || !WIFEXITED(wstatus) ||
+	    (WEXITSTATUS(wstatus) != 0)) {
+		fprintf(stderr, "parent: child did not exit cleanly\n");
+		goto fail;
+	}
+
+	/*
+	 * The child has emptied the ring, the first send has to kick
+	 * the dead peer. The second one goes through the socket again.
+	 */
+	for (i=0; i<2; i++) {
+		status = ring_send_msg(msg_ctx, dst, num_msgs + i, NULL, 0);
+		if (NT_STATUS_IS_OK(status)) {
+			fprintf(stderr, "parent: send %u to dead child "
+				"succeeded\n", i);
+			goto fail;
+		}
+		printf("parent: send %u to dead child gave %s\n", i,
+		       nt_errstr(status));
+	}
+
+	retval = true;
+fail:
+	if (child != -1) {
+		kill(child, SIGTERM);
+		waitpid(child, NULL, 0);
+	}
+	if (ready_fd != -1) {
+		close(ready_fd);
+	}
+	if (go_fd != -1) {
+		close(go_fd);
+	}
+	TALLOC_FREE(frame);
+	lp_set_cmdline("messaging:dgm ring size", "0");
+	return retval;
+}
@@ -0,0 +1,325 @@
+/*
+   Unix SMB/CIFS implementation.
+   Test name lookups with "smbd:shared stat cache"
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+
+/*
+ * Run this against a server with "smbd:shared stat cache = yes" on a
+ * share that is not case sensitive. The first connection looks up names
+ * in a case different from the one on disk, which puts them into the
+ * shared table. The second connection then renames, deletes or
+ * recreates the files, and the third connection, served by an smbd that
+ * has never seen the names, looks them up again. Its only source for
+ * the names is the shared table, so a stale entry shows as a wrong
+ * "not found" or as the size of a file that is gone.
+ *
+ * Changes through smbd replace the entries they touch. With a local path
+ * we also change the files behind smbd's back, the entries then stay
+ * and have to be found stale on lookup.
+ */
+
+extern const char *local_path;
+
+#define SSC_DIR "shared_stat_cache"
+
+static NTSTATUS ssc_create(struct cli_state *cli, const char *name,
+			   size_t size)
+{
+	uint8_t buf[16] = { 0, };
+	uint16_t fnum;
+	NTSTATUS status;
+
+	SMB_ASSERT(size <= sizeof(buf));
+
+	status = cli_openx(cli, name, O_RDWR|O_CREAT|O_EXCL, DENY_NONE,
+			   &fnum);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("create of %s failed: %s\n", name, nt_errstr(status));
+		return status;
+	}
+	status = cli_writeall(cli, fnum, 0, buf, 0, size, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("write to %s failed: %s\n", name, nt_errstr(status));
+		cli_close(cli, fnum);
+		return status;
+	}
+	return cli_close(cli, fnum);
+}
+
+/*
+ * Look up "name" and make sure it is the file of size "size", or that it
+ * does not exist if size is -1.
+ */
+
+static bool ssc_expect(struct cli_state *cli, const char *name, off_t size)
+{
+	off_t fsize;
+	NTSTATUS status;
+
+	status = cli_getatr(cli, name, NULL, &fsize, NULL);
+
+	if (size == -1) {
+		if (!NT_STATUS_EQUAL(status,
+				     NT_STATUS_OBJECT_NAME_NOT_FOUND) &&
+		    !NT_STATUS_EQUAL(status,
+				     NT_STATUS_OBJECT_PATH_NOT_FOUND)) {
+			printf("getatr of %s returned %s, expected it to be "
+			       "gone\n", name, nt_errstr(status));
+			return false;
+		}
+		return true;
+	}
+
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("getatr of %s failed: %s\n", name, nt_errstr(status));
+		return false;
+	}
+	if (fsize != size) {
+		printf("%s has size %d, expected %d\n", name, (int)fsize,
+		       (int)size);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Rename "Local_Rename" and replace "Local_Recreate" with a file of
+ * size 9 in a different case, without smbd seeing it
+ */
+
+static bool ssc_local_changes(void)
+{
+	char *from, *to;
+	int fd;
+	bool ret = false;
+
+	from = talloc_asprintf(talloc_tos(), "%s/%s/Local_Rename",
+			       local_path, SSC_DIR);
+	to = talloc_asprintf(talloc_tos(), "%s/%s/Local_Renamed",
+			     local_path, SSC_DIR);
+	if ((from == NULL) || (to == NULL)) {
+		goto fail;
+	}
+	if (rename(from, to) != 0) {
+		printf("rename(%s) failed: %s\n", from, strerror(errno));
+		goto fail;
+	}
+	TALLOC_FREE(from);
+	TALLOC_FREE(to);
+
+	from = talloc_asprintf(talloc_tos(), "%s/%s/Local_Recreate",
+			       local_path, SSC_DIR);
+	to = talloc_asprintf(talloc_tos(), "%s/%s/local_RECREATE",
+			     local_path, SSC_DIR);
+	if ((from == NULL) || (to == NULL)) {
+		goto fail;
+	}
+	if (unlink(from) != 0) {
+		printf("unlink(%s) failed: %s\n", from, strerror(errno));
+		goto fail;
+	}
+	fd = open(to, O_RDWR|O_CREAT|O_EXCL, 0644);
+	if (fd == -1) {
+		printf("open(%s) failed: %s\n", to, strerror(errno));
+		goto fail;
+	}
+	if (write(fd, "123456789", 9) != 9) {
+		printf("write(%s) failed: %s\n", to, strerror(errno));
+		close(fd);
+		goto fail;
+	}
+	close(fd);
+
+	ret = true;
+fail:
+	TALLOC_FREE(from);
+	TALLOC_FREE(to);
+	return ret;
+}
+
+static void ssc_cleanup(struct cli_state *cli)
+{
+	cli_unlink(cli, SSC_DIR "\\dir\\*",
+		   FILE_ATTRIBUTE_SYSTEM|FILE_ATTRIBUTE_HIDDEN);
+	cli_rmdir(cli, SSC_DIR "\\dir");
+	cli_unlink(cli, SSC_DIR "\\*",
+		   FILE_ATTRIBUTE_SYSTEM|FILE_ATTRIBUTE_HIDDEN);
+	cli_rmdir(cli, SSC_DIR);
+}
+
+bool run_shared_stat_cache(int dummy)
+{
+	struct cli_state *cli1 = NULL;
+	struct cli_state *cli2 = NULL;
+	struct cli_state *cli3 = NULL;
+	NTSTATUS status;
+	bool ret = false;
+
+	printf("Starting SHARED-STAT-CACHE\n");
+
+	if (!torture_open_connection(&cli1, 0) ||
+	    !torture_open_connection(&cli2, 1)) {
+		goto fail;
+	}
+
+	ssc_cleanup(cli1);
+
+	status = cli_mkdir(cli1, SSC_DIR);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	status = cli_mkdir(cli1, SSC_DIR "\\Dir");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	if (!NT_STATUS_IS_OK(ssc_create(cli2, SSC_DIR "\\Rename_Me", 1)) ||
+	    !NT_STATUS_IS_OK(ssc_create(cli2, SSC_DIR "\\Delete_Me", 2)) ||
+	    !NT_STATUS_IS_OK(ssc_create(cli2, SSC_DIR "\\Recreate_Me", 3)) ||
+	    !NT_STATUS_IS_OK(ssc_create(cli2, SSC_DIR "\\Dir\\File", 4))) {
+		goto fail;
+	}
+
+	/*
+	 * Translate the names through the first connection. Its smbd has
+	 * not seen them yet, only a full lookup puts them into the shared
+	 * table.
+	 */
+	if (!ssc_expect(cli1, SSC_DIR "\\RENAME_ME", 1) ||
+	    !ssc_expect(cli1, SSC_DIR "\\DELETE_ME", 2) ||
+	    !ssc_expect(cli1, SSC_DIR "\\RECREATE_ME", 3) ||
+	    !ssc_expect(cli1, SSC_DIR "\\DIR\\FILE", 4)) {
+		goto fail;
+	}
+
+	printf("Changing the names through the second connection\n");
+
+	status = cli_rename(cli2, SSC_DIR "\\Rename_Me", SSC_DIR "\\Renamed");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("rename failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_unlink(cli2, SSC_DIR "\\Delete_Me", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("unlink failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	/*
+	 * Same name in a different case, and a different file behind it
+	 */
+	status = cli_unlink(cli2, SSC_DIR "\\Recreate_Me", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("unlink failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	if (!NT_STATUS_IS_OK(ssc_create(cli2, SSC_DIR "\\recreate_ME", 5))) {
+		goto fail;
+	}
+
+	/*
+	 * The directory goes away and comes back in a different case
+	 */
+	status = cli_unlink(cli2, SSC_DIR "\\Dir\\File", 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("unlink failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	status = cli_rmdir(cli2, SSC_DIR "\\Dir");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("rmdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	status = cli_mkdir(cli2, SSC_DIR "\\dir");
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir failed: %s\n", nt_errstr(status));
+		goto fail;
+	}
+	if (!NT_STATUS_IS_OK(ssc_create(cli2, SSC_DIR "\\dir\\file", 6))) {
+		goto fail;
+	}
+
+	printf("Looking up the names through a third connection\n");
+
+	if (!torture_open_connection(&cli3, 2)) {
+		goto fail;
+	}
+
+	if (!ssc_expect(cli3, SSC_DIR "\\RENAME_ME", -1) ||
+	    !ssc_expect(cli3, SSC_DIR "\\RENAMED", 1) ||
+	    !ssc_expect(cli3, SSC_DIR "\\DELETE_ME", -1) ||
+	    !ssc_expect(cli3, SSC_DIR "\\RECREATE_ME", 5) ||
+	    !ssc_expect(cli3, SSC_DIR "\\DIR\\FILE", 6)) {
+		goto fail;
+	}
+
+	printf("Looking up the names through the first connection\n");
+
+	if (!ssc_expect(cli1, SSC_DIR "\\RENAME_ME", -1) ||
+	    !ssc_expect(cli1, SSC_DIR "\\DELETE_ME", -1) ||
+	    !ssc_expect(cli1, SSC_DIR "\\RECREATE_ME", 5) ||
+	    !ssc_expect(cli1, SSC_DIR "\\DIR\\FILE", 6)) {
+		goto fail;
+	}
+
+	if (local_path == NULL) {
+		printf("No local path given, not changing files locally\n");
+		ret = true;
+		goto fail;
+	}
+
+	printf("Changing the names locally\n");
+
+	if (!NT_STATUS_IS_OK(ssc_create(cli2, SSC_DIR "\\Local_Rename", 7)) ||
+	    !NT_STATUS_IS_OK(ssc_create(cli2, SSC_DIR "\\Local_Recreate",
+					8)) ||
+	    !ssc_expect(cli1, SSC_DIR "\\LOCAL_RENAME", 7) ||
+	    !ssc_expect(cli1, SSC_DIR "\\LOCAL_RECREATE", 8)) {
+		goto fail;
+	}
+
+	if (!ssc_local_changes()) {
+		goto fail;
+	}
+
+	if (!ssc_expect(cli3, SSC_DIR "\\LOCAL_RENAME", -1) ||
+	    !ssc_expect(cli3, SSC_DIR "\\LOCAL_RENAMED", 7) ||
+	    !ssc_expect(cli3, SSC_DIR "\\LOCAL_RECREATE", 9)) {
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	if (cli1 != NULL) {
+		ssc_cleanup(cli1);
+		torture_close_connection(cli1);
+	}
+	if (cli2 != NULL) {
+		torture_close_connection(cli2);
+	}
+	if (cli3 != NULL) {
+		torture_close_connection(cli3);
+	}
+	return ret;
+}
@@ -64,7 +64,7 @@ static bool force_dos_errors;
 static fstring multishare_conn_fname;
 static bool use_multishare_conn = False;
 static bool do_encrypt;
-static const char *local_path = NULL;
+const char *local_path = NULL;
 static enum smb_signing_setting signing_state = SMB_SIGNING_DEFAULT;
 char *test_filename;
 
@@ -6058,6 +6058,89 @@ static bool run_dirtest(int dummy)
 	return correct;
 }
 
+/*
+ * Creating files in a huge directory on a case-insensitive share: Every
+ * new name misses the initial stat in unix_convert. Then look up all
+ * names in a different case.
+ */
+
+static bool run_bigdir_bench(int dummy)
+{
+	struct cli_state *cli;
+	const char *dname = "\\bigdir.dir";
+	struct timeval start;
+	double seconds;
+	NTSTATUS status;
+	bool ret = false;
+	uint16_t fnum;
+	int i;
+
+	printf("starting bigdir_bench test\n");
+
+	if (!torture_open_connection(&cli, 0)) {
+		return false;
+	}
+
+	cli_rmdir(cli, dname);
+	status = cli_mkdir(cli, dname);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("mkdir %s failed (%s)\n", dname, nt_errstr(status));
+		goto fail;
+	}
+
+	start = timeval_current();
+
+	for (i=0; i<torture_numops; i++) {
+		fstring fname;
+
+		slprintf(fname, sizeof(fname), "%s\\File%08d", dname, i);
+		status = cli_openx(cli, fname, O_RDWR|O_CREAT|O_EXCL,
+				   DENY_NONE, &fnum);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("create of %s failed (%s)\n", fname,
+			       nt_errstr(status));
+			goto fail;
+		}
+		cli_close(cli, fnum);
+	}
+
+	seconds = timeval_elapsed(&start);
+	printf("%d creates in %.2f seconds: %d creates/sec\n",
+	       torture_numops, seconds, (int)(torture_numops / seconds));
+
+	start = timeval_current();
+
+	for (i=0; i<torture_numops; i++) {
+		fstring fname;
+
+		slprintf(fname, sizeof(fname), "%s\\FILE%08d", dname, i);
+		status = cli_getatr(cli, fname, NULL, NULL, NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("getatr of %s failed (%s)\n", fname,
+			       nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	seconds = timeval_elapsed(&start);
+	printf("%d case-insensitive lookups in %.2f seconds: "
+	       "%d lookups/sec\n", torture_numops, seconds,
+	       (int)(torture_numops / seconds));
+
+	ret = true;
+fail:
+	for (i=0; i<torture_numops; i++) {
+		fstring fname;
+
+		slprintf(fname, sizeof(fname), "%s\\File%08d", dname, i);
+		cli_unlink(cli, fname,
+			   FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	}
+	cli_rmdir(cli, dname);
+	torture_close_connection(cli);
+	return ret;
+}
+
 static NTSTATUS del_fn(const char *mnt, struct file_info *finfo, const char *mask,
 		   void *state)
 {
@@ -6610,6 +6693,88 @@ static bool run_sesssetup_bench(int dummy)
 	return true;
 }
 
+/*
+ * Open/close loop against a file that already has a large number of
+ * opens. Every iteration adds and removes one entry to a share mode
+ * record carrying OPEN_CLOSE_BENCH_HANDLES entries, so this measures
+ * the locking.tdb fetch/parse/store cost per open.
+ */
+
+#define OPEN_CLOSE_BENCH_HANDLES 500
+
+static bool run_open_close_bench(int dummy)
+{
+	struct cli_state *cli;
+	const char *fname = "\\open_close_bench.dat";
+	uint16_t fnums[OPEN_CLOSE_BENCH_HANDLES];
+	int num_open = 0;
+	struct timeval start;
+	double seconds;
+	NTSTATUS status;
+	bool ret = false;
+	int i;
+
+	printf("starting open_close_bench test\n");
+
+	if (!torture_open_connection(&cli, 0)) {
+		return false;
+	}
+
+	cli_setatr(cli, fname, 0, 0);
+	cli_unlink(cli, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+
+	for (i=0; i<OPEN_CLOSE_BENCH_HANDLES; i++) {
+		status = cli_ntcreate(
+			cli, fname, 0, FILE_READ_DATA|FILE_WRITE_DATA,
+			FILE_ATTRIBUTE_NORMAL,
+			FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+			FILE_OPEN_IF, 0, 0, &fnums[i], NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("open %d of %s failed: %s\n", i, fname,
+			       nt_errstr(status));
+			goto fail;
+		}
+		num_open += 1;
+	}
+
+	start = timeval_current();
+
+	for (i=0; i<torture_numops; i++) {
+		uint16_t fnum;
+
+		status = cli_ntcreate(
+			cli, fname, 0, FILE_READ_DATA,
+			FILE_ATTRIBUTE_NORMAL,
+			FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+			FILE_OPEN, 0, 0, &fnum, NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("open of %s failed: %s\n", fname,
+			       nt_errstr(status));
+			goto fail;
+		}
+		status = cli_close(cli, fnum);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("close failed: %s\n", nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	seconds = timeval_elapsed(&start);
+
+	printf("%d open/close pairs with %d concurrent opens in %.2f seconds: "
+	       "%d ops/sec\n", torture_numops, num_open, seconds,
+	       (int)(torture_numops / seconds));
+
+	ret = true;
+fail:
+	for (i=0; i<num_open; i++) {
+		cli_close(cli, fnums[i]);
+	}
+	cli_unlink(cli, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	torture_close_connection(cli);
+	return ret;
+}
+
 static bool subst_test(const char *str, const char *user, const char *domain,
 		       uid_t uid, gid_t gid, const char *expected)
 {
@@ -7237,6 +7402,556 @@ static size_t null_source(uint8_t *buf, size_t n, void *priv)
 	return thistime;
 }
 
+/*
+ * Strict locking check cost: one handle holds LOCK_BENCH_LOCKS small
+ * byte range locks, a second connection reads in between them.
+ */
+
+#define LOCK_BENCH_LOCKS 2000
+
+static bool run_lock_bench(int dummy)
+{
+	struct cli_state *cli1, *cli2;
+	const char *fname = "\\lockbench.dat";
+	uint16_t fnum1 = (uint16_t)-1;
+	uint16_t fnum2 = (uint16_t)-1;
+	struct timeval start;
+	double seconds;
+	uint8_t c = 0;
+	NTSTATUS status;
+	bool ret = false;
+	int i;
+
+	printf("starting lock_bench test\n");
+
+	if (!torture_open_connection(&cli1, 0) ||
+	    !torture_open_connection(&cli2, 1)) {
+		return false;
+	}
+
+	cli_unlink(cli1, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+
+	status = cli_openx(cli1, fname, O_RDWR|O_CREAT|O_EXCL, DENY_NONE,
+			   &fnum1);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("open of %s failed (%s)\n", fname, nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_writeall(cli1, fnum1, 0, &c, LOCK_BENCH_LOCKS * 2, 1,
+			      NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("write failed (%s)\n", nt_errstr(status));
+		goto fail;
+	}
+
+	for (i=0; i<LOCK_BENCH_LOCKS; i++) {
+		status = cli_lock64(cli1, fnum1, i * 2, 1, 0, WRITE_LOCK);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("lock %d failed (%s)\n", i, nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	status = cli_openx(cli2, fname, O_RDWR, DENY_NONE, &fnum2);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("open2 of %s failed (%s)\n", fname, nt_errstr(status));
+		goto fail;
+	}
+
+	start = timeval_current();
+
+	for (i=0; i<torture_numops; i++) {
+		off_t ofs = (i % LOCK_BENCH_LOCKS) * 2 + 1;
+		size_t nread;
+
+		status = cli_read(cli2, fnum2, (char *)&c, ofs, 1, &nread);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("read at %jd failed (%s)\n", (intmax_t)ofs,
+			       nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	seconds = timeval_elapsed(&start);
+
+	printf("%d reads against %d locks in %.2f seconds: %d reads/sec\n",
+	       torture_numops, LOCK_BENCH_LOCKS, seconds,
+	       (int)(torture_numops / seconds));
+
+	ret = true;
+fail:
+	if (fnum2 != (uint16_t)-1) {
+		cli_close(cli2, fnum2);
+	}
+	if (fnum1 != (uint16_t)-1) {
+		cli_close(cli1, fnum1);
+	}
+	cli_unlink(cli1, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	torture_close_connection(cli1);
+	torture_close_connection(cli2);
+	return ret;
+}
+
+/*
+ * Strict locking checks against a record with many locks go through an
+ * index, see brl_locktest_indexed(). The first I/O after brlock.tdb
+ * changed is still checked by the linear loop, the second one with the
+ * index. Compare both with lock requests, which always walk all locks,
+ * and with what the Windows lock rules say.
+ *
+ * Run this against a share with "posix locking = no", otherwise the
+ * fcntl locks behind the small locks hide wrong answers from brlock.
+ */
+
+struct lock_index_range {
+	uint64_t start;
+	uint64_t size;
+	enum brl_type type;
+};
+
+static bool lock_index_overlap(const struct lock_index_range *l1,
+			       const struct lock_index_range *l2)
+{
+	/* Same rules as brl_overlap() */
+
+	if ((l1->size != 0) &&
+	    (l1->start == l2->start) &&
+	    (l1->size == l2->size)) {
+		return true;
+	}
+	if ((l1->start >= l2->start + l2->size) ||
+	    (l2->start >= l1->start + l1->size)) {
+		return false;
+	}
+	return true;
+}
+
+static bool lock_index_expect_conflict(const struct lock_index_range *held,
+				       size_t num_held,
+				       const struct lock_index_range *probe)
+{
+	size_t i;
+
+	for (i=0; i<num_held; i++) {
+		if ((held[i].type == READ_LOCK) &&
+		    (probe->type == READ_LOCK)) {
+			continue;
+		}
+		if (lock_index_overlap(&held[i], probe)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static NTSTATUS lock_index_io(struct cli_state *cli, uint16_t fnum,
+			      const struct lock_index_range *probe)
+{
+	uint8_t buf[64] = { 0 };
+	size_t nread;
+
+	if (probe->type == READ_LOCK) {
+		return cli_read(cli, fnum, (char *)buf, probe->start,
+				probe->size, &nread);
+	}
+	return cli_writeall(cli, fnum, 0, buf, probe->start, probe->size,
+			    NULL);
+}
+
+static bool lock_index_check(const char *what,
+			     const struct lock_index_range *probe,
+			     bool expected, NTSTATUS status)
+{
+	bool conflict;
+
+	if (NT_STATUS_EQUAL(status, NT_STATUS_FILE_LOCK_CONFLICT) ||
+	    NT_STATUS_EQUAL(status, NT_STATUS_LOCK_NOT_GRANTED)) {
+		conflict = true;
+	} else if (NT_STATUS_IS_OK(status)) {
+		conflict = false;
+	} else {
+		printf("%s %s at %ju/%ju failed: %s\n", what,
+		       probe->type == READ_LOCK ? "read" : "write",
+		       (uintmax_t)probe->start, (uintmax_t)probe->size,
+		       nt_errstr(status));
+		return false;
+	}
+
+	if (conflict != expected) {
+		printf("%s %s at %ju/%ju: expected %s, got %s\n", what,
+		       probe->type == READ_LOCK ? "read" : "write",
+		       (uintmax_t)probe->start, (uintmax_t)probe->size,
+		       expected ? "conflict" : "no conflict",
+		       nt_errstr(status));
+		return false;
+	}
+	return true;
+}
+
+#define LOCK_INDEX_LOCKS 40
+
+static bool run_lock_index(int dummy)
+{
+	struct cli_state *cli1, *cli2;
+	const char *fname = "\\lockindex.dat";
+	const char *fname_bump = "\\lockindex_bump.dat";
+	uint16_t fnum1 = (uint16_t)-1;
+	uint16_t fnum2 = (uint16_t)-1;
+	uint16_t fnum_bump = (uint16_t)-1;
+	struct lock_index_range held[LOCK_INDEX_LOCKS + 5];
+	struct lock_index_range *probes = NULL;
+	size_t num_held = 0;
+	size_t num_probes = 0;
+	static const uint64_t sizes[] = { 0, 1, 2, 4, 13 };
+	static const enum brl_type types[] = { READ_LOCK, WRITE_LOCK };
+	static const struct lock_index_range far[] = {
+		{ 0, UINT64_MAX }, { 0x7FFFFFFFFFFFFFFF, 2 },
+		{ UINT64_MAX - 1, 1 }, { 0x8000000000000000, 0 },
+		{ UINT64_MAX - 0xFF, 0x100 }, { UINT64_MAX, 1 },
+		{ 0x8000000000000000, 1 }, { UINT64_MAX - 1, 2 },
+		{ UINT64_MAX, 0 },
+	};
+	NTSTATUS status;
+	bool ret = false;
+	size_t i, j, k, t;
+
+	printf("starting lock_index test\n");
+
+	if (!torture_open_connection(&cli1, 0) ||
+	    !torture_open_connection(&cli2, 1)) {
+		return false;
+	}
+
+	cli_unlink(cli1, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	cli_unlink(cli1, fname_bump,
+		   FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+
+	status = cli_openx(cli1, fname, O_RDWR|O_CREAT|O_EXCL, DENY_NONE,
+			   &fnum1);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("open of %s failed (%s)\n", fname, nt_errstr(status));
+		goto fail;
+	}
+	status = cli_openx(cli1, fname_bump, O_RDWR|O_CREAT|O_EXCL,
+			   DENY_NONE, &fnum_bump);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("open of %s failed (%s)\n", fname_bump,
+		       nt_errstr(status));
+		goto fail;
+	}
+
+	/*
+	 * Small locks with gaps in between, a few of them shared, two
+	 * zero-size locks and two reaching up to 2^64. The write lock at
+	 * UINT64_MAX has to come before the read lock covering it. Those
+	 * two are above 2^63, so smbd does not map them to POSIX locks,
+	 * which would follow different overlap rules.
+	 */
+
+	for (i=0; i<LOCK_INDEX_LOCKS; i++) {
+		held[num_held++] = (struct lock_index_range) {
+			.start = i * 16, .size = 4,
+			.type = (i % 4 == 3) ? READ_LOCK : WRITE_LOCK
+		};
+	}
+	held[num_held++] = (struct lock_index_range) {
+		.start = 700, .size = 0, .type = WRITE_LOCK };
+	held[num_held++] = (struct lock_index_range) {
+		.start = 710, .size = 0, .type = WRITE_LOCK };
+	held[num_held++] = (struct lock_index_range) {
+		.start = 720, .size = 8, .type = READ_LOCK };
+	held[num_held++] = (struct lock_index_range) {
+		.start = UINT64_MAX, .size = 1, .type = WRITE_LOCK };
+	held[num_held++] = (struct lock_index_range) {
+		.start = 0x8000000000000000, .size = 0x8000000000000000,
+		.type = READ_LOCK };
+
+	for (i=0; i<num_held; i++) {
+		status = cli_lock64(cli1, fnum1, held[i].start, held[i].size,
+				    0, held[i].type);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("lock %ju/%ju failed (%s)\n",
+			       (uintmax_t)held[i].start,
+			       (uintmax_t)held[i].size, nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	/*
+	 * Probe around both ends of all small locks. A lock request
+	 * failing at the same offset as the previous one is retried for
+	 * "lock spin time", so never probe one offset twice in a row.
+	 */
+
+	probes = talloc_array(talloc_tos(), struct lock_index_range,
+			      (num_held * 5 * ARRAY_SIZE(sizes) +
+			       ARRAY_SIZE(far)) * ARRAY_SIZE(types));
+	if (probes == NULL) {
+		printf("talloc failed\n");
+		goto fail;
+	}
+
+	for (t=0; t<ARRAY_SIZE(types); t++) {
+		for (k=0; k<ARRAY_SIZE(sizes); k++) {
+			for (i=0; i<num_held; i++) {
+				const struct lock_index_range *h = &held[i];
+				uint64_t starts[5];
+				size_t num_starts = 0;
+
+				if (h->start >= 0x8000000000000000) {
+					continue;
+				}
+				if (h->start > 0) {
+					starts[num_starts++] = h->start - 1;
+				}
+				starts[num_starts++] = h->start;
+				starts[num_starts++] = h->start + 1;
+				if (h->size > 1) {
+					starts[num_starts++] =
+						h->start + h->size - 1;
+				}
+				if (h->size > 0) {
+					starts[num_starts++] =
+						h->start + h->size;
+				}
+
+				for (j=0; j<num_starts; j++) {
+					probes[num_probes++] =
+						(struct lock_index_range) {
+						.start = starts[j],
+						.size = sizes[k],
+						.type = types[t] };
+				}
+			}
+		}
+		for (i=0; i<ARRAY_SIZE(far); i++) {
+			probes[num_probes] = far[i];
+			probes[num_probes++].type = types[t];
+		}
+	}
+
+	status = cli_openx(cli2, fname, O_RDWR, DENY_NONE, &fnum2);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("open2 of %s failed (%s)\n", fname, nt_errstr(status));
+		goto fail;
+	}
+
+	for (i=0; i<num_probes; i++) {
+		const struct lock_index_range *p = &probes[i];
+		bool expected = lock_index_expect_conflict(held, num_held, p);
+
+		/*
+		 * Zero-size I/O is never checked
+		 */
+		if ((p->size > 0) && (p->start < 0x10000) &&
+		    (p->size <= 0x20)) {
+			/*
+			 * Changing any record in brlock.tdb makes smbd
+			 * re-read the record for the next I/O
+			 */
+			status = cli_lock64(cli1, fnum_bump, 0, 1, 0,
+					    WRITE_LOCK);
+			if (NT_STATUS_IS_OK(status)) {
+				status = cli_unlock64(cli1, fnum_bump, 0, 1);
+			}
+			if (!NT_STATUS_IS_OK(status)) {
+				printf("lock/unlock of %s failed (%s)\n",
+				       fname_bump, nt_errstr(status));
+				goto fail;
+			}
+
+			status = lock_index_io(cli2, fnum2, p);
+			if (!lock_index_check("linear", p, expected,
+					      status)) {
+				goto fail;
+			}
+			status = lock_index_io(cli2, fnum2, p);
+			if (!lock_index_check("indexed", p, expected,
+					      status)) {
+				goto fail;
+			}
+		}
+
+		status = cli_lock64(cli2, fnum2, p->start, p->size, 0,
+				    p->type);
+		if (!lock_index_check("lock", p, expected, status)) {
+			goto fail;
+		}
+		if (NT_STATUS_IS_OK(status)) {
+			status = cli_unlock64(cli2, fnum2, p->start, p->size);
+			if (!NT_STATUS_IS_OK(status)) {
+				printf("unlock %ju/%ju failed (%s)\n",
+				       (uintmax_t)p->start,
+				       (uintmax_t)p->size, nt_errstr(status));
+				goto fail;
+			}
+		}
+	}
+
+	printf("%zu probes against %zu locks ok\n", num_probes, num_held);
+
+	ret = true;
+fail:
+	TALLOC_FREE(probes);
+	if (fnum2 != (uint16_t)-1) {
+		cli_close(cli2, fnum2);
+	}
+	if (fnum_bump != (uint16_t)-1) {
+		cli_close(cli1, fnum_bump);
+	}
+	if (fnum1 != (uint16_t)-1) {
+		cli_close(cli1, fnum1);
+	}
+	cli_unlink(cli1, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	cli_unlink(cli1, fname_bump,
+		   FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	torture_close_connection(cli1);
+	torture_close_connection(cli2);
+	return ret;
+}
+
+/*
+ * Open fname with FILE_READ_EA only and check the result against
+ * what the access check, cached or not, has to return. This is a stat
+ * open, so only the access check and not open(2) can deny it.
+ */
+static bool access_check_cache_open(struct cli_state *cli, const char *fname,
+				    NTSTATUS expected, const char *what)
+{
+	uint16_t fnum;
+	NTSTATUS status;
+
+	status = cli_ntcreate(cli, fname, 0, FILE_READ_EA,
+			      FILE_ATTRIBUTE_NORMAL,
+			      FILE_SHARE_READ|FILE_SHARE_WRITE|
+			      FILE_SHARE_DELETE,
+			      FILE_OPEN, 0, 0, &fnum, NULL);
+	if (NT_STATUS_IS_OK(status)) {
+		cli_close(cli, fnum);
+	}
+	if (!NT_STATUS_EQUAL(status, expected)) {
+		printf("%s: open returned %s, expected %s\n", what,
+		       nt_errstr(status), nt_errstr(expected));
+		return false;
+	}
+	return true;
+}
+
+/*
+ * smbd does not cache results for files changed within the last
+ * second. Wait, then open twice so that the second open is answered
+ * from the cache.
+ */
+static bool access_check_cache_fill(struct cli_state *cli, const char *fname)
+{
+	sleep(2);
+
+	return access_check_cache_open(cli, fname, NT_STATUS_OK,
+				       "uncached open") &&
+		access_check_cache_open(cli, fname, NT_STATUS_OK,
+					"cached open");
+}
+
+/*
+ * "smbd:access check cache" must never grant an open that the
+ * underlying access check denies. The share has to have the option
+ * set and must not store the ACLs in a tdb, so that every permission
+ * change bumps the ctime. Needs a non-root user, root bypasses the
+ * check.
+ */
+static bool run_access_check_cache(int dummy)
+{
+	struct cli_state *cli1, *cli2;
+	const char *fname = "\\accesscache.dat";
+	const char *posix_fname = "accesscache.dat";
+	char *local_fname = NULL;
+	uint16_t fnum;
+	NTSTATUS status;
+	bool ret = false;
+
+	printf("starting access check cache test\n");
+
+	if (!torture_open_connection(&cli1, 0) ||
+	    !torture_open_connection(&cli2, 1)) {
+		return false;
+	}
+
+	status = torture_setup_unix_extensions(cli2);
+	if (!NT_STATUS_IS_OK(status)) {
+		goto fail;
+	}
+
+	cli_unlink(cli1, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+
+	status = cli_openx(cli1, fname, O_RDWR|O_CREAT|O_EXCL, DENY_NONE,
+			   &fnum);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("create of %s failed (%s)\n", fname, nt_errstr(status));
+		goto fail;
+	}
+	cli_close(cli1, fnum);
+
+	status = cli_posix_chmod(cli2, posix_fname, 0644);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_posix_chmod failed (%s)\n", nt_errstr(status));
+		goto fail;
+	}
+
+	if (!access_check_cache_fill(cli1, fname)) {
+		goto fail;
+	}
+
+	status = cli_posix_chmod(cli2, posix_fname, 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_posix_chmod failed (%s)\n", nt_errstr(status));
+		goto fail;
+	}
+
+	if (!access_check_cache_open(cli1, fname, NT_STATUS_ACCESS_DENIED,
+				     "open after remote chmod")) {
+		goto fail;
+	}
+
+	status = cli_posix_chmod(cli2, posix_fname, 0644);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_posix_chmod failed (%s)\n", nt_errstr(status));
+		goto fail;
+	}
+
+	if (local_path == NULL) {
+		printf("no local path given via -l, skipping local chmod\n");
+		ret = true;
+		goto fail;
+	}
+
+	local_fname = talloc_asprintf(talloc_tos(), "%s/%s", local_path,
+				      posix_fname);
+	if (local_fname == NULL) {
+		goto fail;
+	}
+
+	if (!access_check_cache_fill(cli1, fname)) {
+		goto fail;
+	}
+
+	if (chmod(local_fname, 0) != 0) {
+		printf("chmod(%s) failed: %s\n", local_fname, strerror(errno));
+		goto fail;
+	}
+
+	ret = access_check_cache_open(cli1, fname, NT_STATUS_ACCESS_DENIED,
+				      "open after local chmod");
+
+	chmod(local_fname, 0644);
+fail:
+	TALLOC_FREE(local_fname);
+	cli_unlink(cli1, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	torture_close_connection(cli1);
+	torture_close_connection(cli2);
+	return ret;
+}
+
 static bool run_windows_write(int dummy)
 {
 	struct cli_state *cli1;
@@ -8535,6 +9250,161 @@ failed:
 	return false;
 }
 
+/*
+  compare the prepared wildcard matcher against ms_fnmatch()
+ */
+static bool check_ms_fnmatch_compiled(const char *pattern, const char *name)
+{
+	int t, cs;
+
+	for (t=0; t<2; t++) {
+		for (cs=0; cs<2; cs++) {
+			struct ms_fnmatch_pattern *pat;
+			int expected, got;
+
+			pat = ms_fnmatch_compile(talloc_tos(), pattern,
+						 t, cs);
+			if (pat == NULL) {
+				d_fprintf(stderr, "ms_fnmatch_compile(%s) "
+					  "failed\n", pattern);
+				return false;
+			}
+			expected = ms_fnmatch(pattern, name, t, cs);
+			got = ms_fnmatch_compiled(pat, name);
+			TALLOC_FREE(pat);
+
+			if ((expected == 0) != (got == 0)) {
+				d_fprintf(stderr, "pattern [%s] name [%s] "
+					  "translate=%d case_sensitive=%d: "
+					  "expected %d got %d\n",
+					  pattern, name, t, cs,
+					  expected, got);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool run_local_ms_fnmatch(int dummy)
+{
+	static const char *patterns[] = {
+		"*", "*.*", "*.docx", "abc*", "ABC*", "a*c", "*.", "a.*",
+		"?", "a?c", "<.txt", "a>", "\"*", "*.TxT", "..", ".",
+		"M\303\244*", "*\303\244rz", "a**b", "",
+	};
+	static const char *names[] = {
+		"abc", "ABC", "abc.docx", "ABC.DOCX", "a.docx.b", ".docx",
+		"..", ".", "a", "ac", "abbbc", "file.txt", "M\303\244rz",
+		"M\303\204RZ", "m\303\244rz.docx", "averylongfilename.docx",
+		"aVeryLongFileName.DocX", "ab", "",
+	};
+	const char maskchars[] = "<>\"?*abcABC.";
+	const char filechars[] = "abcdefghijklmABC.";
+	char pattern[16], name[20];
+	int i, j;
+
+	for (i=0; i<ARRAY_SIZE(patterns); i++) {
+		for (j=0; j<ARRAY_SIZE(names); j++) {
+			if (!check_ms_fnmatch_compiled(patterns[i],
+						       names[j])) {
+				return false;
+			}
+		}
+	}
+
+	/*
+	 * random() is seeded in main(), use -s to repeat a failure
+	 */
+
+	for (i=0; i<20000; i++) {
+		int plen = random() % (sizeof(pattern) - 1);
+		int nlen = 1 + random() % (sizeof(name) - 2);
+
+		for (j=0; j<plen; j++) {
+			pattern[j] = maskchars[random() % (sizeof(maskchars)-1)];
+		}
+		pattern[plen] = '\0';
+		for (j=0; j<nlen; j++) {
+			name[j] = filechars[random() % (sizeof(filechars)-1)];
+		}
+		name[nlen] = '\0';
+
+		if (!check_ms_fnmatch_compiled(pattern, name)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+  strupper_m()/strlower_m() against toupper_m()/tolower_m() of every
+  character, strcasecmp_m() of the results
+ */
+static bool run_local_string_case(int dummy)
+{
+	static const char *pieces[] = {
+		"a", "Z", "m", "Q", "0", ".", " ", "_", "@", "[", "`", "{",
+		"\303\244", "\303\204", "\303\237", "\346\226\207",
+	};
+	int i;
+
+	/*
+	 * random() is seeded in main(), use -s to repeat a failure
+	 */
+
+	for (i=0; i<10000; i++) {
+		char str[256], upper[256], lower[256];
+		char ref_upper[256], ref_lower[256];
+		size_t len = 0, ulen = 0, llen = 0;
+		int j, num = random() % 40;
+
+		for (j=0; j<num; j++) {
+			const char *p = pieces[random() % ARRAY_SIZE(pieces)];
+			codepoint_t c;
+			size_t size;
+
+			memcpy(str + len, p, strlen(p));
+			len += strlen(p);
+
+			c = next_codepoint(p, &size);
+			ulen += push_codepoint(ref_upper + ulen, toupper_m(c));
+			llen += push_codepoint(ref_lower + llen, tolower_m(c));
+		}
+		str[len] = '\0';
+		ref_upper[ulen] = '\0';
+		ref_lower[llen] = '\0';
+
+		strlcpy(upper, str, sizeof(upper));
+		strlcpy(lower, str, sizeof(lower));
+
+		if (!strupper_m(upper) || !strlower_m(lower)) {
+			d_fprintf(stderr, "changing case of [%s] failed\n",
+				  str);
+			return false;
+		}
+		if (strcmp(upper, ref_upper) != 0) {
+			d_fprintf(stderr, "strupper_m(%s) gave [%s], "
+				  "expected [%s]\n", str, upper, ref_upper);
+			return false;
+		}
+		if (strcmp(lower, ref_lower) != 0) {
+			d_fprintf(stderr, "strlower_m(%s) gave [%s], "
+				  "expected [%s]\n", str, lower, ref_lower);
+			return false;
+		}
+		if ((strcasecmp_m(str, upper) != 0) ||
+		    (strcasecmp_m(lower, upper) != 0) ||
+		    (strncasecmp_m(str, lower, num) != 0)) {
+			d_fprintf(stderr, "[%s] [%s] [%s] do not compare "
+				  "equal\n", str, upper, lower);
+			return false;
+		}
+	}
+
+	return true;
+}
 
 struct talloc_dict_test {
 	int content;
@@ -9615,6 +10485,9 @@ static struct {
 	{"LOCK7",  run_locktest7,  0},
 	{"LOCK8",  run_locktest8,  0},
 	{"LOCK9",  run_locktest9,  0},
+	{"LOCK-BENCH",  run_lock_bench,  0},
+	{"LOCK-INDEX",  run_lock_index,  0},
+	{"ACCESS-CHECK-CACHE", run_access_check_cache, 0},
 	{"UNLINK", run_unlinktest, 0},
 	{"BROWSE", run_browsetest, 0},
 	{"ATTR",   run_attrtest,   0},
@@ -9629,6 +10502,7 @@ static struct {
 	{"OPLOCK2",  run_oplock2, 0},
 	{"OPLOCK4",  run_oplock4, 0},
 	{"DIR",  run_dirtest, 0},
+	{"BIGDIR-BENCH",  run_bigdir_bench, 0},
 	{"DIR1",  run_dirtest1, 0},
 	{"DIR-CREATETIME",  run_dir_createtime, 0},
 	{"DENY1",  torture_denytest1, 0},
@@ -9658,6 +10532,7 @@ static struct {
 	{"PROPERTIES", run_properties, 0},
 	{"MANGLE", torture_mangle, 0},
 	{"MANGLE1", run_mangle1, 0},
+	{"MANGLE-BENCH", torture_mangle_bench, 0},
 	{"W2K", run_w2ktest, 0},
 	{"TRANS2SCAN", torture_trans2_scan, 0},
 	{"NTTRANSSCAN", torture_nttrans_scan, 0},
@@ -9671,6 +10546,7 @@ static struct {
 	{"FDSESS", run_fdsesstest, 0},
 	{ "EATEST", run_eatest, 0},
 	{ "SESSSETUP_BENCH", run_sesssetup_bench, 0},
+	{ "OPEN-CLOSE-BENCH", run_open_close_bench, 0},
 	{ "CHAIN1", run_chain1, 0},
 	{ "CHAIN2", run_chain2, 0},
 	{ "CHAIN3", run_chain3, 0},
@@ -9699,6 +10575,11 @@ static struct {
 	{ "CLEANUP3", run_cleanup3 },
 	{ "CLEANUP4", run_cleanup4 },
 	{ "OPLOCK-CANCEL", run_oplock_cancel },
+	{ "DIRPREFETCH", run_dirprefetch, 0 },
+	{ "DIR-SNAPSHOT", run_dir_snapshot, 0 },
+	{ "DIR-INDEX", run_dir_index, 0 },
+	{ "SHARED-STAT-CACHE", run_shared_stat_cache, 0 },
+	{ "DOSMODE-CACHE", run_dosmode_cache, 0 },
 	{ "LOCAL-SUBSTITUTE", run_local_substitute, 0},
 	{ "LOCAL-GENCACHE", run_local_gencache, 0},
 	{ "LOCAL-TALLOC-DICT", run_local_talloc_dict, 0},
@@ -9711,6 +10592,8 @@ static struct {
 	{ "LOCAL-MESSAGING-FDPASS2", run_messaging_fdpass2, 0 },
 	{ "LOCAL-MESSAGING-FDPASS2a", run_messaging_fdpass2a, 0 },
 	{ "LOCAL-MESSAGING-FDPASS2b", run_messaging_fdpass2b, 0 },
+	{ "LOCAL-MESSAGING-RING1", run_messaging_ring1, 0 },
+	{ "LOCAL-MESSAGING-RING2", run_messaging_ring2, 0 },
 	{ "LOCAL-BASE64", run_local_base64, 0},
 	{ "LOCAL-RBTREE", run_local_rbtree, 0},
 	{ "LOCAL-MEMCACHE", run_local_memcache, 0},
@@ -9722,6 +10605,8 @@ static struct {
 	{ "LOCAL-DBTRANS", run_local_dbtrans, 0},
 	{ "LOCAL-TEVENT-SELECT", run_local_tevent_select, 0},
 	{ "LOCAL-CONVERT-STRING", run_local_convert_string, 0},
+	{ "LOCAL-MS-FNMATCH", run_local_ms_fnmatch, 0},
+	{ "LOCAL-STRING-CASE", run_local_string_case, 0},
 	{ "LOCAL-CONV-AUTH-INFO", run_local_conv_auth_info, 0},
 	{ "LOCAL-sprintf_append", run_local_sprintf_append, 0},
 	{ "LOCAL-hex_encode_buf", run_local_hex_encode_buf, 0},
@@ -9730,7 +10615,10 @@ static struct {
 	{ "local-tdb-opener", run_local_tdb_opener, 0 },
 	{ "local-tdb-writer", run_local_tdb_writer, 0 },
 	{ "LOCAL-DBWRAP-CTDB", run_local_dbwrap_ctdb, 0 },
+	{ "LOCAL-DBWRAP-CTDB-MIGRATE", run_local_dbwrap_ctdb_migrate, 0 },
 	{ "LOCAL-BENCH-PTHREADPOOL", run_bench_pthreadpool, 0 },
+	{ "LOCAL-BENCH-CHARCNV", run_bench_charcnv, 0 },
+	{ "LOCAL-BENCH-STRING-CASE", run_bench_string_case, 0 },
 	{ "qpathinfo-bufsize", run_qpathinfo_bufsize, 0 },
 	{NULL, NULL, 0}};
 